@@ -16,7 +16,16 @@ const BOUNDS: IRect = IRect {
 };
 
 fn bench_box_blur(c: &mut Criterion) {
-    let mut group = c.benchmark_group("box_blur 9");
+    bench_box_blur_within(c, "box_blur 9", BOUNDS);
+    bench_box_blur_within(
+        c,
+        "box_blur 9 whole surface",
+        IRect::from_size(SURFACE_SIDE, SURFACE_SIDE),
+    );
+}
+
+fn bench_box_blur_within(c: &mut Criterion, name: &str, bounds: IRect) {
+    let mut group = c.benchmark_group(name);
 
     for input in [(false, false), (false, true), (true, false), (true, true)].iter() {
         group.bench_with_input(
@@ -47,7 +56,7 @@ fn bench_box_blur(c: &mut Criterion) {
                     f(
                         &input_surface,
                         &mut output_surface,
-                        BOUNDS,
+                        bounds,
                         KERNEL_SIZE,
                         KERNEL_SIZE / 2,
                     )
@@ -57,5 +66,36 @@ fn bench_box_blur(c: &mut Criterion) {
     }
 }
 
-criterion_group!(benches, bench_box_blur);
+fn bench_small_gaussian_blur(c: &mut Criterion) {
+    let mut group = c.benchmark_group("convolve_1d 7");
+
+    // Roughly the kernel of a Gaussian blur with a standard deviation of 1.
+    let kernel: [f32; 7] = [0.006, 0.061, 0.242, 0.382, 0.242, 0.061, 0.006];
+
+    for input in [(false, false), (false, true), (true, false), (true, true)].iter() {
+        group.bench_with_input(
+            BenchmarkId::from_parameter(format!("{:?}", input)),
+            &input,
+            |b, &(vertical, alpha_only)| {
+                let surface_type = if *alpha_only {
+                    SurfaceType::AlphaOnly
+                } else {
+                    SurfaceType::SRgb
+                };
+                let input_surface =
+                    SharedImageSurface::empty(SURFACE_SIDE, SURFACE_SIDE, surface_type).unwrap();
+
+                b.iter(|| {
+                    if *vertical {
+                        input_surface.convolve_1d::<Vertical>(BOUNDS, &kernel)
+                    } else {
+                        input_surface.convolve_1d::<Horizontal>(BOUNDS, &kernel)
+                    }
+                })
+            },
+        );
+    }
+}
+
+criterion_group!(benches, bench_box_blur, bench_small_gaussian_blur);
 criterion_main!(benches);
@@ -0,0 +1,60 @@
+use criterion::{criterion_group, criterion_main, Criterion};
+use std::fmt::Write;
+
+use gio::prelude::*;
+use librsvg::Loader;
+
+/// Makes a document like the ones exported by Inkscape, with a class rule per element.
+fn make_document(num_rules: usize, num_elements: usize) -> String {
+    let mut svg = String::from(
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100\" height=\"100\">\n<style>\n",
+    );
+
+    for i in 0..num_rules {
+        writeln!(svg, ".st{} {{ fill: #{:06x}; stroke-width: 2; }}", i, i).unwrap();
+    }
+
+    svg.push_str("g .st0 rect { opacity: 0.5; }\n</style>\n<g>\n");
+
+    for i in 0..num_elements {
+        writeln!(
+            svg,
+            "<rect class=\"st{}\" x=\"{}\" y=\"{}\" width=\"1\" height=\"1\"/>",
+            i % num_rules,
+            i % 100,
+            i / 100
+        )
+        .unwrap();
+    }
+
+    svg.push_str("</g>\n</svg>\n");
+
+    svg
+}
+
+fn bench_css_cascade(c: &mut Criterion) {
+    let mut group = c.benchmark_group("css_cascade");
+    group.sample_size(10);
+
+    for &(num_rules, num_elements) in &[(100, 1000), (2000, 10000)] {
+        let bytes = glib::Bytes::from_owned(make_document(num_rules, num_elements).into_bytes());
+
+        group.bench_function(
+            format!("{} rules, {} elements", num_rules, num_elements),
+            |b| {
+                b.iter(|| {
+                    let stream = gio::MemoryInputStream::from_bytes(&bytes);
+
+                    Loader::new()
+                        .read_stream(&stream, None::<&gio::File>, None::<&gio::Cancellable>)
+                        .unwrap()
+                })
+            },
+        );
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_css_cascade);
+criterion_main!(benches);
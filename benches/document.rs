@@ -0,0 +1,272 @@
+//! Benchmarks for loading, cascading, and rendering whole documents.
+//!
+//! The other benchmarks time individual pieces of librsvg, like a filter
+//! primitive or the path parser.  These ones time the three phases that an
+//! application goes through with real-world documents from the test suite,
+//! so that regressions in the cascade, in `draw_tree`, or in text layout show
+//! up even when no single piece gets much slower:
+//!
+//! * `load` parses the document and cascades its styles, like `Loader::read_path`.
+//!
+//! * `cascade` runs the cascade again, like `SvgHandle::set_stylesheet`.
+//!
+//! * `render` renders the whole document at several zoom levels.
+//!
+//! Criterion does not measure memory, so before timing each document this
+//! prints the peak number of bytes that librsvg allocated on the heap while
+//! loading and rendering it, and the bytes of temporary surfaces from
+//! `RenderStats`.  Pixels live in Cairo's memory, not in the Rust heap, so
+//! the two numbers are separate.
+//!
+//! To compare against an earlier version, save a baseline with it and then
+//! compare the new version to it:
+//!
+//! ```sh
+//! cargo bench --bench document -- --save-baseline before
+//! # make changes
+//! cargo bench --bench document -- --baseline before
+//! ```
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion};
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::fmt::Write;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use gio::prelude::*;
+use librsvg::{CairoRenderer, Loader, RenderStats, SvgHandle};
+
+/// Documents from `tests/fixtures`, with a short name for each.
+///
+/// `bench_corpus` adds generated documents with many text labels and with long paths, since
+/// the test suite has no map or CAD drawings.
+const CORPUS: &[(&str, &str)] = &[
+    ("wilber", "dimensions/bug760112-wilber.svg"),
+    ("mix-blend-mode", "reftests/svg2/mix-blend-mode.svg"),
+    (
+        "coords-viewattr",
+        "reftests/svg1.1/coords-viewattr-02-b.svg",
+    ),
+    ("filters-gauss", "reftests/svg1.1/filters-gauss-01-b.svg"),
+    ("filters-light", "reftests/svg1.1/filters-light-05-f.svg"),
+    ("filters-turb", "reftests/svg1.1/filters-turb-02-f.svg"),
+    ("text", "reftests/svg1.1/text-text-03-b.svg"),
+];
+
+const ZOOM_LEVELS: &[f64] = &[0.5, 1.0, 2.0];
+
+/// Wraps the system allocator to keep track of the peak number of bytes in use.
+struct CountingAllocator;
+
+static ALLOCATED: AtomicUsize = AtomicUsize::new(0);
+static PEAK: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        let ptr = System.alloc(layout);
+        if !ptr.is_null() {
+            grow(layout.size());
+        }
+        ptr
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout);
+        ALLOCATED.fetch_sub(layout.size(), Ordering::Relaxed);
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        let new_ptr = System.realloc(ptr, layout, new_size);
+        if !new_ptr.is_null() {
+            ALLOCATED.fetch_sub(layout.size(), Ordering::Relaxed);
+            grow(new_size);
+        }
+        new_ptr
+    }
+}
+
+fn grow(size: usize) {
+    let allocated = ALLOCATED.fetch_add(size, Ordering::Relaxed) + size;
+    PEAK.fetch_max(allocated, Ordering::Relaxed);
+}
+
+#[global_allocator]
+static GLOBAL: CountingAllocator = CountingAllocator;
+
+/// Runs `f` and returns its result, along with the heap bytes it allocated at its peak.
+fn peak_heap_bytes<T>(f: impl FnOnce() -> T) -> (T, usize) {
+    let before = ALLOCATED.load(Ordering::Relaxed);
+    PEAK.store(before, Ordering::Relaxed);
+
+    let res = f();
+
+    (res, PEAK.load(Ordering::Relaxed) - before)
+}
+
+/// Makes a document like a map or a chart, with many short text labels.
+fn make_text_document(num_labels: usize) -> String {
+    let mut svg = String::from(
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"1000\" height=\"1000\" \
+         font-family=\"sans-serif\" font-size=\"10\">\n",
+    );
+
+    for i in 0..num_labels {
+        writeln!(
+            svg,
+            "<text x=\"{}\" y=\"{}\">Label {}</text>",
+            (i % 20) * 50,
+            (i / 20) * 12 + 10,
+            i % 100
+        )
+        .unwrap();
+    }
+
+    svg.push_str("</svg>\n");
+
+    svg
+}
+
+/// Makes a document like a map or a CAD drawing, with long paths of many segments.
+fn make_path_document(num_paths: usize, num_segments: usize) -> String {
+    let mut svg = String::from(
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"1000\" height=\"1000\" \
+         fill=\"none\" stroke=\"black\" stroke-width=\"0.5\">\n",
+    );
+
+    for i in 0..num_paths {
+        let y = (i as f64 + 0.5) * 1000.0 / num_paths as f64;
+        write!(svg, "<path d=\"M 0,{:.3}", y).unwrap();
+
+        for j in 0..num_segments {
+            let t = (i * num_segments + j) as f64;
+            write!(
+                svg,
+                " l{:.3},{:.3}",
+                1000.0 / num_segments as f64,
+                (t * 0.731).sin() * 2.0
+            )
+            .unwrap();
+        }
+
+        svg.push_str("\"/>\n");
+    }
+
+    svg.push_str("</svg>\n");
+
+    svg
+}
+
+fn fixture_path(fixture: &str) -> PathBuf {
+    Path::new(env!("CARGO_MANIFEST_DIR"))
+        .join("tests/fixtures")
+        .join(fixture)
+}
+
+/// Creates a surface for rendering a document at a zoom level, and the viewport to use for it.
+fn render_target(handle: &SvgHandle, zoom: f64) -> (cairo::ImageSurface, cairo::Rectangle) {
+    let (width, height) = CairoRenderer::new(handle)
+        .intrinsic_size_in_pixels()
+        .unwrap_or((100.0, 100.0));
+
+    let surface = cairo::ImageSurface::create(
+        cairo::Format::ARgb32,
+        (width * zoom).ceil() as i32,
+        (height * zoom).ceil() as i32,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: width * zoom,
+        height: height * zoom,
+    };
+
+    (surface, viewport)
+}
+
+fn render_with_stats(handle: &SvgHandle, zoom: f64) -> RenderStats {
+    let (surface, viewport) = render_target(handle, zoom);
+    let cr = cairo::Context::new(&surface).unwrap();
+
+    CairoRenderer::new(handle)
+        .render_document_with_stats(&cr, &viewport)
+        .unwrap()
+}
+
+/// Prints the memory used by each phase, since Criterion only measures time.
+fn print_memory(name: &str, load: impl Fn() -> SvgHandle) {
+    let (handle, load_bytes) = peak_heap_bytes(load);
+    println!("{}: load: peak heap {} bytes", name, load_bytes);
+
+    for &zoom in ZOOM_LEVELS {
+        let (stats, render_bytes) = peak_heap_bytes(|| render_with_stats(&handle, zoom));
+        println!(
+            "{}: render at {}x: peak heap {} bytes, temporary surfaces {} bytes",
+            name, zoom, render_bytes, stats.temporary_surface_bytes
+        );
+    }
+}
+
+fn bench_document(c: &mut Criterion, name: &str, load: impl Fn() -> SvgHandle) {
+    print_memory(name, &load);
+
+    let mut group = c.benchmark_group("load");
+    group.sample_size(10);
+    group.bench_function(name, |b| b.iter(&load));
+    group.finish();
+
+    let mut handle = load();
+
+    let mut group = c.benchmark_group("cascade");
+    group.sample_size(10);
+    group.bench_function(name, |b| {
+        b.iter(|| handle.set_stylesheet("").unwrap());
+    });
+    group.finish();
+
+    let mut group = c.benchmark_group("render");
+    group.sample_size(10);
+
+    for &zoom in ZOOM_LEVELS {
+        let (surface, viewport) = render_target(&handle, zoom);
+        let renderer = CairoRenderer::new(&handle);
+
+        group.bench_with_input(BenchmarkId::new(name, zoom), &viewport, |b, viewport| {
+            b.iter(|| {
+                let cr = cairo::Context::new(&surface).unwrap();
+                renderer.render_document(&cr, viewport).unwrap();
+            });
+        });
+    }
+
+    group.finish();
+}
+
+fn bench_corpus(c: &mut Criterion) {
+    for &(name, fixture) in CORPUS {
+        let path = fixture_path(fixture);
+
+        bench_document(c, name, || Loader::new().read_path(&path).unwrap());
+    }
+
+    let generated = [
+        ("text-labels", make_text_document(2000)),
+        ("long-paths", make_path_document(200, 5000)),
+    ];
+
+    for (name, svg) in generated.iter() {
+        let bytes = glib::Bytes::from(svg.as_bytes());
+
+        bench_document(c, name, || {
+            let stream = gio::MemoryInputStream::from_bytes(&bytes);
+
+            Loader::new()
+                .read_stream(&stream, None::<&gio::File>, None::<&gio::Cancellable>)
+                .unwrap()
+        });
+    }
+}
+
+criterion_group!(benches, bench_corpus);
+criterion_main!(benches);
@@ -0,0 +1,34 @@
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion};
+
+use librsvg::{
+    surface_utils::shared_surface::{SharedImageSurface, SurfaceType},
+    IRect,
+};
+
+const SURFACE_SIDE: i32 = 1024;
+const BOUNDS: IRect = IRect {
+    x0: 12,
+    y0: 12,
+    x1: 12 + 1000,
+    y1: 12 + 1000,
+};
+
+fn bench_morphology(c: &mut Criterion) {
+    let mut group = c.benchmark_group("morphology");
+
+    let input_surface =
+        SharedImageSurface::empty(SURFACE_SIDE, SURFACE_SIDE, SurfaceType::SRgb).unwrap();
+
+    for radius in [1, 5, 20, 100].iter() {
+        group.bench_with_input(BenchmarkId::new("erode", radius), radius, |b, &radius| {
+            b.iter(|| input_surface.erode(BOUNDS, radius, radius).unwrap())
+        });
+
+        group.bench_with_input(BenchmarkId::new("dilate", radius), radius, |b, &radius| {
+            b.iter(|| input_surface.dilate(BOUNDS, radius, radius).unwrap())
+        });
+    }
+}
+
+criterion_group!(benches, bench_morphology);
+criterion_main!(benches);
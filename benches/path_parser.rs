@@ -26,6 +26,41 @@ static SLICE_EDGES: [(usize, usize); 14] = [
     (46, 49),
 ];
 
+/// Path data for simple shapes, like the ones in icons, which are the most common case.
+static SMALL_PATHS: [(&str, &str); 2] = [
+    ("rectangle", "M 10 10 H 90 V 90 H 10 Z"),
+    (
+        "icon",
+        "M12 2C6.48 2 2 6.48 2 12s4.48 10 10 10 10-4.48 10-10S17.52 2 12 2zm-2 15l-5-5 \
+         1.41-1.41L10 14.17l7.59-7.59L19 8l-9 9z",
+    ),
+];
+
+/// Builds path data like the one in map or CAD drawings: a long polyline with a mix of
+/// absolute and relative commands, curves, and many decimal places.
+fn large_path(num_segments: usize) -> String {
+    let mut path = String::from("M 1234.5678,-987.6543 ");
+
+    for i in 0..num_segments {
+        let x = (i as f64 * 0.731).sin() * 100.0;
+        let y = (i as f64 * 0.377).cos() * 100.0;
+
+        match i % 4 {
+            0 => path.push_str(&format!("L {:.4},{:.4} ", x, y)),
+            1 => path.push_str(&format!("l{:.4}{:.4}", x, -y)),
+            // implicit repetition of the "l" above
+            2 => path.push_str(&format!("{:.4} {:.4} ", -x, y)),
+            _ => path.push_str(&format!(
+                "c {:.3} {:.3} {:.3} {:.3} {:.3} {:.3} ",
+                x, y, y, x, -x, -y
+            )),
+        }
+    }
+
+    path.push('z');
+    path
+}
+
 fn lex_path(input: &str) {
     let lexer = Lexer::new(black_box(input));
 
@@ -44,6 +79,35 @@ fn path_parser(c: &mut Criterion) {
         });
     });
 
+    for &(name, input) in &SMALL_PATHS {
+        c.bench_function(&format!("parse small path, {}", name), |b| {
+            let input = black_box(input);
+
+            b.iter(|| {
+                let mut builder = PathBuilder::default();
+                let _ = builder.parse(input);
+                builder.into_path()
+            });
+        });
+    }
+
+    for &num_segments in &[1_000, 100_000] {
+        let input = large_path(num_segments);
+
+        c.bench_function(
+            &format!("parse large path, {} segments", num_segments),
+            |b| {
+                let input = black_box(&input);
+
+                b.iter(|| {
+                    let mut builder = PathBuilder::default();
+                    let _ = builder.parse(input);
+                    builder.into_path()
+                });
+            },
+        );
+    }
+
     c.bench_function("lex str", |b| {
         let input = black_box(INPUT);
 
@@ -2,8 +2,8 @@ use criterion::{criterion_group, criterion_main, Criterion};
 
 use librsvg::{
     surface_utils::{
-        shared_surface::{ExclusiveImageSurface, SurfaceType},
-        ImageSurfaceDataExt, Pixel,
+        shared_surface::{ExclusiveImageSurface, SharedImageSurface, SurfaceType},
+        ImageSurfaceDataExt, Pixel, PixelOps,
     },
     IRect,
 };
@@ -15,30 +15,52 @@ const BOUNDS: IRect = IRect {
     y1: 256,
 };
 
+/// Fills a surface with interesting data; `alpha` gives the opacity of each pixel.
+fn make_surface(alpha: fn(i32, i32) -> u8) -> SharedImageSurface {
+    let mut surface = ExclusiveImageSurface::new(256, 256, SurfaceType::SRgb).unwrap();
+
+    surface.modify(&mut |data, stride| {
+        for y in BOUNDS.y_range() {
+            for x in BOUNDS.x_range() {
+                let pixel = Pixel {
+                    r: x as u8,
+                    g: y as u8,
+                    b: x.max(y) as u8,
+                    a: alpha(x, y),
+                };
+
+                data.set_pixel(stride, pixel.premultiply(), x as u32, y as u32);
+            }
+        }
+    });
+
+    surface.share().unwrap()
+}
+
 fn bench_pixbuf_from_surface(c: &mut Criterion) {
     c.bench_function("pixbuf_from_surface", |b| {
-        let mut surface = ExclusiveImageSurface::new(256, 256, SurfaceType::SRgb).unwrap();
-
-        // Fill the surface with interesting data
-        surface.modify(&mut |data, stride| {
-            for y in BOUNDS.y_range() {
-                for x in BOUNDS.x_range() {
-                    let pixel = Pixel {
-                        r: x as u8,
-                        g: y as u8,
-                        b: x.max(y) as u8,
-                        a: 255,
-                    };
-
-                    data.set_pixel(stride, pixel, x as u32, y as u32);
-                }
-            }
-        });
+        let surface = make_surface(|_, _| 255);
 
-        let surface = surface.share().unwrap();
+        b.iter(|| surface.to_pixbuf().unwrap())
+    });
+
+    c.bench_function("pixbuf_from_surface, translucent", |b| {
+        let surface = make_surface(|x, y| (x ^ y) as u8);
 
         b.iter(|| surface.to_pixbuf().unwrap())
     });
+
+    c.bench_function("surface_from_pixbuf, translucent", |b| {
+        let pixbuf = make_surface(|x, y| (x ^ y) as u8).to_pixbuf().unwrap();
+
+        b.iter(|| SharedImageSurface::from_pixbuf(&pixbuf, None, None).unwrap())
+    });
+
+    c.bench_function("unpremultiply surface, translucent", |b| {
+        let surface = make_surface(|x, y| (x ^ y) as u8);
+
+        b.iter(|| surface.unpremultiply(BOUNDS).unwrap())
+    });
 }
 
 criterion_group!(benches, bench_pixbuf_from_surface);
@@ -1,6 +1,6 @@
 use criterion::{black_box, criterion_group, criterion_main, Criterion};
 
-use librsvg::surface_utils::{Pixel, PixelOps};
+use librsvg::surface_utils::{simd, CairoARGB, Pixel, PixelOps};
 
 const OTHER: Pixel = Pixel {
     r: 0x10,
@@ -51,6 +51,12 @@ fn bench_pixel_ops(c: &mut Criterion) {
         let pixels = black_box(make_pixels(N));
         b.iter(|| bench_op(&pixels, |pixel| pixel.unpremultiply()))
     });
+
+    c.bench_function("premultiply_row", |b| {
+        let pixels = black_box(make_pixels(N));
+        let mut output = vec![CairoARGB::default(); N];
+        b.iter(|| simd::premultiply_row(&pixels, &mut output))
+    });
 }
 
 criterion_group!(benches, bench_pixel_ops);
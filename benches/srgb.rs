@@ -3,7 +3,7 @@ use criterion::{black_box, criterion_group, criterion_main, Criterion};
 use librsvg::{
     surface_utils::{
         shared_surface::{ExclusiveImageSurface, SurfaceType},
-        srgb::{linearize, map_unpremultiplied_components_loop},
+        srgb::{map_unpremultiplied_components_loop, LINEARIZE_PREMULTIPLIED},
         ImageSurfaceDataExt, Pixel,
     },
     IRect,
@@ -44,7 +44,12 @@ fn bench_srgb_linearization(c: &mut Criterion) {
         let bounds = black_box(BOUNDS);
 
         b.iter(|| {
-            map_unpremultiplied_components_loop(&surface, &mut output_surface, bounds, linearize);
+            map_unpremultiplied_components_loop(
+                &surface,
+                &mut output_surface,
+                bounds,
+                &LINEARIZE_PREMULTIPLIED,
+            );
         })
     });
 }
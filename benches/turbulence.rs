@@ -0,0 +1,58 @@
+use criterion::{criterion_group, criterion_main, Criterion};
+
+use gio::prelude::*;
+use librsvg::{CairoRenderer, Loader};
+
+const SIZE: i32 = 512;
+
+fn make_document(num_octaves: u32, stitch_tiles: &str) -> String {
+    format!(
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"{size}\" height=\"{size}\">
+  <filter id=\"turbulence\" x=\"0\" y=\"0\" width=\"1\" height=\"1\">
+    <feTurbulence baseFrequency=\"0.01\" numOctaves=\"{octaves}\" seed=\"3\" stitchTiles=\"{stitch}\"/>
+  </filter>
+  <rect width=\"{size}\" height=\"{size}\" filter=\"url(#turbulence)\"/>
+</svg>
+",
+        size = SIZE,
+        octaves = num_octaves,
+        stitch = stitch_tiles,
+    )
+}
+
+fn bench_turbulence(c: &mut Criterion) {
+    let mut group = c.benchmark_group("turbulence");
+    group.sample_size(10);
+
+    for &(num_octaves, stitch_tiles) in &[(1, "noStitch"), (4, "noStitch"), (4, "stitch")] {
+        let bytes = glib::Bytes::from_owned(make_document(num_octaves, stitch_tiles).into_bytes());
+        let stream = gio::MemoryInputStream::from_bytes(&bytes);
+        let handle = Loader::new()
+            .read_stream(&stream, None::<&gio::File>, None::<&gio::Cancellable>)
+            .unwrap();
+
+        let viewport = cairo::Rectangle {
+            x: 0.0,
+            y: 0.0,
+            width: f64::from(SIZE),
+            height: f64::from(SIZE),
+        };
+
+        group.bench_function(format!("{} octaves, {}", num_octaves, stitch_tiles), |b| {
+            b.iter(|| {
+                let surface =
+                    cairo::ImageSurface::create(cairo::Format::ARgb32, SIZE, SIZE).unwrap();
+                let cr = cairo::Context::new(&surface).unwrap();
+
+                CairoRenderer::new(&handle)
+                    .render_document(&cr, &viewport)
+                    .unwrap();
+            })
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_turbulence);
+criterion_main!(benches);
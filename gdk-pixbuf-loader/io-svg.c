@@ -40,6 +40,9 @@ typedef struct {
 
         gboolean                    first_write;
 
+        /* Emitted through prepared_func as soon as the size is known */
+        GdkPixbuf                  *pixbuf;
+
         gpointer                    user_data;
 } SvgContext;
 
@@ -102,6 +105,31 @@ emit_prepared (SvgContext *context, GdkPixbuf *pixbuf)
                 (* context->prepared_func) (pixbuf, NULL, context->user_data);
 }
 
+/* librsvg calls this as soon as it has parsed the size of the image from
+ * the root element, and again when computing the document's dimensions.
+ * The first time around we create the pixbuf at the size requested by the
+ * application, so that it knows the size without waiting for the whole image
+ * to load.  The image is rendered straight into that pixbuf when loading
+ * finishes.
+ */
+static void
+svg_size_func (gint *width, gint *height, gpointer user_data)
+{
+        SvgContext *context = user_data;
+
+        if (context->size_func != NULL)
+                (* context->size_func) (width, height, context->user_data);
+
+        if (context->pixbuf == NULL && *width > 0 && *height > 0) {
+                context->pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, *width, *height);
+
+                if (context->pixbuf != NULL) {
+                        gdk_pixbuf_fill (context->pixbuf, 0);
+                        emit_prepared (context, context->pixbuf);
+                }
+        }
+}
+
 static gboolean
 gdk_pixbuf__svg_image_load_increment (gpointer data,
 				      const guchar *buf, guint size,
@@ -122,7 +150,7 @@ gdk_pixbuf__svg_image_load_increment (gpointer data,
                         return FALSE;
                 }
 
-                rsvg_handle_set_size_callback (context->handle, context->size_func, context->user_data, NULL);
+                rsvg_handle_set_size_callback (context->handle, svg_size_func, context, NULL);
         }
 
         if (!context->handle) {
@@ -155,23 +183,45 @@ gdk_pixbuf__svg_image_stop_load (gpointer data, GError **error)
         }
 
         if (!rsvg_handle_close (context->handle, error)) {
+                g_clear_object (&context->pixbuf);
                 g_object_unref (context->handle);
                 g_free (context);
                 return FALSE;
         }
 
-        pixbuf = rsvg_handle_get_pixbuf (context->handle);
-
-        if (pixbuf != NULL) {
-                emit_prepared (context, pixbuf);
-                emit_updated (context, pixbuf);
-                g_object_unref (pixbuf);
-        }
-        else {
-                rsvg_propagate_error (error, "Error displaying image", ERROR_DISPLAYING_IMAGE);
-                result = FALSE;
+        if (context->pixbuf != NULL) {
+                /* The application already has the pixbuf we prepared; render straight into it */
+                int width = gdk_pixbuf_get_width (context->pixbuf);
+                int height = gdk_pixbuf_get_height (context->pixbuf);
+                RsvgRectangle viewport = { 0.0, 0.0, width, height };
+
+                if (rsvg_handle_render_document_to_buffer (context->handle,
+                                                           gdk_pixbuf_get_pixels (context->pixbuf),
+                                                           width,
+                                                           height,
+                                                           gdk_pixbuf_get_rowstride (context->pixbuf),
+                                                           RSVG_PIXEL_FORMAT_RGBA,
+                                                           &viewport,
+                                                           error)) {
+                        emit_updated (context, context->pixbuf);
+                } else {
+                        result = FALSE;
+                }
+        } else {
+                /* This renders at the size returned by the size callback */
+                pixbuf = rsvg_handle_get_pixbuf (context->handle);
+
+                if (pixbuf != NULL) {
+                        emit_prepared (context, pixbuf);
+                        emit_updated (context, pixbuf);
+                        g_object_unref (pixbuf);
+                } else {
+                        rsvg_propagate_error (error, "Error displaying image", ERROR_DISPLAYING_IMAGE);
+                        result = FALSE;
+                }
         }
 
+        g_clear_object (&context->pixbuf);
         g_object_unref (context->handle);
         g_free (context);
 
@@ -194,6 +194,47 @@ gboolean rsvg_handle_render_document (RsvgHandle           *handle,
                                       const RsvgRectangle  *viewport,
                                       GError              **error);
 
+/**
+ * rsvg_handle_render_damage:
+ * @handle: An #RsvgHandle
+ * @cr: A Cairo context whose target holds the last rendering of the document
+ * @viewport: Viewport size at which the whole SVG would be fitted.
+ * @out_damage: (out)(optional): Place to store the repainted region, in device space.
+ * @error: (optional): a location to store a #GError, or %NULL
+ *
+ * Repaints only the part of a rendering that changed after a call to
+ * rsvg_handle_set_stylesheet().
+ *
+ * User interfaces that change the stylesheet to show states like hover or pressed
+ * can use this instead of rsvg_handle_render_document() to avoid repainting the
+ * whole document.  The target surface of @cr must hold the last rendering of the
+ * document, done with the same transform and @viewport.
+ *
+ * The changed region is cleared to transparent black and the document is rendered
+ * again inside it.  That region is returned in @out_damage; it is empty if no
+ * element changed style since the last rendering.
+ *
+ * Changes to elements that are drawn through a filter, or that are not drawn in
+ * place, like the contents of patterns and masks, cause the whole area visible
+ * through the clip of @cr to be repainted.  If this function returns an error,
+ * render the whole document again with rsvg_handle_render_document().
+ *
+ * API ordering: This function must be called on a fully-loaded @handle.  See
+ * the section <ulink url="#API-ordering">API ordering</ulink> for details.
+ *
+ * Panics: this function will panic if the @handle is not fully-loaded.
+ *
+ * Returns: %TRUE on success, %FALSE on error.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+gboolean rsvg_handle_render_damage (RsvgHandle           *handle,
+                                    cairo_t              *cr,
+                                    const RsvgRectangle  *viewport,
+                                    RsvgRectangle        *out_damage,
+                                    GError              **error);
+
 /**
  * rsvg_handle_get_geometry_for_layer:
  * @handle: An #RsvgHandle
@@ -385,6 +426,234 @@ gboolean rsvg_handle_render_element (RsvgHandle           *handle,
                                      const RsvgRectangle  *element_viewport,
                                      GError              **error);
 
+/**
+ * RsvgTileFunc:
+ * @surface: An image surface with the contents of the tile.
+ * @x: Horizontal position of the tile, in pixels.
+ * @y: Vertical position of the tile, in pixels.
+ * @user_data: user data pointer passed to rsvg_handle_render_tiles()
+ *
+ * Function to let the caller collect tiles from rsvg_handle_render_tiles().
+ *
+ * The @surface is owned by librsvg; call cairo_surface_reference() on it if you
+ * want to keep it after this function returns.
+ *
+ * Since: 2.52
+ */
+typedef void (*RsvgTileFunc) (cairo_surface_t *surface,
+                              int              x,
+                              int              y,
+                              gpointer         user_data);
+
+/**
+ * rsvg_handle_render_tiles:
+ * @handle: An #RsvgHandle
+ * @viewport: Viewport size at which the whole SVG would be fitted.
+ * @tile_width: Width of each tile in pixels; must be positive.
+ * @tile_height: Height of each tile in pixels; must be positive.
+ * @bleed: Number of pixels around each tile that temporary surfaces cover; must not be negative.
+ * @tile_func: (scope call): Function that gets called for each rendered tile.
+ * @user_data: User data pointer to pass to @tile_func.
+ * @error: (optional): a location to store a #GError, or %NULL
+ *
+ * Renders the whole SVG document fitted to a viewport, as a grid of separate tiles.
+ *
+ * The area covered by @viewport, rounded out to whole pixels, is split into tiles
+ * of @tile_width by @tile_height pixels; the tiles in the last column and row may
+ * be smaller.  Each tile is rendered into its own image surface of format
+ * #CAIRO_FORMAT_ARGB32, and @tile_func is called with it as soon as it is complete.
+ * Tiles are produced row by row, from left to right.
+ *
+ * Temporary surfaces for group opacity, masks, blend modes and filters only cover
+ * each tile plus @bleed pixels on each side, so the memory needed for each tile
+ * does not depend on the size of the whole rendering.  Filters that read pixels
+ * further away than @bleed, like large blurs, may show seams between tiles.
+ *
+ * Rendering stops at the first error.
+ *
+ * The tiles are rendered one after the other on the calling thread.  An
+ * #RsvgHandle cannot be used from several threads at once; to render tiles
+ * concurrently, create one handle per thread and give each thread its own
+ * part of the grid.
+ *
+ * API ordering: This function must be called on a fully-loaded @handle.  See
+ * the section <ulink url="#API-ordering">API ordering</ulink> for details.
+ *
+ * Panics: this function will panic if the @handle is not fully-loaded.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+gboolean rsvg_handle_render_tiles (RsvgHandle           *handle,
+                                   const RsvgRectangle  *viewport,
+                                   int                   tile_width,
+                                   int                   tile_height,
+                                   double                bleed,
+                                   RsvgTileFunc          tile_func,
+                                   gpointer              user_data,
+                                   GError              **error);
+
+/**
+ * RsvgPixelFormat:
+ * @RSVG_PIXEL_FORMAT_ARGB32_PREMULTIPLIED: premultiplied alpha, in native-endian
+ * 32-bit words with alpha in the topmost byte; the same as #CAIRO_FORMAT_ARGB32.
+ * @RSVG_PIXEL_FORMAT_RGBA_PREMULTIPLIED: premultiplied alpha, in R, G, B, A bytes.
+ * @RSVG_PIXEL_FORMAT_RGBA: unpremultiplied alpha, in R, G, B, A bytes, as in a #GdkPixbuf.
+ *
+ * Layout of the pixels in a buffer for rsvg_handle_render_document_to_buffer().  All
+ * the formats use four bytes per pixel.
+ *
+ * Since: 2.52
+ */
+typedef enum {
+    RSVG_PIXEL_FORMAT_ARGB32_PREMULTIPLIED,
+    RSVG_PIXEL_FORMAT_RGBA_PREMULTIPLIED,
+    RSVG_PIXEL_FORMAT_RGBA
+} RsvgPixelFormat;
+
+/**
+ * rsvg_handle_render_document_to_buffer:
+ * @handle: An #RsvgHandle
+ * @buffer: (array): Pixels to render into; must be aligned to 4 bytes and hold at
+ * least @stride * @height bytes.
+ * @width: Width of the image in @buffer, in pixels; must be positive.
+ * @height: Height of the image in @buffer, in pixels; must be positive.
+ * @stride: Number of bytes between the start of each row; must be a multiple of 4
+ * and at least @width * 4.
+ * @format: Layout of the pixels in @buffer.
+ * @viewport: Viewport size at which the whole SVG would be fitted.
+ * @error: (optional): a location to store a #GError, or %NULL
+ *
+ * Renders the whole SVG document fitted to a viewport into a buffer of pixels.
+ *
+ * This lets you render straight into memory that you own, for example a mapped
+ * staging buffer for a GPU, without going through an intermediate image surface.
+ *
+ * The image is cleared to transparent black and then the document is rendered into
+ * it as with rsvg_handle_render_document().  For formats other than
+ * #RSVG_PIXEL_FORMAT_ARGB32_PREMULTIPLIED, the pixels are converted in place once
+ * rendering is done.  The padding at the end of each row is not touched.
+ *
+ * API ordering: This function must be called on a fully-loaded @handle.  See
+ * the section <ulink url="#API-ordering">API ordering</ulink> for details.
+ *
+ * Panics: this function will panic if the @handle is not fully-loaded.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+gboolean rsvg_handle_render_document_to_buffer (RsvgHandle           *handle,
+                                                guint8               *buffer,
+                                                int                   width,
+                                                int                   height,
+                                                int                   stride,
+                                                RsvgPixelFormat       format,
+                                                const RsvgRectangle  *viewport,
+                                                GError              **error);
+
+/**
+ * rsvg_handle_render_document_with_stats:
+ * @handle: An #RsvgHandle
+ * @cr: A Cairo context
+ * @viewport: Viewport size at which the whole SVG would be fitted.
+ * @out_stats_json: (out)(transfer full): Place to store the statistics, as a JSON string.
+ * @error: (optional): a location to store a #GError, or %NULL
+ *
+ * Renders the whole SVG document like rsvg_handle_render_document(), and returns
+ * statistics about the rendering.
+ *
+ * Use this to find out which parts of a document are expensive to render.  The
+ * statistics are a JSON object with these members:
+ *
+ * <literal>total_time_ms</literal>: wall time spent rendering, in milliseconds.
+ *
+ * <literal>temporary_surface_bytes</literal>: bytes of all the temporary surfaces
+ * that were allocated, for groups with opacity, masks, filters and pattern tiles.
+ *
+ * <literal>referenced_elements</literal> and
+ * <literal>max_referenced_elements</literal>: number of elements that were
+ * referenced, for example through <literal>use</literal> elements, and the limit
+ * for that number.
+ *
+ * <literal>elements</literal>: an object with a member for each element with an
+ * <literal>id</literal> attribute, with the <literal>time_ms</literal> spent drawing
+ * it and its children, the <literal>times_drawn</literal>, and the
+ * <literal>cache_hits</literal> of filter results or pattern tiles.
+ *
+ * <literal>filter_primitives</literal>: an object with a member for each kind of
+ * filter primitive, like <literal>feGaussianBlur</literal>, with the
+ * <literal>time_ms</literal> spent in it, the <literal>times_rendered</literal>, and
+ * the <literal>output_bytes</literal> of its results.
+ *
+ * Free the returned string with g_free().
+ *
+ * API ordering: This function must be called on a fully-loaded @handle.  See
+ * the section <ulink url="#API-ordering">API ordering</ulink> for details.
+ *
+ * Panics: this function will panic if the @handle is not fully-loaded.
+ *
+ * Returns: %TRUE on success, %FALSE on error.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+gboolean rsvg_handle_render_document_with_stats (RsvgHandle           *handle,
+                                                 cairo_t              *cr,
+                                                 const RsvgRectangle  *viewport,
+                                                 char                **out_stats_json,
+                                                 GError              **error);
+
+/**
+ * rsvg_handle_set_render_limits:
+ * @handle: An #RsvgHandle
+ * @timeout_ms: Time limit for each rendering, in milliseconds, or 0 for no limit.
+ * @max_temporary_surface_bytes: Limit on the bytes of temporary surfaces for each
+ * rendering, or 0 for no limit.
+ *
+ * Limits the time and memory that each rendering of @handle can take.
+ *
+ * Documents from untrusted sources can take a very long time to render, for example
+ * through long chains of expensive filters, or allocate a lot of memory for the
+ * temporary surfaces used for group opacity, masks, filters, and patterns.  Once a
+ * rendering goes over one of these limits, it stops, and the rendering function
+ * returns %FALSE with an error.
+ *
+ * The time is checked before drawing each element and before rendering each filter
+ * primitive, so a single expensive primitive can make a rendering take somewhat
+ * longer than @timeout_ms.  Only the temporary surfaces that are alive at the same
+ * time count towards @max_temporary_surface_bytes; a surface stops counting once it
+ * is freed.  The surfaces that a filter primitive needs are counted before rendering
+ * it.
+ *
+ * These limits apply to rsvg_handle_render_document(), rsvg_handle_render_layer(),
+ * rsvg_handle_render_element(), and the other functions that render the document.
+ * For rsvg_handle_render_tiles(), they apply to the whole call, not to each tile.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+void rsvg_handle_set_render_limits (RsvgHandle *handle,
+                                    guint       timeout_ms,
+                                    gsize       max_temporary_surface_bytes);
+
+/**
+ * rsvg_handle_set_render_cancellable:
+ * @handle: An #RsvgHandle
+ * @cancellable: (nullable): A #GCancellable, or %NULL to stop using one.
+ *
+ * Lets another thread stop the renderings of @handle.
+ *
+ * The @cancellable is checked at the same points as the time limit from
+ * rsvg_handle_set_render_limits().  Once it gets cancelled, rendering stops, and
+ * the rendering function returns %FALSE with an error.  The @handle keeps a
+ * reference to @cancellable until this function is called again.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+void rsvg_handle_set_render_cancellable (RsvgHandle   *handle,
+                                         GCancellable *cancellable);
+
 G_END_DECLS
 
 #endif
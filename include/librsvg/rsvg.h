@@ -203,9 +203,8 @@ GType rsvg_error_get_type (void);
  * is no way to cancel it if loading a remote URI takes a long time.  Also, note that
  * this method does not let you specify #RsvgHandleFlags.
  *
- * Otherwise, loading an SVG without GIO is not recommended, since librsvg will
- * need to buffer your entire data internally before actually being able to
- * parse it.  The deprecated way of doing this is by creating a handle with
+ * Otherwise, loading an SVG without GIO is not recommended.  The deprecated
+ * way of doing this is by creating a handle with
  * rsvg_handle_new() or rsvg_handle_new_with_flags(), and then using
  * rsvg_handle_write() and rsvg_handle_close() to feed the handle with SVG data.
  * Still, please try to use the GIO stream functions instead.
@@ -576,6 +575,11 @@ RsvgHandle *rsvg_handle_new (void);
  *
  * Loads the next @count bytes of the image.
  *
+ * Uncompressed SVG data gets parsed as it is written, so the document tree is
+ * built while the rest of the data arrives; compressed SVGZ data is buffered
+ * until rsvg_handle_close() gets called.  Errors in the data are reported by
+ * rsvg_handle_close().
+ *
  * Before calling this function for the first time, you may need to call
  * rsvg_handle_set_base_uri() or rsvg_handle_set_base_gfile() to set the "base
  * file" for resolving references to external resources.  SVG elements like
@@ -587,9 +591,8 @@ RsvgHandle *rsvg_handle_new (void);
  * Deprecated: 2.46.  Use rsvg_handle_read_stream_sync() or the constructor
  * functions rsvg_handle_new_from_gfile_sync() or
  * rsvg_handle_new_from_stream_sync().  This function is deprecated because it
- * will accumulate data from the @buf in memory until rsvg_handle_close() gets
- * called.  To avoid a big temporary buffer, use the suggested functions, which
- * take a #GFile or a #GInputStream and do not require a temporary buffer.
+ * cannot report errors or be cancelled until rsvg_handle_close() gets called.
+ * The suggested functions take a #GFile or a #GInputStream instead.
  **/
 RSVG_DEPRECATED_FOR(rsvg_handle_read_stream_sync)
 gboolean rsvg_handle_write (RsvgHandle   *handle,
@@ -1163,6 +1166,95 @@ gboolean rsvg_handle_set_stylesheet (RsvgHandle   *handle,
                                      gsize         css_len,
                                      GError      **error);
 
+/**
+ * RsvgSnapshot:
+ *
+ * An opaque copy of a loaded #RsvgHandle, which can be shared between threads.
+ *
+ * An #RsvgHandle can only be used from one thread at a time.  To render the same
+ * document from several threads, call rsvg_handle_freeze() once, and then
+ * rsvg_snapshot_new_handle() in each thread to get a handle for that thread.
+ *
+ * The snapshot keeps the document's elements, attributes, text, and stylesheets,
+ * including the one from rsvg_handle_set_stylesheet(), so creating a handle from it
+ * does not read or parse the XML again.  Each new handle still builds its own
+ * tree, parses the CSS and runs the cascade, and loads referenced images and SVG
+ * files the first time it needs them.  Stylesheets from
+ * <literal>xml-stylesheet</literal> processing instructions get loaded again
+ * from their URL.
+ *
+ * Since: 2.52
+ */
+typedef struct _RsvgSnapshot RsvgSnapshot;
+
+/**
+ * rsvg_handle_freeze:
+ * @handle: A #RsvgHandle.
+ * @error: (optional): return location for errors.
+ *
+ * Makes a snapshot of the loaded document in @handle, which can be used from any
+ * thread to create new handles with rsvg_snapshot_new_handle().
+ *
+ * The snapshot remembers the flags, base URI, and DPI of @handle, and passes them
+ * on to the handles created from it.  Render limits and cancellables are not
+ * copied; set them on each new handle.
+ *
+ * API ordering: This function must be called on a fully-loaded @handle.  See
+ * the section <ulink url="#API-ordering">API ordering</ulink> for details.
+ *
+ * Returns: (transfer full) (nullable): A new snapshot, or %NULL if @handle could
+ * not be loaded.  Free it with rsvg_snapshot_unref().
+ *
+ * Since: 2.52
+ */
+RSVG_API
+RsvgSnapshot *rsvg_handle_freeze (RsvgHandle *handle, GError **error);
+
+/**
+ * rsvg_snapshot_new_handle:
+ * @snapshot: A #RsvgSnapshot.
+ * @error: (optional): return location for errors.
+ *
+ * Creates a fully-loaded #RsvgHandle with the document from @snapshot, for use in
+ * the calling thread.
+ *
+ * This may be called from several threads at the same time with the same
+ * @snapshot.
+ *
+ * Returns: (transfer full) (nullable): A new #RsvgHandle, or %NULL if an error
+ * occurs.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+RsvgHandle *rsvg_snapshot_new_handle (RsvgSnapshot *snapshot, GError **error);
+
+/**
+ * rsvg_snapshot_ref:
+ * @snapshot: A #RsvgSnapshot.
+ *
+ * Increases the reference count of @snapshot by one.  This may be called from any
+ * thread.
+ *
+ * Returns: (transfer full): @snapshot
+ *
+ * Since: 2.52
+ */
+RSVG_API
+RsvgSnapshot *rsvg_snapshot_ref (RsvgSnapshot *snapshot);
+
+/**
+ * rsvg_snapshot_unref:
+ * @snapshot: A #RsvgSnapshot.
+ *
+ * Decreases the reference count of @snapshot by one, and frees it when the count
+ * drops to zero.  This may be called from any thread.
+ *
+ * Since: 2.52
+ */
+RSVG_API
+void rsvg_snapshot_unref (RsvgSnapshot *snapshot);
+
 #ifndef __GTK_DOC_IGNORE__
 /**
  * rsvg_handle_internal_set_testing:
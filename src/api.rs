@@ -8,18 +8,27 @@ pub use crate::{
     accept_language::{AcceptLanguage, Language, UserLanguage},
     error::{ImplementationLimit, LoadingError, RenderingError},
     length::{LengthUnit, RsvgLength as Length},
+    stats::{ElementStats, PrimitiveStats, RenderStats},
 };
 
 use url::Url;
 
+use std::cell::RefCell;
 use std::path::Path;
+use std::rc::Rc;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{mpsc, Arc};
+use std::thread;
+use std::time::Duration;
 
 use gio::prelude::*; // Re-exposes glib's prelude as well
 use gio::Cancellable;
 
 use crate::{
+    budget::RenderBudget,
     dpi::Dpi,
-    handle::{Handle, LoadOptions},
+    handle::{Handle, HandleLoader, HandleSnapshot, LoadOptions},
+    surface_utils::argb32_to_rgba_in_place,
     url_resolver::UrlResolver,
 };
 
@@ -31,10 +40,15 @@ use crate::{
 /// of `Loader` in sequence to configure how SVG data should be
 /// loaded, and finally use one of the loading functions to load an
 /// [`SvgHandle`].
-#[derive(Default)]
+///
+/// A `Loader` is cheap to clone, so a configured loader can be handed
+/// to several worker threads, each of which loads its own [`SvgHandle`].
+#[derive(Clone, Default)]
 pub struct Loader {
     unlimited_size: bool,
     keep_image_data: bool,
+    shared_resource_cache: bool,
+    filter_result_cache: bool,
 }
 
 impl Loader {
@@ -48,6 +62,12 @@ impl Loader {
     /// surfaces that support including image data in compressed
     /// formats, like PDF.
     ///
+    /// * [`with_shared_resource_cache`](#method.with_shared_resource_cache)
+    /// defaults to `false`.
+    ///
+    /// * [`with_filter_result_cache`](#method.with_filter_result_cache)
+    /// defaults to `false`.
+    ///
     /// # Example:
     ///
     /// ```
@@ -122,6 +142,72 @@ impl Loader {
         self
     }
 
+    /// Shares referenced documents and images with other handles.
+    ///
+    /// Normally each [`SvgHandle`] loads and decodes the external SVG
+    /// documents and raster images that it references, and drops them when
+    /// the handle is dropped.  If you load many documents that reference the
+    /// same resources, for example a set of icons that `<use>` elements from
+    /// a common sprite sheet, set this to `true`.  Handles loaded this way
+    /// look up their resources in a cache that is shared by all the handles
+    /// created in the same thread with this option turned on.
+    ///
+    /// The cache is per thread, not per process: handles created in
+    /// different threads never share resources, and each thread that
+    /// loads handles this way has a cache of its own.  This is because an
+    /// [`SvgHandle`] and the documents it references cannot be sent to
+    /// other threads.
+    ///
+    /// Each thread's cache holds a bounded number of bytes and drops the
+    /// least recently used resources first.  Local files are reloaded if
+    /// their modification time or size changes.  Resources that are not
+    /// local files or `data:` URLs are never cached.
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// use librsvg;
+    ///
+    /// let svg_handle = librsvg::Loader::new()
+    ///     .with_shared_resource_cache(true)
+    ///     .read_path("example.svg")
+    ///     .unwrap();
+    /// ```
+    pub fn with_shared_resource_cache(mut self, share: bool) -> Self {
+        self.shared_resource_cache = share;
+        self
+    }
+
+    /// Keeps the results of filters around between renderings.
+    ///
+    /// Filters like `feGaussianBlur`, `feTurbulence`, and the lighting
+    /// primitives are expensive.  If you render the same document many times
+    /// at the same size, for example to show different states of an
+    /// animation or of hover effects, set this to `true`.  The handle will
+    /// then remember the output of each filter, and reuse it when the same
+    /// element is filtered again with the same transformation and the same
+    /// source pixels.
+    ///
+    /// Filters that use `BackgroundImage`, `BackgroundAlpha`, `FillPaint`, or
+    /// `StrokePaint` as inputs are never cached.  The cache holds a bounded
+    /// number of bytes, drops the least recently used results first, and
+    /// is cleared by [`SvgHandle::set_stylesheet`].
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// use librsvg;
+    ///
+    /// let svg_handle = librsvg::Loader::new()
+    ///     .with_filter_result_cache(true)
+    ///     .read_path("example.svg")
+    ///     .unwrap();
+    /// ```
+    pub fn with_filter_result_cache(mut self, cache: bool) -> Self {
+        self.filter_result_cache = cache;
+        self
+    }
+
     /// Reads an SVG document from `path`.
     ///
     /// # Example:
@@ -186,23 +272,60 @@ impl Loader {
         base_file: Option<&F>,
         cancellable: Option<&P>,
     ) -> Result<SvgHandle, LoadingError> {
-        let base_file = base_file.map(|f| f.as_ref());
+        let load_options = self.load_options(base_file.map(|f| f.as_ref()))?;
+
+        Ok(SvgHandle(Handle::from_stream(
+            &load_options,
+            stream.as_ref(),
+            cancellable.map(|c| c.as_ref()),
+        )?))
+    }
 
+    /// Starts loading an SVG document from data that gets written in chunks.
+    ///
+    /// This is for the C API's `rsvg_handle_write()` and `rsvg_handle_close()`.
+    pub(crate) fn push_loader(
+        self,
+        base_file: Option<&gio::File>,
+    ) -> Result<SvgHandleLoader, LoadingError> {
+        let load_options = self.load_options(base_file)?;
+
+        Ok(SvgHandleLoader(Handle::push_loader(&load_options)))
+    }
+
+    fn load_options(&self, base_file: Option<&gio::File>) -> Result<LoadOptions, LoadingError> {
         let base_url = if let Some(base_file) = base_file {
             Some(url_from_file(base_file)?)
         } else {
             None
         };
 
-        let load_options = LoadOptions::new(UrlResolver::new(base_url))
+        Ok(LoadOptions::new(UrlResolver::new(base_url))
             .with_unlimited_size(self.unlimited_size)
-            .keep_image_data(self.keep_image_data);
+            .keep_image_data(self.keep_image_data)
+            .with_shared_resource_cache(self.shared_resource_cache)
+            .with_filter_result_cache(self.filter_result_cache))
+    }
+}
 
-        Ok(SvgHandle(Handle::from_stream(
-            &load_options,
-            stream.as_ref(),
-            cancellable.map(|c| c.as_ref()),
-        )?))
+/// Loads an [`SvgHandle`] from data that arrives in chunks.
+pub(crate) struct SvgHandleLoader(HandleLoader);
+
+impl SvgHandleLoader {
+    /// Parses a chunk of data.
+    pub(crate) fn write(&mut self, buf: &[u8]) {
+        self.0.write(buf);
+    }
+
+    /// Returns the document's size in pixels from the root element's `width` and `height`,
+    /// once its start tag has been parsed.
+    pub(crate) fn intrinsic_size_in_pixels(&self, dpi_x: f64, dpi_y: f64) -> Option<(f64, f64)> {
+        self.0.get_intrinsic_size_in_pixels(Dpi::new(dpi_x, dpi_y))
+    }
+
+    /// Finishes parsing and returns the loaded handle.
+    pub(crate) fn close(self) -> Result<SvgHandle, LoadingError> {
+        Ok(SvgHandle(self.0.close(None)?))
     }
 }
 
@@ -214,6 +337,15 @@ fn url_from_file(file: &gio::File) -> Result<Url, LoadingError> {
 ///
 /// You can create this from one of the `read` methods in
 /// [`Loader`].
+///
+/// # Thread safety
+///
+/// An `SvgHandle` is neither `Send` nor `Sync`.  The loaded document is
+/// a tree of reference-counted nodes, and it lazily loads and caches
+/// external resources while rendering, so it cannot be shared between
+/// threads.  To render the same SVG from several threads, call
+/// [`freeze`](#method.freeze) to get an [`SvgSnapshot`], which can be
+/// sent to each thread to create a handle there.
 pub struct SvgHandle(Handle);
 
 impl SvgHandle {
@@ -239,14 +371,70 @@ impl SvgHandle {
     pub fn set_stylesheet(&mut self, css: &str) -> Result<(), LoadingError> {
         self.0.set_stylesheet(css)
     }
+
+    /// Makes a snapshot of the loaded document that can be shared between threads.
+    ///
+    /// The snapshot includes the stylesheet from [`set_stylesheet`], if there is one.
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// let snapshot = librsvg::Loader::new()
+    ///     .read_path("example.svg")
+    ///     .unwrap()
+    ///     .freeze();
+    ///
+    /// let thread_snapshot = snapshot.clone();
+    ///
+    /// std::thread::spawn(move || {
+    ///     let svg_handle = thread_snapshot.to_handle().unwrap();
+    ///     // render svg_handle in this thread
+    /// })
+    /// .join()
+    /// .unwrap();
+    /// ```
+    ///
+    /// [`set_stylesheet`]: #method.set_stylesheet
+    pub fn freeze(&self) -> SvgSnapshot {
+        SvgSnapshot(Arc::new(self.0.freeze()))
+    }
+}
+
+/// A loaded SVG document that can be sent to and shared between threads.
+///
+/// You can create this with [`SvgHandle::freeze`], and then create an
+/// independent [`SvgHandle`] in each thread with [`to_handle`].  Cloning a
+/// snapshot is cheap, as the clones share the same data.
+///
+/// The snapshot keeps the document's elements, attributes, text and
+/// stylesheets, so creating a handle from it does not read or parse the XML
+/// again.  Each new handle still builds its own tree, parses the CSS and
+/// runs the cascade, and loads referenced images and SVG files the first
+/// time it needs them.  Stylesheets from `xml-stylesheet` processing
+/// instructions get loaded again from their URL.
+///
+/// [`to_handle`]: #method.to_handle
+#[derive(Clone)]
+pub struct SvgSnapshot(Arc<HandleSnapshot>);
+
+impl SvgSnapshot {
+    /// Creates an [`SvgHandle`] for use in the current thread.
+    pub fn to_handle(&self) -> Result<SvgHandle, LoadingError> {
+        Ok(SvgHandle(self.0.thaw()?))
+    }
 }
 
 /// Can render an `SvgHandle` to a Cairo context.
+#[derive(Clone)]
 pub struct CairoRenderer<'a> {
     handle: &'a SvgHandle,
     dpi: Dpi,
     user_language: UserLanguage,
     is_testing: bool,
+    tile_bleed: Option<f64>,
+    timeout: Option<Duration>,
+    max_temporary_surface_bytes: Option<usize>,
+    cancellable: Option<Cancellable>,
 }
 
 // Note that these are different than the C API's default, which is 90.
@@ -278,6 +466,24 @@ pub struct IntrinsicDimensions {
     pub vbox: Option<cairo::Rectangle>,
 }
 
+/// Layout of the pixels in a buffer for [`CairoRenderer::render_document_to_buffer`].
+///
+/// All the formats use four bytes per pixel.
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum PixelFormat {
+    /// Premultiplied alpha, in native-endian 32-bit words with alpha in the topmost byte.
+    ///
+    /// This is the same as `cairo::Format::ARgb32`, so it is B, G, R, A bytes in memory
+    /// on little-endian machines.  Rendering to this format needs no conversion.
+    Argb32Premultiplied,
+
+    /// Premultiplied alpha, in R, G, B, A bytes.
+    RgbaPremultiplied,
+
+    /// Unpremultiplied alpha, in R, G, B, A bytes, as in a `GdkPixbuf`.
+    Rgba,
+}
+
 impl<'a> CairoRenderer<'a> {
     /// Creates a `CairoRenderer` for the specified `SvgHandle`.
     ///
@@ -291,6 +497,10 @@ impl<'a> CairoRenderer<'a> {
             dpi: Dpi::new(DEFAULT_DPI_X, DEFAULT_DPI_Y),
             user_language: UserLanguage::new(&Language::FromEnvironment),
             is_testing: false,
+            tile_bleed: None,
+            timeout: None,
+            max_temporary_surface_bytes: None,
+            cancellable: None,
         }
     }
 
@@ -328,6 +538,138 @@ impl<'a> CairoRenderer<'a> {
         }
     }
 
+    /// Limits the size of intermediate surfaces to the area being drawn.
+    ///
+    /// Group opacity, masks, blend modes, and filters are rendered through
+    /// temporary surfaces.  Normally those are as large as the whole viewport,
+    /// which takes a lot of memory when only a small part of a very large
+    /// rendering is drawn at a time, for example when producing a huge image
+    /// tile by tile.  With this option, temporary surfaces only cover the area
+    /// of the target surface that is inside the Cairo context's clip, plus
+    /// `bleed` device pixels on each side.
+    ///
+    /// Filters need the pixels around the area they change; for example, a
+    /// Gaussian blur reads pixels up to about three times its standard
+    /// deviation away.  Make `bleed` large enough for the filters in your
+    /// documents, as filters that reach further may render differently near
+    /// the edges of each tile.
+    ///
+    /// This applies to [`render_document`], [`render_layer`], and
+    /// [`render_element`].
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// # use librsvg;
+    /// let svg_handle = librsvg::Loader::new()
+    ///     .read_path("example.svg")
+    ///     .unwrap();
+    ///
+    /// let viewport = cairo::Rectangle { x: 0.0, y: 0.0, width: 4000.0, height: 4000.0 };
+    ///
+    /// let renderer = librsvg::CairoRenderer::new(&svg_handle).with_tile_bleed(64.0);
+    ///
+    /// // Render the 1000x1000 tile at (2000, 3000) of a 4000x4000 rendering
+    /// let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, 1000, 1000)?;
+    /// let cr = cairo::Context::new(&surface)?;
+    /// cr.translate(-2000.0, -3000.0);
+    /// renderer.render_document(&cr, &viewport)?;
+    /// # Ok::<(), librsvg::RenderingError>(())
+    /// ```
+    ///
+    /// [`render_document`]: #method.render_document
+    /// [`render_layer`]: #method.render_layer
+    /// [`render_element`]: #method.render_element
+    pub fn with_tile_bleed(self, bleed: f64) -> Self {
+        assert!(bleed >= 0.0);
+
+        CairoRenderer {
+            tile_bleed: Some(bleed),
+            ..self
+        }
+    }
+
+    /// Limits the time that each rendering can take.
+    ///
+    /// Documents from untrusted sources can take a very long time to render, for
+    /// example through long chains of expensive filters.  With this option, rendering
+    /// stops with `RenderingError::LimitExceeded(ImplementationLimit::RenderingTimeExceeded)`
+    /// once `timeout` has passed since it started.
+    ///
+    /// The time is checked before drawing each element and before rendering each filter
+    /// primitive, so a single expensive primitive can make the rendering take somewhat
+    /// longer than `timeout`.  For [`render_tiles`], and for a [`ParallelTileRenderer`],
+    /// the `timeout` is for rendering all the tiles, not for each one.
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// # use librsvg;
+    /// # use std::time::Duration;
+    /// let svg_handle = librsvg::Loader::new()
+    ///     .read_path("example.svg")
+    ///     .unwrap();
+    ///
+    /// let renderer = librsvg::CairoRenderer::new(&svg_handle)
+    ///     .with_render_timeout(Duration::from_secs(2))
+    ///     .with_max_temporary_surface_bytes(256 * 1024 * 1024);
+    ///
+    /// let viewport = cairo::Rectangle { x: 0.0, y: 0.0, width: 640.0, height: 480.0 };
+    ///
+    /// let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, 640, 480)?;
+    /// let cr = cairo::Context::new(&surface)?;
+    ///
+    /// match renderer.render_document(&cr, &viewport) {
+    ///     Err(librsvg::RenderingError::LimitExceeded(limit)) => println!("{}", limit),
+    ///     res => res?,
+    /// }
+    /// # Ok::<(), librsvg::RenderingError>(())
+    /// ```
+    ///
+    /// [`render_tiles`]: #method.render_tiles
+    pub fn with_render_timeout(self, timeout: Duration) -> Self {
+        CairoRenderer {
+            timeout: Some(timeout),
+            ..self
+        }
+    }
+
+    /// Limits the memory that temporary surfaces can take in each rendering.
+    ///
+    /// Group opacity, masks, blend modes, filters, and patterns are rendered through
+    /// temporary surfaces.  With this option, rendering stops with
+    /// `RenderingError::LimitExceeded(ImplementationLimit::TooManyTemporarySurfaceBytes)`
+    /// once the temporary surfaces that are alive at the same time would take more than
+    /// `max_bytes`.  Surfaces stop counting once they are freed, so this limits the memory
+    /// that a rendering needs, not the number of temporary surfaces it uses.  The surfaces
+    /// that a filter primitive needs are counted before rendering it.
+    ///
+    /// For a [`ParallelTileRenderer`], `max_bytes` is shared by all of its threads.
+    /// See [`with_tile_bleed`] to make temporary surfaces smaller when only part of a
+    /// rendering is drawn at a time.
+    ///
+    /// [`with_tile_bleed`]: #method.with_tile_bleed
+    pub fn with_max_temporary_surface_bytes(self, max_bytes: usize) -> Self {
+        CairoRenderer {
+            max_temporary_surface_bytes: Some(max_bytes),
+            ..self
+        }
+    }
+
+    /// Lets another thread stop a rendering through a `gio::Cancellable`.
+    ///
+    /// The cancellable is checked at the same points as the time limit from
+    /// [`with_render_timeout`].  Once it gets cancelled, rendering stops with
+    /// `RenderingError::Cancelled`.
+    ///
+    /// [`with_render_timeout`]: #method.with_render_timeout
+    pub fn with_cancellable<P: IsA<Cancellable>>(self, cancellable: &P) -> Self {
+        CairoRenderer {
+            cancellable: Some(cancellable.as_ref().clone()),
+            ..self
+        }
+    }
+
     /// Queries the `width`, `height`, and `viewBox` attributes in an SVG document.
     ///
     /// If you are calling this function to compute a scaling factor to render the SVG,
@@ -376,9 +718,87 @@ impl<'a> CairoRenderer<'a> {
         cr: &cairo::Context,
         viewport: &cairo::Rectangle,
     ) -> Result<(), RenderingError> {
+        self.handle.0.render_document(
+            cr,
+            viewport,
+            &self.user_language,
+            self.dpi,
+            self.is_testing,
+            self.tile_bleed,
+            None,
+            self.budget(),
+        )
+    }
+
+    /// Renders the whole SVG document like [`render_document`], and returns statistics
+    /// about the rendering.
+    ///
+    /// Use this to find out which parts of a document are expensive to render.  The
+    /// [`RenderStats`] hold the time spent in each element that has an `id` attribute
+    /// and in each kind of filter primitive, the number of bytes of temporary surfaces,
+    /// the number of elements that were referenced, and the number of times that cached
+    /// filter results and pattern tiles were reused.
+    ///
+    /// Collecting the statistics adds a small overhead to the rendering, so use
+    /// [`render_document`] when you do not need them.
+    ///
+    /// [`render_document`]: #method.render_document
+    pub fn render_document_with_stats(
+        &self,
+        cr: &cairo::Context,
+        viewport: &cairo::Rectangle,
+    ) -> Result<RenderStats, RenderingError> {
+        collect_stats(|stats| {
+            self.handle.0.render_document(
+                cr,
+                viewport,
+                &self.user_language,
+                self.dpi,
+                self.is_testing,
+                self.tile_bleed,
+                Some(stats),
+                self.budget(),
+            )
+        })
+    }
+
+    /// Repaints only the part of a rendering that changed after a call to
+    /// [`SvgHandle::set_stylesheet`].
+    ///
+    /// User interfaces that change the stylesheet to show states like hover
+    /// or pressed can use this instead of [`render_document`] to avoid
+    /// repainting the whole document.  The target surface of `cr` must hold
+    /// the last rendering of the document, done with the same transform and
+    /// `viewport`.
+    ///
+    /// The changed region is cleared to transparent black and the document is
+    /// rendered again inside it.  Returns that region in the device space of
+    /// `cr`, or `None` if no element changed style since the last rendering.
+    ///
+    /// Changes to elements that are drawn through a filter, or that are not drawn
+    /// in place, like the contents of patterns and masks, cause the whole area
+    /// visible through the clip of `cr` to be repainted.  If this returns an
+    /// error, render the whole document again with [`render_document`].
+    ///
+    /// [`SvgHandle::set_stylesheet`]: struct.SvgHandle.html#method.set_stylesheet
+    /// [`render_document`]: #method.render_document
+    pub fn render_damage(
+        &self,
+        cr: &cairo::Context,
+        viewport: &cairo::Rectangle,
+    ) -> Result<Option<cairo::Rectangle>, RenderingError> {
         self.handle
             .0
-            .render_document(cr, viewport, &self.user_language, self.dpi, self.is_testing)
+            .render_damage(
+                cr,
+                viewport,
+                &self.user_language,
+                self.dpi,
+                self.is_testing,
+                self.tile_bleed,
+                self.budget(),
+            )
+            .map(|damage| damage.map(cairo::Rectangle::from))
     }
 
     /// Computes the (ink_rect, logical_rect) of an SVG element, as if
@@ -448,6 +868,9 @@ impl<'a> CairoRenderer<'a> {
             &self.user_language,
             self.dpi,
             self.is_testing,
+            self.tile_bleed,
+            None,
+            self.budget(),
         )
     }
 
@@ -520,9 +943,232 @@ impl<'a> CairoRenderer<'a> {
             &self.user_language,
             self.dpi,
             self.is_testing,
+            self.tile_bleed,
+            None,
+            self.budget(),
         )
     }
 
+    /// Renders a single SVG element like [`render_element`], and returns statistics
+    /// about the rendering.
+    ///
+    /// See [`render_document_with_stats`] for the statistics that are collected.
+    ///
+    /// [`render_element`]: #method.render_element
+    /// [`render_document_with_stats`]: #method.render_document_with_stats
+    pub fn render_element_with_stats(
+        &self,
+        cr: &cairo::Context,
+        id: Option<&str>,
+        element_viewport: &cairo::Rectangle,
+    ) -> Result<RenderStats, RenderingError> {
+        collect_stats(|stats| {
+            self.handle.0.render_element(
+                cr,
+                id,
+                element_viewport,
+                &self.user_language,
+                self.dpi,
+                self.is_testing,
+                self.tile_bleed,
+                Some(stats),
+                self.budget(),
+            )
+        })
+    }
+
+    /// Renders the whole SVG document fitted to a viewport, as a grid of separate tiles.
+    ///
+    /// The area covered by `viewport`, rounded out to whole pixels, is split
+    /// into tiles of `tile_width` by `tile_height` pixels; the tiles in the
+    /// last column and row may be smaller.  Each tile is rendered into its own
+    /// image surface, and `tile_done` is called with the tile's position in
+    /// pixels and its surface as soon as it is complete.  Tiles are produced
+    /// row by row, from left to right.
+    ///
+    /// Rendering stops at the first error, and that error is returned.  The
+    /// limits from [`with_render_timeout`] and [`with_max_temporary_surface_bytes`]
+    /// are for all the tiles together.
+    ///
+    /// An `SvgHandle` cannot be shared between threads, so the tiles are
+    /// rendered one after the other on the calling thread.  To render tiles
+    /// concurrently, use a [`ParallelTileRenderer`].  Use [`with_tile_bleed`]
+    /// so that the memory needed for each tile does not depend on the size
+    /// of the whole rendering.
+    ///
+    /// # Panics
+    ///
+    /// Will panic if `tile_width` or `tile_height` are not positive.
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// # use librsvg;
+    /// let svg_handle = librsvg::Loader::new()
+    ///     .read_path("example.svg")
+    ///     .unwrap();
+    ///
+    /// let viewport = cairo::Rectangle { x: 0.0, y: 0.0, width: 4096.0, height: 4096.0 };
+    ///
+    /// librsvg::CairoRenderer::new(&svg_handle)
+    ///     .with_tile_bleed(64.0)
+    ///     .render_tiles(&viewport, 256, 256, |x, y, surface| {
+    ///         println!("tile at ({}, {}) is {} pixels wide", x, y, surface.width());
+    ///     })?;
+    /// # Ok::<(), librsvg::RenderingError>(())
+    /// ```
+    ///
+    /// [`with_render_timeout`]: #method.with_render_timeout
+    /// [`with_max_temporary_surface_bytes`]: #method.with_max_temporary_surface_bytes
+    /// [`with_tile_bleed`]: #method.with_tile_bleed
+    pub fn render_tiles<F>(
+        &self,
+        viewport: &cairo::Rectangle,
+        tile_width: i32,
+        tile_height: i32,
+        mut tile_done: F,
+    ) -> Result<(), RenderingError>
+    where
+        F: FnMut(i32, i32, cairo::ImageSurface),
+    {
+        // The time limit is for all the tiles, not for each of them.
+        let budget = self.budget();
+
+        for tile in tile_grid(viewport, tile_width, tile_height) {
+            let surface = self.render_tile(viewport, &tile, budget.clone())?;
+            tile_done(tile.x, tile.y, surface);
+        }
+
+        Ok(())
+    }
+
+    fn render_tile(
+        &self,
+        viewport: &cairo::Rectangle,
+        tile: &Tile,
+        budget: Option<Arc<RenderBudget>>,
+    ) -> Result<cairo::ImageSurface, RenderingError> {
+        let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, tile.width, tile.height)?;
+
+        {
+            let cr = cairo::Context::new(&surface)?;
+            cr.translate(-f64::from(tile.x), -f64::from(tile.y));
+
+            self.handle.0.render_document(
+                &cr,
+                viewport,
+                &self.user_language,
+                self.dpi,
+                self.is_testing,
+                self.tile_bleed,
+                None,
+                budget,
+            )?;
+        }
+
+        surface.flush();
+
+        Ok(surface)
+    }
+
+    /// Renders the whole SVG document fitted to a viewport into a buffer of pixels.
+    ///
+    /// The `buffer` holds an image of `width` by `height` pixels, whose rows
+    /// start every `stride` bytes, in the specified `format`.  This lets you
+    /// render straight into memory that you own, for example a mapped staging
+    /// buffer for a GPU, without going through an intermediate image surface.
+    ///
+    /// The image is cleared to transparent black and then the document is
+    /// rendered into it as with [`render_document`].  For formats other than
+    /// [`PixelFormat::Argb32Premultiplied`], the pixels are converted in place
+    /// once rendering is done.  The padding at the end of each row is not touched.
+    ///
+    /// # Panics
+    ///
+    /// Will panic if `width` or `height` are not positive, if `stride` is not a
+    /// multiple of 4 bytes or is smaller than `width * 4`, or if `buffer` is
+    /// shorter than `stride * height` bytes or does not start at a multiple of 4 bytes.
+    ///
+    /// # Example:
+    ///
+    /// ```
+    /// # use librsvg;
+    /// let svg_handle = librsvg::Loader::new()
+    ///     .read_path("example.svg")
+    ///     .unwrap();
+    ///
+    /// let (width, height) = (640, 480);
+    /// let stride = width * 4;
+    /// let mut buffer = vec![0u8; (stride * height) as usize];
+    ///
+    /// let viewport = cairo::Rectangle { x: 0.0, y: 0.0, width: 640.0, height: 480.0 };
+    ///
+    /// librsvg::CairoRenderer::new(&svg_handle).render_document_to_buffer(
+    ///     &mut buffer,
+    ///     width,
+    ///     height,
+    ///     stride,
+    ///     librsvg::PixelFormat::Rgba,
+    ///     &viewport,
+    /// )?;
+    /// # Ok::<(), librsvg::RenderingError>(())
+    /// ```
+    ///
+    /// [`render_document`]: #method.render_document
+    pub fn render_document_to_buffer(
+        &self,
+        buffer: &mut [u8],
+        width: i32,
+        height: i32,
+        stride: i32,
+        format: PixelFormat,
+        viewport: &cairo::Rectangle,
+    ) -> Result<(), RenderingError> {
+        assert!(width > 0 && height > 0);
+        assert!(stride % 4 == 0 && stride / 4 >= width);
+        assert!(buffer.len() >= stride as usize * height as usize);
+        assert!(buffer.as_ptr() as usize % 4 == 0);
+
+        // Safety: cairo only accesses `stride * height` bytes, which we checked above,
+        // and the surface is finished before `buffer` is released.
+        let surface = unsafe {
+            cairo::ImageSurface::create_for_data_unsafe(
+                buffer.as_mut_ptr(),
+                cairo::Format::ARgb32,
+                width,
+                height,
+                stride,
+            )?
+        };
+
+        let res = cairo::Context::new(&surface)
+            .map_err(RenderingError::from)
+            .and_then(|cr| {
+                cr.set_operator(cairo::Operator::Clear);
+                cr.paint()?;
+                cr.set_operator(cairo::Operator::Over);
+
+                self.render_document(&cr, viewport)
+            });
+
+        surface.finish();
+        drop(surface);
+
+        res?;
+
+        let (width, height, stride) = (width as usize, height as usize, stride as usize);
+
+        match format {
+            PixelFormat::Argb32Premultiplied => (),
+            PixelFormat::RgbaPremultiplied => {
+                argb32_to_rgba_in_place(buffer, width, height, stride, false)
+            }
+            PixelFormat::Rgba => argb32_to_rgba_in_place(buffer, width, height, stride, true),
+        }
+
+        Ok(())
+    }
+
     /// Turns on test mode.  Do not use this function; it is for librsvg's test suite only.
     pub fn test_mode(self) -> Self {
         CairoRenderer {
@@ -530,4 +1176,377 @@ impl<'a> CairoRenderer<'a> {
             ..self
         }
     }
+
+    /// Creates the budget for a rendering that starts now, if any limits were given.
+    fn budget(&self) -> Option<Arc<RenderBudget>> {
+        new_budget(
+            self.timeout,
+            self.max_temporary_surface_bytes,
+            self.cancellable.as_ref(),
+        )
+    }
+}
+
+/// Creates the budget for a rendering that starts now, if any limits were given.
+fn new_budget(
+    timeout: Option<Duration>,
+    max_temporary_surface_bytes: Option<usize>,
+    cancellable: Option<&Cancellable>,
+) -> Option<Arc<RenderBudget>> {
+    if timeout.is_none() && max_temporary_surface_bytes.is_none() && cancellable.is_none() {
+        return None;
+    }
+
+    Some(Arc::new(RenderBudget::new(
+        timeout,
+        max_temporary_surface_bytes,
+        cancellable.cloned(),
+    )))
+}
+
+/// Calls `render` with a place to collect statistics, and returns those.
+fn collect_stats<F>(render: F) -> Result<RenderStats, RenderingError>
+where
+    F: FnOnce(Rc<RefCell<RenderStats>>) -> Result<(), RenderingError>,
+{
+    let stats = Rc::new(RefCell::new(RenderStats::default()));
+
+    render(stats.clone())?;
+
+    let stats = Rc::try_unwrap(stats)
+        .ok()
+        .expect("drawing context must not outlive the rendering");
+
+    Ok(stats.into_inner())
+}
+
+/// Position and size of a tile, in pixels.
+#[derive(Debug, Copy, Clone)]
+struct Tile {
+    x: i32,
+    y: i32,
+    width: i32,
+    height: i32,
+}
+
+/// Splits the area covered by `viewport`, rounded out to whole pixels, into tiles.
+///
+/// The tiles in the last column and row may be smaller.  They are returned row by
+/// row, from left to right.
+fn tile_grid(viewport: &cairo::Rectangle, tile_width: i32, tile_height: i32) -> Vec<Tile> {
+    assert!(tile_width > 0 && tile_height > 0);
+
+    let x0 = viewport.x.floor() as i32;
+    let y0 = viewport.y.floor() as i32;
+    let x1 = (viewport.x + viewport.width).ceil() as i32;
+    let y1 = (viewport.y + viewport.height).ceil() as i32;
+
+    let mut tiles = Vec::new();
+
+    for y in (y0..y1).step_by(tile_height as usize) {
+        for x in (x0..x1).step_by(tile_width as usize) {
+            tiles.push(Tile {
+                x,
+                y,
+                width: tile_width.min(x1 - x),
+                height: tile_height.min(y1 - y),
+            });
+        }
+    }
+
+    tiles
+}
+
+/// Renders tiles of an SVG document on several threads at once.
+///
+/// An [`SvgHandle`] cannot be shared between threads, so
+/// [`CairoRenderer::render_tiles`] renders all the tiles on the calling
+/// thread.  A `ParallelTileRenderer` keeps an [`SvgSnapshot`] of the
+/// document instead, and each of its worker threads creates its own
+/// `SvgHandle` from it and renders tiles until there are none left.
+///
+/// The workers render with the same settings as the [`CairoRenderer`] that
+/// the `ParallelTileRenderer` was created from, so the tiles are the same as
+/// the ones from [`CairoRenderer::render_tiles`].
+///
+/// Each thread still builds its own tree and runs the cascade, as described
+/// in [`SvgSnapshot`], so this pays off when rendering takes much longer
+/// than that, for example for large maps or for many tiles.
+///
+/// # Example:
+///
+/// ```
+/// # use librsvg;
+/// let svg_handle = librsvg::Loader::new().read_path("example.svg")?;
+///
+/// let renderer = librsvg::ParallelTileRenderer::new(
+///     &librsvg::CairoRenderer::new(&svg_handle).with_tile_bleed(64.0),
+/// );
+///
+/// let viewport = cairo::Rectangle { x: 0.0, y: 0.0, width: 4096.0, height: 4096.0 };
+///
+/// renderer.render_tiles(&viewport, 256, 256, |x, y, surface| {
+///     println!("tile at ({}, {}) is {} pixels wide", x, y, surface.width());
+/// })?;
+/// # Ok::<(), Box<dyn std::error::Error>>(())
+/// ```
+pub struct ParallelTileRenderer {
+    snapshot: SvgSnapshot,
+    settings: RendererSettings,
+    num_threads: usize,
+}
+
+/// The settings of a [`CairoRenderer`] without its handle, to send them to other threads.
+#[derive(Clone)]
+struct RendererSettings {
+    dpi: Dpi,
+    user_language: UserLanguage,
+    is_testing: bool,
+    tile_bleed: Option<f64>,
+    timeout: Option<Duration>,
+    max_temporary_surface_bytes: Option<usize>,
+    cancellable: Option<Cancellable>,
+}
+
+impl RendererSettings {
+    fn from_renderer(renderer: &CairoRenderer<'_>) -> RendererSettings {
+        RendererSettings {
+            dpi: renderer.dpi,
+            user_language: renderer.user_language.clone(),
+            is_testing: renderer.is_testing,
+            tile_bleed: renderer.tile_bleed,
+            timeout: renderer.timeout,
+            max_temporary_surface_bytes: renderer.max_temporary_surface_bytes,
+            cancellable: renderer.cancellable.clone(),
+        }
+    }
+
+    fn to_renderer<'a>(&self, handle: &'a SvgHandle) -> CairoRenderer<'a> {
+        CairoRenderer {
+            handle,
+            dpi: self.dpi,
+            user_language: self.user_language.clone(),
+            is_testing: self.is_testing,
+            tile_bleed: self.tile_bleed,
+            timeout: self.timeout,
+            max_temporary_surface_bytes: self.max_temporary_surface_bytes,
+            cancellable: self.cancellable.clone(),
+        }
+    }
+}
+
+/// A rendered tile, as it gets sent from a worker thread.
+///
+/// Cairo surfaces cannot be sent between threads, so this has a copy of the pixels.
+struct RenderedTile {
+    tile: Tile,
+    stride: usize,
+    data: Vec<u8>,
+}
+
+impl ParallelTileRenderer {
+    /// Creates a `ParallelTileRenderer` for the document and the settings of `renderer`.
+    ///
+    /// This makes a snapshot of the document with [`SvgHandle::freeze`], including the
+    /// stylesheet from [`SvgHandle::set_stylesheet`].  The tiles are rendered with the
+    /// DPI, user language, tile bleed, render limits and cancellable of `renderer`.
+    ///
+    /// The renderer uses as many threads as rayon's global thread pool has.
+    pub fn new(renderer: &CairoRenderer<'_>) -> ParallelTileRenderer {
+        ParallelTileRenderer {
+            snapshot: renderer.handle.freeze(),
+            settings: RendererSettings::from_renderer(renderer),
+            num_threads: rayon::current_num_threads(),
+        }
+    }
+
+    /// Configures the dots-per-inch for resolving physical lengths.
+    ///
+    /// See [`CairoRenderer::with_dpi`].
+    pub fn with_dpi(self, dpi_x: f64, dpi_y: f64) -> Self {
+        assert!(dpi_x > 0.0);
+        assert!(dpi_y > 0.0);
+
+        ParallelTileRenderer {
+            settings: RendererSettings {
+                dpi: Dpi::new(dpi_x, dpi_y),
+                ..self.settings
+            },
+            ..self
+        }
+    }
+
+    /// Limits temporary surfaces to each tile plus `bleed` pixels around it.
+    ///
+    /// See [`CairoRenderer::with_tile_bleed`].  Without this, each thread needs
+    /// temporary surfaces as large as the whole rendering.
+    ///
+    /// # Panics
+    ///
+    /// Will panic if `bleed` is negative.
+    pub fn with_tile_bleed(self, bleed: f64) -> Self {
+        assert!(bleed >= 0.0);
+
+        ParallelTileRenderer {
+            settings: RendererSettings {
+                tile_bleed: Some(bleed),
+                ..self.settings
+            },
+            ..self
+        }
+    }
+
+    /// Sets the number of worker threads.
+    ///
+    /// # Panics
+    ///
+    /// Will panic if `num_threads` is zero.
+    pub fn with_threads(self, num_threads: usize) -> Self {
+        assert!(num_threads > 0);
+
+        ParallelTileRenderer {
+            num_threads,
+            ..self
+        }
+    }
+
+    /// Renders the whole SVG document fitted to a viewport, as a grid of separate tiles.
+    ///
+    /// The tiles are the same as for [`CairoRenderer::render_tiles`], but they
+    /// are rendered by several threads at once, so they are not produced in
+    /// order.  `tile_done` is called on the calling thread with the tile's
+    /// position in pixels and its surface as soon as each tile is complete.
+    ///
+    /// Rendering stops at the first error, and that error is returned.  The
+    /// time and memory limits are shared by all the threads, and are for the
+    /// whole call.
+    ///
+    /// # Panics
+    ///
+    /// Will panic if `tile_width` or `tile_height` are not positive.
+    pub fn render_tiles<F>(
+        &self,
+        viewport: &cairo::Rectangle,
+        tile_width: i32,
+        tile_height: i32,
+        mut tile_done: F,
+    ) -> Result<(), RenderingError>
+    where
+        F: FnMut(i32, i32, cairo::ImageSurface),
+    {
+        let tiles = Arc::new(tile_grid(viewport, tile_width, tile_height));
+        let next_tile = Arc::new(AtomicUsize::new(0));
+        let stop = Arc::new(AtomicBool::new(false));
+
+        // All the workers share the time and memory limits.
+        let budget = new_budget(
+            self.settings.timeout,
+            self.settings.max_temporary_surface_bytes,
+            self.settings.cancellable.as_ref(),
+        );
+
+        let (sender, receiver) = mpsc::channel();
+
+        let workers = (0..self.num_threads.min(tiles.len()))
+            .map(|_| {
+                let snapshot = self.snapshot.clone();
+                let settings = self.settings.clone();
+                let budget = budget.clone();
+                let viewport = *viewport;
+                let (tiles, next_tile, stop) = (tiles.clone(), next_tile.clone(), stop.clone());
+                let sender = sender.clone();
+
+                thread::spawn(move || {
+                    let handle = match snapshot.to_handle() {
+                        Ok(handle) => handle,
+                        Err(e) => {
+                            let _ = sender.send(Err(RenderingError::Rendering(format!(
+                                "could not create the document in a worker thread: {}",
+                                e
+                            ))));
+                            return;
+                        }
+                    };
+
+                    let renderer = settings.to_renderer(&handle);
+
+                    while !stop.load(Ordering::Relaxed) {
+                        let tile = match tiles.get(next_tile.fetch_add(1, Ordering::Relaxed)) {
+                            Some(tile) => *tile,
+                            None => break,
+                        };
+
+                        let res = renderer
+                            .render_tile(&viewport, &tile, budget.clone())
+                            .and_then(|surface| copy_tile(tile, surface));
+
+                        let failed = res.is_err();
+
+                        // The receiver is gone if rendering was stopped by an error.
+                        if sender.send(res).is_err() || failed {
+                            break;
+                        }
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+
+        // Only the workers have senders now, so the loop ends when all of them are
+        // done.
+        drop(sender);
+
+        let res = receiver.iter().try_for_each(|rendered| {
+            let rendered = rendered?;
+            let surface = surface_from_tile(&rendered)?;
+
+            tile_done(rendered.tile.x, rendered.tile.y, surface);
+
+            Ok(())
+        });
+
+        stop.store(true, Ordering::Relaxed);
+        drop(receiver);
+
+        for worker in workers {
+            if let Err(panic) = worker.join() {
+                std::panic::resume_unwind(panic);
+            }
+        }
+
+        res
+    }
+}
+
+/// Copies the pixels of a tile's surface, so that they can be sent to another thread.
+fn copy_tile(tile: Tile, mut surface: cairo::ImageSurface) -> Result<RenderedTile, RenderingError> {
+    let stride = surface.stride() as usize;
+    let data = surface
+        .data()
+        .map_err(|e| RenderingError::Rendering(format!("{}", e)))?
+        .to_vec();
+
+    Ok(RenderedTile { tile, stride, data })
+}
+
+fn surface_from_tile(rendered: &RenderedTile) -> Result<cairo::ImageSurface, RenderingError> {
+    let tile = &rendered.tile;
+
+    let mut surface = cairo::ImageSurface::create(cairo::Format::ARgb32, tile.width, tile.height)?;
+
+    {
+        let stride = surface.stride() as usize;
+        let mut data = surface
+            .data()
+            .map_err(|e| RenderingError::Rendering(format!("{}", e)))?;
+
+        let row_len = tile.width as usize * 4;
+
+        for y in 0..tile.height as usize {
+            data[y * stride..y * stride + row_len].copy_from_slice(
+                &rendered.data[y * rendered.stride..y * rendered.stride + row_len],
+            );
+        }
+    }
+
+    Ok(surface)
 }
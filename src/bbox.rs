@@ -34,6 +34,11 @@ impl BoundingBox {
         }
     }
 
+    /// Returns the ink rectangle transformed to device space, if there is one.
+    pub fn device_ink_rect(&self) -> Option<Rect> {
+        self.ink_rect.map(|r| self.transform.transform_rect(&r))
+    }
+
     pub fn clear(mut self) {
         self.rect = None;
         self.ink_rect = None;
@@ -25,11 +25,14 @@ use librsvg::rsvg_convert_only::{
     Validate, Vertical,
 };
 use librsvg::{
-    AcceptLanguage, CairoRenderer, Color, Language, LengthUnit, Loader, Parse, RenderingError,
+    AcceptLanguage, CairoRenderer, Color, Language, LengthUnit, Loader, Parse, RenderStats,
+    RenderingError,
 };
 use once_cell::unsync::OnceCell;
-use std::ops::Deref;
-use std::path::PathBuf;
+use rayon::prelude::*;
+use std::collections::hash_map::{Entry, HashMap};
+use std::io::Write;
+use std::path::{Path, PathBuf};
 
 #[derive(Debug)]
 pub struct Error(String);
@@ -67,6 +70,8 @@ impl_error_from!(RenderingError);
 impl_error_from!(cairo::IoError);
 impl_error_from!(cairo::StreamWithError);
 impl_error_from!(clap::Error);
+impl_error_from!(png::EncodingError);
+impl_error_from!(std::io::Error);
 
 macro_rules! error {
     ($($arg:tt)*) => (Error(std::format!($($arg)*)));
@@ -169,8 +174,19 @@ impl ResizeStrategy {
     }
 }
 
+/// Maximum size of the image buffer used to render PNG output.
+///
+/// Larger images are rendered in horizontal strips that fit in this size, and each
+/// strip is written to the PNG file as soon as it is rendered.
+const PNG_STRIP_BYTES: usize = 64 * 1024 * 1024;
+
+/// Pixels around each strip of a PNG image that are rendered for the sake of filters.
+///
+/// See `CairoRenderer::with_tile_bleed()`.
+const PNG_STRIP_BLEED: f64 = 256.0;
+
 enum Surface {
-    Png(cairo::ImageSurface, OutputStream),
+    Png(PngSize, OutputStream),
     #[cfg(system_deps_have_cairo_pdf)]
     Pdf(cairo::PdfSurface, Size),
     #[cfg(system_deps_have_cairo_ps)]
@@ -179,20 +195,12 @@ enum Surface {
     Svg(cairo::SvgSurface, Size),
 }
 
-impl Deref for Surface {
-    type Target = cairo::Surface;
-
-    fn deref(&self) -> &cairo::Surface {
-        match self {
-            Self::Png(surface, _) => &surface,
-            #[cfg(system_deps_have_cairo_pdf)]
-            Self::Pdf(surface, _) => &surface,
-            #[cfg(system_deps_have_cairo_ps)]
-            Self::Ps(surface, _) => &surface,
-            #[cfg(system_deps_have_cairo_svg)]
-            Self::Svg(surface, _) => &surface,
-        }
-    }
+/// Size in pixels of a PNG image, and the height of the strips in which it gets rendered.
+#[derive(Clone, Copy, Debug)]
+struct PngSize {
+    width: i32,
+    height: i32,
+    strip_height: i32,
 }
 
 impl Surface {
@@ -208,10 +216,28 @@ impl Surface {
 
     fn new_for_png(size: Size, stream: OutputStream) -> Result<Self, Error> {
         // We use ceil() to avoid chopping off the last pixel if it is partially covered.
-        let w = checked_i32(size.w.ceil())?;
-        let h = checked_i32(size.h.ceil())?;
-        let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, w, h)?;
-        Ok(Self::Png(surface, stream))
+        let width = checked_i32(size.w.ceil())?;
+        let height = checked_i32(size.h.ceil())?;
+
+        // This is Cairo's limit for image surfaces.  We keep it for the whole image even
+        // though we render in strips, so the limit doesn't depend on the image's shape.
+        const MAX_IMAGE_SIZE: i32 = 32767;
+
+        if width <= 0 || height <= 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE {
+            return Err(Error::from(cairo::Error::InvalidSize));
+        }
+
+        let row_bytes = width as usize * 4;
+        let strip_height = (PNG_STRIP_BYTES / row_bytes).max(1).min(height as usize) as i32;
+
+        Ok(Self::Png(
+            PngSize {
+                width,
+                height,
+                strip_height,
+            },
+            stream,
+        ))
     }
 
     #[cfg(system_deps_have_cairo_pdf)]
@@ -252,6 +278,19 @@ impl Surface {
         Err(Error("unsupported format".to_string()))
     }
 
+    /// The Cairo surface for vector formats.  PNG output is rendered in strips instead.
+    fn vector_surface(&self) -> Option<&cairo::Surface> {
+        match self {
+            Self::Png(..) => None,
+            #[cfg(system_deps_have_cairo_pdf)]
+            Self::Pdf(surface, _) => Some(&**surface),
+            #[cfg(system_deps_have_cairo_ps)]
+            Self::Ps(surface, _) => Some(&**surface),
+            #[cfg(system_deps_have_cairo_svg)]
+            Self::Svg(surface, _) => Some(&**surface),
+        }
+    }
+
     #[allow(clippy::too_many_arguments)] // yeah, yeah, we'll refactor it eventually
     pub fn render(
         &self,
@@ -262,9 +301,146 @@ impl Surface {
         geometry: cairo::Rectangle,
         background_color: Option<Color>,
         id: Option<&str>,
+        stats: Option<&mut RenderStats>,
     ) -> Result<(), Error> {
-        let cr = cairo::Context::new(self)?;
+        if let Self::Png(size, stream) = self {
+            return Self::render_png(
+                *size,
+                stream,
+                renderer,
+                left,
+                top,
+                final_size,
+                geometry,
+                background_color,
+                id,
+                stats,
+            );
+        }
+
+        let cr = cairo::Context::new(self.vector_surface().unwrap())?;
+
+        Self::render_to_context(
+            &cr,
+            renderer,
+            left,
+            top,
+            final_size,
+            geometry,
+            background_color,
+            id,
+            stats,
+        )?;
+
+        cr.show_page()?;
+
+        Ok(())
+    }
 
+    /// Renders a PNG image strip by strip, and writes each strip out as soon as it is done.
+    ///
+    /// This keeps memory usage bounded by the size of a strip, regardless of the size
+    /// of the image.  All the strips are rendered into the same surface, and the document
+    /// keeps the extents of its groups and the paths of its shapes from one strip to the
+    /// next, so each strip after the first one mostly draws only what it overlaps.
+    #[allow(clippy::too_many_arguments)]
+    fn render_png(
+        size: PngSize,
+        stream: &OutputStream,
+        renderer: &CairoRenderer,
+        left: f64,
+        top: f64,
+        final_size: Size,
+        geometry: cairo::Rectangle,
+        background_color: Option<Color>,
+        id: Option<&str>,
+        mut stats: Option<&mut RenderStats>,
+    ) -> Result<(), Error> {
+        let mut encoder = png::Encoder::new(
+            stream.clone().into_write(),
+            size.width as u32,
+            size.height as u32,
+        );
+        encoder.set_color(png::ColorType::RGBA);
+        encoder.set_depth(png::BitDepth::Eight);
+
+        let mut writer = encoder.write_header()?;
+        let mut png_stream = writer.stream_writer();
+
+        // Only limit temporary surfaces if the image does not fit in a single strip, so
+        // that smaller images are rendered exactly as they would be in one go.
+        let strip_renderer;
+        let renderer = if size.strip_height < size.height {
+            strip_renderer = renderer.clone().with_tile_bleed(PNG_STRIP_BLEED);
+            &strip_renderer
+        } else {
+            renderer
+        };
+
+        let mut row = vec![0u8; size.width as usize * 4];
+
+        let mut surface =
+            cairo::ImageSurface::create(cairo::Format::ARgb32, size.width, size.strip_height)?;
+
+        for y in (0..size.height).step_by(size.strip_height as usize) {
+            let rows = size.strip_height.min(size.height - y);
+
+            {
+                let cr = cairo::Context::new(&surface)?;
+
+                // The last strip may be shorter than the surface; don't draw below the image.
+                cr.rectangle(0.0, 0.0, f64::from(size.width), f64::from(rows));
+                cr.clip();
+
+                cr.set_operator(cairo::Operator::Clear);
+                cr.paint()?;
+                cr.set_operator(cairo::Operator::Over);
+
+                cr.translate(0.0, -f64::from(y));
+
+                Self::render_to_context(
+                    &cr,
+                    renderer,
+                    left,
+                    top,
+                    final_size,
+                    geometry,
+                    background_color,
+                    id,
+                    stats.as_deref_mut(),
+                )?;
+            }
+
+            surface.flush();
+
+            let stride = surface.stride() as usize;
+            let data = surface
+                .data()
+                .map_err(|e| error!("Error reading rendered image: {}", e))?;
+
+            for strip_row in data.chunks(stride).take(rows as usize) {
+                unpremultiply_row(&strip_row[..row.len()], &mut row);
+                png_stream.write_all(&row)?;
+            }
+        }
+
+        png_stream.finish()?;
+
+        Ok(())
+    }
+
+    #[allow(clippy::too_many_arguments)]
+    fn render_to_context(
+        cr: &cairo::Context,
+        renderer: &CairoRenderer,
+        left: f64,
+        top: f64,
+        final_size: Size,
+        geometry: cairo::Rectangle,
+        background_color: Option<Color>,
+        id: Option<&str>,
+        stats: Option<&mut RenderStats>,
+    ) -> Result<(), Error> {
         if let Some(Color::RGBA(rgba)) = background_color {
             cr.set_source_rgba(
                 rgba.red_f32().into(),
@@ -297,28 +473,60 @@ impl Surface {
             height: geometry.height,
         };
 
-        match id {
-            None => renderer.render_document(&cr, &viewport)?,
-            Some(_) => renderer.render_element(&cr, id, &viewport)?,
-        }
+        match (id, stats) {
+            (None, None) => renderer.render_document(&cr, &viewport)?,
+            (Some(_), None) => renderer.render_element(&cr, id, &viewport)?,
 
-        if !matches!(self, Self::Png(_, _)) {
-            cr.show_page()?;
+            // Images rendered in strips add up the statistics of each strip.
+            (None, Some(stats)) => {
+                stats.merge(&renderer.render_document_with_stats(&cr, &viewport)?)
+            }
+            (Some(_), Some(stats)) => {
+                stats.merge(&renderer.render_element_with_stats(&cr, id, &viewport)?)
+            }
         }
 
         Ok(())
     }
 
     pub fn finish(self) -> Result<(), Error> {
-        match self {
-            Self::Png(surface, stream) => surface.write_to_png(&mut stream.into_write())?,
-            _ => self.finish_output_stream().map(|_| ())?,
+        match self.vector_surface() {
+            // PNG images are written out while rendering
+            None => (),
+            Some(surface) => surface.finish_output_stream().map(|_| ())?,
         }
 
         Ok(())
     }
 }
 
+/// Converts a row of Cairo's premultiplied ARGB32 pixels to the straight RGBA used by PNG.
+///
+/// This uses the same rounding as Cairo's own PNG writer.
+fn unpremultiply_row(src: &[u8], dest: &mut [u8]) {
+    for (src, dest) in src.chunks_exact(4).zip(dest.chunks_exact_mut(4)) {
+        let pixel = u32::from_ne_bytes([src[0], src[1], src[2], src[3]]);
+
+        let a = pixel >> 24;
+        let r = (pixel >> 16) & 0xff;
+        let g = (pixel >> 8) & 0xff;
+        let b = pixel & 0xff;
+
+        let unpremultiply = |c: u32| {
+            if a == 0 {
+                0
+            } else {
+                ((c * 255 + a / 2) / a) as u8
+            }
+        };
+
+        dest[0] = unpremultiply(r);
+        dest[1] = unpremultiply(g);
+        dest[2] = unpremultiply(b);
+        dest[3] = a as u8;
+    }
+}
+
 fn checked_i32(x: f64) -> Result<i32, cairo::Error> {
     cast::i32(x).map_err(|_| cairo::Error::InvalidSize)
 }
@@ -384,6 +592,22 @@ enum Input {
     Named(PathOrUrl),
 }
 
+impl Input {
+    /// Name of the input file without its directory and extension.
+    fn stem(&self) -> Option<String> {
+        match self {
+            Input::Stdin => None,
+            Input::Named(PathOrUrl::Path(p)) => p.file_stem(),
+            Input::Named(PathOrUrl::Url(u)) => u
+                .path_segments()
+                .and_then(|mut segments| segments.next_back())
+                .and_then(|name| Path::new(name).file_stem()),
+        }
+        .map(|stem| stem.to_string_lossy().into_owned())
+        .filter(|stem| !stem.is_empty())
+    }
+}
+
 impl std::fmt::Display for Input {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
@@ -420,6 +644,16 @@ arg_enum! {
     }
 }
 
+/// Returns the output file for `input` in a batch conversion, by replacing `{}` in the
+/// template with the input's file name without its extension.
+fn batch_output(input: &Input, template: &str) -> Result<Output, Error> {
+    let stem = input
+        .stem()
+        .ok_or_else(|| error!("Cannot derive an output filename for {}", input))?;
+
+    Ok(Output::Path(PathBuf::from(template.replace("{}", &stem))))
+}
+
 struct Converter {
     pub dpi: (f64, f64),
     pub zoom: Scale,
@@ -438,6 +672,9 @@ struct Converter {
     pub keep_image_data: bool,
     pub input: Vec<Input>,
     pub output: Output,
+    pub output_template: Option<String>,
+    pub jobs: usize,
+    pub profile: bool,
 }
 
 impl Converter {
@@ -449,132 +686,275 @@ impl Converter {
             None => None,
         };
 
-        let mut surface: OnceCell<Surface> = OnceCell::new();
+        let loader = Loader::new()
+            .with_unlimited_size(self.unlimited)
+            .keep_image_data(self.keep_image_data);
+
+        if let Some(ref template) = self.output_template {
+            return self.convert_batch(&loader, template, stylesheet.as_deref());
+        }
+
+        let surface: OnceCell<Surface> = OnceCell::new();
 
         for input in &self.input {
-            let (stream, basefile) = match input {
-                Input::Stdin => (Stdin::stream(), None),
-                Input::Named(p) => {
-                    let file = p.get_gfile();
-                    let stream = file
-                        .read(None::<&Cancellable>)
-                        .map_err(|e| error!("Error reading file \"{}\": {}", input, e))?;
-                    (stream.upcast::<InputStream>(), Some(file))
+            self.render_input(
+                &loader,
+                input,
+                stylesheet.as_deref(),
+                &surface,
+                &self.output,
+            )?;
+        }
+
+        if let Some(s) = surface.into_inner() {
+            s.finish()
+                .map_err(|e| error!("Error saving output {}: {}", self.output, e))?
+        };
+
+        Ok(())
+    }
+
+    /// Converts each input to its own output file, using a pool of worker threads.
+    ///
+    /// Failures are reported as they happen and do not stop the other conversions.
+    /// If two inputs would be converted to the same file, nothing is converted.
+    fn convert_batch(
+        &self,
+        loader: &Loader,
+        template: &str,
+        stylesheet: Option<&str>,
+    ) -> Result<(), Error> {
+        let outputs: Vec<Result<Output, Error>> = self
+            .input
+            .iter()
+            .map(|input| batch_output(input, template))
+            .collect();
+
+        // Otherwise, two threads could write to the same file at the same time.
+        let mut inputs_by_path = HashMap::new();
+        let mut duplicates = 0;
+
+        for (input, output) in self.input.iter().zip(&outputs) {
+            if let Ok(Output::Path(ref path)) = *output {
+                match inputs_by_path.entry(path) {
+                    Entry::Vacant(e) => {
+                        e.insert(input);
+                    }
+
+                    Entry::Occupied(e) => {
+                        std::eprintln!(
+                            "Both {} and {} would be converted to {}",
+                            e.get(),
+                            input,
+                            path.display()
+                        );
+                        duplicates += 1;
+                    }
                 }
-            };
-
-            let mut handle = Loader::new()
-                .with_unlimited_size(self.unlimited)
-                .keep_image_data(self.keep_image_data)
-                .read_stream(&stream, basefile.as_ref(), None::<&Cancellable>)
-                .map_err(|e| error!("Error reading SVG {}: {}", input, e))?;
-
-            if let Some(ref css) = stylesheet {
-                handle
-                    .set_stylesheet(&css)
-                    .map_err(|e| error!("Error applying stylesheet: {}", e))?;
             }
+        }
 
-            let renderer = CairoRenderer::new(&handle)
-                .with_dpi(self.dpi.0, self.dpi.1)
-                .with_language(&self.language);
-
-            let geometry = natural_geometry(&renderer, input, self.export_id.as_deref())?;
-
-            // natural_size is in pixels
-            let natural_size = Size::new(geometry.width, geometry.height);
-
-            let params = NormalizeParams::from_dpi(Dpi::new(self.dpi.0, self.dpi.1));
-
-            // Convert natural size and requested size to pixels or points, depending on the target format,
-            let (natural_size, requested_width, requested_height, page_size) = match self.format {
-                Format::Png => {
-                    // PNG surface requires units in pixels
-                    (
-                        natural_size,
-                        self.width.map(|l| l.to_user(&params)),
-                        self.height.map(|l| l.to_user(&params)),
-                        self.page_size.map(|(w, h)| Size {
-                            w: w.to_user(&params),
-                            h: h.to_user(&params),
-                        }),
-                    )
-                }
+        if duplicates > 0 {
+            return Err(error!(
+                "{} of {} files would overwrite the output of another file",
+                duplicates,
+                self.input.len()
+            ));
+        }
 
-                Format::Pdf | Format::Ps | Format::Eps => {
-                    // These surfaces require units in points
-                    (
-                        Size {
-                            w: ULength::<Horizontal>::new(natural_size.w, LengthUnit::Px)
-                                .to_points(&params),
-                            h: ULength::<Vertical>::new(natural_size.h, LengthUnit::Px)
-                                .to_points(&params),
-                        },
-                        self.width.map(|l| l.to_points(&params)),
-                        self.height.map(|l| l.to_points(&params)),
-                        self.page_size.map(|(w, h)| Size {
-                            w: w.to_points(&params),
-                            h: h.to_points(&params),
-                        }),
-                    )
-                }
+        let pool = rayon::ThreadPoolBuilder::new()
+            .num_threads(self.jobs)
+            .build()
+            .map_err(|e| error!("Error starting worker threads: {}", e))?;
+
+        // Each worker thread shares the images and documents referenced by the
+        // inputs that it converts.
+        let loader = loader.clone().with_shared_resource_cache(true);
+
+        let failed = pool.install(|| {
+            self.input
+                .par_iter()
+                .zip(&outputs)
+                .filter(|(input, output)| {
+                    let res = output
+                        .as_ref()
+                        .map_err(|e| error!("{}", e))
+                        .and_then(|output| self.convert_one(&loader, input, output, stylesheet));
+
+                    if let Err(ref e) = res {
+                        std::eprintln!("{}", e);
+                    }
 
-                Format::Svg => {
-                    // TODO: SVG surface can be created with any unit type; let's use pixels for now
-                    (
-                        natural_size,
-                        self.width.map(|l| l.to_user(&params)),
-                        self.height.map(|l| l.to_user(&params)),
-                        self.page_size.map(|(w, h)| Size {
-                            w: w.to_user(&params),
-                            h: h.to_user(&params),
-                        }),
-                    )
-                }
-            };
+                    res.is_err()
+                })
+                .count()
+        });
 
-            let strategy = match (requested_width, requested_height) {
-                // when w and h are not specified, scale to the requested zoom (if any)
-                (None, None) => ResizeStrategy::Scale(self.zoom),
+        if failed > 0 {
+            Err(error!(
+                "{} of {} files could not be converted",
+                failed,
+                self.input.len()
+            ))
+        } else {
+            Ok(())
+        }
+    }
 
-                // when w and h are specified, but zoom is not, scale to the requested size
-                (Some(w), Some(h)) if self.zoom.is_identity() => ResizeStrategy::Fit(w, h),
+    fn convert_one(
+        &self,
+        loader: &Loader,
+        input: &Input,
+        output: &Output,
+        stylesheet: Option<&str>,
+    ) -> Result<(), Error> {
+        let surface: OnceCell<Surface> = OnceCell::new();
 
-                // if only one between w and h is specified and there is no zoom, scale to the
-                // requested w or h and use the same scaling factor for the other
-                (Some(w), None) if self.zoom.is_identity() => ResizeStrategy::FitWidth(w),
-                (None, Some(h)) if self.zoom.is_identity() => ResizeStrategy::FitHeight(h),
+        self.render_input(loader, input, stylesheet, &surface, output)?;
 
-                // otherwise scale the image, but cap the zoom to match the requested size
-                _ => ResizeStrategy::FitLargestScale(self.zoom, requested_width, requested_height),
-            };
+        if let Some(s) = surface.into_inner() {
+            s.finish()
+                .map_err(|e| error!("Error saving output {}: {}", output, e))?
+        };
 
-            let final_size = self.final_size(&strategy, &natural_size, input)?;
+        Ok(())
+    }
 
-            // Create the surface once on the first input
-            let page_size = page_size.unwrap_or(final_size);
-            let s = surface.get_or_try_init(|| self.create_surface(page_size))?;
+    fn render_input(
+        &self,
+        loader: &Loader,
+        input: &Input,
+        stylesheet: Option<&str>,
+        surface: &OnceCell<Surface>,
+        output: &Output,
+    ) -> Result<(), Error> {
+        let (stream, basefile) = match input {
+            Input::Stdin => (Stdin::stream(), None),
+            Input::Named(p) => {
+                let file = p.get_gfile();
+                let stream = file
+                    .read(None::<&Cancellable>)
+                    .map_err(|e| error!("Error reading file \"{}\": {}", input, e))?;
+                (stream.upcast::<InputStream>(), Some(file))
+            }
+        };
 
-            let left = self.left.map(|l| l.to_user(&params)).unwrap_or(0.0);
-            let top = self.top.map(|l| l.to_user(&params)).unwrap_or(0.0);
+        let mut handle = loader
+            .clone()
+            .read_stream(&stream, basefile.as_ref(), None::<&Cancellable>)
+            .map_err(|e| error!("Error reading SVG {}: {}", input, e))?;
 
-            s.render(
-                &renderer,
-                left,
-                top,
-                final_size,
-                geometry,
-                self.background_color,
-                self.export_id.as_deref(),
-            )
-            .map_err(|e| error!("Error rendering SVG {}: {}", input, e))?
+        if let Some(css) = stylesheet {
+            handle
+                .set_stylesheet(&css)
+                .map_err(|e| error!("Error applying stylesheet: {}", e))?;
         }
 
-        if let Some(s) = surface.take() {
-            s.finish()
-                .map_err(|e| error!("Error saving output {}: {}", self.output, e))?
+        let renderer = CairoRenderer::new(&handle)
+            .with_dpi(self.dpi.0, self.dpi.1)
+            .with_language(&self.language);
+
+        let geometry = natural_geometry(&renderer, input, self.export_id.as_deref())?;
+
+        // natural_size is in pixels
+        let natural_size = Size::new(geometry.width, geometry.height);
+
+        let params = NormalizeParams::from_dpi(Dpi::new(self.dpi.0, self.dpi.1));
+
+        // Convert natural size and requested size to pixels or points, depending on the target format,
+        let (natural_size, requested_width, requested_height, page_size) = match self.format {
+            Format::Png => {
+                // PNG surface requires units in pixels
+                (
+                    natural_size,
+                    self.width.map(|l| l.to_user(&params)),
+                    self.height.map(|l| l.to_user(&params)),
+                    self.page_size.map(|(w, h)| Size {
+                        w: w.to_user(&params),
+                        h: h.to_user(&params),
+                    }),
+                )
+            }
+
+            Format::Pdf | Format::Ps | Format::Eps => {
+                // These surfaces require units in points
+                (
+                    Size {
+                        w: ULength::<Horizontal>::new(natural_size.w, LengthUnit::Px)
+                            .to_points(&params),
+                        h: ULength::<Vertical>::new(natural_size.h, LengthUnit::Px)
+                            .to_points(&params),
+                    },
+                    self.width.map(|l| l.to_points(&params)),
+                    self.height.map(|l| l.to_points(&params)),
+                    self.page_size.map(|(w, h)| Size {
+                        w: w.to_points(&params),
+                        h: h.to_points(&params),
+                    }),
+                )
+            }
+
+            Format::Svg => {
+                // TODO: SVG surface can be created with any unit type; let's use pixels for now
+                (
+                    natural_size,
+                    self.width.map(|l| l.to_user(&params)),
+                    self.height.map(|l| l.to_user(&params)),
+                    self.page_size.map(|(w, h)| Size {
+                        w: w.to_user(&params),
+                        h: h.to_user(&params),
+                    }),
+                )
+            }
+        };
+
+        let strategy = match (requested_width, requested_height) {
+            // when w and h are not specified, scale to the requested zoom (if any)
+            (None, None) => ResizeStrategy::Scale(self.zoom),
+
+            // when w and h are specified, but zoom is not, scale to the requested size
+            (Some(w), Some(h)) if self.zoom.is_identity() => ResizeStrategy::Fit(w, h),
+
+            // if only one between w and h is specified and there is no zoom, scale to the
+            // requested w or h and use the same scaling factor for the other
+            (Some(w), None) if self.zoom.is_identity() => ResizeStrategy::FitWidth(w),
+            (None, Some(h)) if self.zoom.is_identity() => ResizeStrategy::FitHeight(h),
+
+            // otherwise scale the image, but cap the zoom to match the requested size
+            _ => ResizeStrategy::FitLargestScale(self.zoom, requested_width, requested_height),
+        };
+
+        let final_size = self.final_size(&strategy, &natural_size, input)?;
+
+        // Create the surface once on the first input
+        let page_size = page_size.unwrap_or(final_size);
+        let s = surface.get_or_try_init(|| self.create_surface(page_size, output))?;
+
+        let left = self.left.map(|l| l.to_user(&params)).unwrap_or(0.0);
+        let top = self.top.map(|l| l.to_user(&params)).unwrap_or(0.0);
+
+        let mut stats = if self.profile {
+            Some(RenderStats::default())
+        } else {
+            None
         };
 
+        s.render(
+            &renderer,
+            left,
+            top,
+            final_size,
+            geometry,
+            self.background_color,
+            self.export_id.as_deref(),
+            stats.as_mut(),
+        )
+        .map_err(|e| error!("Error rendering SVG {}: {}", input, e))?;
+
+        if let Some(stats) = stats {
+            std::eprint!("{}", stats.to_json_for_input(&input.to_string()));
+        }
+
         Ok(())
     }
 
@@ -592,14 +972,14 @@ impl Converter {
             .ok_or_else(|| error!("The SVG {} has no dimensions", input))
     }
 
-    fn create_surface(&self, size: Size) -> Result<Surface, Error> {
-        let output_stream = match self.output {
+    fn create_surface(&self, size: Size, output: &Output) -> Result<Surface, Error> {
+        let output_stream = match *output {
             Output::Stdout => Stdout::stream(),
             Output::Path(ref p) => {
                 let file = gio::File::for_path(p);
                 let stream = file
                     .replace(None, false, FileCreateFlags::NONE, None::<&Cancellable>)
-                    .map_err(|e| error!("Error opening output \"{}\": {}", self.output, e))?;
+                    .map_err(|e| error!("Error opening output \"{}\": {}", output, e))?;
                 stream.upcast::<OutputStream>()
             }
         };
@@ -756,6 +1136,24 @@ fn parse_args() -> Result<Converter, Error> {
                 .empty_values(false)
                 .help("Output filename [defaults to stdout]"),
         )
+        .arg(
+            clap::Arg::with_name("output_template")
+                .long("output-template")
+                .empty_values(false)
+                .value_name("template")
+                .conflicts_with("output")
+                .help("Convert each input to its own file; {} in the template is replaced by the input's name without extension"),
+        )
+        .arg(
+            clap::Arg::with_name("jobs")
+                .short("j")
+                .long("jobs")
+                .takes_value(true)
+                .value_name("number")
+                .requires("output_template")
+                .validator(is_valid_jobs)
+                .help("Number of files to convert in parallel with --output-template [defaults to the number of CPUs]"),
+        )
         .arg(
             clap::Arg::with_name("export_id")
                 .short("i")
@@ -810,6 +1208,11 @@ fn parse_args() -> Result<Converter, Error> {
                 .long("no-keep-image-data")
                 .help("Do not keep image data"),
         )
+        .arg(
+            clap::Arg::with_name("profile")
+                .long("profile")
+                .help("Print statistics about the rendering of each file as JSON to stderr"),
+        )
         .arg(
             clap::Arg::with_name("FILE")
                 .help("The input file(s) to convert")
@@ -900,7 +1303,12 @@ fn parse_args() -> Result<Converter, Error> {
         None => vec![Input::Stdin],
     };
 
-    if input.len() > 1 && !matches!(format, Format::Ps | Format::Eps | Format::Pdf) {
+    let output_template = value_t!(matches, "output_template", String).or_none()?;
+
+    if output_template.is_none()
+        && input.len() > 1
+        && !matches!(format, Format::Ps | Format::Eps | Format::Pdf)
+    {
         return Err(error!(
             "Multiple SVG files are only allowed for PDF and (E)PS output."
         ));
@@ -936,6 +1344,9 @@ fn parse_args() -> Result<Converter, Error> {
             .map(PathBuf::from)
             .map(Output::Path)
             .unwrap_or(Output::Stdout),
+        output_template,
+        jobs: value_t!(matches, "jobs", usize).or_none()?.unwrap_or(0),
+        profile: matches.is_present("profile"),
     })
 }
 
@@ -947,6 +1358,14 @@ fn is_valid_resolution(v: String) -> Result<(), String> {
     }
 }
 
+fn is_valid_jobs(v: String) -> Result<(), String> {
+    match v.parse::<usize>() {
+        Ok(jobs) if jobs > 0 => Ok(()),
+        Ok(_) => Err(String::from("Invalid number of jobs")),
+        Err(e) => Err(format!("{}", e)),
+    }
+}
+
 fn is_valid_zoom_factor(v: String) -> Result<(), String> {
     match v.parse::<f64>() {
         Ok(res) if res > 0.0 => Ok(()),
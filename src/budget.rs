@@ -0,0 +1,220 @@
+//! Limits on the time and memory that a single rendering can take.
+//!
+//! The limits in `limits.rs` protect against documents that reference or load
+//! too many elements, but a document can still take a long time to render, for
+//! example through a long chain of expensive filters, or allocate a lot of
+//! memory for temporary surfaces.  Applications that render documents from
+//! untrusted sources can give a `CairoRenderer` a time limit, a limit on the
+//! bytes of temporary surfaces, and a `gio::Cancellable`.
+//!
+//! Those go into a `RenderBudget` that is created for each rendering and shared
+//! by all the `DrawingCtx` used during it.  The budget is checked cooperatively:
+//! before drawing each element, before rendering each filter primitive, and
+//! when allocating temporary surfaces.  When it runs out, rendering stops with
+//! `RenderingError::Cancelled` or `RenderingError::LimitExceeded`.
+//!
+//! The memory limit is on the bytes of the temporary surfaces that are alive at
+//! the same time.  Each allocation returns a `SurfaceAllocation`, which gets
+//! attached to the new surface and gives its bytes back to the budget when cairo
+//! frees the surface.  A budget can also be shared by the threads that render
+//! the tiles of a `ParallelTileRenderer`, so that all of them count against the
+//! same deadline and memory limit.
+
+use std::rc::Rc;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use gio::prelude::*;
+
+use crate::error::{ImplementationLimit, RenderingError};
+
+/// Time and memory left for a rendering.
+pub struct RenderBudget {
+    deadline: Option<Instant>,
+    max_temporary_surface_bytes: Option<usize>,
+    cancellable: Option<gio::Cancellable>,
+
+    /// Bytes of the temporary surfaces that have not been freed yet.
+    live_surface_bytes: AtomicUsize,
+}
+
+impl RenderBudget {
+    /// Creates a budget for a rendering that starts now.
+    pub fn new(
+        timeout: Option<Duration>,
+        max_temporary_surface_bytes: Option<usize>,
+        cancellable: Option<gio::Cancellable>,
+    ) -> RenderBudget {
+        RenderBudget {
+            deadline: timeout.map(|t| Instant::now() + t),
+            max_temporary_surface_bytes,
+            cancellable,
+            live_surface_bytes: AtomicUsize::new(0),
+        }
+    }
+
+    /// Returns an error if the rendering was cancelled or ran out of time.
+    pub fn check(&self) -> Result<(), RenderingError> {
+        if let Some(ref cancellable) = self.cancellable {
+            if cancellable.is_cancelled() {
+                return Err(RenderingError::Cancelled);
+            }
+        }
+
+        if let Some(deadline) = self.deadline {
+            if Instant::now() >= deadline {
+                return Err(RenderingError::LimitExceeded(
+                    ImplementationLimit::RenderingTimeExceeded,
+                ));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Accounts for a temporary surface that is about to be allocated, and returns an error
+    /// if it does not fit in the budget along with the surfaces that are still alive.
+    ///
+    /// The surface's bytes are given back when the returned `SurfaceAllocation` is dropped.
+    pub fn allocate_surface(
+        budget: &Arc<RenderBudget>,
+        width: i32,
+        height: i32,
+    ) -> Result<SurfaceAllocation, RenderingError> {
+        let bytes = (width.max(0) as usize)
+            .saturating_mul(height.max(0) as usize)
+            .saturating_mul(4);
+
+        let live = budget
+            .live_surface_bytes
+            .fetch_add(bytes, Ordering::Relaxed)
+            .saturating_add(bytes);
+
+        let allocation = SurfaceAllocation {
+            budget: Some(budget.clone()),
+            bytes,
+        };
+
+        match budget.max_temporary_surface_bytes {
+            Some(max) if live > max => Err(RenderingError::LimitExceeded(
+                ImplementationLimit::TooManyTemporarySurfaceBytes,
+            )),
+
+            _ => Ok(allocation),
+        }
+    }
+
+    /// Bytes of the temporary surfaces that are alive.
+    #[cfg(test)]
+    fn live_surface_bytes(&self) -> usize {
+        self.live_surface_bytes.load(Ordering::Relaxed)
+    }
+}
+
+/// Bytes of a temporary surface, which count against a budget until this is dropped.
+pub struct SurfaceAllocation {
+    budget: Option<Arc<RenderBudget>>,
+    bytes: usize,
+}
+
+static SURFACE_ALLOCATION: cairo::UserDataKey<SurfaceAllocation> = cairo::UserDataKey::new();
+
+impl SurfaceAllocation {
+    /// An allocation for a rendering without a budget.
+    pub fn unbudgeted() -> SurfaceAllocation {
+        SurfaceAllocation {
+            budget: None,
+            bytes: 0,
+        }
+    }
+
+    /// Keeps the allocation until cairo frees `surface`.
+    pub fn attach_to(self, surface: &cairo::Surface) {
+        if self.budget.is_some() {
+            // If cairo cannot store the allocation, it is dropped here, and the surface
+            // stops counting against the budget a bit early.
+            let _ = surface.set_user_data(&SURFACE_ALLOCATION, Rc::new(self));
+        }
+    }
+}
+
+impl Drop for SurfaceAllocation {
+    fn drop(&mut self) {
+        if let Some(ref budget) = self.budget {
+            budget
+                .live_surface_bytes
+                .fetch_sub(self.bytes, Ordering::Relaxed);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn unlimited_budget_never_runs_out() {
+        let budget = Arc::new(RenderBudget::new(None, None, None));
+
+        let _a = RenderBudget::allocate_surface(&budget, i32::MAX, i32::MAX).unwrap();
+        let _b = RenderBudget::allocate_surface(&budget, i32::MAX, i32::MAX).unwrap();
+        assert!(budget.check().is_ok());
+    }
+
+    #[test]
+    fn adds_up_live_temporary_surfaces() {
+        let budget = Arc::new(RenderBudget::new(None, Some(800), None));
+
+        let _a = RenderBudget::allocate_surface(&budget, 10, 10).unwrap();
+        let _b = RenderBudget::allocate_surface(&budget, 10, 10).unwrap();
+        assert!(matches!(
+            RenderBudget::allocate_surface(&budget, 1, 1),
+            Err(RenderingError::LimitExceeded(
+                ImplementationLimit::TooManyTemporarySurfaceBytes
+            ))
+        ));
+
+        // The failed allocation was given back.
+        assert_eq!(budget.live_surface_bytes(), 800);
+    }
+
+    #[test]
+    fn freed_surfaces_do_not_count() {
+        let budget = Arc::new(RenderBudget::new(None, Some(800), None));
+
+        for _ in 0..10 {
+            let allocation = RenderBudget::allocate_surface(&budget, 10, 20).unwrap();
+            let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, 10, 20).unwrap();
+            allocation.attach_to(&surface);
+
+            assert_eq!(budget.live_surface_bytes(), 800);
+        }
+
+        assert_eq!(budget.live_surface_bytes(), 0);
+    }
+
+    #[test]
+    fn runs_out_of_time() {
+        let budget = RenderBudget::new(Some(Duration::from_secs(0)), None, None);
+
+        assert!(matches!(
+            budget.check(),
+            Err(RenderingError::LimitExceeded(
+                ImplementationLimit::RenderingTimeExceeded
+            ))
+        ));
+    }
+
+    #[test]
+    fn gets_cancelled() {
+        let cancellable = gio::Cancellable::new();
+        let budget = RenderBudget::new(None, None, Some(cancellable.clone()));
+
+        assert!(budget.check().is_ok());
+
+        cancellable.cancel();
+
+        assert!(matches!(budget.check(), Err(RenderingError::Cancelled)));
+    }
+}
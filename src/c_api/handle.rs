@@ -21,10 +21,13 @@
 use std::cell::{Cell, Ref, RefCell, RefMut};
 use std::ffi::{CStr, CString, OsStr};
 use std::fmt;
+use std::mem;
 use std::path::PathBuf;
 use std::ptr;
 use std::slice;
 use std::str;
+use std::sync::Arc;
+use std::time::Duration;
 use std::{f64, i32};
 
 use gdk_pixbuf::Pixbuf;
@@ -35,12 +38,15 @@ use url::Url;
 use glib::subclass::prelude::*;
 use glib::translate::*;
 use glib::{ffi::gpointer, gobject_ffi};
-use glib::{Bytes, Cast, ParamFlags, ParamSpec, StaticType, ToValue};
+use glib::{Cast, ParamFlags, ParamSpec, StaticType, ToValue};
 use once_cell::sync::Lazy;
 
 use glib::types::instance_of;
 
-use crate::api::{self, CairoRenderer, IntrinsicDimensions, Loader, LoadingError, SvgHandle};
+use crate::api::{
+    self, CairoRenderer, IntrinsicDimensions, Loader, LoadingError, PixelFormat, RenderStats,
+    SvgHandle, SvgHandleLoader, SvgSnapshot,
+};
 
 use crate::{
     length::RsvgLength,
@@ -180,9 +186,16 @@ enum LoadState {
 
     /// Being loaded using the legacy write()/close() API.
     ///
-    /// We buffer all the data from `write()` calls until the time `close()` is called;
-    /// then we run the buffer through a decompressor in case this is an SVGZ file.
-    Loading { buffer: Vec<u8> },
+    /// Each chunk from `write()` gets parsed as it arrives, so that `close()` only has
+    /// to finish the document.  If the loader could not be created, the error is kept
+    /// here and returned from `close()`.
+    ///
+    /// `size_reported` is set once the size callback has been called with the size from
+    /// the root element's attributes.
+    Loading {
+        loader: Result<SvgHandleLoader, LoadingError>,
+        size_reported: bool,
+    },
 
     /// Loading finished successfully; the document is in the `SvgHandle`.
     ClosedOk { handle: SvgHandle },
@@ -295,6 +308,9 @@ mod imp {
         pub(super) base_url: BaseUrl,
         pub(super) size_callback: SizeCallback,
         pub(super) is_testing: bool,
+        pub(super) render_timeout: Option<Duration>,
+        pub(super) max_temporary_surface_bytes: Option<usize>,
+        pub(super) render_cancellable: Option<gio::Cancellable>,
     }
 
     #[glib::object_subclass]
@@ -315,6 +331,9 @@ mod imp {
                     base_url: BaseUrl::default(),
                     size_callback: SizeCallback::default(),
                     is_testing: false,
+                    render_timeout: None,
+                    max_temporary_surface_bytes: None,
+                    render_cancellable: None,
                 }),
                 load_state: RefCell::new(LoadState::Start),
             }
@@ -532,6 +551,39 @@ pub type RsvgSizeFunc = Option<
     ),
 >;
 
+// Keep in sync with rsvg-cairo.h:RsvgTileFunc
+pub type RsvgTileFunc = Option<
+    unsafe extern "C" fn(
+        surface: *mut cairo::ffi::cairo_surface_t,
+        x: libc::c_int,
+        y: libc::c_int,
+        user_data: gpointer,
+    ),
+>;
+
+// Keep in sync with rsvg-cairo.h:RsvgPixelFormat
+pub type RsvgPixelFormat = libc::c_int;
+
+fn pixel_format_from_c(format: RsvgPixelFormat) -> Option<PixelFormat> {
+    match format {
+        0 => Some(PixelFormat::Argb32Premultiplied),
+        1 => Some(PixelFormat::RgbaPremultiplied),
+        2 => Some(PixelFormat::Rgba),
+        _ => None,
+    }
+}
+
+/// Contents of an `RsvgSnapshot`; C code gets it as a pointer from `Arc::into_raw`.
+///
+/// Besides the document, this has the loading options of the original handle, to
+/// create new handles like it in other threads.
+pub struct RsvgSnapshot {
+    snapshot: SvgSnapshot,
+    flags: RsvgHandleFlags,
+    dpi: Dpi,
+    base_url: Option<String>,
+}
+
 struct SizeCallback {
     size_func: RsvgSizeFunc,
     user_data: gpointer,
@@ -728,17 +780,59 @@ impl CHandle {
 
         match *state {
             LoadState::Start => {
-                *state = LoadState::Loading {
-                    buffer: Vec::from(buf),
+                let base_file = imp.inner.borrow().base_url.get_gfile();
+                let mut loader = self.make_loader().push_loader(base_file.as_ref());
+
+                if let Ok(ref mut loader) = loader {
+                    loader.write(buf);
                 }
+
+                *state = LoadState::Loading {
+                    loader,
+                    size_reported: false,
+                };
             }
 
-            LoadState::Loading { ref mut buffer } => {
-                buffer.extend_from_slice(buf);
+            LoadState::Loading { ref mut loader, .. } => {
+                if let Ok(ref mut loader) = *loader {
+                    loader.write(buf);
+                }
             }
 
             _ => {
                 rsvg_g_critical("Handle must not be closed in order to write to it");
+                return;
+            }
+        }
+
+        // Call the size callback as soon as the root element's start tag has been parsed,
+        // so that callers like the gdk-pixbuf loader can know the size of the image before
+        // the rest of the document arrives.
+        let size = match *state {
+            LoadState::Loading {
+                loader: Ok(ref loader),
+                ref mut size_reported,
+            } if !*size_reported => {
+                let dpi = imp.inner.borrow().dpi;
+
+                loader
+                    .intrinsic_size_in_pixels(dpi.x(), dpi.y())
+                    .map(|(w, h)| {
+                        *size_reported = true;
+                        (w.round(), h.round())
+                    })
+            }
+
+            _ => None,
+        };
+
+        // The callback may want to query the handle, so don't keep it borrowed
+        drop(state);
+
+        if let Some((w, h)) = size {
+            if let (Ok(w), Ok(h)) = (checked_i32(w), checked_i32(h)) {
+                let inner = imp.inner.borrow();
+                inner.size_callback.call(w, h);
             }
         }
     }
@@ -746,27 +840,23 @@ impl CHandle {
     fn close(&self) -> Result<(), LoadingError> {
         let imp = imp::CHandle::from_instance(self);
 
-        let inner = imp.inner.borrow();
         let mut state = imp.load_state.borrow_mut();
 
-        match *state {
-            LoadState::Start => {
-                *state = LoadState::ClosedError;
-                Err(LoadingError::XmlParseError(String::from(
-                    "caller did not write any data",
-                )))
-            }
-
-            LoadState::Loading { ref buffer } => {
-                let bytes = Bytes::from(&*buffer);
-                let stream = gio::MemoryInputStream::from_bytes(&bytes);
+        match mem::replace(&mut *state, LoadState::ClosedError) {
+            LoadState::Start => Err(LoadingError::XmlParseError(String::from(
+                "caller did not write any data",
+            ))),
 
-                let base_file = inner.base_url.get_gfile();
-                self.read_stream(state, &stream.upcast(), base_file.as_ref(), None)
+            LoadState::Loading { loader, .. } => {
+                state.set_from_loading_result(loader.and_then(|loader| loader.close()))
             }
 
             // Closing is idempotent
-            LoadState::ClosedOk { .. } => Ok(()),
+            LoadState::ClosedOk { handle } => {
+                *state = LoadState::ClosedOk { handle };
+                Ok(())
+            }
+
             LoadState::ClosedError => Ok(()),
         }
     }
@@ -937,6 +1027,18 @@ impl CHandle {
             renderer = renderer.test_mode();
         }
 
+        if let Some(timeout) = inner.render_timeout {
+            renderer = renderer.with_render_timeout(timeout);
+        }
+
+        if let Some(max_bytes) = inner.max_temporary_surface_bytes {
+            renderer = renderer.with_max_temporary_surface_bytes(max_bytes);
+        }
+
+        if let Some(ref cancellable) = inner.render_cancellable {
+            renderer = renderer.with_cancellable(cancellable);
+        }
+
         renderer
     }
 
@@ -965,6 +1067,32 @@ impl CHandle {
         }
     }
 
+    fn freeze(&self) -> Result<RsvgSnapshot, RenderingError> {
+        let handle = self.get_handle_ref()?;
+
+        let imp = imp::CHandle::from_instance(self);
+        let inner = imp.inner.borrow();
+
+        Ok(RsvgSnapshot {
+            snapshot: handle.freeze(),
+            flags: HandleFlags::from(inner.load_flags).bits(),
+            dpi: inner.dpi,
+            base_url: inner.base_url.get().map(|url| url.as_str().to_string()),
+        })
+    }
+
+    fn load_snapshot(&self, snapshot: &RsvgSnapshot) -> Result<(), LoadingError> {
+        if let Some(ref url) = snapshot.base_url {
+            self.set_base_url(url);
+        }
+
+        let imp = imp::CHandle::from_instance(self);
+        imp.inner.borrow_mut().dpi = snapshot.dpi;
+
+        let mut state = imp.load_state.borrow_mut();
+        state.set_from_loading_result(snapshot.snapshot.to_handle())
+    }
+
     fn render_cairo_sub(
         &self,
         cr: *mut cairo::ffi::cairo_t,
@@ -1023,6 +1151,34 @@ impl CHandle {
         Ok(renderer.render_document(&cr, viewport)?)
     }
 
+    fn render_document_with_stats(
+        &self,
+        cr: *mut cairo::ffi::cairo_t,
+        viewport: &cairo::Rectangle,
+    ) -> Result<RenderStats, RenderingError> {
+        let cr = check_cairo_context(cr)?;
+
+        let handle = self.get_handle_ref()?;
+
+        let renderer = self.make_renderer(&handle);
+        Ok(renderer.render_document_with_stats(&cr, viewport)?)
+    }
+
+    fn render_damage(
+        &self,
+        cr: *mut cairo::ffi::cairo_t,
+        viewport: &cairo::Rectangle,
+    ) -> Result<Option<RsvgRectangle>, RenderingError> {
+        let cr = check_cairo_context(cr)?;
+
+        let handle = self.get_handle_ref()?;
+
+        let renderer = self.make_renderer(&handle);
+        Ok(renderer
+            .render_damage(&cr, viewport)?
+            .map(RsvgRectangle::from))
+    }
+
     fn get_geometry_for_layer(
         &self,
         id: Option<&str>,
@@ -1079,6 +1235,44 @@ impl CHandle {
         Ok(renderer.render_element(&cr, id, element_viewport)?)
     }
 
+    fn render_tiles(
+        &self,
+        viewport: &cairo::Rectangle,
+        tile_width: i32,
+        tile_height: i32,
+        bleed: f64,
+        tile_func: RsvgTileFunc,
+        user_data: gpointer,
+    ) -> Result<(), RenderingError> {
+        let handle = self.get_handle_ref()?;
+
+        let renderer = self.make_renderer(&handle).with_tile_bleed(bleed);
+
+        let tile_func = tile_func.unwrap();
+
+        Ok(
+            renderer.render_tiles(viewport, tile_width, tile_height, |x, y, surface| unsafe {
+                tile_func(surface.to_raw_none(), x, y, user_data);
+            })?,
+        )
+    }
+
+    fn render_document_to_buffer(
+        &self,
+        buffer: &mut [u8],
+        width: i32,
+        height: i32,
+        stride: i32,
+        format: PixelFormat,
+        viewport: &cairo::Rectangle,
+    ) -> Result<(), RenderingError> {
+        let handle = self.get_handle_ref()?;
+
+        let renderer = self.make_renderer(&handle);
+
+        Ok(renderer.render_document_to_buffer(buffer, width, height, stride, format, viewport)?)
+    }
+
     fn get_intrinsic_dimensions(&self) -> Result<IntrinsicDimensions, RenderingError> {
         let handle = self.get_handle_ref()?;
         let renderer = self.make_renderer(&handle);
@@ -1096,6 +1290,29 @@ impl CHandle {
         let mut inner = imp.inner.borrow_mut();
         inner.is_testing = is_testing;
     }
+
+    fn set_render_limits(&self, timeout_ms: u32, max_temporary_surface_bytes: usize) {
+        let imp = imp::CHandle::from_instance(self);
+        let mut inner = imp.inner.borrow_mut();
+
+        inner.render_timeout = if timeout_ms > 0 {
+            Some(Duration::from_millis(u64::from(timeout_ms)))
+        } else {
+            None
+        };
+
+        inner.max_temporary_surface_bytes = if max_temporary_surface_bytes > 0 {
+            Some(max_temporary_surface_bytes)
+        } else {
+            None
+        };
+    }
+
+    fn set_render_cancellable(&self, cancellable: Option<gio::Cancellable>) {
+        let imp = imp::CHandle::from_instance(self);
+        let mut inner = imp.inner.borrow_mut();
+        inner.render_cancellable = cancellable;
+    }
 }
 
 fn is_rsvg_handle(obj: *const RsvgHandle) -> bool {
@@ -1254,6 +1471,42 @@ pub unsafe extern "C" fn rsvg_handle_internal_set_testing(
     rhandle.set_testing(from_glib(testing));
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_set_render_limits(
+    handle: *const RsvgHandle,
+    timeout_ms: libc::c_uint,
+    max_temporary_surface_bytes: usize,
+) {
+    rsvg_return_if_fail! {
+        rsvg_handle_set_render_limits;
+
+        is_rsvg_handle(handle),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    rhandle.set_render_limits(timeout_ms, max_temporary_surface_bytes);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_set_render_cancellable(
+    handle: *const RsvgHandle,
+    cancellable: *mut gio::ffi::GCancellable,
+) {
+    rsvg_return_if_fail! {
+        rsvg_handle_set_render_cancellable;
+
+        is_rsvg_handle(handle),
+        cancellable.is_null() || is_cancellable(cancellable),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    let cancellable: Option<gio::Cancellable> = from_glib_none(cancellable);
+
+    rhandle.set_render_cancellable(cancellable);
+}
+
 trait IntoGError {
     type GlibResult;
 
@@ -1738,6 +1991,82 @@ pub unsafe extern "C" fn rsvg_handle_set_stylesheet(
     rhandle.set_stylesheet(css).into_gerror(error)
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_freeze(
+    handle: *const RsvgHandle,
+    error: *mut *mut glib::ffi::GError,
+) -> *const RsvgSnapshot {
+    rsvg_return_val_if_fail! {
+        rsvg_handle_freeze => ptr::null();
+
+        is_rsvg_handle(handle),
+        error.is_null() || (*error).is_null(),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    match rhandle.freeze() {
+        Ok(snapshot) => Arc::into_raw(Arc::new(snapshot)),
+
+        Err(e) => {
+            set_gerror(error, 0, &format!("{}", e));
+            ptr::null()
+        }
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_snapshot_new_handle(
+    snapshot: *const RsvgSnapshot,
+    error: *mut *mut glib::ffi::GError,
+) -> *const RsvgHandle {
+    rsvg_return_val_if_fail! {
+        rsvg_snapshot_new_handle => ptr::null();
+
+        !snapshot.is_null(),
+        error.is_null() || (*error).is_null(),
+    }
+
+    let snapshot = &*snapshot;
+
+    let raw_handle = rsvg_handle_new_with_flags(snapshot.flags);
+
+    let rhandle = get_rust_handle(raw_handle);
+
+    match rhandle.load_snapshot(snapshot) {
+        Ok(()) => raw_handle,
+
+        Err(e) => {
+            set_gerror(error, 0, &format!("{}", e));
+            gobject_ffi::g_object_unref(raw_handle as *mut _);
+            ptr::null_mut()
+        }
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_snapshot_ref(snapshot: *const RsvgSnapshot) -> *const RsvgSnapshot {
+    rsvg_return_val_if_fail! {
+        rsvg_snapshot_ref => ptr::null();
+
+        !snapshot.is_null(),
+    }
+
+    Arc::increment_strong_count(snapshot);
+    snapshot
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_snapshot_unref(snapshot: *const RsvgSnapshot) {
+    rsvg_return_if_fail! {
+        rsvg_snapshot_unref;
+
+        !snapshot.is_null(),
+    }
+
+    Arc::decrement_strong_count(snapshot);
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn rsvg_handle_get_intrinsic_dimensions(
     handle: *const RsvgHandle,
@@ -1823,6 +2152,63 @@ pub unsafe extern "C" fn rsvg_handle_render_document(
         .into_gerror(error)
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_render_document_with_stats(
+    handle: *const RsvgHandle,
+    cr: *mut cairo::ffi::cairo_t,
+    viewport: *const RsvgRectangle,
+    out_stats_json: *mut *mut libc::c_char,
+    error: *mut *mut glib::ffi::GError,
+) -> glib::ffi::gboolean {
+    rsvg_return_val_if_fail! {
+        rsvg_handle_render_document_with_stats => false.into_glib();
+
+        is_rsvg_handle(handle),
+        !cr.is_null(),
+        !viewport.is_null(),
+        !out_stats_json.is_null(),
+        error.is_null() || (*error).is_null(),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    rhandle
+        .render_document_with_stats(cr, &(*viewport).into())
+        .map(|stats| {
+            *out_stats_json = stats.to_json().to_glib_full();
+        })
+        .into_gerror(error)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_render_damage(
+    handle: *const RsvgHandle,
+    cr: *mut cairo::ffi::cairo_t,
+    viewport: *const RsvgRectangle,
+    out_damage: *mut RsvgRectangle,
+    error: *mut *mut glib::ffi::GError,
+) -> glib::ffi::gboolean {
+    rsvg_return_val_if_fail! {
+        rsvg_handle_render_damage => false.into_glib();
+
+        is_rsvg_handle(handle),
+        !cr.is_null(),
+        !viewport.is_null(),
+        error.is_null() || (*error).is_null(),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    rhandle
+        .render_damage(cr, &(*viewport).into())
+        .map(|damage| {
+            if !out_damage.is_null() {
+                *out_damage = damage.unwrap_or_default();
+            }
+        })
+        .into_gerror(error)
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn rsvg_handle_get_geometry_for_layer(
     handle: *mut RsvgHandle,
@@ -1941,6 +2327,84 @@ pub unsafe extern "C" fn rsvg_handle_render_element(
         .into_gerror(error)
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_render_tiles(
+    handle: *const RsvgHandle,
+    viewport: *const RsvgRectangle,
+    tile_width: libc::c_int,
+    tile_height: libc::c_int,
+    bleed: libc::c_double,
+    tile_func: RsvgTileFunc,
+    user_data: gpointer,
+    error: *mut *mut glib::ffi::GError,
+) -> glib::ffi::gboolean {
+    rsvg_return_val_if_fail! {
+        rsvg_handle_render_tiles => false.into_glib();
+
+        is_rsvg_handle(handle),
+        !viewport.is_null(),
+        tile_width > 0,
+        tile_height > 0,
+        bleed >= 0.0,
+        tile_func.is_some(),
+        error.is_null() || (*error).is_null(),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    rhandle
+        .render_tiles(
+            &(*viewport).into(),
+            tile_width,
+            tile_height,
+            bleed,
+            tile_func,
+            user_data,
+        )
+        .into_gerror(error)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rsvg_handle_render_document_to_buffer(
+    handle: *const RsvgHandle,
+    buffer: *mut u8,
+    width: libc::c_int,
+    height: libc::c_int,
+    stride: libc::c_int,
+    format: RsvgPixelFormat,
+    viewport: *const RsvgRectangle,
+    error: *mut *mut glib::ffi::GError,
+) -> glib::ffi::gboolean {
+    rsvg_return_val_if_fail! {
+        rsvg_handle_render_document_to_buffer => false.into_glib();
+
+        is_rsvg_handle(handle),
+        !buffer.is_null(),
+        buffer as usize % 4 == 0,
+        width > 0,
+        height > 0,
+        stride % 4 == 0 && stride / 4 >= width,
+        pixel_format_from_c(format).is_some(),
+        !viewport.is_null(),
+        error.is_null() || (*error).is_null(),
+    }
+
+    let rhandle = get_rust_handle(handle);
+
+    let buffer = slice::from_raw_parts_mut(buffer, stride as usize * height as usize);
+
+    rhandle
+        .render_document_to_buffer(
+            buffer,
+            width,
+            height,
+            stride,
+            pixel_format_from_c(format).unwrap(),
+            &(*viewport).into(),
+        )
+        .into_gerror(error)
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn rsvg_handle_get_desc(handle: *const RsvgHandle) -> *mut libc::c_char {
     rsvg_return_val_if_fail! {
@@ -10,6 +10,7 @@ pub use handle::{
     rsvg_error_get_type,
     rsvg_handle_close,
     rsvg_handle_flags_get_type,
+    rsvg_handle_freeze,
     rsvg_handle_get_base_uri,
     rsvg_handle_get_dimensions,
     rsvg_handle_get_dimensions_sub,
@@ -28,14 +29,23 @@ pub use handle::{
     rsvg_handle_new_with_flags,
     rsvg_handle_read_stream_sync,
     rsvg_handle_render_cairo_sub,
+    rsvg_handle_render_damage,
     rsvg_handle_render_element,
     rsvg_handle_render_document,
+    rsvg_handle_render_document_to_buffer,
+    rsvg_handle_render_document_with_stats,
     rsvg_handle_render_layer,
+    rsvg_handle_render_tiles,
     rsvg_handle_set_base_gfile,
     rsvg_handle_set_base_uri,
     rsvg_handle_set_dpi_x_y,
+    rsvg_handle_set_render_cancellable,
+    rsvg_handle_set_render_limits,
     rsvg_handle_set_size_callback,
     rsvg_handle_write,
+    rsvg_snapshot_new_handle,
+    rsvg_snapshot_ref,
+    rsvg_snapshot_unref,
 };
 
 pub use dpi::{rsvg_set_default_dpi, rsvg_set_default_dpi_x_y};
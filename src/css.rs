@@ -72,6 +72,15 @@
 //! element, plus a selector, and returns a bool.  We iterate through
 //! the rules in the stylesheets and gather the matches; then sort the
 //! matches by specificity and apply the result to each element.
+//!
+//! Testing every selector against every element gets slow for big
+//! documents with big stylesheets, so each stylesheet keeps a
+//! `SelectorMap` that indexes its selectors by the id, class, or local
+//! name in their rightmost compound selector; an element only gets
+//! tested against the selectors that could possibly match it.  During
+//! the cascade we also keep a bloom filter with the ids, classes, and
+//! names of the current element's ancestors, which lets the `selectors`
+//! crate reject selectors like `#foo rect` without walking up the tree.
 
 use cssparser::{
     self, match_ignore_ascii_case, parse_important, AtRuleParser, AtRuleType, BasicParseErrorKind,
@@ -81,15 +90,18 @@ use cssparser::{
 use data_url::mime::Mime;
 use markup5ever::{namespace_url, ns, LocalName, Namespace, Prefix, QualName};
 use selectors::attr::{AttrSelectorOperation, CaseSensitivity, NamespaceConstraint};
+use selectors::bloom::BloomFilter;
 use selectors::matching::{ElementSelectorFlags, MatchingContext, MatchingMode, QuirksMode};
+use selectors::parser::{AncestorHashes, Component};
 use selectors::{OpaqueElement, SelectorImpl, SelectorList};
 use std::cmp::Ordering;
+use std::collections::HashMap;
 use std::fmt;
 use std::str;
 
 use crate::error::*;
 use crate::io::{self, BinaryData};
-use crate::node::{Node, NodeBorrow, NodeCascade};
+use crate::node::{ElementTable, Node, NodeBorrow};
 use crate::properties::{parse_property, ComputedValues, ParsedProperty};
 use crate::url_resolver::UrlResolver;
 
@@ -592,6 +604,110 @@ pub enum Origin {
 pub struct Stylesheet {
     origin: Origin,
     qualified_rules: Vec<QualifiedRule>,
+    selector_map: SelectorMap,
+}
+
+/// Position of a selector in a stylesheet, with its hashes for the bloom filter.
+struct IndexedSelector {
+    /// Index into `Stylesheet.qualified_rules`.
+    rule: usize,
+
+    /// Index into the rule's list of selectors.
+    selector: usize,
+
+    hashes: AncestorHashes,
+}
+
+/// The selectors of a stylesheet, by the id, class, or local name that an element must
+/// have for them to match.
+///
+/// Each selector is stored only once, under the most specific of those that appears in
+/// its rightmost compound selector; for example, `g #foo.bar` is stored under the id
+/// `foo`.  Selectors without any of them, like `*` or `[fill]`, go in `other`.
+#[derive(Default)]
+struct SelectorMap {
+    by_id: HashMap<String, Vec<IndexedSelector>>,
+    by_class: HashMap<String, Vec<IndexedSelector>>,
+    by_local_name: HashMap<LocalName, Vec<IndexedSelector>>,
+    other: Vec<IndexedSelector>,
+}
+
+impl SelectorMap {
+    fn insert(
+        &mut self,
+        rule: usize,
+        selector_index: usize,
+        selector: &selectors::parser::Selector<Selector>,
+    ) {
+        let mut id = None;
+        let mut class = None;
+        let mut local_name = None;
+
+        for component in selector.iter() {
+            match *component {
+                Component::ID(ref i) => id = Some(i),
+                Component::Class(ref c) => class = Some(c),
+                Component::LocalName(ref l) => local_name = Some(&l.name),
+                _ => (),
+            }
+        }
+
+        let indexed = IndexedSelector {
+            rule,
+            selector: selector_index,
+            hashes: AncestorHashes::new(selector, QuirksMode::NoQuirks),
+        };
+
+        if let Some(id) = id {
+            self.by_id.entry(id.to_string()).or_default().push(indexed);
+        } else if let Some(class) = class {
+            self.by_class
+                .entry(class.to_string())
+                .or_default()
+                .push(indexed);
+        } else if let Some(local_name) = local_name {
+            self.by_local_name
+                .entry(local_name.clone())
+                .or_default()
+                .push(indexed);
+        } else {
+            self.other.push(indexed);
+        }
+    }
+
+    /// Returns the selectors that may match an element, in the order they appear in the stylesheet.
+    fn candidates(&self, node: &Node) -> Vec<&IndexedSelector> {
+        let mut candidates = Vec::new();
+
+        {
+            let element = node.borrow_element();
+
+            if let Some(v) = element.get_id().and_then(|id| self.by_id.get(id)) {
+                candidates.extend(v);
+            }
+
+            if let Some(classes) = element.get_class() {
+                for class in classes.split_whitespace() {
+                    if let Some(v) = self.by_class.get(class) {
+                        candidates.extend(v);
+                    }
+                }
+            }
+
+            if let Some(v) = self.by_local_name.get(&element.element_name().local) {
+                candidates.extend(v);
+            }
+        }
+
+        candidates.extend(&self.other);
+
+        // Document order is important for selectors of the same specificity, and a class may
+        // be repeated in the `class` attribute.
+        candidates.sort_by_key(|c| (c.rule, c.selector));
+        candidates.dedup_by_key(|c| (c.rule, c.selector));
+
+        candidates
+    }
 }
 
 /// A match during the selector matching process
@@ -637,6 +753,7 @@ impl Stylesheet {
         Stylesheet {
             origin,
             qualified_rules: Vec::new(),
+            selector_map: SelectorMap::default(),
         }
     }
 
@@ -681,12 +798,22 @@ impl Stylesheet {
                     // ignore invalid imports
                     let _ = self.load(&url, &url_resolver);
                 }
-                Rule::QualifiedRule(qr) => self.qualified_rules.push(qr),
+                Rule::QualifiedRule(qr) => self.add_qualified_rule(qr),
             });
 
         Ok(())
     }
 
+    fn add_qualified_rule(&mut self, rule: QualifiedRule) {
+        let rule_index = self.qualified_rules.len();
+
+        for (i, selector) in rule.selectors.0.iter().enumerate() {
+            self.selector_map.insert(rule_index, i, selector);
+        }
+
+        self.qualified_rules.push(rule);
+    }
+
     /// Parses a stylesheet referenced by an URL
     fn load(&mut self, href: &str, url_resolver: &UrlResolver) -> Result<(), LoadingError> {
         let aurl = url_resolver
@@ -727,50 +854,94 @@ impl Stylesheet {
         match_ctx: &mut MatchingContext<'_, Selector>,
         acc: &mut Vec<Match<'a>>,
     ) {
-        for rule in &self.qualified_rules {
-            for selector in &rule.selectors.0 {
-                // This magic call is stolen from selectors::matching::matches_selector_list()
-                let matches = selectors::matching::matches_selector(
-                    selector,
-                    0,
-                    None,
-                    &RsvgElement(node.clone()),
-                    match_ctx,
-                    &mut |_, _| {},
-                );
-
-                if matches {
-                    for decl in rule.declarations.iter() {
-                        acc.push(Match {
-                            declaration: decl,
-                            specificity: selector.specificity(),
-                            origin: self.origin,
-                        });
-                    }
+        let element = RsvgElement(node.clone());
+
+        for candidate in self.selector_map.candidates(node) {
+            let rule = &self.qualified_rules[candidate.rule];
+            let selector = &rule.selectors.0[candidate.selector];
+
+            // This magic call is stolen from selectors::matching::matches_selector_list()
+            let matches = selectors::matching::matches_selector(
+                selector,
+                0,
+                Some(&candidate.hashes),
+                &element,
+                match_ctx,
+                &mut |_, _| {},
+            );
+
+            if matches {
+                for decl in rule.declarations.iter() {
+                    acc.push(Match {
+                        declaration: decl,
+                        specificity: selector.specificity(),
+                        origin: self.origin,
+                    });
                 }
             }
         }
     }
 }
 
+/// Computes the hashes that an element contributes to the bloom filter of its descendants.
+///
+/// These need to match the ones that `AncestorHashes` computes for selectors.
+fn element_hashes(node: &Node) -> Vec<u32> {
+    let element = node.borrow_element();
+    let name = element.element_name();
+
+    let mut hashes = vec![name.local.get_hash(), name.ns.get_hash()];
+
+    if let Some(id) = element.get_id() {
+        hashes.push(LocalName::from(id).get_hash());
+    }
+
+    if let Some(classes) = element.get_class() {
+        hashes.extend(
+            classes
+                .split_whitespace()
+                .map(|class| LocalName::from(class).get_hash()),
+        );
+    }
+
+    hashes
+}
+
 fn is_text_css(mime_type: &Mime) -> bool {
     mime_type.type_ == "text" && mime_type.subtype == "css"
 }
 
-/// Runs the CSS cascade on the specified tree from all the stylesheets
+/// Runs the CSS cascade on the elements of a tree from all the stylesheets
 pub fn cascade(
-    root: &mut Node,
+    elements: &ElementTable,
     ua_stylesheets: &[Stylesheet],
     author_stylesheets: &[Stylesheet],
     user_stylesheets: &[Stylesheet],
 ) {
-    for mut node in root.descendants().filter(|n| n.is_element()) {
+    // Hashes of the ids, classes, and names of the ancestors of the current element.
+    let mut bloom_filter = BloomFilter::new();
+
+    // The ancestors of the current element, with what each one put in the bloom filter,
+    // to remove it when leaving the ancestor's subtree.
+    let mut ancestors: Vec<(usize, Vec<u32>)> = Vec::new();
+
+    for (index, node) in elements.nodes().iter().enumerate() {
+        while let Some(&(ancestor, _)) = ancestors.last() {
+            if elements.subtree_end(ancestor) > index {
+                break;
+            }
+
+            let (_, hashes) = ancestors.pop().unwrap();
+            for hash in hashes {
+                bloom_filter.remove_hash(hash);
+            }
+        }
+
         let mut matches = Vec::new();
 
         let mut match_ctx = MatchingContext::new(
             MatchingMode::Normal,
-            // FIXME: how the fuck does one set up a bloom filter here?
-            None,
+            Some(&bloom_filter),
             // n_index_cache,
             None,
             QuirksMode::NoQuirks,
@@ -781,7 +952,7 @@ pub fn cascade(
             .chain(author_stylesheets)
             .chain(user_stylesheets)
         {
-            s.get_matches(&node, &mut match_ctx, &mut matches);
+            s.get_matches(node, &mut match_ctx, &mut matches);
         }
 
         matches.as_mut_slice().sort();
@@ -792,10 +963,16 @@ pub fn cascade(
         }
 
         node.borrow_element_mut().set_style_attribute();
+
+        let hashes = element_hashes(node);
+        for hash in &hashes {
+            bloom_filter.insert_hash(*hash);
+        }
+        ancestors.push((index, hashes));
     }
 
     let values = ComputedValues::default();
-    root.cascade(&values);
+    elements.cascade(&values);
 }
 
 #[cfg(test)]
@@ -804,6 +981,9 @@ mod tests {
     use selectors::Element;
 
     use crate::document::Document;
+    use crate::properties::Opacity;
+    use crate::unit_interval::UnitInterval;
+    use std::rc::Rc;
 
     #[test]
     fn impl_element() {
@@ -880,4 +1060,68 @@ mod tests {
         assert!(d.is_empty());
         assert!(!a.is_empty());
     }
+
+    #[test]
+    fn cascade_matches_indexed_selectors() {
+        let document = Document::load_from_bytes(
+            br#"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg">
+  <style>
+    rect { opacity: 0.1; }
+    .foo { opacity: 0.2; }
+    g.outer #b { opacity: 0.3; }
+    #c .foo { opacity: 0.4; }
+    #nonexistent rect { opacity: 0.5; }
+  </style>
+  <g class="outer">
+    <rect id="a"/>
+    <rect id="b" class="foo"/>
+  </g>
+  <g id="c">
+    <rect id="d" class="bar foo"/>
+  </g>
+  <rect id="e" class="foo foo"/>
+</svg>
+"#,
+        );
+
+        let opacity = |id| {
+            let node = document.lookup_internal_node(id).unwrap();
+            let Opacity(UnitInterval(o)) = node.borrow_element().get_computed_values().opacity();
+            o
+        };
+
+        assert_eq!(opacity("a"), 0.1);
+        assert_eq!(opacity("b"), 0.3);
+        assert_eq!(opacity("d"), 0.4);
+        assert_eq!(opacity("e"), 0.2);
+    }
+
+    #[test]
+    fn cascade_shares_identical_styles() {
+        let document = Document::load_from_bytes(
+            br#"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg">
+  <style>
+    .foo { fill: lime; }
+  </style>
+  <g id="g1"><rect id="a" class="foo"/></g>
+  <g id="g2"><rect id="b" class="foo"/></g>
+  <rect id="c" class="foo" opacity="0.5"/>
+</svg>
+"#,
+        );
+
+        let values = |id| {
+            document
+                .lookup_internal_node(id)
+                .unwrap()
+                .borrow_element()
+                .get_shared_computed_values()
+        };
+
+        assert!(Rc::ptr_eq(&values("g1"), &values("g2")));
+        assert!(Rc::ptr_eq(&values("a"), &values("b")));
+        assert!(!Rc::ptr_eq(&values("a"), &values("c")));
+    }
 }
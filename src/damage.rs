@@ -0,0 +1,180 @@
+//! Tracking of the parts of a rendering that change when a document is restyled.
+//!
+//! User interfaces often change the stylesheet of an SVG with
+//! `SvgHandle::set_stylesheet` to show hover or pressed states, and then
+//! repaint it.  Usually only a few elements change, so instead of repainting
+//! everything, `CairoRenderer::render_damage` repaints just the region they
+//! cover.
+//!
+//! `Document::cascade` compares the computed values of each element before
+//! and after the cascade, and keeps the previous values of the elements that
+//! changed in a `Restyled` set.  To find the region to repaint, the document
+//! is measured twice, once with the previous values swapped back in and once
+//! with the new ones, while an `ExtentsRecorder` collects the device-space
+//! extents of the restyled elements.  The damage is the union of both.
+//!
+//! Elements that cannot be bounded this way make the whole rendering
+//! damaged: those under a filter, since filters can paint outside of their
+//! contents; those drawn into patterns, masks or other intermediate
+//! surfaces; and those that are not drawn by themselves, like gradient stops.
+
+use std::collections::{HashMap, HashSet};
+use std::mem;
+use std::rc::Rc;
+
+use crate::bbox::BoundingBox;
+use crate::node::{Node, NodeBorrow, NodeData};
+use crate::properties::{ComputedValues, Filter};
+use crate::rect::Rect;
+use crate::transform::Transform;
+
+/// Identity of a node, to use as a hash key while the node is alive.
+fn node_key(node: &Node) -> *const NodeData {
+    &*node.borrow() as *const NodeData
+}
+
+struct RestyledElement {
+    node: Node,
+    values: Rc<ComputedValues>,
+}
+
+/// Elements whose computed values changed since the document was last rendered.
+#[derive(Default)]
+pub struct Restyled {
+    elements: HashMap<*const NodeData, RestyledElement>,
+}
+
+impl Restyled {
+    /// Records that an element's computed values changed from `previous_values`.
+    ///
+    /// If the element was already restyled, its oldest values are kept, since those
+    /// are the ones it was rendered with.
+    pub fn insert(&mut self, node: &Node, previous_values: Rc<ComputedValues>) {
+        self.elements
+            .entry(node_key(node))
+            .or_insert_with(|| RestyledElement {
+                node: node.clone(),
+                values: previous_values,
+            });
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.elements.is_empty()
+    }
+
+    /// Exchanges the current computed values of the restyled elements with their previous ones.
+    ///
+    /// Calling this twice leaves the elements as they were.
+    pub fn swap_values(&mut self) {
+        for e in self.elements.values_mut() {
+            let current = e.node.borrow_element().get_shared_computed_values();
+            let previous = mem::replace(&mut e.values, current);
+            e.node.borrow_element_mut().set_computed_values(previous);
+        }
+    }
+
+    /// Returns whether any restyled element is drawn through a filter, before or after restyling.
+    pub fn has_filtered_elements(&self) -> bool {
+        let has_filter = |values: &ComputedValues| values.filter() != Filter::None;
+
+        self.elements.values().any(|e| {
+            has_filter(&e.values)
+                || e.node
+                    .ancestors()
+                    .any(|n| n.is_element() && has_filter(n.borrow_element().get_computed_values()))
+        })
+    }
+
+    /// Returns the nodes whose extents need to be measured to compute the damage.
+    ///
+    /// Text content elements do not get drawn by themselves, so for those the enclosing
+    /// `<text>` element is measured instead.
+    fn nodes_to_measure(&self) -> impl Iterator<Item = Node> + '_ {
+        self.elements
+            .values()
+            .map(|e| enclosing_text(&e.node).unwrap_or_else(|| e.node.clone()))
+    }
+
+    /// Computes the device-space region to repaint from two measurements of the document,
+    /// before and after restyling.
+    ///
+    /// Returns `None` if the damage cannot be bounded, and the whole rendering needs to
+    /// be repainted.
+    pub fn damage(&self, before: &ExtentsRecorder, after: &ExtentsRecorder) -> Option<Rect> {
+        let mut damage: Option<Rect> = None;
+
+        for node in self.nodes_to_measure() {
+            let key = node_key(&node);
+
+            match (before.extents.get(&key), after.extents.get(&key)) {
+                (None, None) => return None,
+                (Some(Extents::Unbounded), _) | (_, Some(Extents::Unbounded)) => return None,
+                (b, a) => {
+                    for extents in [b, a].iter().flatten() {
+                        if let Extents::Drawn(Some(rect)) = extents {
+                            damage = Some(damage.map_or(*rect, |d| d.union(rect)));
+                        }
+                    }
+                }
+            }
+        }
+
+        Some(damage.unwrap_or_default())
+    }
+
+    /// Creates a recorder for the extents of the nodes needed by `damage`.
+    pub fn recorder(&self) -> ExtentsRecorder {
+        ExtentsRecorder {
+            targets: self.nodes_to_measure().map(|n| node_key(&n)).collect(),
+            extents: HashMap::new(),
+        }
+    }
+}
+
+fn enclosing_text(node: &Node) -> Option<Node> {
+    node.ancestors()
+        .find(|n| n.is_element() && is_element_of_type!(n, Text))
+}
+
+enum Extents {
+    /// Union of the device-space ink rectangles of each place where the element was drawn.
+    Drawn(Option<Rect>),
+
+    /// The element was drawn to a surface that is not composited in place, like a pattern tile.
+    Unbounded,
+}
+
+/// Collects the device-space extents of some elements while a document is drawn.
+pub struct ExtentsRecorder {
+    targets: HashSet<*const NodeData>,
+    extents: HashMap<*const NodeData, Extents>,
+}
+
+impl ExtentsRecorder {
+    /// Records that a node was drawn with the given bounding box.
+    ///
+    /// `to_device` transforms from the pixel space of the surface where the node was drawn
+    /// to the device space.  It is `None` if that surface does not get composited in place.
+    pub fn record(&mut self, node: &Node, bbox: &BoundingBox, to_device: Option<Transform>) {
+        let key = node_key(node);
+
+        if !self.targets.contains(&key) {
+            return;
+        }
+
+        let extents = self.extents.entry(key).or_insert(Extents::Drawn(None));
+
+        match (to_device, extents) {
+            (None, extents) => *extents = Extents::Unbounded,
+
+            (Some(to_device), Extents::Drawn(drawn)) => {
+                if let Some(rect) = bbox.device_ink_rect() {
+                    let rect = to_device.transform_rect(&rect);
+                    *drawn = Some(drawn.map_or(rect, |r| r.union(&rect)));
+                }
+            }
+
+            (Some(_), Extents::Unbounded) => (),
+        }
+    }
+}
@@ -4,23 +4,31 @@ use data_url::mime::Mime;
 use gdk_pixbuf::{prelude::PixbufLoaderExt, PixbufLoader};
 use markup5ever::QualName;
 use once_cell::sync::Lazy;
+use rctree::NodeEdge;
 use std::cell::RefCell;
 use std::collections::hash_map::Entry;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
 use std::fmt;
 use std::include_str;
+use std::mem;
 use std::rc::Rc;
 use std::str::FromStr;
 
 use crate::css::{self, Origin, Stylesheet};
+use crate::damage::Restyled;
 use crate::error::{AcquireError, AllowedUrlError, LoadingError, NodeIdError};
+use crate::filters::cache::{FilterCacheKey, FilterResultCache};
 use crate::handle::LoadOptions;
 use crate::io::{self, BinaryData};
+use crate::layout::FontProperties;
 use crate::limits;
-use crate::node::{Node, NodeBorrow, NodeData};
+use crate::node::{ElementTable, Node, NodeBorrow, NodeData};
+use crate::properties::ComputedValues;
+use crate::resource_cache;
 use crate::surface_utils::shared_surface::SharedImageSurface;
+use crate::text::LayoutCache;
 use crate::url_resolver::{AllowedUrl, UrlResolver};
-use crate::xml::{xml_load_from_possibly_compressed_stream, Attributes};
+use crate::xml::{xml_load_from_possibly_compressed_stream, Attributes, XmlPushLoader};
 
 static UA_STYLESHEETS: Lazy<Vec<Stylesheet>> = Lazy::new(|| {
     vec![Stylesheet::from_data(
@@ -32,7 +40,7 @@ static UA_STYLESHEETS: Lazy<Vec<Stylesheet>> = Lazy::new(|| {
 });
 
 /// Identifier of a node
-#[derive(Debug, PartialEq, Clone)]
+#[derive(Debug, PartialEq, Eq, Hash, Clone)]
 pub enum NodeId {
     /// element id
     Internal(String),
@@ -68,10 +76,22 @@ impl fmt::Display for NodeId {
 }
 
 /// A loaded SVG file and its derived data.
+///
+/// There is no serialized form of a loaded document.  The tree is made of
+/// reference-counted nodes whose elements hold parsed attribute values,
+/// `Rc<ComputedValues>` shared between nodes, and paths and text layouts
+/// that belong to cairo and Pango; none of those have a stable, relocatable
+/// representation that could be written to disk and mapped back in.
+/// Applications that load the same files repeatedly can instead keep their
+/// handles around, and loaders that opt into `with_shared_resource_cache`
+/// reuse the documents and images that are referenced from several files.
 pub struct Document {
     /// Tree of nodes; the root is guaranteed to be an `<svg>` element.
     tree: Node,
 
+    /// The elements of `tree` in document order, to walk them without following the tree.
+    elements: ElementTable,
+
     /// Mapping from `id` attributes to nodes.
     ids: HashMap<String, Node>,
 
@@ -89,6 +109,20 @@ pub struct Document {
 
     /// Stylesheets defined in the document
     stylesheets: Vec<Stylesheet>,
+
+    /// Where each of `stylesheets` came from, to parse them again in a thawed snapshot.
+    stylesheet_sources: Vec<StylesheetSource>,
+
+    /// Outputs of filters from previous renderings.
+    ///
+    /// Only used if `load_options.cache_filter_results` is set.
+    filter_results: RefCell<FilterResultCache>,
+
+    /// Shaped text from previous spans and renderings.
+    text_layouts: RefCell<LayoutCache>,
+
+    /// Elements restyled since the last rendering, to compute the damage to repaint.
+    restyled: RefCell<Restyled>,
 }
 
 impl Document {
@@ -106,6 +140,14 @@ impl Document {
         )
     }
 
+    /// Starts loading a document from data that will be written to the returned loader in chunks.
+    pub fn push_loader(load_options: &LoadOptions) -> XmlPushLoader {
+        XmlPushLoader::new(
+            DocumentBuilder::new(load_options),
+            load_options.unlimited_size,
+        )
+    }
+
     /// Utility function to load a document from a static string in tests.
     #[cfg(test)]
     pub fn load_from_bytes(input: &'static [u8]) -> Document {
@@ -155,12 +197,182 @@ impl Document {
         self.images.borrow_mut().lookup(&self.load_options, &aurl)
     }
 
+    /// Approximate number of bytes that the document takes in memory.
+    ///
+    /// This is what a document is charged in the shared resource cache.  The size
+    /// of the file it came from is a poor estimate, and even more so for SVGZ files,
+    /// so this adds up the nodes of the tree, their attributes and text, and each
+    /// distinct set of computed values once.
+    pub fn approximate_size(&self) -> usize {
+        // An rctree node has five links to other nodes, the reference counts
+        // of its Rc, and the borrow flag of its RefCell.
+        let node_overhead = mem::size_of::<NodeData>() + 8 * mem::size_of::<usize>();
+
+        let mut computed_values = HashSet::new();
+
+        self.tree
+            .descendants()
+            .map(|node| {
+                node_overhead
+                    + match *node.borrow() {
+                        NodeData::Element(ref e) => {
+                            let values = e.get_shared_computed_values();
+
+                            let values_size = if computed_values.insert(Rc::as_ptr(&values)) {
+                                mem::size_of::<ComputedValues>()
+                            } else {
+                                0
+                            };
+
+                            e.approximate_size() + values_size
+                        }
+
+                        NodeData::Text(ref chars) => chars.approximate_size(),
+                    }
+            })
+            .sum::<usize>()
+            + self.elements.approximate_size()
+    }
+
+    /// Whether the outputs of filters should be looked up in and stored into the cache.
+    pub fn caches_filter_results(&self) -> bool {
+        self.load_options.cache_filter_results
+    }
+
+    /// Returns the output of a filter from a previous rendering, if there is one.
+    pub fn lookup_filter_result(
+        &self,
+        key: &FilterCacheKey,
+        source: &SharedImageSurface,
+    ) -> Option<SharedImageSurface> {
+        if !self.caches_filter_results() {
+            return None;
+        }
+
+        self.filter_results.borrow_mut().get(key, source)
+    }
+
+    /// Stores the output of a filter to be reused by later renderings.
+    pub fn store_filter_result(
+        &self,
+        key: FilterCacheKey,
+        source: SharedImageSurface,
+        output: SharedImageSurface,
+    ) {
+        if self.caches_filter_results() {
+            self.filter_results.borrow_mut().insert(key, source, output);
+        }
+    }
+
+    /// Returns a layout that was shaped for the same text and font properties, if there is one.
+    pub fn lookup_text_layout(&self, text: &str, props: &FontProperties) -> Option<pango::Layout> {
+        self.text_layouts.borrow_mut().get(text, props)
+    }
+
+    /// Stores a shaped layout to be reused by other spans and later renderings.
+    pub fn store_text_layout(&self, text: &str, props: &FontProperties, layout: pango::Layout) {
+        self.text_layouts.borrow_mut().insert(text, props, layout);
+    }
+
+    /// Copies the tree and the sources of the stylesheets into a snapshot that can be
+    /// sent to other threads.
+    ///
+    /// See [`DocumentSnapshot`] for what gets copied.
+    pub fn freeze(&self) -> DocumentSnapshot {
+        let mut nodes = Vec::new();
+
+        // Indices of the elements whose end has not been reached yet.
+        let mut open = Vec::new();
+
+        for edge in self.tree.traverse() {
+            match edge {
+                NodeEdge::Start(node) => {
+                    let parent = open.last().copied();
+
+                    let data = match *node.borrow() {
+                        NodeData::Element(ref e) => SnapshotNodeData::Element(
+                            e.element_name().clone(),
+                            e.get_attributes().clone(),
+                        ),
+
+                        NodeData::Text(ref chars) => SnapshotNodeData::Text(chars.get_string()),
+                    };
+
+                    if node.is_element() {
+                        open.push(nodes.len());
+                    }
+
+                    nodes.push(SnapshotNode { parent, data });
+                }
+
+                NodeEdge::End(node) if node.is_element() => {
+                    open.pop();
+                }
+
+                _ => (),
+            }
+        }
+
+        DocumentSnapshot {
+            load_options: self.load_options.clone(),
+            nodes,
+            stylesheets: self.stylesheet_sources.clone(),
+        }
+    }
+
     /// Runs the CSS cascade on the document tree
     ///
     /// This uses the default UserAgent stylesheet, the document's internal stylesheets,
     /// plus an extra set of stylesheets supplied by the caller.
+    ///
+    /// The elements whose computed values change are remembered along with their previous
+    /// values, until the next call to `take_restyled` or `clear_restyled`.
     pub fn cascade(&mut self, extra: &[Stylesheet]) {
-        css::cascade(&mut self.tree, &UA_STYLESHEETS, &self.stylesheets, extra);
+        let previous: Vec<_> = self
+            .elements
+            .nodes()
+            .iter()
+            .map(|n| n.borrow_element().get_shared_computed_values())
+            .collect();
+
+        self.run_cascade(extra);
+
+        let restyled = self.restyled.get_mut();
+
+        for (node, old_values) in self.elements.nodes().iter().zip(previous) {
+            let new_values = node.borrow_element().get_shared_computed_values();
+
+            if !Rc::ptr_eq(&old_values, &new_values) && *old_values != *new_values {
+                restyled.insert(node, old_values);
+            }
+        }
+    }
+
+    fn run_cascade(&mut self, extra: &[Stylesheet]) {
+        css::cascade(&self.elements, &UA_STYLESHEETS, &self.stylesheets, extra);
+
+        // Any filter may look different with the new styles, and any group may have
+        // different extents.
+        self.filter_results.get_mut().clear();
+
+        for node in self
+            .elements
+            .nodes()
+            .iter()
+            .filter(|n| is_element_of_type!(n, Group))
+        {
+            borrow_element_as!(node, Group).clear_layer_cache();
+        }
+    }
+
+    /// Returns the elements restyled since the document was last rendered, and forgets them.
+    pub fn take_restyled(&self) -> Restyled {
+        mem::take(&mut *self.restyled.borrow_mut())
+    }
+
+    /// Forgets the restyled elements, once the whole document has been rendered again.
+    pub fn clear_restyled(&self) {
+        *self.restyled.borrow_mut() = Restyled::default();
     }
 }
 
@@ -199,17 +411,13 @@ impl Resources {
             Entry::Occupied(e) => e.get().clone(),
             Entry::Vacant(e) => {
                 let aurl = e.key();
-                // FIXME: pass a cancellable to these
-                let doc = io::acquire_stream(aurl, None)
-                    .map_err(LoadingError::from)
-                    .and_then(|stream| {
-                        Document::load_from_stream(
-                            &load_options.copy_with_base_url(aurl),
-                            &stream,
-                            None,
-                        )
+                let doc = if load_options.use_shared_resource_cache {
+                    resource_cache::lookup_document(load_options, aurl, || {
+                        load_extern_document(load_options, aurl)
                     })
-                    .map(Rc::new);
+                } else {
+                    load_extern_document(load_options, aurl)
+                };
                 let res = e.insert(doc);
                 res.clone()
             }
@@ -217,6 +425,19 @@ impl Resources {
     }
 }
 
+fn load_extern_document(
+    load_options: &LoadOptions,
+    aurl: &AllowedUrl,
+) -> Result<Rc<Document>, LoadingError> {
+    // FIXME: pass a cancellable to these
+    io::acquire_stream(aurl, None)
+        .map_err(LoadingError::from)
+        .and_then(|stream| {
+            Document::load_from_stream(&load_options.copy_with_base_url(aurl), &stream, None)
+        })
+        .map(Rc::new)
+}
+
 struct Images {
     images: HashMap<AllowedUrl, Result<SharedImageSurface, LoadingError>>,
 }
@@ -236,7 +457,14 @@ impl Images {
         match self.images.entry(aurl.clone()) {
             Entry::Occupied(e) => e.get().clone(),
             Entry::Vacant(e) => {
-                let surface = load_image(load_options, e.key());
+                let aurl = e.key();
+                let surface = if load_options.use_shared_resource_cache {
+                    resource_cache::lookup_image(load_options, aurl, || {
+                        load_image(load_options, aurl)
+                    })
+                } else {
+                    load_image(load_options, aurl)
+                };
                 let res = e.insert(surface);
                 res.clone()
             }
@@ -367,6 +595,15 @@ impl<'i> AcquiredNodes<'i> {
         self.document.lookup_image(href)
     }
 
+    pub fn document(&self) -> &'i Document {
+        self.document
+    }
+
+    /// Number of elements acquired so far, which is limited to `MAX_REFERENCED_ELEMENTS`.
+    pub fn num_elements_acquired(&self) -> usize {
+        self.num_elements_acquired
+    }
+
     /// Acquires a node.
     /// Nodes acquired by this function must be released in reverse acquiring order.
     pub fn acquire(&mut self, node_id: &NodeId) -> Result<AcquiredNode, AcquireError> {
@@ -440,11 +677,94 @@ impl NodeStack {
     }
 }
 
+/// Where one of the document's stylesheets came from.
+#[derive(Clone)]
+enum StylesheetSource {
+    /// The contents of a `<style>` element.
+    Text(String),
+
+    /// The `href` of an `xml-stylesheet` processing instruction.
+    Href(String),
+}
+
+/// A node of a [`DocumentSnapshot`].
+struct SnapshotNode {
+    /// Index of the parent element in `DocumentSnapshot.nodes`, or `None` for the root.
+    parent: Option<usize>,
+
+    data: SnapshotNodeData,
+}
+
+enum SnapshotNodeData {
+    Element(QualName, Attributes),
+    Text(String),
+}
+
+/// A copy of a loaded document that can be sent to and shared between threads.
+///
+/// The `Document` itself cannot leave its thread: its tree is made of `Rc` nodes, and it
+/// fills its caches of resources, filter results and text layouts while rendering.  The
+/// snapshot keeps only plain data, namely every node's name, attributes or text in document
+/// order, and the sources of the stylesheets; [`thaw`](#method.thaw) builds an independent
+/// `Document` from it.
+///
+/// This saves reading, decompressing and parsing the XML, and processing XIncludes, for
+/// every thread.  Each thawed document still builds its own tree, parses its stylesheets
+/// and runs the cascade, and loads its referenced images and documents the first time it
+/// renders them; stylesheets from `xml-stylesheet` processing instructions are loaded
+/// again from their `href`.
+pub struct DocumentSnapshot {
+    load_options: LoadOptions,
+    nodes: Vec<SnapshotNode>,
+    stylesheets: Vec<StylesheetSource>,
+}
+
+impl DocumentSnapshot {
+    /// Builds a new `Document` from the snapshot, and runs the cascade on it.
+    pub fn thaw(&self) -> Result<Document, LoadingError> {
+        let mut builder = DocumentBuilder::new(&self.load_options);
+
+        for source in &self.stylesheets {
+            match *source {
+                StylesheetSource::Text(ref text) => builder.append_stylesheet_from_text(text),
+
+                StylesheetSource::Href(ref href) => builder
+                    .append_stylesheet_from_xml_processing_instruction(
+                        None,
+                        Some(String::from("text/css")),
+                        href,
+                    )?,
+            }
+        }
+
+        let mut elements: Vec<Option<Node>> = Vec::with_capacity(self.nodes.len());
+
+        for node in &self.nodes {
+            let parent = node.parent.map(|p| elements[p].clone().unwrap());
+
+            match node.data {
+                SnapshotNodeData::Element(ref name, ref attrs) => {
+                    let element = builder.append_element(name, attrs.clone(), parent);
+                    elements.push(Some(element));
+                }
+
+                SnapshotNodeData::Text(ref text) => {
+                    builder.append_characters(text, &mut parent.unwrap());
+                    elements.push(None);
+                }
+            }
+        }
+
+        builder.build()
+    }
+}
+
 pub struct DocumentBuilder {
     load_options: LoadOptions,
     tree: Option<Node>,
     ids: HashMap<String, Node>,
     stylesheets: Vec<Stylesheet>,
+    stylesheet_sources: Vec<StylesheetSource>,
 }
 
 impl DocumentBuilder {
@@ -454,6 +774,7 @@ impl DocumentBuilder {
             tree: None,
             ids: HashMap::new(),
             stylesheets: Vec::new(),
+            stylesheet_sources: Vec::new(),
         }
     }
 
@@ -476,11 +797,18 @@ impl DocumentBuilder {
             Stylesheet::from_href(href, &self.load_options.url_resolver, Origin::Author)
         {
             self.stylesheets.push(stylesheet);
+            self.stylesheet_sources
+                .push(StylesheetSource::Href(href.to_string()));
         }
 
         Ok(())
     }
 
+    /// Returns the root element, once its start tag has been parsed.
+    pub fn root(&self) -> Option<Node> {
+        self.tree.clone()
+    }
+
     pub fn append_element(
         &mut self,
         name: &QualName,
@@ -513,6 +841,8 @@ impl DocumentBuilder {
             Stylesheet::from_data(text, &self.load_options.url_resolver, Origin::Author)
         {
             self.stylesheets.push(stylesheet);
+            self.stylesheet_sources
+                .push(StylesheetSource::Text(text.to_string()));
         }
     }
 
@@ -542,6 +872,7 @@ impl DocumentBuilder {
             tree,
             ids,
             stylesheets,
+            stylesheet_sources,
             ..
         } = self;
 
@@ -549,15 +880,24 @@ impl DocumentBuilder {
             Some(root) if root.is_element() => {
                 if is_element_of_type!(root, Svg) {
                     let mut document = Document {
+                        elements: ElementTable::new(&root),
                         tree: root,
                         ids,
                         externs: RefCell::new(Resources::new()),
                         images: RefCell::new(Images::new()),
                         load_options,
                         stylesheets,
+                        stylesheet_sources,
+                        filter_results: RefCell::new(FilterResultCache::new(
+                            limits::MAX_FILTER_RESULT_CACHE_BYTES,
+                        )),
+                        text_layouts: RefCell::new(LayoutCache::new(
+                            limits::MAX_TEXT_LAYOUT_CACHE_ENTRIES,
+                        )),
+                        restyled: RefCell::new(Restyled::default()),
                     };
 
-                    document.cascade(&[]);
+                    document.run_cascade(&[]);
 
                     Ok(document)
                 } else {
@@ -607,4 +947,61 @@ mod tests {
             Some(String::from("image/png"))
         );
     }
+
+    #[test]
+    fn element_table_has_parents_and_subtrees() {
+        let document = Document::load_from_bytes(
+            br#"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" id="svg">
+  <g id="g">
+    <rect id="a"/>
+    <text id="text">hello <tspan id="tspan">world</tspan></text>
+  </g>
+  <rect id="b"/>
+</svg>
+"#,
+        );
+
+        let elements = &document.elements;
+
+        let ids: Vec<_> = elements
+            .nodes()
+            .iter()
+            .map(|n| n.borrow_element().get_id().unwrap().to_string())
+            .collect();
+        assert_eq!(ids, ["svg", "g", "a", "text", "tspan", "b"]);
+
+        let parents: Vec<_> = (0..ids.len()).map(|i| elements.parent(i)).collect();
+        assert_eq!(parents, [None, Some(0), Some(1), Some(1), Some(3), Some(0)]);
+
+        let ends: Vec<_> = (0..ids.len()).map(|i| elements.subtree_end(i)).collect();
+        assert_eq!(ends, [6, 5, 3, 5, 5, 6]);
+    }
+
+    #[test]
+    fn cascade_remembers_restyled_elements() {
+        let mut document = Document::load_from_bytes(
+            br#"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <rect id="a" width="10" height="10"/>
+  <rect id="b" x="20" width="10" height="10"/>
+</svg>
+"#,
+        );
+
+        assert!(document.take_restyled().is_empty());
+
+        let stylesheet = || {
+            Stylesheet::from_data("#a { fill: red; }", &UrlResolver::new(None), Origin::User)
+                .unwrap()
+        };
+
+        document.cascade(&[stylesheet()]);
+        assert!(!document.take_restyled().is_empty());
+        assert!(document.take_restyled().is_empty());
+
+        // Nothing changes when the same styles are applied again.
+        document.cascade(&[stylesheet()]);
+        assert!(document.take_restyled().is_empty());
+    }
 }
@@ -6,25 +6,31 @@ use once_cell::sync::Lazy;
 use pango::prelude::FontMapExt;
 use regex::{Captures, Regex};
 use std::borrow::Cow;
-use std::cell::RefCell;
+use std::cell::{Cell, RefCell, RefMut};
 use std::convert::TryFrom;
 use std::f64::consts::*;
+use std::hash::{Hash, Hasher};
 use std::rc::{Rc, Weak};
+use std::sync::Arc;
 
 use crate::accept_language::UserLanguage;
 use crate::aspect_ratio::AspectRatio;
 use crate::bbox::BoundingBox;
+use crate::budget::{RenderBudget, SurfaceAllocation};
 use crate::coord_units::CoordUnits;
+use crate::damage::ExtentsRecorder;
 use crate::document::{AcquiredNodes, NodeId};
 use crate::dpi::Dpi;
 use crate::element::Element;
 use crate::error::{AcquireError, ImplementationLimit, RenderingError};
-use crate::filter::FilterValueList;
-use crate::filters::{self, FilterSpec};
+use crate::filter::{FilterValue, FilterValueList};
+use crate::filters::{self, cache::FilterCacheKey, FilterSpec};
 use crate::float_eq_cairo::ApproxEqCairo;
 use crate::gradient::{GradientVariant, SpreadMethod, UserSpaceGradient};
 use crate::layout::{Image, Shape, StackingContext, Stroke, TextSpan};
 use crate::length::*;
+use crate::limits;
+use crate::lru::LruCache;
 use crate::marker;
 use crate::node::{CascadedValues, Node, NodeBorrow, NodeDraw};
 use crate::paint_server::{PaintSource, UserSpacePaintSource};
@@ -34,7 +40,8 @@ use crate::properties::{
     ClipRule, ComputedValues, FillRule, Filter, MixBlendMode, Opacity, Overflow, PaintTarget,
     ShapeRendering, StrokeLinecap, StrokeLinejoin, TextRendering,
 };
-use crate::rect::Rect;
+use crate::rect::{IRect, Rect};
+use crate::stats::RenderStats;
 use crate::surface_utils::{
     shared_surface::ExclusiveImageSurface, shared_surface::SharedImageSurface,
     shared_surface::SurfaceType,
@@ -108,6 +115,7 @@ struct PathHelper<'a> {
     cr: &'a cairo::Context,
     transform: Transform,
     path: &'a Path,
+    cache: Option<&'a PathCache>,
     is_square_linecap: bool,
     has_path: Option<bool>,
 }
@@ -117,12 +125,14 @@ impl<'a> PathHelper<'a> {
         cr: &'a cairo::Context,
         transform: Transform,
         path: &'a Path,
+        cache: Option<&'a PathCache>,
         linecap: StrokeLinecap,
     ) -> Self {
         PathHelper {
             cr,
             transform,
             path,
+            cache,
             is_square_linecap: linecap == StrokeLinecap::Square,
             has_path: None,
         }
@@ -133,12 +143,30 @@ impl<'a> PathHelper<'a> {
             Some(false) | None => {
                 self.has_path = Some(true);
                 self.cr.set_matrix(self.transform.into());
-                self.path.to_cairo(self.cr, self.is_square_linecap)
+
+                match self.cache {
+                    Some(cache) => {
+                        cache.set_path(self.cr, self.transform, self.path, self.is_square_linecap)
+                    }
+                    None => self.path.to_cairo(self.cr, self.is_square_linecap),
+                }
             }
             Some(true) => Ok(()),
         }
     }
 
+    /// Computes the bounding box of the path that was set with `set`.
+    pub fn stroke_and_fill_box(
+        &self,
+        stroke: &Stroke,
+        stroke_paint_source: &PaintSource,
+    ) -> Result<BoundingBox, RenderingError> {
+        match self.cache {
+            Some(cache) => cache.stroke_and_fill_box(self.cr, stroke, stroke_paint_source),
+            None => compute_stroke_and_fill_box(self.cr, stroke, stroke_paint_source),
+        }
+    }
+
     pub fn unset(&mut self) {
         match self.has_path {
             Some(true) | None => {
@@ -150,6 +178,271 @@ impl<'a> PathHelper<'a> {
     }
 }
 
+/// Cache of a shape's cairo path and bounding box, kept between renderings.
+///
+/// Turning a `Path` into a cairo path converts elliptical arcs to Bézier curves, and
+/// computing the bounding box asks cairo for the fill and stroke extents.  For large
+/// paths this is a good part of the rendering time, and it gets repeated every time
+/// the same document is rendered.
+///
+/// Cairo stores paths in device space with limited precision, so the cached path
+/// is only reused when the scale and rotation of the transform are about the same;
+/// the translation does not matter.  The extents are computed with a tolerance in
+/// device space, too, so they are cached under the same condition, plus the stroke
+/// parameters that affect them.
+#[derive(Default)]
+pub struct PathCache {
+    entry: RefCell<Option<PathCacheEntry>>,
+}
+
+struct PathCacheEntry {
+    transform: Transform,
+    is_square_linecap: bool,
+    path: cairo::Path,
+    extents: Option<(ExtentsKey, BoundingBox)>,
+}
+
+/// The parameters of the stroke that are used in `compute_stroke_and_fill_box`.
+struct ExtentsKey {
+    width: f64,
+    miter_limit: f64,
+    line_cap: StrokeLinecap,
+    line_join: StrokeLinejoin,
+    dash_offset: f64,
+    dashes: Box<[f64]>,
+    has_stroke_paint: bool,
+}
+
+impl ExtentsKey {
+    fn new(stroke: &Stroke, stroke_paint_source: &PaintSource) -> ExtentsKey {
+        ExtentsKey {
+            width: stroke.width,
+            miter_limit: stroke.miter_limit.0,
+            line_cap: stroke.line_cap,
+            line_join: stroke.line_join,
+            dash_offset: stroke.dash_offset,
+            dashes: stroke.dashes.clone(),
+            has_stroke_paint: !matches!(stroke_paint_source, PaintSource::None),
+        }
+    }
+
+    /// Whether the key is for the same stroke; this doesn't allocate a key for it.
+    fn matches(&self, stroke: &Stroke, stroke_paint_source: &PaintSource) -> bool {
+        self.width == stroke.width
+            && self.miter_limit == stroke.miter_limit.0
+            && self.line_cap == stroke.line_cap
+            && self.line_join == stroke.line_join
+            && self.dash_offset == stroke.dash_offset
+            && self.dashes == stroke.dashes
+            && self.has_stroke_paint == !matches!(stroke_paint_source, PaintSource::None)
+    }
+}
+
+/// Relative difference in the scale or rotation of the transform up to which
+/// a cached path can be reused.
+const PATH_CACHE_SCALE_TOLERANCE: f64 = 0.01;
+
+fn same_linear_transform(a: &Transform, b: &Transform) -> bool {
+    let max = a.xx.abs().max(a.yx.abs()).max(a.xy.abs()).max(a.yy.abs());
+    let tolerance = max * PATH_CACHE_SCALE_TOLERANCE;
+
+    (a.xx - b.xx).abs() <= tolerance
+        && (a.yx - b.yx).abs() <= tolerance
+        && (a.xy - b.xy).abs() <= tolerance
+        && (a.yy - b.yy).abs() <= tolerance
+}
+
+impl PathCache {
+    /// Sets the path on the cairo context, whose matrix must already be `transform`.
+    fn set_path(
+        &self,
+        cr: &cairo::Context,
+        transform: Transform,
+        path: &Path,
+        is_square_linecap: bool,
+    ) -> Result<(), RenderingError> {
+        let mut entry = self.entry.borrow_mut();
+
+        if let Some(ref e) = *entry {
+            if e.is_square_linecap == is_square_linecap
+                && same_linear_transform(&e.transform, &transform)
+            {
+                cr.append_path(&e.path);
+                return cr.status().map_err(|e| e.into());
+            }
+        }
+
+        path.to_cairo(cr, is_square_linecap)?;
+
+        *entry = Some(PathCacheEntry {
+            transform,
+            is_square_linecap,
+            path: cr.copy_path()?,
+            extents: None,
+        });
+
+        Ok(())
+    }
+
+    fn stroke_and_fill_box(
+        &self,
+        cr: &cairo::Context,
+        stroke: &Stroke,
+        stroke_paint_source: &PaintSource,
+    ) -> Result<BoundingBox, RenderingError> {
+        let mut entry = self.entry.borrow_mut();
+
+        if let Some(PathCacheEntry {
+            extents: Some((ref cached_key, bbox)),
+            ..
+        }) = *entry
+        {
+            if cached_key.matches(stroke, stroke_paint_source) {
+                return Ok(bbox.with_transform(Transform::from(cr.matrix())));
+            }
+        }
+
+        let bbox = compute_stroke_and_fill_box(cr, stroke, stroke_paint_source)?;
+
+        if let Some(ref mut e) = *entry {
+            e.extents = Some((ExtentsKey::new(stroke, stroke_paint_source), bbox));
+        }
+
+        Ok(bbox)
+    }
+}
+
+/// Bounding box of the contents of a group from the last time it was drawn.
+///
+/// If the cached ink rectangle is outside the clip, the group is not drawn at all,
+/// so that tiled renders skip whole subtrees outside of the tile instead of computing
+/// the path and extents of each shape in them.  The box is in the group's user space,
+/// and it is only reused if the group is drawn with its own cascade, the same linear
+/// part of the transform, and the same viewport and DPI, since those are all that
+/// lengths, font hinting, and stroke extents depend on.
+#[derive(Default)]
+pub struct LayerCache {
+    entry: RefCell<Option<LayerCacheEntry>>,
+}
+
+struct LayerCacheEntry {
+    key: LayerCacheKey,
+    bbox: BoundingBox,
+}
+
+#[derive(PartialEq)]
+struct LayerCacheKey {
+    linear_transform: [f64; 4],
+    dpi: (f64, f64),
+    vbox: ViewBox,
+}
+
+impl LayerCacheKey {
+    fn new(transform: &Transform, view_params: &ViewParams) -> LayerCacheKey {
+        LayerCacheKey {
+            linear_transform: [transform.xx, transform.yx, transform.xy, transform.yy],
+            dpi: (view_params.dpi.x, view_params.dpi.y),
+            vbox: view_params.vbox,
+        }
+    }
+}
+
+impl LayerCache {
+    fn get(&self, key: &LayerCacheKey) -> Option<BoundingBox> {
+        match *self.entry.borrow() {
+            Some(ref e) if e.key == *key => Some(e.bbox),
+            _ => None,
+        }
+    }
+
+    fn set(&self, entry: Option<LayerCacheEntry>) {
+        *self.entry.borrow_mut() = entry;
+    }
+
+    pub fn clear(&self) {
+        self.set(None);
+    }
+}
+
+/// Everything that determines the contents of a rendered pattern tile.
+///
+/// The tile is rendered without the rotation or skew of the current transform;
+/// those are applied when painting with it.  The viewport is included because
+/// lengths in the pattern's contents may be relative to it.
+#[derive(Clone)]
+struct PatternTileKey {
+    node: Node,
+    width: i32,
+    height: i32,
+    content_transform: Transform,
+    opacity: UnitInterval,
+    vbox: ViewBox,
+}
+
+impl PatternTileKey {
+    /// The numbers in the key, as bits, so that keys can be compared and hashed exactly.
+    fn bits(&self) -> [u64; 11] {
+        let t = &self.content_transform;
+        let vbox = &self.vbox;
+
+        [
+            t.xx.to_bits(),
+            t.yx.to_bits(),
+            t.xy.to_bits(),
+            t.yy.to_bits(),
+            t.x0.to_bits(),
+            t.y0.to_bits(),
+            self.opacity.0.to_bits(),
+            vbox.x0.to_bits(),
+            vbox.y0.to_bits(),
+            vbox.x1.to_bits(),
+            vbox.y1.to_bits(),
+        ]
+    }
+}
+
+impl PartialEq for PatternTileKey {
+    fn eq(&self, other: &PatternTileKey) -> bool {
+        self.node == other.node
+            && self.width == other.width
+            && self.height == other.height
+            && self.bits() == other.bits()
+    }
+}
+
+impl Eq for PatternTileKey {}
+
+impl Hash for PatternTileKey {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        // Nodes can't be hashed; keys for different patterns will just go to the same bucket.
+        self.width.hash(state);
+        self.height.hash(state);
+        self.bits().hash(state);
+    }
+}
+
+/// Rendered pattern tiles, shared by all the shapes painted with a pattern during a rendering.
+///
+/// The cache is bounded by the number of bytes of the tiles in it, and the least
+/// recently used tiles are dropped first.
+struct PatternTileCache(LruCache<PatternTileKey, cairo::Surface>);
+
+impl PatternTileCache {
+    fn new(max_size: usize) -> PatternTileCache {
+        PatternTileCache(LruCache::new(max_size))
+    }
+
+    fn get(&mut self, key: &PatternTileKey) -> Option<cairo::Surface> {
+        self.0.get(key).cloned()
+    }
+
+    fn insert(&mut self, key: PatternTileKey, surface: cairo::Surface) {
+        let size = key.width as usize * key.height as usize * 4;
+
+        self.0.insert(key, surface, size);
+    }
+}
+
 #[derive(Copy, Clone)]
 struct Viewport {
     /// The viewport's coordinate system, or "user coordinate system" in SVG terms.
@@ -173,6 +466,36 @@ pub struct DrawingCtx {
 
     drawsub_stack: Vec<Node>,
 
+    pattern_tiles: Rc<RefCell<PatternTileCache>>,
+
+    /// Part of the toplevel viewport that temporary surfaces need to cover.
+    ///
+    /// This is in the pixel space of temporary surfaces, i.e. the toplevel viewport
+    /// scaled by the initial transform.  If `None`, temporary surfaces cover the
+    /// whole toplevel viewport.
+    temporary_surface_region: Option<IRect>,
+
+    /// Collects the extents of restyled elements while measuring the damage to repaint.
+    extents: Option<Rc<RefCell<ExtentsRecorder>>>,
+
+    /// Transform from the pixel space of `cr` to the device space of the toplevel `cr`.
+    ///
+    /// This is `None` when drawing to a surface that does not get composited in place,
+    /// like a pattern tile or a mask.
+    to_toplevel_device: Option<Transform>,
+
+    /// Collects statistics about the rendering, if they were requested.
+    stats: Option<Rc<RefCell<RenderStats>>>,
+
+    /// Time and memory limits for the rendering, if any were given.
+    budget: Option<Arc<RenderBudget>>,
+
+    /// Number of things drawn so far that can paint outside of the bounding box of
+    /// their element, or whose extents depend on more than a `LayerCache` is keyed on.
+    ///
+    /// Groups whose drawing changes this are not cached.
+    uncacheable_draws: Rc<Cell<usize>>,
+
     measuring: bool,
     testing: bool,
 }
@@ -186,6 +509,9 @@ pub enum DrawingMode {
 /// The toplevel drawing routine.
 ///
 /// This creates a DrawingCtx internally and starts drawing at the specified `node`.
+///
+/// If `tile_bleed` is `Some`, temporary surfaces only cover the part of the viewport that
+/// is visible through the clip of `cr`, plus that many pixels on each side.
 pub fn draw_tree(
     mode: DrawingMode,
     cr: &cairo::Context,
@@ -194,6 +520,10 @@ pub fn draw_tree(
     dpi: Dpi,
     measuring: bool,
     testing: bool,
+    tile_bleed: Option<f64>,
+    extents: Option<Rc<RefCell<ExtentsRecorder>>>,
+    stats: Option<Rc<RefCell<RenderStats>>>,
+    budget: Option<Arc<RenderBudget>>,
     acquired_nodes: &mut AcquiredNodes<'_>,
 ) -> Result<BoundingBox, RenderingError> {
     let (drawsub_stack, node) = match mode {
@@ -238,8 +568,15 @@ pub fn draw_tree(
         measuring,
         testing,
         drawsub_stack,
+        extents,
+        stats,
+        budget,
     );
 
+    if let Some(bleed) = tile_bleed {
+        draw_ctx.limit_temporary_surfaces_to_clip(bleed)?;
+    }
+
     let content_bbox = draw_ctx.draw_node_from_stack(&node, acquired_nodes, &cascaded, false)?;
 
     user_bbox.insert(&content_bbox);
@@ -278,6 +615,9 @@ impl DrawingCtx {
         measuring: bool,
         testing: bool,
         drawsub_stack: Vec<Node>,
+        extents: Option<Rc<RefCell<ExtentsRecorder>>>,
+        stats: Option<Rc<RefCell<RenderStats>>>,
+        budget: Option<Arc<RenderBudget>>,
     ) -> DrawingCtx {
         let vbox = ViewBox::from(viewport);
         let initial_viewport = Viewport { transform, vbox };
@@ -292,6 +632,15 @@ impl DrawingCtx {
             user_language,
             viewport_stack: Rc::new(RefCell::new(viewport_stack)),
             drawsub_stack,
+            pattern_tiles: Rc::new(RefCell::new(PatternTileCache::new(
+                limits::MAX_PATTERN_TILE_CACHE_BYTES,
+            ))),
+            temporary_surface_region: None,
+            extents,
+            to_toplevel_device: Some(Transform::identity()),
+            stats,
+            budget,
+            uncacheable_draws: Rc::new(Cell::new(0)),
             measuring,
             testing,
         }
@@ -316,6 +665,13 @@ impl DrawingCtx {
             user_language: self.user_language.clone(),
             viewport_stack: self.viewport_stack.clone(),
             drawsub_stack: Vec::new(),
+            pattern_tiles: self.pattern_tiles.clone(),
+            temporary_surface_region: self.temporary_surface_region,
+            extents: self.extents.clone(),
+            to_toplevel_device: None,
+            stats: self.stats.clone(),
+            budget: self.budget.clone(),
+            uncacheable_draws: self.uncacheable_draws.clone(),
             measuring: self.measuring,
             testing: self.testing,
         }
@@ -333,6 +689,68 @@ impl DrawingCtx {
         self.measuring
     }
 
+    /// Returns the statistics being collected for this rendering, if they were requested.
+    pub fn stats(&self) -> Option<RefMut<'_, RenderStats>> {
+        self.stats.as_ref().map(|stats| stats.borrow_mut())
+    }
+
+    pub fn collects_stats(&self) -> bool {
+        self.stats.is_some()
+    }
+
+    /// Returns an error if the rendering was cancelled or ran out of time.
+    pub fn check_budget(&self) -> Result<(), RenderingError> {
+        match self.budget {
+            Some(ref budget) => budget.check(),
+            None => Ok(()),
+        }
+    }
+
+    /// Accounts for a temporary surface that is about to be allocated.
+    ///
+    /// Returns an error if the surface does not fit in the rendering's memory limit along
+    /// with the temporary surfaces that are still alive.  Attach the returned allocation
+    /// to the new surface, so that it counts against the limit until it is freed.
+    pub fn allocate_temporary_surface(
+        &self,
+        width: i32,
+        height: i32,
+    ) -> Result<SurfaceAllocation, RenderingError> {
+        if let Some(mut stats) = self.stats() {
+            stats.record_temporary_surface(width, height);
+        }
+
+        self.reserve_temporary_bytes(width, height)
+    }
+
+    /// Like `allocate_temporary_surface`, but for memory that is not a surface of its own
+    /// and so is not recorded in the statistics, like the scratch buffers of a filter.
+    pub fn reserve_temporary_bytes(
+        &self,
+        width: i32,
+        height: i32,
+    ) -> Result<SurfaceAllocation, RenderingError> {
+        match self.budget {
+            Some(ref budget) => RenderBudget::allocate_surface(budget, width, height),
+            None => Ok(SurfaceAllocation::unbudgeted()),
+        }
+    }
+
+    /// Records the extents of a node that was just drawn, if they are being collected.
+    pub fn record_extents(&self, node: &Node, bbox: &BoundingBox) {
+        if let Some(ref extents) = self.extents {
+            extents
+                .borrow_mut()
+                .record(node, bbox, self.to_toplevel_device);
+        }
+    }
+
+    /// Notes that the element being drawn keeps its enclosing groups from being cached
+    /// in a `LayerCache`.
+    pub fn mark_uncacheable(&self) {
+        self.uncacheable_draws.set(self.uncacheable_draws.get() + 1);
+    }
+
     fn get_transform(&self) -> Transform {
         Transform::from(self.cr.matrix())
     }
@@ -341,7 +759,7 @@ impl DrawingCtx {
         BoundingBox::new().with_transform(self.get_transform())
     }
 
-    fn size_for_temporary_surface(&self) -> (i32, i32) {
+    fn size_for_toplevel_viewport(&self) -> (i32, i32) {
         let rect = self.toplevel_viewport();
 
         let (viewport_width, viewport_height) = (rect.width(), rect.height());
@@ -356,26 +774,122 @@ impl DrawingCtx {
         (width.ceil() as i32, height.ceil() as i32)
     }
 
+    /// Area covered by temporary surfaces, in their pixel space.
+    fn rect_for_temporary_surface(&self) -> IRect {
+        let (width, height) = self.size_for_toplevel_viewport();
+        let full = IRect::from_size(width, height);
+
+        match self.temporary_surface_region {
+            None => full,
+
+            // Nothing is visible, but we still need a valid surface to draw to.
+            Some(region) => region
+                .intersection(&full)
+                .unwrap_or_else(|| IRect::from_size(1, 1)),
+        }
+    }
+
+    /// Returns whether a rectangle in the current user space is completely outside the clip.
+    ///
+    /// The clip extents are a bounding box of the clip region, so this can return `false`
+    /// for rectangles that are not visible, but never `true` for visible ones.
+    fn is_outside_clip(&self, rect: &Rect) -> Result<bool, RenderingError> {
+        self.is_outside_clip_in(rect, &self.get_transform())
+    }
+
+    /// Like `is_outside_clip`, but for a rectangle in the user space of `transform`.
+    fn is_outside_clip_in(
+        &self,
+        rect: &Rect,
+        transform: &Transform,
+    ) -> Result<bool, RenderingError> {
+        let (x0, y0, x1, y1) = self.cr.clip_extents()?;
+
+        let clip = self
+            .get_transform()
+            .transform_rect(&Rect::new(x0, y0, x1, y1));
+        let rect = transform.transform_rect(rect);
+
+        // Leave one device pixel around the rectangle for antialiasing.
+        let rect = Rect::new(rect.x0 - 1.0, rect.y0 - 1.0, rect.x1 + 1.0, rect.y1 + 1.0);
+
+        Ok(rect.intersection(&clip).is_none())
+    }
+
+    fn temporary_surface_origin(&self) -> (f64, f64) {
+        let rect = self.rect_for_temporary_surface();
+        (f64::from(rect.x0), f64::from(rect.y0))
+    }
+
+    /// Limits temporary surfaces to what is visible through the clip of the toplevel `cr`.
+    ///
+    /// Temporary surfaces are made large enough to cover the clip region plus `bleed`
+    /// device pixels on each side, so that filters can read pixels around the visible
+    /// area.
+    fn limit_temporary_surfaces_to_clip(&mut self, bleed: f64) -> Result<(), RenderingError> {
+        let (x0, y0, x1, y1) = self.cr.clip_extents()?;
+
+        let clip = self
+            .get_transform()
+            .transform_rect(&Rect::new(x0, y0, x1, y1));
+
+        let clip = Rect::new(
+            clip.x0 - bleed,
+            clip.y0 - bleed,
+            clip.x1 + bleed,
+            clip.y1 + bleed,
+        );
+
+        let device_to_temporary = CompositingAffines::new(
+            Transform::identity(),
+            self.initial_transform_with_offset(),
+            0,
+            (0.0, 0.0),
+        )
+        .for_snapshot;
+
+        let region = IRect::from(device_to_temporary.transform_rect(&clip));
+
+        // Add a pixel on each side, in case temporary surfaces are not aligned to device pixels.
+        self.temporary_surface_region = Some(IRect::new(
+            region.x0 - 1,
+            region.y0 - 1,
+            region.x1 + 1,
+            region.y1 + 1,
+        ));
+
+        Ok(())
+    }
+
     pub fn create_surface_for_toplevel_viewport(
         &self,
     ) -> Result<cairo::ImageSurface, RenderingError> {
-        let (w, h) = self.size_for_temporary_surface();
+        let rect = self.rect_for_temporary_surface();
+        let allocation = self.allocate_temporary_surface(rect.width(), rect.height())?;
 
-        Ok(cairo::ImageSurface::create(cairo::Format::ARgb32, w, h)?)
+        let surface =
+            cairo::ImageSurface::create(cairo::Format::ARgb32, rect.width(), rect.height())?;
+        allocation.attach_to(&surface);
+
+        Ok(surface)
     }
 
     fn create_similar_surface_for_toplevel_viewport(
         &self,
         surface: &cairo::Surface,
     ) -> Result<cairo::Surface, RenderingError> {
-        let (w, h) = self.size_for_temporary_surface();
+        let rect = self.rect_for_temporary_surface();
+        let allocation = self.allocate_temporary_surface(rect.width(), rect.height())?;
 
-        Ok(cairo::Surface::create_similar(
+        let similar = cairo::Surface::create_similar(
             surface,
             cairo::Content::ColorAlpha,
-            w,
-            h,
-        )?)
+            rect.width(),
+            rect.height(),
+        )?;
+        allocation.attach_to(&similar);
+
+        Ok(similar)
     }
 
     fn get_top_viewport(&self) -> Viewport {
@@ -668,6 +1182,11 @@ impl DrawingCtx {
     ) -> Result<BoundingBox, RenderingError> {
         let orig_transform = self.get_transform();
 
+        // The result of a filter can extend past the bounding box of what it filters.
+        if stacking_ctx.filter != Filter::None {
+            self.mark_uncacheable();
+        }
+
         self.cr.transform(stacking_ctx.transform.into());
 
         let res = if clipping {
@@ -703,6 +1222,7 @@ impl DrawingCtx {
                         affine_at_start,
                         self.initial_transform_with_offset(),
                         self.cr_stack.borrow().len(),
+                        self.temporary_surface_origin(),
                     );
 
                     // Create temporary surface and its cr
@@ -721,6 +1241,9 @@ impl DrawingCtx {
 
                     let (source_surface, mut res, bbox) = {
                         let mut temporary_draw_ctx = self.nested(cr);
+                        temporary_draw_ctx.to_toplevel_device = self
+                            .to_toplevel_device
+                            .map(|t| affines.compositing.post_transform(&t));
 
                         // Draw!
 
@@ -867,6 +1390,87 @@ impl DrawingCtx {
         }
     }
 
+    /// Draws a group like `with_discrete_layer`, but skips it entirely if the bounding box
+    /// of its contents from a previous render is outside the clip.
+    ///
+    /// A skipped group returns its cached bounding box, so that the groups around it
+    /// still get the same bounding box for their objectBoundingBox units.
+    pub fn with_cached_layer(
+        &mut self,
+        cache: &LayerCache,
+        cascaded: &CascadedValues<'_>,
+        stacking_ctx: &StackingContext,
+        acquired_nodes: &mut AcquiredNodes<'_>,
+        clipping: bool,
+        draw_fn: &mut dyn FnMut(
+            &mut AcquiredNodes<'_>,
+            &mut DrawingCtx,
+        ) -> Result<BoundingBox, RenderingError>,
+    ) -> Result<BoundingBox, RenderingError> {
+        let values = cascaded.get();
+
+        // While measuring, all the elements need to be drawn to record their extents.
+        if clipping
+            || self.measuring
+            || self.extents.is_some()
+            || !cascaded.is_own_cascade()
+            || stacking_ctx.filter != Filter::None
+        {
+            return self.with_discrete_layer(
+                stacking_ctx,
+                acquired_nodes,
+                values,
+                clipping,
+                None,
+                draw_fn,
+            );
+        }
+
+        let layer_transform = self.get_transform().pre_transform(&stacking_ctx.transform);
+        let key = LayerCacheKey::new(&layer_transform, &self.get_view_params());
+
+        if let Some(bbox) = cache.get(&key) {
+            if let Some(ref ink_rect) = bbox.ink_rect {
+                if self.is_outside_clip_in(ink_rect, &layer_transform)? {
+                    let mut res_bbox = self.empty_bbox();
+                    res_bbox.insert(&bbox.with_transform(layer_transform));
+                    return Ok(res_bbox);
+                }
+            }
+        }
+
+        let uncacheable_draws = self.uncacheable_draws.get();
+        let mut contents_bbox = None;
+
+        let res = self.with_discrete_layer(
+            stacking_ctx,
+            acquired_nodes,
+            values,
+            clipping,
+            None,
+            &mut |an, dc| {
+                let bbox = draw_fn(an, dc)?;
+
+                // The contents may be drawn on a temporary surface, so take the bbox
+                // relative to the group's user space instead of the current device space.
+                let mut local_bbox = dc.empty_bbox();
+                local_bbox.insert(&bbox);
+                contents_bbox = Some(local_bbox.with_transform(Transform::identity()));
+
+                Ok(bbox)
+            },
+        );
+
+        cache.set(match (&res, contents_bbox) {
+            (Ok(_), Some(bbox)) if self.uncacheable_draws.get() == uncacheable_draws => {
+                Some(LayerCacheEntry { key, bbox })
+            }
+            _ => None,
+        });
+
+        res
+    }
+
     fn initial_transform_with_offset(&self) -> Transform {
         let rect = self.toplevel_viewport();
 
@@ -940,18 +1544,41 @@ impl DrawingCtx {
             })
             .collect::<Result<Vec<FilterSpec>, _>>()
         {
-            specs.iter().try_fold(surface_to_filter, |surface, spec| {
-                filters::render(
-                    &spec,
-                    stroke_paint_source.clone(),
-                    fill_paint_source.clone(),
-                    surface,
-                    acquired_nodes,
-                    self,
-                    self.get_transform(),
-                    node_bbox,
-                )
-            })?
+            let caches_filter_results = acquired_nodes.document().caches_filter_results();
+
+            specs.iter().zip(filter_list.iter()).try_fold(
+                surface_to_filter,
+                |surface, (spec, filter_value)| {
+                    // Only filters that come from a <filter> element are cached;
+                    // filter functions like blur() have no node to identify them.
+                    let cache_key = match *filter_value {
+                        FilterValue::Url(ref node_id) if caches_filter_results => {
+                            Some(FilterCacheKey::new(
+                                node_id,
+                                &self.get_view_params(),
+                                self.get_transform(),
+                                node_bbox.rect,
+                                current_color,
+                                user_space_params.font_size(),
+                                &surface,
+                            ))
+                        }
+                        _ => None,
+                    };
+
+                    filters::render(
+                        &spec,
+                        stroke_paint_source.clone(),
+                        fill_paint_source.clone(),
+                        surface,
+                        acquired_nodes,
+                        self,
+                        self.get_transform(),
+                        node_bbox,
+                        cache_key,
+                    )
+                },
+            )?
         } else {
             surface_to_filter
         };
@@ -1029,11 +1656,64 @@ impl DrawingCtx {
             )
         };
 
+        let key = PatternTileKey {
+            node: pattern.node_with_children.clone(),
+            width: pw,
+            height: ph,
+            content_transform: caffine,
+            opacity: pattern.opacity,
+            vbox: self.get_top_viewport().vbox,
+        };
+
+        let cached_tile = self.pattern_tiles.borrow_mut().get(&key);
+
+        let surface = match cached_tile {
+            Some(surface) => {
+                if let (Some(mut stats), Some(id)) = (
+                    self.stats(),
+                    pattern.node_with_children.borrow_element().get_id(),
+                ) {
+                    stats.record_cache_hit(id);
+                }
+
+                surface
+            }
+            None => {
+                let surface = self.render_pattern_tile(pattern, acquired_nodes, pw, ph, caffine)?;
+                self.pattern_tiles.borrow_mut().insert(key, surface.clone());
+                surface
+            }
+        };
+
+        // Set the final surface as a Cairo pattern into the Cairo context
+        let pattern = cairo::SurfacePattern::create(&surface);
+
+        if let Some(m) = affine.invert() {
+            pattern.set_matrix(m.into())
+        }
+        pattern.set_extend(cairo::Extend::Repeat);
+        pattern.set_filter(cairo::Filter::Best);
+        self.cr.set_source(&pattern)?;
+
+        Ok(true)
+    }
+
+    /// Renders one tile of a pattern's contents into a new surface.
+    fn render_pattern_tile(
+        &mut self,
+        pattern: &UserSpacePattern,
+        acquired_nodes: &mut AcquiredNodes<'_>,
+        pw: i32,
+        ph: i32,
+        caffine: Transform,
+    ) -> Result<cairo::Surface, RenderingError> {
         // Draw to another surface
+        let allocation = self.allocate_temporary_surface(pw, ph)?;
         let surface = self
             .cr
             .target()
             .create_similar(cairo::Content::ColorAlpha, pw, ph)?;
+        allocation.attach_to(&surface);
 
         let cr_pattern = cairo::Context::new(&surface)?;
 
@@ -1045,6 +1725,10 @@ impl DrawingCtx {
         {
             let mut pattern_draw_ctx = self.nested(cr_pattern);
 
+            // The tile is not clipped like the toplevel target, so temporary surfaces
+            // for its contents must not be limited to the clip region.
+            pattern_draw_ctx.temporary_surface_region = None;
+
             pattern_draw_ctx
                 .with_alpha(pattern.opacity, &mut |dc| {
                     let pattern_cascaded =
@@ -1079,17 +1763,7 @@ impl DrawingCtx {
                 .map(|_| ())?;
         }
 
-        // Set the final surface as a Cairo pattern into the Cairo context
-        let pattern = cairo::SurfacePattern::create(&surface);
-
-        if let Some(m) = affine.invert() {
-            pattern.set_matrix(m.into())
-        }
-        pattern.set_extend(cairo::Extend::Repeat);
-        pattern.set_filter(cairo::Filter::Best);
-        self.cr.set_source(&pattern)?;
-
-        Ok(true)
+        Ok(surface)
     }
 
     fn set_color(&self, rgba: cssparser::RGBA) {
@@ -1137,7 +1811,9 @@ impl DrawingCtx {
         acquired_nodes: &mut AcquiredNodes<'_>,
         paint_source: &UserSpacePaintSource,
     ) -> Result<SharedImageSurface, RenderingError> {
+        let allocation = self.allocate_temporary_surface(width, height)?;
         let mut surface = ExclusiveImageSurface::new(width, height, SurfaceType::SRgb)?;
+        surface.attach_allocation(allocation);
 
         surface.draw::<RenderingError>(&mut |cr| {
             let mut temporary_draw_ctx = self.nested(cr);
@@ -1197,6 +1873,25 @@ impl DrawingCtx {
             return Ok(self.empty_bbox());
         }
 
+        // If the shape's opacity can be applied to its paint directly, draw it
+        // without a temporary surface.
+        let folded_opacity = if clipping {
+            None
+        } else {
+            opacity_for_paint(shape, stacking_ctx)
+        };
+
+        let opaque_stacking_ctx;
+        let stacking_ctx = if folded_opacity.is_some() {
+            opaque_stacking_ctx = StackingContext {
+                opacity: Opacity(UnitInterval::clamp(1.0)),
+                ..stacking_ctx.clone()
+            };
+            &opaque_stacking_ctx
+        } else {
+            stacking_ctx
+        };
+
         self.with_discrete_layer(
             stacking_ctx,
             acquired_nodes,
@@ -1206,8 +1901,13 @@ impl DrawingCtx {
             &mut |an, dc| {
                 let cr = dc.cr.clone();
                 let transform = dc.get_transform();
-                let mut path_helper =
-                    PathHelper::new(&cr, transform, &shape.path, shape.stroke.line_cap);
+                let mut path_helper = PathHelper::new(
+                    &cr,
+                    transform,
+                    &shape.path,
+                    shape.path_cache.as_deref(),
+                    shape.stroke.line_cap,
+                );
 
                 if clipping {
                     if shape.is_visible {
@@ -1224,12 +1924,29 @@ impl DrawingCtx {
                 cr.set_fill_rule(cairo::FillRule::from(shape.fill_rule));
 
                 path_helper.set()?;
-                let bbox = compute_stroke_and_fill_box(&cr, &shape.stroke, &shape.stroke_paint)?;
+                let bbox = path_helper.stroke_and_fill_box(&shape.stroke, &shape.stroke_paint)?;
 
-                let stroke_paint = shape.stroke_paint.to_user_space(&bbox, view_params, values);
-                let fill_paint = shape.fill_paint.to_user_space(&bbox, view_params, values);
+                let mut stroke_paint = shape.stroke_paint.to_user_space(&bbox, view_params, values);
+                let mut fill_paint = shape.fill_paint.to_user_space(&bbox, view_params, values);
+
+                if let Some(opacity) = folded_opacity {
+                    stroke_paint = with_folded_opacity(stroke_paint, opacity);
+                    fill_paint = with_folded_opacity(fill_paint, opacity);
+                }
 
-                if shape.is_visible {
+                // Markers can be drawn outside of the shape's extents, so only shapes
+                // without them can be culled.
+                let has_markers = shape.marker_start.node_ref.is_some()
+                    || shape.marker_mid.node_ref.is_some()
+                    || shape.marker_end.node_ref.is_some();
+
+                let is_culled = !has_markers
+                    && match bbox.ink_rect {
+                        Some(ref ink_rect) => dc.is_outside_clip(ink_rect)?,
+                        None => false,
+                    };
+
+                if shape.is_visible && !is_culled {
                     for &target in &shape.paint_order.targets {
                         // fill and stroke operations will preserve the path.
                         // markers operation will clear the path.
@@ -1245,6 +1962,9 @@ impl DrawingCtx {
                             }
 
                             PaintTarget::Markers => {
+                                if has_markers {
+                                    dc.mark_uncacheable();
+                                }
                                 path_helper.unset();
                                 marker::render_markers_for_shape(shape, dc, an, clipping)?;
                             }
@@ -1338,6 +2058,26 @@ impl DrawingCtx {
         }
     }
 
+    fn font_options(&self) -> cairo::FontOptions {
+        let mut options = cairo::FontOptions::new().unwrap();
+        if self.testing {
+            options.set_antialias(cairo::Antialias::Gray);
+        }
+
+        options.set_hint_style(cairo::HintStyle::None);
+        options.set_hint_metrics(cairo::HintMetrics::Off);
+
+        options
+    }
+
+    /// Updates a layout from a previous measurement for the current transform and font options.
+    ///
+    /// Pango only shapes the text again if those changed since the layout was last used.
+    pub fn update_pango_layout(&self, layout: &pango::Layout) {
+        self.cr.set_font_options(&self.font_options());
+        pangocairo::functions::update_layout(&self.cr, layout);
+    }
+
     pub fn draw_text_span(
         &mut self,
         view_params: &ViewParams,
@@ -1480,6 +2220,7 @@ impl DrawingCtx {
                     Transform::from(draw.matrix()),
                     self.initial_transform_with_offset(),
                     depth,
+                    self.temporary_surface_origin(),
                 );
 
                 cr.set_matrix(affines.for_snapshot.into());
@@ -1502,9 +2243,13 @@ impl DrawingCtx {
         width: i32,
         height: i32,
     ) -> Result<SharedImageSurface, RenderingError> {
+        let allocation = self.allocate_temporary_surface(width, height)?;
         let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, width, height)?;
+        allocation.attach_to(&surface);
 
         let save_initial_viewport = self.initial_viewport;
+        let save_temporary_surface_region = self.temporary_surface_region;
+        let save_to_toplevel_device = self.to_toplevel_device;
         let save_cr = self.cr.clone();
 
         {
@@ -1516,12 +2261,16 @@ impl DrawingCtx {
                 transform: affine,
                 vbox: ViewBox::from(Rect::from_size(f64::from(width), f64::from(height))),
             };
+            self.temporary_surface_region = None;
+            self.to_toplevel_device = None;
 
             let _ = self.draw_node_from_stack(node, acquired_nodes, cascaded, false)?;
         }
 
         self.cr = save_cr;
         self.initial_viewport = save_initial_viewport;
+        self.temporary_surface_region = save_temporary_surface_region;
+        self.to_toplevel_device = save_to_toplevel_device;
 
         Ok(SharedImageSurface::wrap(surface, SurfaceType::SRgb)?)
     }
@@ -1754,7 +2503,14 @@ struct CompositingAffines {
 }
 
 impl CompositingAffines {
-    fn new(current: Transform, initial: Transform, cr_stack_depth: usize) -> CompositingAffines {
+    /// `origin` is the position of the topmost temporary surface within the toplevel
+    /// viewport, in the temporary surface's pixel space.
+    fn new(
+        current: Transform,
+        initial: Transform,
+        cr_stack_depth: usize,
+        origin: (f64, f64),
+    ) -> CompositingAffines {
         let is_topmost_temporary_surface = cr_stack_depth == 0;
 
         let initial_inverse = initial.invert().unwrap();
@@ -1771,12 +2527,15 @@ impl CompositingAffines {
             current
                 .post_transform(&initial_inverse)
                 .post_scale(scale_x, scale_y)
+                .post_translate(-origin.0, -origin.1)
         } else {
             current
         };
 
         let compositing = if is_topmost_temporary_surface {
-            initial.pre_scale(1.0 / scale_x, 1.0 / scale_y)
+            initial
+                .pre_scale(1.0 / scale_x, 1.0 / scale_y)
+                .pre_translate(origin.0, origin.1)
         } else {
             Transform::identity()
         };
@@ -1793,6 +2552,57 @@ impl CompositingAffines {
     }
 }
 
+/// Returns the opacity of a shape if it can be folded into the alpha of its paint.
+///
+/// A translucent element is normally drawn to a temporary surface, which is then
+/// composited with the opacity.  For a shape that only paints its fill or only its
+/// stroke with a solid color, and which has no markers, the result is the same as
+/// painting with the opacity multiplied into the color's alpha, since nothing
+/// that it paints overlaps.  Anything else that needs a temporary surface, like a
+/// filter or a mask, rules this out.
+fn opacity_for_paint(shape: &Shape, stacking_ctx: &StackingContext) -> Option<f64> {
+    let Opacity(UnitInterval(opacity)) = stacking_ctx.opacity;
+
+    if approx_eq!(f64, opacity, 1.0)
+        || stacking_ctx.filter != Filter::None
+        || stacking_ctx.mask.is_some()
+        || stacking_ctx.mix_blend_mode != MixBlendMode::Normal
+        || stacking_ctx.clip_in_object_space.is_some()
+    {
+        return None;
+    }
+
+    if shape.marker_start.node_ref.is_some()
+        || shape.marker_mid.node_ref.is_some()
+        || shape.marker_end.node_ref.is_some()
+    {
+        return None;
+    }
+
+    let has_fill = !matches!(shape.fill_paint, PaintSource::None);
+    let has_stroke = !matches!(shape.stroke_paint, PaintSource::None)
+        && !shape.stroke.width.approx_eq_cairo(0.0);
+
+    let is_solid = |paint: &PaintSource| matches!(*paint, PaintSource::SolidColor(_));
+
+    match (has_fill, has_stroke) {
+        (true, true) => None,
+        (true, false) if !is_solid(&shape.fill_paint) => None,
+        (false, true) if !is_solid(&shape.stroke_paint) => None,
+        _ => Some(opacity),
+    }
+}
+
+fn with_folded_opacity(paint: UserSpacePaintSource, opacity: f64) -> UserSpacePaintSource {
+    match paint {
+        UserSpacePaintSource::SolidColor(rgba) => UserSpacePaintSource::SolidColor(RGBA {
+            alpha: (f64::from(rgba.alpha) * opacity).round() as u8,
+            ..rgba
+        }),
+        paint => paint,
+    }
+}
+
 fn compute_stroke_and_fill_box(
     cr: &cairo::Context,
     stroke: &Stroke,
@@ -2036,15 +2846,7 @@ impl From<&DrawingCtx> for pango::Context {
     fn from(draw_ctx: &DrawingCtx) -> pango::Context {
         let cr = draw_ctx.cr.clone();
 
-        let mut options = cairo::FontOptions::new().unwrap();
-        if draw_ctx.testing {
-            options.set_antialias(cairo::Antialias::Gray);
-        }
-
-        options.set_hint_style(cairo::HintStyle::None);
-        options.set_hint_metrics(cairo::HintMetrics::Off);
-
-        cr.set_font_options(&options);
+        cr.set_font_options(&draw_ctx.font_options());
 
         let font_map = pangocairo::FontMap::default().unwrap();
         let context = font_map.create_context().unwrap();
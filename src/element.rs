@@ -4,7 +4,9 @@ use markup5ever::{expanded_name, local_name, namespace_url, ns, QualName};
 use once_cell::sync::Lazy;
 use std::collections::{HashMap, HashSet};
 use std::fmt;
+use std::mem;
 use std::ops::Deref;
+use std::rc::Rc;
 
 use crate::accept_language::UserLanguage;
 use crate::bbox::BoundingBox;
@@ -102,7 +104,7 @@ pub struct ElementInner<T: SetAttributes + Draw> {
     specified_values: SpecifiedValues,
     important_styles: HashSet<QualName>,
     result: ElementResult,
-    values: ComputedValues,
+    values: Rc<ComputedValues>,
     required_extensions: Option<RequiredExtensions>,
     required_features: Option<RequiredFeatures>,
     system_language: Option<SystemLanguage>,
@@ -171,8 +173,19 @@ impl<T: SetAttributes + Draw> ElementInner<T> {
         &self.values
     }
 
-    fn set_computed_values(&mut self, values: &ComputedValues) {
-        self.values = values.clone();
+    fn get_shared_computed_values(&self) -> Rc<ComputedValues> {
+        self.values.clone()
+    }
+
+    fn set_computed_values(&mut self, values: Rc<ComputedValues>) {
+        self.values = values;
+    }
+
+    fn approximate_size(&self) -> usize {
+        mem::size_of::<Self>()
+            + self.id.as_ref().map_or(0, String::len)
+            + self.class.as_ref().map_or(0, String::len)
+            + self.attributes.approximate_size()
     }
 
     fn get_cond(&self, user_language: &UserLanguage) -> bool {
@@ -523,10 +536,21 @@ impl Element {
         call_inner!(self, get_computed_values)
     }
 
-    pub fn set_computed_values(&mut self, values: &ComputedValues) {
+    /// Returns the computed values, which may be shared with other elements.
+    pub fn get_shared_computed_values(&self) -> Rc<ComputedValues> {
+        call_inner!(self, get_shared_computed_values)
+    }
+
+    pub fn set_computed_values(&mut self, values: Rc<ComputedValues>) {
         call_inner!(self, set_computed_values, values);
     }
 
+    /// Approximate number of bytes that the element takes in memory, not counting
+    /// its computed values, which may be shared with other elements.
+    pub fn approximate_size(&self) -> usize {
+        call_inner!(self, approximate_size)
+    }
+
     pub fn get_cond(&self, user_language: &UserLanguage) -> bool {
         call_inner!(self, get_cond, user_language)
     }
@@ -136,6 +136,9 @@ pub enum RenderingError {
 
     /// Not enough memory was available for rendering.
     OutOfMemory(String),
+
+    /// Rendering was stopped through the `gio::Cancellable` given to the renderer.
+    Cancelled,
 }
 
 impl From<DefsLookupErrorKind> for RenderingError {
@@ -157,6 +160,7 @@ impl fmt::Display for RenderingError {
             RenderingError::IdNotFound => write!(f, "element id not found"),
             RenderingError::InvalidId(ref s) => write!(f, "invalid id: {:?}", s),
             RenderingError::OutOfMemory(ref s) => write!(f, "out of memory: {}", s),
+            RenderingError::Cancelled => write!(f, "rendering was cancelled"),
         }
     }
 }
@@ -416,6 +420,22 @@ pub enum ImplementationLimit {
     /// allow loading more than a certain number of elements during
     /// the initial loading process.
     TooManyLoadedElements,
+
+    /// Rendering took longer than the time limit given to the renderer.
+    ///
+    /// Applications that render documents from untrusted sources can set a
+    /// time limit for each rendering, so that documents which take a long
+    /// time to render, for example through long chains of expensive filters,
+    /// do not tie up the application indefinitely.
+    RenderingTimeExceeded,
+
+    /// Rendering allocated more bytes of temporary surfaces than the limit
+    /// given to the renderer.
+    ///
+    /// Group opacity, masks, filters, and patterns are rendered through
+    /// temporary surfaces.  Applications that render documents from untrusted
+    /// sources can limit the memory that those take in each rendering.
+    TooManyTemporarySurfaceBytes,
 }
 
 impl error::Error for LoadingError {}
@@ -466,6 +486,14 @@ impl fmt::Display for ImplementationLimit {
                 "cannot load more than {} XML elements",
                 limits::MAX_LOADED_ELEMENTS
             ),
+
+            ImplementationLimit::RenderingTimeExceeded => {
+                write!(f, "exceeded the time limit for rendering")
+            }
+
+            ImplementationLimit::TooManyTemporarySurfaceBytes => {
+                write!(f, "exceeded the memory limit for temporary surfaces")
+            }
         }
     }
 }
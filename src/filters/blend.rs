@@ -52,8 +52,8 @@ pub struct FeBlend {
 /// Resolved `feBlend` primitive for rendering.
 #[derive(Clone, Default)]
 pub struct Blend {
-    in1: Input,
-    in2: Input,
+    pub in1: Input,
+    pub in2: Input,
     mode: Mode,
     color_interpolation_filters: ColorInterpolationFilters,
 }
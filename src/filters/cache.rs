@@ -0,0 +1,281 @@
+//! Cache of filter results between renderings of a document.
+//!
+//! Applications that render the same document over and over, for example to
+//! show the states of an animation, end up running the same filters on the
+//! same pixels every time.  When a `Loader` opts in with
+//! `with_filter_result_cache`, the document keeps the output of each filter
+//! in this cache.
+//!
+//! A filter's output depends on more than its source pixels: its parameters
+//! are resolved against the viewport and DPI, and its effects region depends
+//! on the current transform and on the bounding box of the filtered element.
+//! Colors like `flood-color="currentColor"` and lengths in `em` units get
+//! resolved against the filtered element's `color` and font size.  All of
+//! those go into the cache key, along with a hash of the source surface.
+//! Filters that read the background or the fill and stroke paints are never
+//! cached, since those inputs are not part of the key.
+//!
+//! Two different source surfaces can have the same 64-bit hash, so each entry
+//! also keeps the source surface it was computed from, and a lookup only hits
+//! if the pixels are the same.  This costs the memory of the source surface,
+//! and a comparison of its pixels on each hit, but a collision would
+//! otherwise paint the output of a different filter input without any error.
+//!
+//! The cache is bounded by the number of bytes of the surfaces in it, and
+//! the least recently used entries are evicted first.  It gets cleared when
+//! the document's styles are recomputed, as that can change any filter.
+
+use std::collections::hash_map::DefaultHasher;
+use std::hash::{Hash, Hasher};
+
+use cssparser::RGBA;
+
+use crate::document::NodeId;
+use crate::drawing_ctx::ViewParams;
+use crate::lru::LruCache;
+use crate::rect::Rect;
+use crate::surface_utils::shared_surface::SharedImageSurface;
+use crate::transform::Transform;
+use crate::viewbox::ViewBox;
+
+/// Everything that determines the output of a filter.
+#[derive(Debug, Clone)]
+pub struct FilterCacheKey {
+    filter: NodeId,
+    dpi: (f64, f64),
+    vbox: ViewBox,
+    transform: Transform,
+    node_bbox: Option<Rect>,
+    current_color: RGBA,
+    font_size: f64,
+    source_hash: u64,
+}
+
+impl FilterCacheKey {
+    pub fn new(
+        filter: &NodeId,
+        view_params: &ViewParams,
+        transform: Transform,
+        node_bbox: Option<Rect>,
+        current_color: RGBA,
+        font_size: f64,
+        source_surface: &SharedImageSurface,
+    ) -> FilterCacheKey {
+        let mut hasher = DefaultHasher::new();
+        source_surface.hash_pixels(&mut hasher);
+
+        FilterCacheKey {
+            filter: filter.clone(),
+            dpi: (view_params.dpi.x, view_params.dpi.y),
+            vbox: view_params.vbox,
+            transform,
+            node_bbox,
+            current_color,
+            font_size,
+            source_hash: hasher.finish(),
+        }
+    }
+
+    /// The `<filter>` element whose output this is.
+    pub fn filter(&self) -> &NodeId {
+        &self.filter
+    }
+
+    /// The numbers in the key, as bits, so that keys can be compared and hashed exactly.
+    fn bits(&self) -> [u64; 19] {
+        let vbox = &self.vbox;
+        let t = &self.transform;
+        let bbox = self.node_bbox.unwrap_or_default();
+
+        [
+            self.dpi.0.to_bits(),
+            self.dpi.1.to_bits(),
+            vbox.x0.to_bits(),
+            vbox.y0.to_bits(),
+            vbox.x1.to_bits(),
+            vbox.y1.to_bits(),
+            t.xx.to_bits(),
+            t.yx.to_bits(),
+            t.xy.to_bits(),
+            t.yy.to_bits(),
+            t.x0.to_bits(),
+            t.y0.to_bits(),
+            self.node_bbox.is_some() as u64,
+            bbox.x0.to_bits(),
+            bbox.y0.to_bits(),
+            bbox.x1.to_bits(),
+            bbox.y1.to_bits(),
+            u64::from(u32::from_be_bytes([
+                self.current_color.red,
+                self.current_color.green,
+                self.current_color.blue,
+                self.current_color.alpha,
+            ])),
+            self.font_size.to_bits(),
+        ]
+    }
+}
+
+impl PartialEq for FilterCacheKey {
+    fn eq(&self, other: &FilterCacheKey) -> bool {
+        self.filter == other.filter
+            && self.source_hash == other.source_hash
+            && self.bits() == other.bits()
+    }
+}
+
+impl Eq for FilterCacheKey {}
+
+impl Hash for FilterCacheKey {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.filter.hash(state);
+        self.source_hash.hash(state);
+        self.bits().hash(state);
+    }
+}
+
+struct Entry {
+    source: SharedImageSurface,
+    output: SharedImageSurface,
+}
+
+pub struct FilterResultCache(LruCache<FilterCacheKey, Entry>);
+
+fn surface_size(surface: &SharedImageSurface) -> usize {
+    surface.stride() as usize * surface.height() as usize
+}
+
+impl FilterResultCache {
+    pub fn new(max_size: usize) -> FilterResultCache {
+        FilterResultCache(LruCache::new(max_size))
+    }
+
+    /// Returns the output of the filter for `key`, if it was computed from the same source pixels.
+    pub fn get(
+        &mut self,
+        key: &FilterCacheKey,
+        source: &SharedImageSurface,
+    ) -> Option<SharedImageSurface> {
+        self.0
+            .get(key)
+            .filter(|entry| entry.source.same_pixels(source))
+            .map(|entry| entry.output.clone())
+    }
+
+    pub fn insert(
+        &mut self,
+        key: FilterCacheKey,
+        source: SharedImageSurface,
+        output: SharedImageSurface,
+    ) {
+        let size = surface_size(&source) + surface_size(&output);
+
+        self.0.insert(key, Entry { source, output }, size);
+    }
+
+    pub fn clear(&mut self) {
+        self.0.clear();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::dpi::Dpi;
+    use crate::surface_utils::shared_surface::SurfaceType;
+
+    const BLACK: RGBA = RGBA {
+        red: 0,
+        green: 0,
+        blue: 0,
+        alpha: 255,
+    };
+
+    fn key_with_color(id: &str, color: RGBA, surface: &SharedImageSurface) -> FilterCacheKey {
+        FilterCacheKey::new(
+            &NodeId::Internal(String::from(id)),
+            &ViewParams::new(Dpi::new(96.0, 96.0), 100.0, 100.0),
+            Transform::identity(),
+            None,
+            color,
+            12.0,
+            surface,
+        )
+    }
+
+    fn key(id: &str, surface: &SharedImageSurface) -> FilterCacheKey {
+        key_with_color(id, BLACK, surface)
+    }
+
+    fn surface(width: i32) -> SharedImageSurface {
+        SharedImageSurface::empty(width, 1, SurfaceType::SRgb).unwrap()
+    }
+
+    #[test]
+    fn key_depends_on_source_pixels() {
+        assert_eq!(key("a", &surface(1)), key("a", &surface(1)));
+        assert_ne!(key("a", &surface(1)), key("a", &surface(2)));
+        assert_ne!(key("a", &surface(1)), key("b", &surface(1)));
+    }
+
+    #[test]
+    fn key_depends_on_current_color() {
+        let s = surface(1);
+        let red = RGBA::new(255, 0, 0, 255);
+        let blue = RGBA::new(0, 0, 255, 255);
+
+        assert_eq!(key_with_color("a", red, &s), key_with_color("a", red, &s));
+        assert_ne!(key_with_color("a", red, &s), key_with_color("a", blue, &s));
+
+        let mut cache = FilterResultCache::new(1024);
+
+        cache.insert(key_with_color("a", red, &s), s.clone(), s.clone());
+
+        assert!(cache.get(&key_with_color("a", red, &s), &s).is_some());
+        assert!(cache.get(&key_with_color("a", blue, &s), &s).is_none());
+    }
+
+    #[test]
+    fn checks_source_pixels_on_hit() {
+        let s = surface(1);
+        let mut cache = FilterResultCache::new(1024);
+
+        cache.insert(key("a", &s), s.clone(), s.clone());
+
+        // Pretend that a different source surface has the same hash.
+        assert!(cache.get(&key("a", &s), &surface(2)).is_none());
+        assert!(cache.get(&key("a", &s), &s).is_some());
+    }
+
+    #[test]
+    fn evicts_least_recently_used() {
+        let s = surface(10);
+        let size = surface_size(&s) * 2;
+
+        let mut cache = FilterResultCache::new(size * 2);
+
+        cache.insert(key("a", &s), s.clone(), s.clone());
+        cache.insert(key("b", &s), s.clone(), s.clone());
+
+        assert!(cache.get(&key("a", &s), &s).is_some());
+
+        cache.insert(key("c", &s), s.clone(), s.clone());
+
+        assert!(cache.get(&key("a", &s), &s).is_some());
+        assert!(cache.get(&key("b", &s), &s).is_none());
+        assert!(cache.get(&key("c", &s), &s).is_some());
+        assert_eq!(cache.0.total_size(), size * 2);
+    }
+
+    #[test]
+    fn clear_empties_cache() {
+        let s = surface(1);
+        let mut cache = FilterResultCache::new(1024);
+
+        cache.insert(key("a", &s), s.clone(), s.clone());
+        cache.clear();
+
+        assert!(cache.get(&key("a", &s), &s).is_none());
+        assert_eq!(cache.0.total_size(), 0);
+    }
+}
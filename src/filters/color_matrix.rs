@@ -10,9 +10,7 @@ use crate::node::{CascadedValues, Node};
 use crate::parsers::{NumberList, Parse, ParseValue};
 use crate::properties::ColorInterpolationFilters;
 use crate::rect::IRect;
-use crate::surface_utils::{
-    iterators::Pixels, shared_surface::ExclusiveImageSurface, ImageSurfaceDataExt, Pixel,
-};
+use crate::surface_utils::{shared_surface::ExclusiveImageSurface, Pixel};
 use crate::util::clamp;
 use crate::xml::Attributes;
 
@@ -152,36 +150,36 @@ impl ColorMatrix {
             input_1.surface().surface_type(),
         )?;
 
-        surface.modify(&mut |data, stride| {
-            for (x, y, pixel) in Pixels::within(input_1.surface(), bounds) {
-                let alpha = f64::from(pixel.a) / 255f64;
-
-                let pixel_vec = if alpha == 0.0 {
-                    Vector5::new(0.0, 0.0, 0.0, 0.0, 1.0)
-                } else {
-                    Vector5::new(
-                        f64::from(pixel.r) / 255f64 / alpha,
-                        f64::from(pixel.g) / 255f64 / alpha,
-                        f64::from(pixel.b) / 255f64 / alpha,
-                        alpha,
-                        1.0,
-                    )
-                };
-                let mut new_pixel_vec = Vector5::zeros();
-                self.matrix.mul_to(&pixel_vec, &mut new_pixel_vec);
+        let input_surface = input_1.surface();
 
-                let new_alpha = clamp(new_pixel_vec[3], 0.0, 1.0);
+        surface.par_map_pixels(bounds, |x, y| {
+            let pixel = input_surface.get_pixel(x, y);
 
-                let premultiply = |x: f64| ((clamp(x, 0.0, 1.0) * new_alpha * 255f64) + 0.5) as u8;
+            let alpha = f64::from(pixel.a) / 255f64;
 
-                let output_pixel = Pixel {
-                    r: premultiply(new_pixel_vec[0]),
-                    g: premultiply(new_pixel_vec[1]),
-                    b: premultiply(new_pixel_vec[2]),
-                    a: ((new_alpha * 255f64) + 0.5) as u8,
-                };
+            let pixel_vec = if alpha == 0.0 {
+                Vector5::new(0.0, 0.0, 0.0, 0.0, 1.0)
+            } else {
+                Vector5::new(
+                    f64::from(pixel.r) / 255f64 / alpha,
+                    f64::from(pixel.g) / 255f64 / alpha,
+                    f64::from(pixel.b) / 255f64 / alpha,
+                    alpha,
+                    1.0,
+                )
+            };
+            let mut new_pixel_vec = Vector5::zeros();
+            self.matrix.mul_to(&pixel_vec, &mut new_pixel_vec);
+
+            let new_alpha = clamp(new_pixel_vec[3], 0.0, 1.0);
+
+            let premultiply = |x: f64| ((clamp(x, 0.0, 1.0) * new_alpha * 255f64) + 0.5) as u8;
 
-                data.set_pixel(stride, output_pixel, x, y);
+            Pixel {
+                r: premultiply(new_pixel_vec[0]),
+                g: premultiply(new_pixel_vec[1]),
+                b: premultiply(new_pixel_vec[2]),
+                a: ((new_alpha * 255f64) + 0.5) as u8,
             }
         });
 
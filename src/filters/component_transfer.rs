@@ -11,9 +11,7 @@ use crate::node::{CascadedValues, Node, NodeBorrow};
 use crate::parsers::{NumberList, Parse, ParseValue};
 use crate::properties::ColorInterpolationFilters;
 use crate::rect::IRect;
-use crate::surface_utils::{
-    iterators::Pixels, shared_surface::ExclusiveImageSurface, ImageSurfaceDataExt, Pixel,
-};
+use crate::surface_utils::{shared_surface::ExclusiveImageSurface, Pixel};
 use crate::util::clamp;
 use crate::xml::Attributes;
 
@@ -346,19 +344,19 @@ impl ComponentTransfer {
         let compute_a = |alpha| compute_a(&params_a, alpha);
 
         // Do the actual processing.
-        surface.modify(&mut |data, stride| {
-            for (x, y, pixel) in Pixels::within(input_1.surface(), bounds) {
-                let alpha = f64::from(pixel.a) / 255f64;
-                let new_alpha = compute_a(alpha);
-
-                let output_pixel = Pixel {
-                    r: compute_r(pixel.r, alpha, new_alpha),
-                    g: compute_g(pixel.g, alpha, new_alpha),
-                    b: compute_b(pixel.b, alpha, new_alpha),
-                    a: ((new_alpha * 255f64) + 0.5) as u8,
-                };
-
-                data.set_pixel(stride, output_pixel, x, y);
+        let input_surface = input_1.surface();
+
+        surface.par_map_pixels(bounds, |x, y| {
+            let pixel = input_surface.get_pixel(x, y);
+
+            let alpha = f64::from(pixel.a) / 255f64;
+            let new_alpha = compute_a(alpha);
+
+            Pixel {
+                r: compute_r(pixel.r, alpha, new_alpha),
+                g: compute_g(pixel.g, alpha, new_alpha),
+                b: compute_b(pixel.b, alpha, new_alpha),
+                a: ((new_alpha * 255f64) + 0.5) as u8,
             }
         });
 
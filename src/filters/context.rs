@@ -37,6 +37,18 @@ pub struct FilterResult {
     pub output: FilterOutput,
 }
 
+/// A surface converted to the other color space, computed the first time a primitive needs it.
+///
+/// Several primitives often read the same input in the same color space, for example the
+/// source graphic in linearRGB; this avoids converting it again for each of them.
+type Conversion = OnceCell<Result<SharedImageSurface, cairo::Error>>;
+
+/// A primitive output stored in the context, along with its conversion.
+struct StoredOutput {
+    output: FilterOutput,
+    converted: Conversion,
+}
+
 /// An input to a filter primitive.
 #[derive(Debug, Clone)]
 pub enum FilterInput {
@@ -55,13 +67,19 @@ pub struct FilterContext {
 
     /// The source graphic surface.
     source_surface: SharedImageSurface,
+    /// The source graphic converted to linearRGB.
+    source_surface_converted: Conversion,
+    /// Input surface for primitives that require an input of `SourceAlpha`. Computed lazily.
+    source_alpha_surface: OnceCell<Result<SharedImageSurface, cairo::Error>>,
     /// Output of the last filter primitive.
-    last_result: Option<FilterOutput>,
+    last_result: Option<Rc<StoredOutput>>,
     /// Surfaces of the previous filter primitives by name.
-    previous_results: HashMap<CustomIdent, FilterOutput>,
+    previous_results: HashMap<CustomIdent, Rc<StoredOutput>>,
 
     /// Input surface for primitives that require an input of `BackgroundImage` or `BackgroundAlpha`. Computed lazily.
     background_surface: OnceCell<Result<SharedImageSurface, FilterError>>,
+    /// The background image converted to linearRGB.
+    background_surface_converted: Conversion,
 
     // Input surface for primitives that require an input of `StrokePaint`, Computed lazily.
     stroke_paint_surface: OnceCell<Result<SharedImageSurface, FilterError>>,
@@ -166,9 +184,12 @@ impl FilterContext {
             stroke_paint,
             fill_paint,
             source_surface: source_surface.clone(),
+            source_surface_converted: OnceCell::new(),
+            source_alpha_surface: OnceCell::new(),
             last_result: None,
             previous_results: HashMap::new(),
             background_surface: OnceCell::new(),
+            background_surface_converted: OnceCell::new(),
             stroke_paint_surface: OnceCell::new(),
             fill_paint_surface: OnceCell::new(),
             primitive_units: filter.primitive_units,
@@ -178,12 +199,33 @@ impl FilterContext {
         })
     }
 
+    /// Whether the primitives rendered so far only used inputs derived from the source graphic.
+    ///
+    /// Returns `false` if any of them used the background or the stroke or fill paints.
+    pub fn uses_only_source_graphic(&self) -> bool {
+        self.background_surface.get().is_none()
+            && self.stroke_paint_surface.get().is_none()
+            && self.fill_paint_surface.get().is_none()
+    }
+
     /// Returns the surface corresponding to the source graphic.
     #[inline]
     pub fn source_graphic(&self) -> &SharedImageSurface {
         &self.source_surface
     }
 
+    /// Returns the alpha channel of the source graphic.
+    fn source_alpha(&self) -> Result<SharedImageSurface, FilterError> {
+        let res = self.source_alpha_surface.get_or_init(|| {
+            self.source_surface
+                .extract_alpha(self.effects_region().into())
+        });
+
+        res.as_ref()
+            .map(|s| s.clone())
+            .map_err(|e| FilterError::CairoError(*e))
+    }
+
     /// Returns the surface corresponding to the background image snapshot.
     fn background_image(&self, draw_ctx: &DrawingCtx) -> Result<SharedImageSurface, FilterError> {
         let res = self.background_surface.get_or_init(|| {
@@ -243,7 +285,12 @@ impl FilterContext {
     #[inline]
     pub fn into_output(self) -> Result<SharedImageSurface, cairo::Error> {
         match self.last_result {
-            Some(FilterOutput { surface, bounds }) => surface.to_srgb(bounds),
+            Some(ref stored) => convert(
+                &stored.output.surface,
+                stored.output.bounds,
+                &stored.converted,
+                ColorInterpolationFilters::Srgb,
+            ),
             None => SharedImageSurface::empty(
                 self.source_surface.width(),
                 self.source_surface.height(),
@@ -255,11 +302,22 @@ impl FilterContext {
     /// Stores a filter primitive result into the context.
     #[inline]
     pub fn store_result(&mut self, result: FilterResult) {
+        let stored = Rc::new(StoredOutput {
+            output: result.output,
+            converted: OnceCell::new(),
+        });
+
         if let Some(name) = result.name {
-            self.previous_results.insert(name, result.output.clone());
+            self.previous_results.insert(name, stored.clone());
         }
 
-        self.last_result = Some(result.output);
+        self.last_result = Some(stored);
+    }
+
+    /// Drops a named result that no later primitive will read.
+    #[inline]
+    pub fn release_result(&mut self, name: &CustomIdent) {
+        self.previous_results.remove(name);
     }
 
     /// Returns the paffine matrix.
@@ -281,35 +339,48 @@ impl FilterContext {
     }
 
     /// Retrieves the filter input surface according to the SVG rules.
+    ///
+    /// Also returns where to keep the input's conversion to the other color space, if it is
+    /// worth keeping.
     fn get_input_raw(
         &self,
         acquired_nodes: &mut AcquiredNodes<'_>,
         draw_ctx: &mut DrawingCtx,
         in_: &Input,
-    ) -> Result<FilterInput, FilterError> {
+    ) -> Result<(FilterInput, Option<&Conversion>), FilterError> {
         match *in_ {
             Input::Unspecified => {
                 // No value => use the last result.
                 // As per the SVG spec, if the filter primitive is the first in the chain, return the
                 // source graphic.
-                if let Some(output) = self.last_result.as_ref() {
-                    Ok(FilterInput::PrimitiveOutput(output.clone()))
+                if let Some(stored) = self.last_result.as_ref() {
+                    Ok((
+                        FilterInput::PrimitiveOutput(stored.output.clone()),
+                        Some(&stored.converted),
+                    ))
                 } else {
-                    Ok(FilterInput::StandardInput(self.source_graphic().clone()))
+                    Ok((
+                        FilterInput::StandardInput(self.source_graphic().clone()),
+                        Some(&self.source_surface_converted),
+                    ))
                 }
             }
 
-            Input::SourceGraphic => Ok(FilterInput::StandardInput(self.source_graphic().clone())),
+            Input::SourceGraphic => Ok((
+                FilterInput::StandardInput(self.source_graphic().clone()),
+                Some(&self.source_surface_converted),
+            )),
 
             Input::SourceAlpha => self
-                .source_graphic()
-                .extract_alpha(self.effects_region().into())
-                .map_err(FilterError::CairoError)
-                .map(FilterInput::StandardInput),
+                .source_alpha()
+                .map(|surface| (FilterInput::StandardInput(surface), None)),
 
-            Input::BackgroundImage => self
-                .background_image(draw_ctx)
-                .map(FilterInput::StandardInput),
+            Input::BackgroundImage => self.background_image(draw_ctx).map(|surface| {
+                (
+                    FilterInput::StandardInput(surface),
+                    Some(&self.background_surface_converted),
+                )
+            }),
 
             Input::BackgroundAlpha => self
                 .background_image(draw_ctx)
@@ -318,21 +389,25 @@ impl FilterContext {
                         .extract_alpha(self.effects_region().into())
                         .map_err(FilterError::CairoError)
                 })
-                .map(FilterInput::StandardInput),
+                .map(|surface| (FilterInput::StandardInput(surface), None)),
 
             Input::FillPaint => self
                 .fill_paint_image(acquired_nodes, draw_ctx)
-                .map(FilterInput::StandardInput),
+                .map(|surface| (FilterInput::StandardInput(surface), None)),
 
             Input::StrokePaint => self
                 .stroke_paint_image(acquired_nodes, draw_ctx)
-                .map(FilterInput::StandardInput),
+                .map(|surface| (FilterInput::StandardInput(surface), None)),
 
             Input::FilterOutput(ref name) => self
                 .previous_results
                 .get(name)
-                .cloned()
-                .map(FilterInput::PrimitiveOutput)
+                .map(|stored| {
+                    (
+                        FilterInput::PrimitiveOutput(stored.output.clone()),
+                        Some(&stored.converted),
+                    )
+                })
                 .ok_or(FilterError::InvalidInput),
         }
     }
@@ -347,7 +422,7 @@ impl FilterContext {
         in_: &Input,
         color_interpolation_filters: ColorInterpolationFilters,
     ) -> Result<FilterInput, FilterError> {
-        let raw = self.get_input_raw(acquired_nodes, draw_ctx, in_)?;
+        let (raw, converted) = self.get_input_raw(acquired_nodes, draw_ctx, in_)?;
 
         // Convert the input surface to the desired format.
         let (surface, bounds) = match raw {
@@ -358,10 +433,14 @@ impl FilterContext {
             }) => (surface, *bounds),
         };
 
-        let surface = match color_interpolation_filters {
-            ColorInterpolationFilters::Auto => Ok(surface.clone()),
-            ColorInterpolationFilters::LinearRgb => surface.to_linear_rgb(bounds),
-            ColorInterpolationFilters::Srgb => surface.to_srgb(bounds),
+        let surface = match converted {
+            Some(converted) => convert(surface, bounds, converted, color_interpolation_filters),
+            None => convert(
+                surface,
+                bounds,
+                &OnceCell::new(),
+                color_interpolation_filters,
+            ),
         };
 
         surface
@@ -375,6 +454,35 @@ impl FilterContext {
     }
 }
 
+/// Converts a surface to the color space specified by `color_interpolation_filters`.
+///
+/// Surfaces that are already in that color space, or that only have an alpha channel, are
+/// returned as they are.  Otherwise the conversion is computed once and kept in `converted`.
+fn convert(
+    surface: &SharedImageSurface,
+    bounds: IRect,
+    converted: &Conversion,
+    color_interpolation_filters: ColorInterpolationFilters,
+) -> Result<SharedImageSurface, cairo::Error> {
+    let needs_conversion = match (color_interpolation_filters, surface.surface_type()) {
+        (ColorInterpolationFilters::Auto, _) => false,
+        (_, SurfaceType::AlphaOnly) => false,
+        (ColorInterpolationFilters::LinearRgb, t) => t != SurfaceType::LinearRgb,
+        (ColorInterpolationFilters::Srgb, t) => t != SurfaceType::SRgb,
+    };
+
+    if !needs_conversion {
+        return Ok(surface.clone());
+    }
+
+    let res = converted.get_or_init(|| match color_interpolation_filters {
+        ColorInterpolationFilters::LinearRgb => surface.to_linear_rgb(bounds),
+        _ => surface.to_srgb(bounds),
+    });
+
+    res.as_ref().map(|s| s.clone()).map_err(|e| *e)
+}
+
 impl FilterInput {
     /// Retrieves the surface from `FilterInput`.
     #[inline]
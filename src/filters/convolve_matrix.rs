@@ -11,9 +11,7 @@ use crate::parsers::{NonNegative, NumberList, NumberOptionalNumber, Parse, Parse
 use crate::properties::ColorInterpolationFilters;
 use crate::rect::IRect;
 use crate::surface_utils::{
-    iterators::{PixelRectangle, Pixels},
-    shared_surface::ExclusiveImageSurface,
-    EdgeMode, ImageSurfaceDataExt, Pixel,
+    iterators::PixelRectangle, shared_surface::ExclusiveImageSurface, EdgeMode, Pixel,
 };
 use crate::util::clamp;
 use crate::xml::Attributes;
@@ -35,7 +33,7 @@ pub struct FeConvolveMatrix {
 /// Resolved `feConvolveMatrix` primitive for rendering.
 #[derive(Clone)]
 pub struct ConvolveMatrix {
-    in1: Input,
+    pub in1: Input,
     order: (u32, u32),
     kernel_matrix: Option<DMatrix<f64>>,
     divisor: f64,
@@ -218,67 +216,65 @@ impl ConvolveMatrix {
             input_1.surface().surface_type(),
         )?;
 
-        surface.modify(&mut |data, stride| {
-            for (x, y, pixel) in Pixels::within(&input_surface, bounds) {
-                // Compute the convolution rectangle bounds.
-                let kernel_bounds = IRect::new(
-                    x as i32 - target_x as i32,
-                    y as i32 - target_y as i32,
-                    x as i32 - target_x as i32 + self.order.0 as i32,
-                    y as i32 - target_y as i32 + self.order.1 as i32,
-                );
-
-                // Do the convolution.
-                let mut r = 0.0;
-                let mut g = 0.0;
-                let mut b = 0.0;
-                let mut a = 0.0;
-
-                for (x, y, pixel) in
-                    PixelRectangle::within(&input_surface, bounds, kernel_bounds, self.edge_mode)
-                {
-                    let kernel_x = (kernel_bounds.x1 - x - 1) as usize;
-                    let kernel_y = (kernel_bounds.y1 - y - 1) as usize;
-
-                    r += f64::from(pixel.r) / 255.0 * matrix[(kernel_y, kernel_x)];
-                    g += f64::from(pixel.g) / 255.0 * matrix[(kernel_y, kernel_x)];
-                    b += f64::from(pixel.b) / 255.0 * matrix[(kernel_y, kernel_x)];
-
-                    if !self.preserve_alpha {
-                        a += f64::from(pixel.a) / 255.0 * matrix[(kernel_y, kernel_x)];
-                    }
-                }
-
-                // If preserve_alpha is true, set a to the source alpha value.
-                if self.preserve_alpha {
-                    a = f64::from(pixel.a) / 255.0;
-                } else {
-                    a = a / divisor + self.bias;
+        surface.par_map_pixels(bounds, |x, y| {
+            let pixel = input_surface.get_pixel(x, y);
+
+            // Compute the convolution rectangle bounds.
+            let kernel_bounds = IRect::new(
+                x as i32 - target_x as i32,
+                y as i32 - target_y as i32,
+                x as i32 - target_x as i32 + self.order.0 as i32,
+                y as i32 - target_y as i32 + self.order.1 as i32,
+            );
+
+            // Do the convolution.
+            let mut r = 0.0;
+            let mut g = 0.0;
+            let mut b = 0.0;
+            let mut a = 0.0;
+
+            for (x, y, pixel) in
+                PixelRectangle::within(&input_surface, bounds, kernel_bounds, self.edge_mode)
+            {
+                let kernel_x = (kernel_bounds.x1 - x - 1) as usize;
+                let kernel_y = (kernel_bounds.y1 - y - 1) as usize;
+
+                r += f64::from(pixel.r) / 255.0 * matrix[(kernel_y, kernel_x)];
+                g += f64::from(pixel.g) / 255.0 * matrix[(kernel_y, kernel_x)];
+                b += f64::from(pixel.b) / 255.0 * matrix[(kernel_y, kernel_x)];
+
+                if !self.preserve_alpha {
+                    a += f64::from(pixel.a) / 255.0 * matrix[(kernel_y, kernel_x)];
                 }
+            }
 
-                let clamped_a = clamp(a, 0.0, 1.0);
+            // If preserve_alpha is true, set a to the source alpha value.
+            if self.preserve_alpha {
+                a = f64::from(pixel.a) / 255.0;
+            } else {
+                a = a / divisor + self.bias;
+            }
 
-                let compute = |x| {
-                    let x = x / divisor + self.bias * a;
+            let clamped_a = clamp(a, 0.0, 1.0);
 
-                    let x = if self.preserve_alpha {
-                        // Premultiply the output value.
-                        clamp(x, 0.0, 1.0) * clamped_a
-                    } else {
-                        clamp(x, 0.0, clamped_a)
-                    };
+            let compute = |x| {
+                let x = x / divisor + self.bias * a;
 
-                    ((x * 255.0) + 0.5) as u8
+                let x = if self.preserve_alpha {
+                    // Premultiply the output value.
+                    clamp(x, 0.0, 1.0) * clamped_a
+                } else {
+                    clamp(x, 0.0, clamped_a)
                 };
 
-                let output_pixel = Pixel {
-                    r: compute(r),
-                    g: compute(g),
-                    b: compute(b),
-                    a: ((clamped_a * 255.0) + 0.5) as u8,
-                };
+                ((x * 255.0) + 0.5) as u8
+            };
 
-                data.set_pixel(stride, output_pixel, x, y);
+            Pixel {
+                r: compute(r),
+                g: compute(g),
+                b: compute(b),
+                a: ((clamped_a * 255.0) + 0.5) as u8,
             }
         });
 
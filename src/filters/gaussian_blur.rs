@@ -2,7 +2,6 @@ use std::cmp::min;
 use std::f64;
 
 use markup5ever::{expanded_name, local_name, namespace_url, ns};
-use nalgebra::{DMatrix, Dynamic, VecStorage};
 
 use crate::document::AcquiredNodes;
 use crate::drawing_ctx::DrawingCtx;
@@ -11,9 +10,8 @@ use crate::node::{CascadedValues, Node};
 use crate::parsers::{NonNegative, NumberOptionalNumber, ParseValue};
 use crate::properties::ColorInterpolationFilters;
 use crate::rect::IRect;
-use crate::surface_utils::{
-    shared_surface::{BlurDirection, Horizontal, SharedImageSurface, Vertical},
-    EdgeMode,
+use crate::surface_utils::shared_surface::{
+    BlurDirection, Horizontal, SharedImageSurface, Vertical,
 };
 use crate::xml::Attributes;
 
@@ -162,30 +160,17 @@ fn three_box_blurs<B: BlurDirection>(
 /// Applies the gaussian blur.
 ///
 /// This is intended to be used in two steps, horizontal and vertical.
-fn gaussian_blur(
+fn gaussian_blur<B: BlurDirection>(
     input_surface: &SharedImageSurface,
     bounds: IRect,
     std_deviation: f64,
-    vertical: bool,
 ) -> Result<SharedImageSurface, FilterError> {
-    let kernel = gaussian_kernel(std_deviation);
-    let (rows, cols) = if vertical {
-        (kernel.len(), 1)
-    } else {
-        (1, kernel.len())
-    };
-    let kernel = DMatrix::from_data(VecStorage::new(
-        Dynamic::new(rows),
-        Dynamic::new(cols),
-        kernel,
-    ));
-
-    Ok(input_surface.convolve(
-        bounds,
-        ((cols / 2) as i32, (rows / 2) as i32),
-        &kernel,
-        EdgeMode::None,
-    )?)
+    let kernel: Vec<f32> = gaussian_kernel(std_deviation)
+        .into_iter()
+        .map(|k| k as f32)
+        .collect();
+
+    Ok(input_surface.convolve_1d::<B>(bounds, &kernel)?)
 }
 
 impl GaussianBlur {
@@ -224,7 +209,7 @@ impl GaussianBlur {
             // The spec says for deviation >= 2.0 three box blurs can be used as an optimization.
             three_box_blurs::<Horizontal>(input_1.surface(), bounds, std_x)?
         } else if std_x != 0.0 {
-            gaussian_blur(input_1.surface(), bounds, std_x, false)?
+            gaussian_blur::<Horizontal>(input_1.surface(), bounds, std_x)?
         } else {
             input_1.surface().clone()
         };
@@ -234,7 +219,7 @@ impl GaussianBlur {
             // The spec says for deviation >= 2.0 three box blurs can be used as an optimization.
             three_box_blurs::<Vertical>(&horiz_result_surface, bounds, std_y)?
         } else if std_y != 0.0 {
-            gaussian_blur(&horiz_result_surface, bounds, std_y, true)?
+            gaussian_blur::<Vertical>(&horiz_result_surface, bounds, std_y)?
         } else {
             horiz_result_surface
         };
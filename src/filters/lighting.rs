@@ -437,6 +437,11 @@ impl SpecularLighting {
 macro_rules! impl_lighting_filter {
     ($lighting_type:ty, $params_name:ident, $alpha_func:ident) => {
         impl $params_name {
+            /// Returns the input of the lighting filter.
+            pub fn in1(&self) -> &Input {
+                &self.params.in1
+            }
+
             pub fn render(
                 &self,
                 bounds_builder: BoundsBuilder,
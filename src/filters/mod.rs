@@ -2,11 +2,12 @@
 
 use cssparser::{BasicParseError, Parser};
 use markup5ever::{expanded_name, local_name, namespace_url, ns};
+use std::collections::HashMap;
 use std::rc::Rc;
 use std::time::Instant;
 
 use crate::bbox::BoundingBox;
-use crate::document::AcquiredNodes;
+use crate::document::{AcquiredNodes, NodeId};
 use crate::drawing_ctx::DrawingCtx;
 use crate::element::{Draw, ElementResult, SetAttributes};
 use crate::error::{ElementError, ParseError, RenderingError};
@@ -23,6 +24,9 @@ use crate::xml::Attributes;
 mod bounds;
 use self::bounds::BoundsBuilder;
 
+pub mod cache;
+use self::cache::FilterCacheKey;
+
 pub mod context;
 use self::context::{FilterContext, FilterOutput, FilterResult};
 
@@ -114,6 +118,32 @@ impl PrimitiveParams {
     }
 }
 
+impl PrimitiveParams {
+    /// Returns the inputs that a primitive reads.
+    #[rustfmt::skip]
+    fn inputs(&self) -> Vec<&Input> {
+        use PrimitiveParams::*;
+        match self {
+            Blend(p)             => vec![&p.in1, &p.in2],
+            ColorMatrix(p)       => vec![&p.in1],
+            ComponentTransfer(p) => vec![&p.in1],
+            Composite(p)         => vec![&p.in1, &p.in2],
+            ConvolveMatrix(p)    => vec![&p.in1],
+            DiffuseLighting(p)   => vec![p.in1()],
+            DisplacementMap(p)   => vec![&p.in1, &p.in2],
+            Flood(_)             => vec![],
+            GaussianBlur(p)      => vec![&p.in1],
+            Image(_)             => vec![],
+            Merge(p)             => p.merge_nodes.iter().map(|n| &n.in1).collect(),
+            Morphology(p)        => vec![&p.in1],
+            Offset(p)            => vec![&p.in1],
+            SpecularLighting(p)  => vec![p.in1()],
+            Tile(p)              => vec![&p.in1],
+            Turbulence(_)        => vec![],
+        }
+    }
+}
+
 /// The base filter primitive node containing common properties.
 #[derive(Default, Clone)]
 pub struct Primitive {
@@ -310,6 +340,9 @@ pub fn extract_filter_from_filter_node(
 }
 
 /// Applies a filter and returns the resulting surface.
+///
+/// If `cache_key` is given, the result is looked up in the document's filter
+/// result cache first, and stored there if it could be cached.
 pub fn render(
     filter: &FilterSpec,
     stroke_paint_source: Rc<UserSpacePaintSource>,
@@ -319,7 +352,26 @@ pub fn render(
     draw_ctx: &mut DrawingCtx,
     transform: Transform,
     node_bbox: BoundingBox,
+    cache_key: Option<FilterCacheKey>,
 ) -> Result<SharedImageSurface, RenderingError> {
+    if let Some(ref key) = cache_key {
+        if let Some(surface) = acquired_nodes
+            .document()
+            .lookup_filter_result(key, &source_surface)
+        {
+            rsvg_log!("(reusing cached filter result)");
+
+            if let Some(mut stats) = draw_ctx.stats() {
+                match key.filter() {
+                    NodeId::Internal(id) => stats.record_cache_hit(id),
+                    external => stats.record_cache_hit(&external.to_string()),
+                }
+            }
+
+            return Ok(surface);
+        }
+    }
+
     FilterContext::new(
         &filter.user_space_filter,
         stroke_paint_source,
@@ -329,10 +381,28 @@ pub fn render(
         node_bbox,
     )
     .and_then(|mut filter_ctx| {
-        for user_space_primitive in &filter.primitives {
+        let last_reads = last_reads_of_results(&filter.primitives);
+
+        for (i, user_space_primitive) in filter.primitives.iter().enumerate() {
+            draw_ctx.check_budget()?;
+
+            // Primitives render into surfaces as large as the source graphic, whatever
+            // their subregion, and most of them need another one as scratch space while
+            // they run, for a blur's first pass or to convert an input to another color
+            // space.  Count both before rendering, so that a large filter runs out of
+            // budget before it allocates them.
+            let (width, height) = (source_surface.width(), source_surface.height());
+            let output_allocation = draw_ctx.allocate_temporary_surface(width, height)?;
+            let scratch_allocation = draw_ctx.reserve_temporary_bytes(width, height)?;
+
             let start = Instant::now();
 
-            match render_primitive(&user_space_primitive, &filter_ctx, acquired_nodes, draw_ctx) {
+            let result =
+                render_primitive(&user_space_primitive, &filter_ctx, acquired_nodes, draw_ctx);
+
+            drop(scratch_allocation);
+
+            match result {
                 Ok(output) => {
                     let elapsed = start.elapsed();
                     rsvg_log!(
@@ -341,6 +411,18 @@ pub fn render(
                         elapsed.as_secs() as f64 + f64::from(elapsed.subsec_nanos()) / 1e9
                     );
 
+                    let surface = &output.surface;
+
+                    if let Some(mut stats) = draw_ctx.stats() {
+                        stats.record_primitive(
+                            user_space_primitive.params.name(),
+                            elapsed,
+                            surface.stride() as usize * surface.height() as usize,
+                        );
+                    }
+
+                    surface.attach_allocation(output_allocation);
+
                     filter_ctx.store_result(FilterResult {
                         name: user_space_primitive.result.clone(),
                         output,
@@ -354,15 +436,47 @@ pub fn render(
                         err
                     );
 
-                    // Exit early on Cairo errors. Continue rendering otherwise.
-                    if let FilterError::CairoError(status) = err {
-                        return Err(FilterError::CairoError(status));
+                    // Exit early on Cairo errors and when the rendering runs out of
+                    // budget. Continue rendering otherwise.
+                    if stops_rendering(&err) {
+                        return Err(err);
                     }
                 }
             }
+
+            // Free the named results that no later primitive reads, instead
+            // of keeping all of them alive until the end of the filter chain.
+            let names = user_space_primitive
+                .params
+                .inputs()
+                .into_iter()
+                .filter_map(|input| match *input {
+                    Input::FilterOutput(ref name) => Some(name),
+                    _ => None,
+                })
+                .chain(user_space_primitive.result.as_ref());
+
+            for name in names {
+                if last_reads.get(name).map_or(true, |&last| last <= i) {
+                    filter_ctx.release_result(name);
+                }
+            }
+        }
+
+        let cacheable = filter_ctx.uses_only_source_graphic();
+        let output = filter_ctx.into_output()?;
+
+        if cacheable {
+            if let Some(key) = cache_key {
+                acquired_nodes.document().store_filter_result(
+                    key,
+                    source_surface.clone(),
+                    output.clone(),
+                );
+            }
         }
 
-        Ok(filter_ctx.into_output()?)
+        Ok(output)
     })
     .or_else(|err| match err {
         FilterError::CairoError(status) => {
@@ -370,6 +484,8 @@ pub fn render(
             Err(RenderingError::from(status))
         }
 
+        FilterError::Rendering(err) if stops_rendering_error(&err) => Err(err),
+
         _ => {
             // ignore other filter errors and just return an empty surface
             Ok(SharedImageSurface::empty(
@@ -381,6 +497,45 @@ pub fn render(
     })
 }
 
+/// Whether an error from a primitive must stop the whole rendering.
+///
+/// Other errors just make the primitive's output transparent black.
+fn stops_rendering(err: &FilterError) -> bool {
+    match *err {
+        FilterError::CairoError(_) => true,
+        FilterError::Rendering(ref err) => stops_rendering_error(err),
+        _ => false,
+    }
+}
+
+/// Whether a rendering error means that the rendering ran out of budget or was cancelled.
+fn stops_rendering_error(err: &RenderingError) -> bool {
+    matches!(
+        *err,
+        RenderingError::Cancelled | RenderingError::LimitExceeded(_)
+    )
+}
+
+/// Computes the index of the last primitive that reads each named result.
+///
+/// A name can be used by the `result` attribute of several primitives; this
+/// just takes the last read of the name overall, which may keep a result that
+/// was overwritten by a later primitive alive a bit longer than necessary,
+/// but is always safe, even if the later primitive fails to render.
+fn last_reads_of_results(primitives: &[UserSpacePrimitive]) -> HashMap<&CustomIdent, usize> {
+    let mut last_reads = HashMap::new();
+
+    for (i, primitive) in primitives.iter().enumerate() {
+        for input in primitive.params.inputs() {
+            if let Input::FilterOutput(ref name) = *input {
+                last_reads.insert(name, i);
+            }
+        }
+    }
+
+    last_reads
+}
+
 #[rustfmt::skip]
 fn render_primitive(
     primitive: &UserSpacePrimitive,
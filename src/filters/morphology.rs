@@ -1,5 +1,3 @@
-use std::cmp::{max, min};
-
 use cssparser::Parser;
 use markup5ever::{expanded_name, local_name, namespace_url, ns};
 
@@ -11,11 +9,6 @@ use crate::node::Node;
 use crate::parsers::{NonNegative, NumberOptionalNumber, Parse, ParseValue};
 use crate::properties::ColorInterpolationFilters;
 use crate::rect::IRect;
-use crate::surface_utils::{
-    iterators::{PixelRectangle, Pixels},
-    shared_surface::ExclusiveImageSurface,
-    EdgeMode, ImageSurfaceDataExt, Pixel,
-};
 use crate::xml::Attributes;
 
 use super::bounds::BoundsBuilder;
@@ -44,7 +37,7 @@ pub struct FeMorphology {
 /// Resolved `feMorphology` primitive for rendering.
 #[derive(Clone, Default)]
 pub struct Morphology {
-    in1: Input,
+    pub in1: Input,
     operator: Operator,
     radius: (f64, f64),
 }
@@ -100,63 +93,19 @@ impl Morphology {
         let (rx, ry) = ctx.paffine().transform_distance(rx, ry);
 
         // The radii can become negative here due to the transform.
-        // Additionally The radii being excessively large causes cpu hangups
-        let (rx, ry) = (rx.abs().min(10.0), ry.abs().min(10.0));
-
-        let mut surface = ExclusiveImageSurface::new(
-            ctx.source_graphic().width(),
-            ctx.source_graphic().height(),
-            input_1.surface().surface_type(),
-        )?;
-
-        surface.modify(&mut |data, stride| {
-            for (x, y, _pixel) in Pixels::within(input_1.surface(), bounds) {
-                // Compute the kernel rectangle bounds.
-                let kernel_bounds = IRect::new(
-                    (f64::from(x) - rx).floor() as i32,
-                    (f64::from(y) - ry).floor() as i32,
-                    (f64::from(x) + rx).ceil() as i32 + 1,
-                    (f64::from(y) + ry).ceil() as i32 + 1,
-                );
-
-                // Compute the new pixel values.
-                let initial = match self.operator {
-                    Operator::Erode => u8::max_value(),
-                    Operator::Dilate => u8::min_value(),
-                };
-
-                let mut output_pixel = Pixel {
-                    r: initial,
-                    g: initial,
-                    b: initial,
-                    a: initial,
-                };
-
-                for (_x, _y, pixel) in PixelRectangle::within(
-                    &input_1.surface(),
-                    bounds,
-                    kernel_bounds,
-                    EdgeMode::None,
-                ) {
-                    let op = match self.operator {
-                        Operator::Erode => min,
-                        Operator::Dilate => max,
-                    };
-
-                    output_pixel.r = op(output_pixel.r, pixel.r);
-                    output_pixel.g = op(output_pixel.g, pixel.g);
-                    output_pixel.b = op(output_pixel.b, pixel.b);
-                    output_pixel.a = op(output_pixel.a, pixel.a);
-                }
-
-                data.set_pixel(stride, output_pixel, x, y);
-            }
-        });
-
-        Ok(FilterOutput {
-            surface: surface.share()?,
-            bounds,
-        })
+        //
+        // The window around each pixel goes from floor(x - rx) to ceil(x + rx), so it has
+        // ceil(rx) pixels on each side.  The cost of the operation does not depend on the
+        // radii, and they are clamped to the size of the bounds, so large radii are fine.
+        let rx = rx.abs().ceil() as usize;
+        let ry = ry.abs().ceil() as usize;
+
+        let surface = match self.operator {
+            Operator::Erode => input_1.surface().erode(bounds, rx, ry)?,
+            Operator::Dilate => input_1.surface().dilate(bounds, rx, ry)?,
+        };
+
+        Ok(FilterOutput { surface, bounds })
     }
 }
 
@@ -23,7 +23,7 @@ pub struct FeTile {
 /// Resolved `feTile` primitive for rendering.
 #[derive(Clone, Default)]
 pub struct Tile {
-    in1: Input,
+    pub in1: Input,
 }
 
 impl SetAttributes for FeTile {
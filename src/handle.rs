@@ -2,18 +2,28 @@
 //!
 //! This module provides the primitives on which the public APIs are implemented.
 
+use std::cell::RefCell;
+use std::rc::Rc;
+use std::sync::Arc;
+use std::time::Instant;
+
 use crate::accept_language::UserLanguage;
 use crate::bbox::BoundingBox;
+use crate::budget::RenderBudget;
 use crate::css::{Origin, Stylesheet};
-use crate::document::{AcquiredNodes, Document, NodeId};
+use crate::damage::{ExtentsRecorder, Restyled};
+use crate::document::{AcquiredNodes, Document, DocumentSnapshot, NodeId};
 use crate::dpi::Dpi;
 use crate::drawing_ctx::{draw_tree, with_saved_cr, DrawingMode, ViewParams};
 use crate::error::{DefsLookupErrorKind, LoadingError, RenderingError};
 use crate::length::*;
 use crate::node::{CascadedValues, Node, NodeBorrow};
 use crate::rect::Rect;
+use crate::stats::RenderStats;
 use crate::structure::IntrinsicDimensions;
+use crate::transform::Transform;
 use crate::url_resolver::{AllowedUrl, UrlResolver};
+use crate::xml::XmlPushLoader;
 
 /// Loading options for SVG documents.
 #[derive(Clone)]
@@ -26,6 +36,12 @@ pub struct LoadOptions {
 
     /// Whether to keep original (undecoded) image data to embed in Cairo PDF surfaces.
     pub keep_image_data: bool,
+
+    /// Whether to look up referenced documents and images in the shared resource cache.
+    pub use_shared_resource_cache: bool,
+
+    /// Whether to cache the results of filters between renderings.
+    pub cache_filter_results: bool,
 }
 
 impl LoadOptions {
@@ -35,6 +51,8 @@ impl LoadOptions {
             url_resolver,
             unlimited_size: false,
             keep_image_data: false,
+            use_shared_resource_cache: false,
+            cache_filter_results: false,
         }
     }
 
@@ -56,6 +74,22 @@ impl LoadOptions {
         self
     }
 
+    /// Sets whether referenced resources should be shared with other documents.
+    ///
+    /// See the `resource_cache` module for details.
+    pub fn with_shared_resource_cache(mut self, share: bool) -> Self {
+        self.use_shared_resource_cache = share;
+        self
+    }
+
+    /// Sets whether the results of filters should be cached between renderings.
+    ///
+    /// See the `filters::cache` module for details.
+    pub fn with_filter_result_cache(mut self, cache: bool) -> Self {
+        self.cache_filter_results = cache;
+        self
+    }
+
     /// Creates a new `LoadOptions` with a different `url resolver`.
     ///
     /// This is used when loading a referenced file that may in turn cause other files
@@ -68,10 +102,58 @@ impl LoadOptions {
             url_resolver,
             unlimited_size: self.unlimited_size,
             keep_image_data: self.keep_image_data,
+            use_shared_resource_cache: self.use_shared_resource_cache,
+            cache_filter_results: self.cache_filter_results,
         }
     }
 }
 
+/// Loads a `Handle` from data that arrives in chunks.
+///
+/// The document tree is built as the data gets written; `close()` finishes it.
+pub struct HandleLoader(XmlPushLoader);
+
+impl HandleLoader {
+    pub fn write(&mut self, buf: &[u8]) {
+        self.0.write(buf);
+    }
+
+    /// Computes the size in pixels of the document as soon as the start tag of its root
+    /// `<svg>` element has been parsed, or returns `None`.
+    ///
+    /// This is like `Handle::get_intrinsic_size_in_pixels()`, but styles have not been
+    /// cascaded yet, so sizes relative to the font size also return `None`.
+    pub fn get_intrinsic_size_in_pixels(&self, dpi: Dpi) -> Option<(f64, f64)> {
+        let root = self.0.root()?;
+
+        if !is_element_of_type!(root, Svg) {
+            return None;
+        }
+
+        let dimensions = borrow_element_as!(root, Svg).get_intrinsic_dimensions();
+
+        use crate::length::LengthUnit::*;
+
+        let units = [
+            dimensions.width.map(|l| l.unit),
+            dimensions.height.map(|l| l.unit),
+        ];
+
+        if units.iter().any(|u| matches!(u, Some(Em) | Some(Ex))) {
+            return None;
+        }
+
+        intrinsic_size_in_pixels(&root, &dimensions, dpi)
+    }
+
+    pub fn close(self, cancellable: Option<&gio::Cancellable>) -> Result<Handle, LoadingError> {
+        Ok(Handle {
+            document: self.0.close(cancellable)?,
+            user_stylesheet: None,
+        })
+    }
+}
+
 /// Main handle to an SVG document.
 ///
 /// This is the main object in librsvg.  It gets created with the [`from_stream`] method
@@ -80,6 +162,35 @@ impl LoadOptions {
 /// [`from_stream`]: #method.from_stream
 pub struct Handle {
     document: Document,
+
+    /// The CSS from the last call to `set_stylesheet`, to apply it again in a thawed snapshot.
+    user_stylesheet: Option<String>,
+}
+
+/// A copy of a loaded `Handle` that can be sent to and shared between threads.
+///
+/// See `DocumentSnapshot` for what this does and does not share.
+pub struct HandleSnapshot {
+    document: DocumentSnapshot,
+    user_stylesheet: Option<String>,
+}
+
+impl HandleSnapshot {
+    /// Builds a new `Handle` from the snapshot, with the same user stylesheet as the
+    /// original one.
+    pub fn thaw(&self) -> Result<Handle, LoadingError> {
+        let mut handle = Handle {
+            document: self.document.thaw()?,
+            user_stylesheet: None,
+        };
+
+        if let Some(ref css) = self.user_stylesheet {
+            handle.set_stylesheet(css)?;
+            handle.document.clear_restyled();
+        }
+
+        Ok(handle)
+    }
 }
 
 impl Handle {
@@ -91,9 +202,15 @@ impl Handle {
     ) -> Result<Handle, LoadingError> {
         Ok(Handle {
             document: Document::load_from_stream(load_options, stream, cancellable)?,
+            user_stylesheet: None,
         })
     }
 
+    /// Starts loading an SVG document from data that arrives in chunks.
+    pub fn push_loader(load_options: &LoadOptions) -> HandleLoader {
+        HandleLoader(Document::push_loader(load_options))
+    }
+
     /// Queries whether a document has a certain element `#foo`.
     ///
     /// The `id` must be an URL fragment identifier, i.e. something
@@ -114,31 +231,7 @@ impl Handle {
     /// If any of the width/height are percentages, we cannot compute the size here.  Here
     /// just normalize lengths with physical units, or units based on the font size.
     pub fn get_intrinsic_size_in_pixels(&self, dpi: Dpi) -> Option<(f64, f64)> {
-        let dimensions = self.get_intrinsic_dimensions();
-
-        if dimensions.width.is_none() || dimensions.height.is_none() {
-            // If either of width/height don't exist, the spec says they should default to 100%,
-            // which is a percentage-based unit - which we can't resolve here.
-            return None;
-        }
-
-        let w = dimensions.width.unwrap();
-        let h = dimensions.height.unwrap();
-
-        use crate::length::LengthUnit::*;
-
-        if w.unit == Percent || h.unit == Percent {
-            return None;
-        }
-
-        let view_params = ViewParams::new(dpi, 0.0, 0.0);
-        let root = self.document.root();
-        let cascaded = CascadedValues::new_from_node(&root);
-        let values = cascaded.get();
-
-        let params = NormalizeParams::new(&values, &view_params);
-
-        Some((w.to_user(&params), h.to_user(&params)))
+        intrinsic_size_in_pixels(&self.document.root(), &self.get_intrinsic_dimensions(), dpi)
     }
 
     fn get_node_or_root(&self, id: Option<&str>) -> Result<Node, RenderingError> {
@@ -170,6 +263,10 @@ impl Handle {
             dpi,
             true,
             is_testing,
+            None,
+            None,
+            None,
+            None,
             &mut AcquiredNodes::new(&self.document),
         )?;
 
@@ -233,8 +330,158 @@ impl Handle {
         user_language: &UserLanguage,
         dpi: Dpi,
         is_testing: bool,
+        tile_bleed: Option<f64>,
+        stats: Option<Rc<RefCell<RenderStats>>>,
+        budget: Option<Arc<RenderBudget>>,
     ) -> Result<(), RenderingError> {
-        self.render_layer(cr, None, viewport, user_language, dpi, is_testing)
+        self.render_layer(
+            cr,
+            None,
+            viewport,
+            user_language,
+            dpi,
+            is_testing,
+            tile_bleed,
+            stats,
+            budget,
+        )?;
+
+        self.document.clear_restyled();
+
+        Ok(())
+    }
+
+    /// Repaints the part of a previous rendering that changed since the document was restyled.
+    ///
+    /// Returns the repainted region in device space, or `None` if nothing changed.
+    pub fn render_damage(
+        &self,
+        cr: &cairo::Context,
+        viewport: &cairo::Rectangle,
+        user_language: &UserLanguage,
+        dpi: Dpi,
+        is_testing: bool,
+        tile_bleed: Option<f64>,
+        budget: Option<Arc<RenderBudget>>,
+    ) -> Result<Option<Rect>, RenderingError> {
+        cr.status()?;
+
+        let mut restyled = self.document.take_restyled();
+
+        if restyled.is_empty() {
+            return Ok(None);
+        }
+
+        let damage = if restyled.has_filtered_elements() {
+            None
+        } else {
+            let measure = |restyled: &Restyled| {
+                self.measure_extents(
+                    cr,
+                    viewport,
+                    user_language,
+                    dpi,
+                    is_testing,
+                    restyled,
+                    budget.clone(),
+                )
+            };
+
+            restyled.swap_values();
+            let before = measure(&restyled);
+            restyled.swap_values();
+
+            let after = measure(&restyled)?;
+
+            restyled.damage(&before?, &after)
+        };
+
+        let damage = match damage {
+            Some(rect) => rect,
+            None => {
+                let (x0, y0, x1, y1) = cr.clip_extents()?;
+                Transform::from(cr.matrix()).transform_rect(&Rect::new(x0, y0, x1, y1))
+            }
+        };
+
+        // Round out to whole pixels, with one more for antialiasing.
+        let damage = Rect::new(
+            damage.x0.floor() - 1.0,
+            damage.y0.floor() - 1.0,
+            damage.x1.ceil() + 1.0,
+            damage.y1.ceil() + 1.0,
+        );
+
+        with_saved_cr(cr, || {
+            let matrix = cr.matrix();
+
+            cr.identity_matrix();
+            cr.rectangle(damage.x0, damage.y0, damage.width(), damage.height());
+            cr.clip();
+
+            cr.set_operator(cairo::Operator::Clear);
+            cr.paint()?;
+            cr.set_operator(cairo::Operator::Over);
+
+            cr.set_matrix(matrix);
+
+            self.render_document(
+                cr,
+                viewport,
+                user_language,
+                dpi,
+                is_testing,
+                tile_bleed,
+                None,
+                budget,
+            )
+        })?;
+
+        Ok(Some(damage))
+    }
+
+    /// Draws the whole document without painting, to collect the extents of restyled elements.
+    fn measure_extents(
+        &self,
+        cr: &cairo::Context,
+        viewport: &cairo::Rectangle,
+        user_language: &UserLanguage,
+        dpi: Dpi,
+        is_testing: bool,
+        restyled: &Restyled,
+        budget: Option<Arc<RenderBudget>>,
+    ) -> Result<ExtentsRecorder, RenderingError> {
+        let target = cairo::ImageSurface::create(cairo::Format::Rgb24, 1, 1)?;
+        let measure_cr = cairo::Context::new(&target)?;
+        measure_cr.set_matrix(cr.matrix());
+
+        let root = self.document.root();
+        let extents = Rc::new(RefCell::new(restyled.recorder()));
+
+        draw_tree(
+            DrawingMode::LimitToStack {
+                node: root.clone(),
+                root,
+            },
+            &measure_cr,
+            Rect::from(*viewport),
+            user_language,
+            dpi,
+            true,
+            is_testing,
+            // Keeps temporary surfaces as small as the 1x1 target.
+            Some(0.0),
+            Some(extents.clone()),
+            None,
+            budget,
+            &mut AcquiredNodes::new(&self.document),
+        )?;
+
+        let extents = Rc::try_unwrap(extents)
+            .ok()
+            .expect("drawing context must not outlive the measurement");
+
+        Ok(extents.into_inner())
     }
 
     pub fn render_layer(
@@ -245,14 +492,21 @@ impl Handle {
         user_language: &UserLanguage,
         dpi: Dpi,
         is_testing: bool,
+        tile_bleed: Option<f64>,
+        stats: Option<Rc<RefCell<RenderStats>>>,
+        budget: Option<Arc<RenderBudget>>,
     ) -> Result<(), RenderingError> {
         cr.status()?;
 
+        let start = Instant::now();
+
         let node = self.get_node_or_root(id)?;
         let root = self.document.root();
 
         let viewport = Rect::from(*viewport);
 
+        let mut acquired_nodes = AcquiredNodes::new(&self.document);
+
         with_saved_cr(cr, || {
             draw_tree(
                 DrawingMode::LimitToStack { node, root },
@@ -262,10 +516,18 @@ impl Handle {
                 dpi,
                 false,
                 is_testing,
-                &mut AcquiredNodes::new(&self.document),
+                tile_bleed,
+                None,
+                stats.clone(),
+                budget,
+                &mut acquired_nodes,
             )
             .map(|_bbox| ())
-        })
+        })?;
+
+        record_totals(stats.as_ref(), start, &acquired_nodes);
+
+        Ok(())
     }
 
     fn get_bbox_for_element(
@@ -274,6 +536,7 @@ impl Handle {
         user_language: &UserLanguage,
         dpi: Dpi,
         is_testing: bool,
+        budget: Option<Arc<RenderBudget>>,
     ) -> Result<BoundingBox, RenderingError> {
         let target = cairo::ImageSurface::create(cairo::Format::Rgb24, 1, 1)?;
         let cr = cairo::Context::new(&target)?;
@@ -288,6 +551,10 @@ impl Handle {
             dpi,
             true,
             is_testing,
+            None,
+            None,
+            None,
+            budget,
             &mut AcquiredNodes::new(&self.document),
         )
     }
@@ -302,7 +569,7 @@ impl Handle {
     ) -> Result<(cairo::Rectangle, cairo::Rectangle), RenderingError> {
         let node = self.get_node_or_root(id)?;
 
-        let bbox = self.get_bbox_for_element(&node, user_language, dpi, is_testing)?;
+        let bbox = self.get_bbox_for_element(&node, user_language, dpi, is_testing, None)?;
 
         let ink_rect = bbox.ink_rect.unwrap_or_default();
         let logical_rect = bbox.rect.unwrap_or_default();
@@ -324,12 +591,18 @@ impl Handle {
         user_language: &UserLanguage,
         dpi: Dpi,
         is_testing: bool,
+        tile_bleed: Option<f64>,
+        stats: Option<Rc<RefCell<RenderStats>>>,
+        budget: Option<Arc<RenderBudget>>,
     ) -> Result<(), RenderingError> {
         cr.status()?;
 
+        let start = Instant::now();
+
         let node = self.get_node_or_root(id)?;
 
-        let bbox = self.get_bbox_for_element(&node, user_language, dpi, is_testing)?;
+        let bbox =
+            self.get_bbox_for_element(&node, user_language, dpi, is_testing, budget.clone())?;
 
         if bbox.ink_rect.is_none() || bbox.rect.is_none() {
             // Nothing to draw
@@ -344,6 +617,8 @@ impl Handle {
 
         // Render, transforming so element is at the new viewport's origin
 
+        let mut acquired_nodes = AcquiredNodes::new(&self.document);
+
         with_saved_cr(cr, || {
             let factor = (element_viewport.width / ink_r.width())
                 .min(element_viewport.height / ink_r.height());
@@ -360,10 +635,18 @@ impl Handle {
                 dpi,
                 false,
                 is_testing,
-                &mut AcquiredNodes::new(&self.document),
+                tile_bleed,
+                None,
+                stats.clone(),
+                budget,
+                &mut acquired_nodes,
             )
             .map(|_bbox| ())
-        })
+        })?;
+
+        record_totals(stats.as_ref(), start, &acquired_nodes);
+
+        Ok(())
     }
 
     pub fn get_intrinsic_dimensions(&self) -> IntrinsicDimensions {
@@ -374,8 +657,61 @@ impl Handle {
         let mut stylesheet = Stylesheet::new(Origin::User);
         stylesheet.parse(css, &UrlResolver::new(None))?;
         self.document.cascade(&[stylesheet]);
+        self.user_stylesheet = Some(css.to_string());
         Ok(())
     }
+
+    /// Copies the document into a snapshot from which other threads can build their own
+    /// `Handle`.
+    pub fn freeze(&self) -> HandleSnapshot {
+        HandleSnapshot {
+            document: self.document.freeze(),
+            user_stylesheet: self.user_stylesheet.clone(),
+        }
+    }
+}
+
+/// Adds the time since `start` and the number of acquired elements to `stats`, if given.
+fn record_totals(
+    stats: Option<&Rc<RefCell<RenderStats>>>,
+    start: Instant,
+    acquired_nodes: &AcquiredNodes<'_>,
+) {
+    if let Some(stats) = stats {
+        let mut stats = stats.borrow_mut();
+        stats.total_time += start.elapsed();
+        stats.referenced_elements += acquired_nodes.num_elements_acquired();
+    }
+}
+
+/// Computes the pixel size of a document's intrinsic dimensions, if they are not percentages.
+fn intrinsic_size_in_pixels(
+    root: &Node,
+    dimensions: &IntrinsicDimensions,
+    dpi: Dpi,
+) -> Option<(f64, f64)> {
+    if dimensions.width.is_none() || dimensions.height.is_none() {
+        // If either of width/height don't exist, the spec says they should default to 100%,
+        // which is a percentage-based unit - which we can't resolve here.
+        return None;
+    }
+
+    let w = dimensions.width.unwrap();
+    let h = dimensions.height.unwrap();
+
+    use crate::length::LengthUnit::*;
+
+    if w.unit == Percent || h.unit == Percent {
+        return None;
+    }
+
+    let view_params = ViewParams::new(dpi, 0.0, 0.0);
+    let cascaded = CascadedValues::new_from_node(root);
+    let values = cascaded.get();
+
+    let params = NormalizeParams::new(&values, &view_params);
+
+    Some((w.to_user(&params), h.to_user(&params)))
 }
 
 fn unit_rectangle() -> Rect {
@@ -8,6 +8,7 @@ use crate::aspect_ratio::AspectRatio;
 use crate::coord_units::CoordUnits;
 use crate::dasharray::Dasharray;
 use crate::document::AcquiredNodes;
+use crate::drawing_ctx::PathCache;
 use crate::element::Element;
 use crate::length::*;
 use crate::node::*;
@@ -37,6 +38,7 @@ use crate::unit_interval::UnitInterval;
 ///
 /// Here we store all the parameters that may lead to the decision to actually
 /// render an element as an isolated group.
+#[derive(Clone)]
 pub struct StackingContext {
     pub element_name: String,
     pub transform: Transform,
@@ -65,6 +67,7 @@ pub struct Stroke {
 /// involves knowing the bounding box of the path.
 pub struct Shape {
     pub path: Rc<Path>,
+    pub path_cache: Option<Rc<PathCache>>,
     pub is_visible: bool,
     pub paint_order: PaintOrder,
     pub stroke: Stroke,
@@ -106,6 +109,7 @@ pub struct TextSpan {
 }
 
 /// Font-related properties extracted from `ComputedValues`.
+#[derive(Clone, PartialEq)]
 pub struct FontProperties {
     pub xml_lang: XmlLang,
     pub writing_mode: WritingMode,
@@ -322,6 +322,11 @@ impl NormalizeParams {
         }
     }
 
+    /// The font size that `em` and `ex` units are relative to, in user-space units.
+    pub fn font_size(&self) -> f64 {
+        self.font_size
+    }
+
     /// Just used by rsvg-convert, where there is no font size nor viewport.
     pub fn from_dpi(dpi: Dpi) -> NormalizeParams {
         NormalizeParams {
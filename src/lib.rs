@@ -180,10 +180,12 @@ mod angle;
 mod api;
 mod aspect_ratio;
 mod bbox;
+mod budget;
 pub mod c_api;
 mod color;
 mod cond;
 mod css;
+mod damage;
 mod dasharray;
 mod document;
 mod dpi;
@@ -203,6 +205,7 @@ mod iri;
 mod layout;
 mod length;
 mod limits;
+mod lru;
 mod marker;
 mod paint_server;
 mod path_builder;
@@ -211,8 +214,10 @@ mod pattern;
 mod properties;
 mod property_defs;
 mod rect;
+mod resource_cache;
 mod shapes;
 mod space;
+mod stats;
 mod structure;
 mod style;
 pub mod surface_utils;
@@ -32,3 +32,37 @@ pub const MAX_REFERENCED_ELEMENTS: usize = 500_000;
 /// in an attempt to exhaust memory.  We don't allow loading more than
 /// this number of elements during the initial streaming load process.
 pub const MAX_LOADED_ELEMENTS: usize = 1_000_000;
+
+/// Maximum number of bytes kept in the shared resource cache of each thread.
+///
+/// When a `Loader` opts into the shared resource cache, decoded images and
+/// parsed external documents are kept around after their referencing
+/// document goes away, so that they can be reused by other documents.
+/// This limits how much memory those cached resources can take; the least
+/// recently used ones are dropped first.
+pub const MAX_SHARED_RESOURCE_CACHE_BYTES: usize = 256 * 1024 * 1024;
+
+/// Maximum number of bytes of filter results cached by each document.
+///
+/// When a `Loader` opts into caching filter results, the output of each
+/// filter is kept around so that rendering the same element again with the
+/// same source pixels does not have to run the filter primitives again.
+/// This limits how much memory those results can take; the least recently
+/// used ones are dropped first.
+pub const MAX_FILTER_RESULT_CACHE_BYTES: usize = 64 * 1024 * 1024;
+
+/// Maximum number of bytes of rendered pattern tiles to keep during a rendering
+///
+/// Shapes that are painted with the same pattern at the same scale share the
+/// tile with the pattern's contents, instead of rendering it again for each shape.
+/// This limits how much memory those tiles can take; the least recently used
+/// ones are dropped first.
+pub const MAX_PATTERN_TILE_CACHE_BYTES: usize = 32 * 1024 * 1024;
+
+/// Maximum number of shaped text layouts cached by each document.
+///
+/// Documents like maps and charts repeat the same labels with the same fonts
+/// many times, so each span's `pango::Layout` is kept around to be reused by
+/// other spans and by later renderings.  This limits how many layouts are
+/// kept; the least recently used ones are dropped first.
+pub const MAX_TEXT_LAYOUT_CACHE_ENTRIES: usize = 4096;
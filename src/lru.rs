@@ -0,0 +1,189 @@
+//! A bounded cache that drops the least recently used entries first.
+//!
+//! The caches of filter results, of rendered pattern tiles, of shaped text
+//! layouts, and of referenced resources all keep values that are expensive to
+//! compute, up to some budget.  Each entry has a size in whatever unit its
+//! cache is bounded by, for example bytes of pixels, or just 1 to bound the
+//! number of entries.  When inserting an entry makes the total size go over
+//! the budget, the entries that were used least recently are evicted until it
+//! fits again.
+
+use std::borrow::Borrow;
+use std::collections::{BTreeMap, HashMap};
+use std::hash::Hash;
+
+struct Entry<V> {
+    value: V,
+    size: usize,
+    last_used: u64,
+}
+
+pub struct LruCache<K, V> {
+    entries: HashMap<K, Entry<V>>,
+
+    /// Keys of the entries, by the time they were last used; the oldest comes first.
+    by_last_use: BTreeMap<u64, K>,
+
+    total_size: usize,
+    max_size: usize,
+
+    /// Incremented on every access.
+    clock: u64,
+}
+
+impl<K: Hash + Eq + Clone, V> LruCache<K, V> {
+    pub fn new(max_size: usize) -> LruCache<K, V> {
+        LruCache {
+            entries: HashMap::new(),
+            by_last_use: BTreeMap::new(),
+            total_size: 0,
+            max_size,
+            clock: 0,
+        }
+    }
+
+    /// Returns the value for `key`, and marks it as the most recently used one.
+    pub fn get<Q>(&mut self, key: &Q) -> Option<&V>
+    where
+        K: Borrow<Q>,
+        Q: Hash + Eq + ?Sized,
+    {
+        let entry = self.entries.get_mut(key)?;
+
+        self.clock += 1;
+
+        let key = self.by_last_use.remove(&entry.last_used).unwrap();
+        self.by_last_use.insert(self.clock, key);
+        entry.last_used = self.clock;
+
+        Some(&entry.value)
+    }
+
+    /// Inserts a value, replacing any previous one for the same key.
+    ///
+    /// Values larger than the cache's maximum size are not stored.
+    pub fn insert(&mut self, key: K, value: V, size: usize) {
+        self.remove(&key);
+
+        if size > self.max_size {
+            return;
+        }
+
+        self.clock += 1;
+        self.total_size += size;
+        self.by_last_use.insert(self.clock, key.clone());
+        self.entries.insert(
+            key,
+            Entry {
+                value,
+                size,
+                last_used: self.clock,
+            },
+        );
+
+        while self.total_size > self.max_size {
+            let oldest = *self.by_last_use.keys().next().unwrap();
+            let key = self.by_last_use.remove(&oldest).unwrap();
+            self.remove(&key);
+        }
+    }
+
+    pub fn remove<Q>(&mut self, key: &Q) -> Option<V>
+    where
+        K: Borrow<Q>,
+        Q: Hash + Eq + ?Sized,
+    {
+        let entry = self.entries.remove(key)?;
+
+        self.by_last_use.remove(&entry.last_used);
+        self.total_size -= entry.size;
+
+        Some(entry.value)
+    }
+
+    pub fn clear(&mut self) {
+        self.entries.clear();
+        self.by_last_use.clear();
+        self.total_size = 0;
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+
+    /// Sum of the sizes of all the entries.
+    pub fn total_size(&self) -> usize {
+        self.total_size
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn evicts_least_recently_used() {
+        let mut cache = LruCache::new(100);
+
+        cache.insert("a", 1, 40);
+        cache.insert("b", 2, 40);
+
+        assert_eq!(cache.get("a"), Some(&1));
+
+        cache.insert("c", 3, 40);
+
+        assert_eq!(cache.get("a"), Some(&1));
+        assert_eq!(cache.get("b"), None);
+        assert_eq!(cache.get("c"), Some(&3));
+        assert_eq!(cache.total_size(), 80);
+    }
+
+    #[test]
+    fn evicts_as_many_entries_as_needed() {
+        let mut cache = LruCache::new(100);
+
+        cache.insert("a", 1, 30);
+        cache.insert("b", 2, 30);
+        cache.insert("c", 3, 30);
+        cache.insert("d", 4, 70);
+
+        assert_eq!(cache.get("a"), None);
+        assert_eq!(cache.get("b"), None);
+        assert_eq!(cache.get("c"), Some(&3));
+        assert_eq!(cache.get("d"), Some(&4));
+        assert_eq!(cache.total_size(), 100);
+    }
+
+    #[test]
+    fn replaces_entries_with_the_same_key() {
+        let mut cache = LruCache::new(100);
+
+        cache.insert("a", 1, 40);
+        cache.insert("a", 2, 50);
+
+        assert_eq!(cache.get("a"), Some(&2));
+        assert_eq!(cache.total_size(), 50);
+    }
+
+    #[test]
+    fn does_not_store_oversized_entries() {
+        let mut cache = LruCache::new(100);
+
+        cache.insert("a", 1, 40);
+        cache.insert("a", 2, 101);
+
+        assert!(cache.is_empty());
+        assert_eq!(cache.total_size(), 0);
+    }
+
+    #[test]
+    fn clear_empties_cache() {
+        let mut cache = LruCache::new(100);
+
+        cache.insert("a", 1, 40);
+        cache.clear();
+
+        assert_eq!(cache.get("a"), None);
+        assert_eq!(cache.total_size(), 0);
+    }
+}
@@ -8,8 +8,13 @@
 //! Nodes are not constructed directly by callers;
 
 use markup5ever::QualName;
+use rctree::NodeEdge;
 use std::cell::{Ref, RefMut};
+use std::collections::VecDeque;
 use std::fmt;
+use std::mem;
+use std::rc::Rc;
+use std::time::Instant;
 
 use crate::bbox::BoundingBox;
 use crate::document::AcquiredNodes;
@@ -53,6 +58,20 @@ pub type WeakNode = rctree::WeakNode<NodeData>;
 /// spaces), and a single text node with "`Hello`" in it from the
 /// `<text>` element.
 ///
+/// Each node is a separate heap allocation, with pointers to its parent and
+/// siblings.  Nodes get handed out as long-lived references: `AcquiredNodes`, the
+/// `<use>` instancing code, text chunks, and the C API's `RsvgHandle` all hold on
+/// to a `Node` and expect it to stay valid, and to be able to walk up to its
+/// parent, independently of the document.  Walks over the whole document, like the
+/// cascade, go through an [`ElementTable`] instead, which keeps the elements in
+/// document order in contiguous arrays with `u32` indices to their parents.  The
+/// styles, which are the largest part of a node, are shared between elements with
+/// the same specified values (see `ElementTable::cascade`).
+///
+/// The table is only an index for those walks; the tree itself is not stored in an
+/// arena.  Loading a document still allocates each node separately, drawing still
+/// follows the `rctree` pointers, and a `Node` is not `Send`.
+///
 /// ## Accessing the node's contents
 ///
 /// Code that traverses the DOM tree needs to find out at runtime what
@@ -107,7 +126,7 @@ pub struct CascadedValues<'a> {
 
 enum CascadedInner<'a> {
     FromNode(Ref<'a, Element>),
-    FromValues(Box<ComputedValues>),
+    FromValues(Rc<ComputedValues>),
 }
 
 impl<'a> CascadedValues<'a> {
@@ -157,18 +176,26 @@ impl<'a> CascadedValues<'a> {
         fill: Option<PaintSource>,
         stroke: Option<PaintSource>,
     ) -> CascadedValues<'a> {
-        let mut v = Box::new(values.clone());
+        let mut v = values.clone();
         node.borrow_element()
             .get_specified_values()
             .to_computed_values(&mut v);
 
         CascadedValues {
-            inner: CascadedInner::FromValues(v),
+            inner: CascadedInner::FromValues(Rc::new(v)),
             context_fill: fill,
             context_stroke: stroke,
         }
     }
 
+    /// Whether these are the node's own computed values, not ones overridden by a `<use>`
+    /// or with context paints from a `<marker>`.
+    pub fn is_own_cascade(&self) -> bool {
+        matches!(self.inner, CascadedInner::FromNode(_))
+            && self.context_fill.is_none()
+            && self.context_stroke.is_none()
+    }
+
     /// Returns the cascaded `ComputedValues`.
     ///
     /// Nodes should use this from their `Draw::draw()` implementation to get the
@@ -176,7 +203,7 @@ impl<'a> CascadedValues<'a> {
     pub fn get(&'a self) -> &'a ComputedValues {
         match self.inner {
             CascadedInner::FromNode(ref e) => e.get_computed_values(),
-            CascadedInner::FromValues(ref v) => &*v,
+            CascadedInner::FromValues(ref v) => &**v,
         }
 
         // if values.fill == "context-fill" {
@@ -186,6 +213,17 @@ impl<'a> CascadedValues<'a> {
         //     values.stroke=self.context_stroke
         // }
     }
+
+    /// Returns the cascaded `ComputedValues` as a reference-counted value.
+    ///
+    /// This is for things that need to keep the values after the `CascadedValues` is gone,
+    /// like the spans of a text layout; it does not copy the values.
+    pub fn get_shared(&self) -> Rc<ComputedValues> {
+        match self.inner {
+            CascadedInner::FromNode(ref e) => e.get_shared_computed_values(),
+            CascadedInner::FromValues(ref v) => v.clone(),
+        }
+    }
 }
 
 /// Helper trait to get different NodeData variants
@@ -263,25 +301,177 @@ macro_rules! borrow_element_as {
     };
 }
 
-/// Helper trait for cascading recursively
-pub trait NodeCascade {
-    fn cascade(&mut self, values: &ComputedValues);
+/// The elements of a tree in document order, with the index of each one's parent.
+///
+/// Walking the `rctree` nodes visits every text node in between the elements, and
+/// follows a pointer to a separate allocation at each step.  The cascade only needs the
+/// elements and their parents, so the `Document` builds this table once after loading
+/// and walks its contiguous arrays instead.  The nodes still own their data; the table
+/// just refers to them by `u32` indices, which are enough for `limits::MAX_LOADED_ELEMENTS`.
+/// This is not an arena: it does not change how nodes are allocated or stored.
+pub struct ElementTable {
+    nodes: Vec<Node>,
+
+    /// Index of each element's parent in `nodes`; the root has `NO_PARENT`.
+    parents: Vec<u32>,
+
+    /// For each element, the index just past its last descendant in `nodes`.
+    subtree_ends: Vec<u32>,
 }
 
-impl NodeCascade for Node {
-    fn cascade(&mut self, values: &ComputedValues) {
-        let mut values = values.clone();
+const NO_PARENT: u32 = u32::MAX;
+
+impl ElementTable {
+    /// Builds the table for the elements in the subtree of `root`, which must be an element.
+    pub fn new(root: &Node) -> ElementTable {
+        let mut nodes = Vec::new();
+        let mut parents = Vec::new();
+        let mut subtree_ends = Vec::new();
+
+        // Indices of the elements whose end has not been reached yet.
+        let mut open = Vec::new();
+
+        for edge in root.traverse() {
+            match edge {
+                NodeEdge::Start(node) if node.is_element() => {
+                    let index = nodes.len() as u32;
+
+                    parents.push(open.last().copied().unwrap_or(NO_PARENT));
+                    subtree_ends.push(index);
+                    nodes.push(node);
+                    open.push(index);
+                }
+
+                NodeEdge::End(node) if node.is_element() => {
+                    let index = open.pop().unwrap();
+                    subtree_ends[index as usize] = nodes.len() as u32;
+                }
+
+                _ => (),
+            }
+        }
+
+        ElementTable {
+            nodes,
+            parents,
+            subtree_ends,
+        }
+    }
+
+    /// The elements in document order.
+    pub fn nodes(&self) -> &[Node] {
+        &self.nodes
+    }
+
+    /// Index of the parent of the element at `index`, or `None` for the root.
+    pub fn parent(&self, index: usize) -> Option<usize> {
+        match self.parents[index] {
+            NO_PARENT => None,
+            p => Some(p as usize),
+        }
+    }
+
+    /// Index just past the last descendant of the element at `index`.
+    pub fn subtree_end(&self, index: usize) -> usize {
+        self.subtree_ends[index] as usize
+    }
 
-        {
-            let mut elt = self.borrow_element_mut();
+    /// Number of bytes used by the table itself, not counting the nodes.
+    pub fn approximate_size(&self) -> usize {
+        self.nodes.capacity() * mem::size_of::<Node>()
+            + (self.parents.capacity() + self.subtree_ends.capacity()) * mem::size_of::<u32>()
+    }
 
-            elt.get_specified_values().to_computed_values(&mut values);
-            elt.set_computed_values(&values);
+    /// Computes the values of every element from its specified values and its parent's
+    /// computed values, starting with `values` for the root.
+    ///
+    /// Parents come before their children in document order, so their values are always
+    /// computed by the time a child needs them.
+    pub fn cascade(&self, values: &ComputedValues) {
+        let root_values = Rc::new(values.clone());
+        let mut cache = StyleSharingCache::default();
+        let mut computed: Vec<Rc<ComputedValues>> = Vec::with_capacity(self.nodes.len());
+
+        for (index, node) in self.nodes.iter().enumerate() {
+            let parent_values = match self.parent(index) {
+                Some(parent) => &computed[parent],
+                None => &root_values,
+            };
+
+            let values = cache.lookup(parent_values, node).unwrap_or_else(|| {
+                let mut values = (**parent_values).clone();
+                node.borrow_element()
+                    .get_specified_values()
+                    .to_computed_values(&mut values);
+
+                let values = Rc::new(values);
+                cache.insert(parent_values, node, &values);
+                values
+            });
+
+            node.borrow_element_mut()
+                .set_computed_values(values.clone());
+
+            computed.push(values);
         }
+    }
+}
+
+/// Number of recently computed styles that are kept in a `StyleSharingCache`.
+const STYLE_SHARING_CACHE_SIZE: usize = 16;
+
+/// Recently computed styles, to share them among elements during the cascade.
+///
+/// An element's computed values only depend on its parent's computed values and on its own
+/// specified values.  Siblings very often have the same specified values, so instead of
+/// computing and storing a copy for each of them, they share a single `Rc<ComputedValues>`.
+/// Since the parent's values are compared by pointer, the children of elements that share
+/// their values can share theirs in turn.
+#[derive(Default)]
+struct StyleSharingCache {
+    /// The most recently inserted entries are at the front.
+    entries: VecDeque<StyleSharingEntry>,
+}
 
-        for mut child in self.children().filter(|c| c.is_element()) {
-            child.cascade(&values);
+struct StyleSharingEntry {
+    parent_values: Rc<ComputedValues>,
+    node: Node,
+    values: Rc<ComputedValues>,
+}
+
+impl StyleSharingCache {
+    fn lookup(
+        &self,
+        parent_values: &Rc<ComputedValues>,
+        node: &Node,
+    ) -> Option<Rc<ComputedValues>> {
+        let element = node.borrow_element();
+        let specified = element.get_specified_values();
+
+        self.entries
+            .iter()
+            .find(|e| {
+                Rc::ptr_eq(&e.parent_values, parent_values)
+                    && *e.node.borrow_element().get_specified_values() == *specified
+            })
+            .map(|e| e.values.clone())
+    }
+
+    fn insert(
+        &mut self,
+        parent_values: &Rc<ComputedValues>,
+        node: &Node,
+        values: &Rc<ComputedValues>,
+    ) {
+        if self.entries.len() == STYLE_SHARING_CACHE_SIZE {
+            self.entries.pop_back();
         }
+
+        self.entries.push_front(StyleSharingEntry {
+            parent_values: parent_values.clone(),
+            node: node.clone(),
+            values: values.clone(),
+        });
     }
 }
 
@@ -313,7 +503,26 @@ impl NodeDraw for Node {
         clipping: bool,
     ) -> Result<BoundingBox, RenderingError> {
         match *self.borrow() {
-            NodeData::Element(ref e) => e.draw(self, acquired_nodes, cascaded, draw_ctx, clipping),
+            NodeData::Element(ref e) => {
+                draw_ctx.check_budget()?;
+
+                let start = if draw_ctx.collects_stats() {
+                    Some(Instant::now())
+                } else {
+                    None
+                };
+
+                let bbox = e.draw(self, acquired_nodes, cascaded, draw_ctx, clipping)?;
+                draw_ctx.record_extents(self, &bbox);
+
+                if let (Some(start), Some(id)) = (start, e.get_id()) {
+                    if let Some(mut stats) = draw_ctx.stats() {
+                        stats.record_element(id, start.elapsed());
+                    }
+                }
+
+                Ok(bbox)
+            }
             _ => Ok(draw_ctx.empty_bbox()),
         }
     }
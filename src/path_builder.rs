@@ -4,22 +4,23 @@
 //! module deals with this as follows:
 //!
 //! * The path parser pushes commands into a [`PathBuilder`].  This is a mutable,
-//! temporary storage for path data.
+//! temporary storage for path data, but it already uses the compact representation
+//! of packed commands and a separate array of coordinates.
 //!
-//! * Then, the [`PathBuilder`] gets turned into a long-term, immutable [`Path`] that has
-//! a more compact representation.
+//! * Then, the [`PathBuilder`] gets turned into a long-term, immutable [`Path`] that
+//! takes over that storage.
 //!
-//! The code tries to reduce work in the allocator, by using a [`TinyVec`] with space for at
-//! least 32 commands on the stack for `PathBuilder`; most paths in SVGs in the wild have
-//! fewer than 32 commands, and larger ones will spill to the heap.
+//! The code tries to reduce work in the allocator.  Since the `PathBuilder` already has
+//! the final representation, turning it into a `Path` only shrinks its two arrays to fit,
+//! instead of converting each command.  The arrays are not pre-sized from the path data;
+//! scanning the string beforehand took longer than the reallocations that it saved, even
+//! for path data that is megabytes long.
 //!
 //! See these blog posts for details and profiles:
 //!
 //! * [Compact representation for path data](https://people.gnome.org/~federico/blog/reducing-memory-consumption-in-librsvg-4.html)
 //! * [Reducing slack space and allocator work](https://people.gnome.org/~federico/blog/reducing-memory-consumption-in-librsvg-3.html)
 
-use tinyvec::TinyVec;
-
 use std::f64;
 use std::f64::consts::*;
 use std::slice;
@@ -335,26 +336,7 @@ pub enum PathCommand {
     ClosePath,
 }
 
-// This is just so we can use TinyVec, whose type parameter requires T: Default.
-// There is no actual default for path commands in the SVG spec; this is just our
-// implementation detail.
-enum_default!(
-    PathCommand,
-    PathCommand::CurveTo(CubicBezierCurve::default())
-);
-
 impl PathCommand {
-    /// Returns the number of coordinate values that this command will generate in a `Path`.
-    fn num_coordinates(&self) -> usize {
-        match *self {
-            PathCommand::MoveTo(..) => 2,
-            PathCommand::LineTo(..) => 2,
-            PathCommand::CurveTo(_) => 6,
-            PathCommand::Arc(_) => 7,
-            PathCommand::ClosePath => 0,
-        }
-    }
-
     /// Pushes a command's coordinates to `coords` and returns the corresponding `PackedCommand`.
     fn to_packed(&self, coords: &mut Vec<f64>) -> PackedCommand {
         match *self {
@@ -432,7 +414,8 @@ impl PathCommand {
 /// methods.
 #[derive(Default)]
 pub struct PathBuilder {
-    path_commands: TinyVec<[PathCommand; 32]>,
+    commands: Vec<PackedCommand>,
+    coords: Vec<f64>,
 }
 
 /// An immutable path with a compact representation.
@@ -502,33 +485,25 @@ impl PathBuilder {
 
     /// Consumes the `PathBuilder` and returns a compact, immutable representation as a `Path`.
     pub fn into_path(self) -> Path {
-        let num_coords = self
-            .path_commands
-            .iter()
-            .map(PathCommand::num_coordinates)
-            .sum();
-
-        let mut coords = Vec::with_capacity(num_coords);
-        let packed_commands: Vec<_> = self
-            .path_commands
-            .iter()
-            .map(|cmd| cmd.to_packed(&mut coords))
-            .collect();
-
         Path {
-            commands: packed_commands.into_boxed_slice(),
-            coords: coords.into_boxed_slice(),
+            commands: self.commands.into_boxed_slice(),
+            coords: self.coords.into_boxed_slice(),
         }
     }
 
+    fn push(&mut self, command: PathCommand) {
+        let packed = command.to_packed(&mut self.coords);
+        self.commands.push(packed);
+    }
+
     /// Adds a MoveTo command to the path.
     pub fn move_to(&mut self, x: f64, y: f64) {
-        self.path_commands.push(PathCommand::MoveTo(x, y));
+        self.push(PathCommand::MoveTo(x, y));
     }
 
     /// Adds a LineTo command to the path.
     pub fn line_to(&mut self, x: f64, y: f64) {
-        self.path_commands.push(PathCommand::LineTo(x, y));
+        self.push(PathCommand::LineTo(x, y));
     }
 
     /// Adds a CurveTo command to the path.
@@ -538,7 +513,7 @@ impl PathBuilder {
             pt2: (x3, y3),
             to: (x4, y4),
         };
-        self.path_commands.push(PathCommand::CurveTo(curve));
+        self.push(PathCommand::CurveTo(curve));
     }
 
     /// Adds an EllipticalArc command to the path.
@@ -562,12 +537,12 @@ impl PathBuilder {
             from: (x1, y1),
             to: (x2, y2),
         };
-        self.path_commands.push(PathCommand::Arc(arc));
+        self.push(PathCommand::Arc(arc));
     }
 
     /// Adds a ClosePath command to the path.
     pub fn close_path(&mut self) {
-        self.path_commands.push(PathCommand::ClosePath);
+        self.push(PathCommand::ClosePath);
     }
 }
 
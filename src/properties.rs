@@ -43,7 +43,7 @@ pub use crate::property_defs::*;
 ///
 /// `Specified` is a value given by the SVG or CSS stylesheet.  This will later be
 /// resolved into part of a `ComputedValues` struct.
-#[derive(Clone)]
+#[derive(Clone, PartialEq)]
 pub enum SpecifiedValue<T>
 where
     T: Property + Clone + Default,
@@ -87,7 +87,7 @@ impl PropertyId {
 }
 
 /// Holds the specified values for the CSS properties of an element.
-#[derive(Clone)]
+#[derive(Clone, PartialEq)]
 pub struct SpecifiedValues {
     indices: [u8; PropertyId::UnsetProperty as usize],
     props: Vec<ParsedProperty>,
@@ -209,7 +209,7 @@ macro_rules! make_properties {
         }
 
         /// Embodies "which property is this" plus the property's value
-        #[derive(Clone)]
+        #[derive(Clone, PartialEq)]
         pub enum ParsedProperty {
             // we put all the properties here; these are for SpecifiedValues
             $($short_name(SpecifiedValue<$short_name>),)+
@@ -233,7 +233,7 @@ macro_rules! make_properties {
         }
 
         /// Holds the computed values for the CSS properties of an element.
-        #[derive(Debug, Default, Clone)]
+        #[derive(Debug, Default, Clone, PartialEq)]
         pub struct ComputedValues {
             $(
                 $long_field: $long_name,
@@ -0,0 +1,303 @@
+//! Cache of referenced resources shared between documents.
+//!
+//! Each [`Document`] keeps its own table of the external SVG documents and
+//! images that it references, but those tables go away with the document, so
+//! every new handle would have to fetch and decode the same resources again.
+//! When a `Loader` opts in with `with_shared_resource_cache`, the
+//! documents that it creates look up their external documents and images
+//! in this cache first.
+//!
+//! Documents are trees of reference-counted nodes and cannot be sent across
+//! threads, so there is one cache per thread instead of one per process.  A
+//! worker thread that loads many documents benefits from it all the same.
+//!
+//! Entries are validated by their URL plus the modification time and size
+//! of the file they came from; `data:` URLs carry their content in the URL
+//! itself, so they are always valid.  Resources that cannot be validated
+//! this way, for example those loaded over the network, are not cached.
+//! The file is checked before and after loading it, and the resource is only
+//! cached if it did not change in between.
+//!
+//! The cache is bounded by the approximate number of bytes of its entries,
+//! and the least recently used entries are evicted first.  Images are
+//! charged the size of their pixels, and documents the estimate from
+//! `Document::approximate_size`.
+
+use gio::prelude::*;
+use std::cell::RefCell;
+use std::rc::Rc;
+
+use crate::document::Document;
+use crate::error::LoadingError;
+use crate::handle::LoadOptions;
+use crate::limits;
+use crate::lru::LruCache;
+use crate::surface_utils::shared_surface::SharedImageSurface;
+use crate::url_resolver::AllowedUrl;
+
+/// How to tell whether a cached resource is still current.
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+enum Validator {
+    /// The content is part of the URL itself, as for `data:` URLs.
+    Immutable,
+
+    /// Modification time and size of a local file.
+    File {
+        mtime: u64,
+        mtime_usec: u32,
+        size: i64,
+    },
+}
+
+impl Validator {
+    /// Computes the validator for a resource, or `None` if it cannot be validated.
+    fn for_url(aurl: &AllowedUrl) -> Option<Validator> {
+        match aurl.scheme() {
+            "data" => Some(Validator::Immutable),
+
+            "file" => {
+                let file = gio::File::for_uri(aurl.as_str());
+                let info = file
+                    .query_info(
+                        "time::modified,time::modified-usec,standard::size",
+                        gio::FileQueryInfoFlags::NONE,
+                        None::<&gio::Cancellable>,
+                    )
+                    .ok()?;
+
+                Some(Validator::File {
+                    mtime: info.attribute_uint64("time::modified"),
+                    mtime_usec: info.attribute_uint32("time::modified-usec"),
+                    size: info.size(),
+                })
+            }
+
+            _ => None,
+        }
+    }
+}
+
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Hash)]
+enum Kind {
+    Document,
+    Image,
+}
+
+/// Everything that determines the result of loading a resource.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+struct Key {
+    url: AllowedUrl,
+    kind: Kind,
+    unlimited_size: bool,
+    keep_image_data: bool,
+}
+
+impl Key {
+    fn new(aurl: &AllowedUrl, kind: Kind, load_options: &LoadOptions) -> Key {
+        Key {
+            url: aurl.clone(),
+            kind,
+            unlimited_size: load_options.unlimited_size,
+            keep_image_data: load_options.keep_image_data,
+        }
+    }
+}
+
+#[derive(Clone)]
+enum Resource {
+    Document(Rc<Document>),
+    Image(SharedImageSurface),
+}
+
+struct Entry {
+    validator: Validator,
+    resource: Resource,
+}
+
+struct ResourceCache(LruCache<Key, Entry>);
+
+impl ResourceCache {
+    fn new(max_size: usize) -> ResourceCache {
+        ResourceCache(LruCache::new(max_size))
+    }
+
+    fn get(&mut self, key: &Key, validator: Validator) -> Option<Resource> {
+        match self.0.get(key) {
+            Some(entry) if entry.validator == validator => Some(entry.resource.clone()),
+
+            Some(_) => {
+                // The file changed since we cached it; drop the old entry.
+                self.0.remove(key);
+                None
+            }
+
+            None => None,
+        }
+    }
+
+    fn insert(&mut self, key: Key, validator: Validator, resource: Resource, size: usize) {
+        self.0.insert(
+            key,
+            Entry {
+                validator,
+                resource,
+            },
+            size,
+        );
+    }
+}
+
+thread_local! {
+    static CACHE: RefCell<ResourceCache> =
+        RefCell::new(ResourceCache::new(limits::MAX_SHARED_RESOURCE_CACHE_BYTES));
+}
+
+/// Whether the resource still has the validator it had before loading it.
+///
+/// If a file is replaced while it is being loaded, we can't tell which version we
+/// got, so it must not be cached under either validator.
+fn unchanged_while_loading(aurl: &AllowedUrl, validator: Validator) -> bool {
+    Validator::for_url(aurl) == Some(validator)
+}
+
+/// Returns the external document at `aurl`, calling `load` if it is not in the cache already.
+///
+/// Errors are returned to the caller but not cached.
+pub fn lookup_document<F>(
+    load_options: &LoadOptions,
+    aurl: &AllowedUrl,
+    load: F,
+) -> Result<Rc<Document>, LoadingError>
+where
+    F: FnOnce() -> Result<Rc<Document>, LoadingError>,
+{
+    let validator = match Validator::for_url(aurl) {
+        Some(v) => v,
+        None => return load(),
+    };
+
+    let key = Key::new(aurl, Kind::Document, load_options);
+
+    // Don't hold the borrow while loading; loading a resource can cause other
+    // resources to be looked up.
+    if let Some(Resource::Document(doc)) = CACHE.with(|c| c.borrow_mut().get(&key, validator)) {
+        return Ok(doc);
+    }
+
+    let doc = load()?;
+
+    if unchanged_while_loading(aurl, validator) {
+        let size = doc.approximate_size();
+
+        CACHE.with(|c| {
+            c.borrow_mut()
+                .insert(key, validator, Resource::Document(doc.clone()), size)
+        });
+    }
+
+    Ok(doc)
+}
+
+/// Returns the decoded image at `aurl`, calling `load` if it is not in the cache already.
+///
+/// Errors are returned to the caller but not cached.
+pub fn lookup_image<F>(
+    load_options: &LoadOptions,
+    aurl: &AllowedUrl,
+    load: F,
+) -> Result<SharedImageSurface, LoadingError>
+where
+    F: FnOnce() -> Result<SharedImageSurface, LoadingError>,
+{
+    let validator = match Validator::for_url(aurl) {
+        Some(v) => v,
+        None => return load(),
+    };
+
+    let key = Key::new(aurl, Kind::Image, load_options);
+
+    if let Some(Resource::Image(surface)) = CACHE.with(|c| c.borrow_mut().get(&key, validator)) {
+        return Ok(surface);
+    }
+
+    let surface = load()?;
+
+    if unchanged_while_loading(aurl, validator) {
+        let size = surface.stride() as usize * surface.height() as usize;
+
+        CACHE.with(|c| {
+            c.borrow_mut()
+                .insert(key, validator, Resource::Image(surface.clone()), size)
+        });
+    }
+
+    Ok(surface)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::surface_utils::shared_surface::SurfaceType;
+    use crate::url_resolver::UrlResolver;
+    use url::Url;
+
+    fn key(href: &str) -> Key {
+        let resolver = UrlResolver::new(Some(Url::parse("file:///example/test.svg").unwrap()));
+        let aurl = resolver.resolve_href(href).unwrap();
+        Key::new(&aurl, Kind::Image, &LoadOptions::new(resolver))
+    }
+
+    fn image() -> Resource {
+        Resource::Image(SharedImageSurface::empty(1, 1, SurfaceType::SRgb).unwrap())
+    }
+
+    #[test]
+    fn evicts_least_recently_used() {
+        let mut cache = ResourceCache::new(100);
+
+        cache.insert(key("data:,a"), Validator::Immutable, image(), 40);
+        cache.insert(key("data:,b"), Validator::Immutable, image(), 40);
+
+        assert!(cache.get(&key("data:,a"), Validator::Immutable).is_some());
+
+        cache.insert(key("data:,c"), Validator::Immutable, image(), 40);
+
+        assert!(cache.get(&key("data:,a"), Validator::Immutable).is_some());
+        assert!(cache.get(&key("data:,b"), Validator::Immutable).is_none());
+        assert!(cache.get(&key("data:,c"), Validator::Immutable).is_some());
+        assert_eq!(cache.0.total_size(), 80);
+    }
+
+    #[test]
+    fn does_not_cache_oversized_entries() {
+        let mut cache = ResourceCache::new(100);
+
+        cache.insert(key("data:,a"), Validator::Immutable, image(), 101);
+
+        assert!(cache.get(&key("data:,a"), Validator::Immutable).is_none());
+        assert_eq!(cache.0.total_size(), 0);
+    }
+
+    #[test]
+    fn drops_stale_entries() {
+        let mut cache = ResourceCache::new(100);
+
+        let old = Validator::File {
+            mtime: 1,
+            mtime_usec: 0,
+            size: 10,
+        };
+
+        let new = Validator::File {
+            mtime: 2,
+            mtime_usec: 0,
+            size: 10,
+        };
+
+        cache.insert(key("file:///example/foo.png"), old, image(), 10);
+
+        assert!(cache.get(&key("file:///example/foo.png"), new).is_none());
+        assert!(cache.0.is_empty());
+        assert_eq!(cache.0.total_size(), 0);
+    }
+}
@@ -8,7 +8,7 @@ use std::rc::Rc;
 
 use crate::bbox::BoundingBox;
 use crate::document::AcquiredNodes;
-use crate::drawing_ctx::DrawingCtx;
+use crate::drawing_ctx::{DrawingCtx, PathCache};
 use crate::element::{Draw, ElementResult, SetAttributes};
 use crate::error::*;
 use crate::iri::Iri;
@@ -27,12 +27,28 @@ enum Markers {
 
 struct ShapeDef {
     path: Rc<SvgPath>,
+    path_cache: Option<Rc<PathCache>>,
     markers: Markers,
 }
 
 impl ShapeDef {
     fn new(path: Rc<SvgPath>, markers: Markers) -> ShapeDef {
-        ShapeDef { path, markers }
+        ShapeDef {
+            path,
+            path_cache: None,
+            markers,
+        }
+    }
+
+    /// Lets the shape keep its cairo path and extents between renderings.
+    ///
+    /// Only shapes whose `SvgPath` does not depend on the viewport should do this,
+    /// since the cache does not know about changes in the path itself.
+    fn with_cache(self, path_cache: Rc<PathCache>) -> ShapeDef {
+        ShapeDef {
+            path_cache: Some(path_cache),
+            ..self
+        }
     }
 }
 
@@ -115,6 +131,7 @@ macro_rules! impl_draw {
 
                 let shape = Shape {
                     path: shape_def.path,
+                    path_cache: shape_def.path_cache,
                     is_visible,
                     paint_order,
                     stroke,
@@ -225,6 +242,7 @@ fn make_ellipse(cx: f64, cy: f64, rx: f64, ry: f64) -> SvgPath {
 #[derive(Default)]
 pub struct Path {
     path: Rc<SvgPath>,
+    path_cache: Rc<PathCache>,
 }
 
 impl_draw!(Path);
@@ -241,6 +259,7 @@ impl SetAttributes for Path {
                     rsvg_log!("could not parse path: {}", e);
                 }
                 self.path = Rc::new(builder.into_path());
+                self.path_cache = Rc::default();
             }
         }
 
@@ -250,7 +269,7 @@ impl SetAttributes for Path {
 
 impl BasicShape for Path {
     fn make_shape(&self, _params: &NormalizeParams) -> ShapeDef {
-        ShapeDef::new(self.path.clone(), Markers::Yes)
+        ShapeDef::new(self.path.clone(), Markers::Yes).with_cache(self.path_cache.clone())
     }
 }
 
@@ -0,0 +1,299 @@
+//! Statistics collected while rendering a document.
+//!
+//! Applications that render documents from untrusted or unknown sources
+//! need to find out which parts of a document are expensive to render.
+//! `CairoRenderer::render_document_with_stats` collects a `RenderStats`
+//! during the rendering: the time spent in each element that has an `id`
+//! and in each kind of filter primitive, the number of bytes of temporary
+//! surfaces, the number of referenced elements, and the hits on the caches
+//! of filter results and pattern tiles.
+//!
+//! Nothing is collected when rendering normally, so there is no cost for
+//! applications that do not ask for statistics.
+
+use std::collections::BTreeMap;
+use std::fmt::Write;
+use std::time::Duration;
+
+use crate::limits;
+
+/// Statistics about a rendering, from [`CairoRenderer::render_document_with_stats`].
+///
+/// [`CairoRenderer::render_document_with_stats`]: struct.CairoRenderer.html#method.render_document_with_stats
+#[derive(Debug, Default, Clone, PartialEq)]
+pub struct RenderStats {
+    /// Wall time spent rendering.
+    pub total_time: Duration,
+
+    /// Number of bytes of all the temporary surfaces that were allocated.
+    ///
+    /// This includes the surfaces for groups with opacity, masks, filters and their
+    /// primitives, and pattern tiles.  Surfaces are often freed before others are
+    /// allocated, so this is more than the peak memory usage.
+    pub temporary_surface_bytes: usize,
+
+    /// Number of elements that were acquired by reference, for example through `<use>`
+    /// or `fill="url(#pattern)"`.
+    ///
+    /// Rendering fails if this goes above a fixed limit, to protect against documents
+    /// that reference an exponential number of elements.
+    pub referenced_elements: usize,
+
+    /// Statistics for each element with an `id` attribute, by its id.
+    pub elements: BTreeMap<String, ElementStats>,
+
+    /// Statistics for each kind of filter primitive, by its element name, like
+    /// `feGaussianBlur`.
+    pub filter_primitives: BTreeMap<String, PrimitiveStats>,
+}
+
+/// Statistics about an element with an `id` attribute.
+#[derive(Debug, Default, Clone, PartialEq)]
+pub struct ElementStats {
+    /// Wall time spent drawing the element, including its children.
+    pub time: Duration,
+
+    /// Number of times the element was drawn.
+    ///
+    /// This can be more than one for elements that are instanced with `<use>`, or
+    /// drawn as part of a pattern, mask or marker.
+    pub times_drawn: usize,
+
+    /// Number of times a cached result was reused instead of rendering the element.
+    ///
+    /// This counts reuses of a `<filter>`'s output or of a `<pattern>`'s tile.
+    pub cache_hits: usize,
+}
+
+/// Statistics about a kind of filter primitive.
+#[derive(Debug, Default, Clone, PartialEq)]
+pub struct PrimitiveStats {
+    /// Wall time spent rendering primitives of this kind.
+    pub time: Duration,
+
+    /// Number of times a primitive of this kind was rendered.
+    pub times_rendered: usize,
+
+    /// Number of bytes of the surfaces output by primitives of this kind.
+    pub output_bytes: usize,
+}
+
+impl RenderStats {
+    pub(crate) fn record_element(&mut self, id: &str, time: Duration) {
+        let element = self.element(id);
+        element.time += time;
+        element.times_drawn += 1;
+    }
+
+    pub(crate) fn record_cache_hit(&mut self, id: &str) {
+        self.element(id).cache_hits += 1;
+    }
+
+    pub(crate) fn record_primitive(&mut self, name: &str, time: Duration, output_bytes: usize) {
+        let primitive = self.filter_primitives.entry(name.to_string()).or_default();
+        primitive.time += time;
+        primitive.times_rendered += 1;
+        primitive.output_bytes += output_bytes;
+    }
+
+    pub(crate) fn record_temporary_surface(&mut self, width: i32, height: i32) {
+        self.temporary_surface_bytes += width.max(0) as usize * height.max(0) as usize * 4;
+    }
+
+    fn element(&mut self, id: &str) -> &mut ElementStats {
+        self.elements.entry(id.to_string()).or_default()
+    }
+
+    /// Adds the statistics of another rendering to these ones.
+    ///
+    /// This is useful to get the totals for a document that is rendered in several
+    /// parts, like tiles.
+    pub fn merge(&mut self, other: &RenderStats) {
+        self.total_time += other.total_time;
+        self.temporary_surface_bytes += other.temporary_surface_bytes;
+        self.referenced_elements += other.referenced_elements;
+
+        for (id, e) in &other.elements {
+            let element = self.element(id);
+            element.time += e.time;
+            element.times_drawn += e.times_drawn;
+            element.cache_hits += e.cache_hits;
+        }
+
+        for (name, p) in &other.filter_primitives {
+            let primitive = self.filter_primitives.entry(name.clone()).or_default();
+            primitive.time += p.time;
+            primitive.times_rendered += p.times_rendered;
+            primitive.output_bytes += p.output_bytes;
+        }
+    }
+
+    /// Formats the statistics as a JSON object.
+    ///
+    /// Times are in milliseconds.  Elements and filter primitives are sorted by name.
+    pub fn to_json(&self) -> String {
+        self.json(None)
+    }
+
+    /// Formats the statistics as a JSON object, with the name of the document that was rendered.
+    ///
+    /// The object has the same fields as for [`to_json`], preceded by an `"input"` field with
+    /// the name.  This lets tools tell apart the statistics for several documents.
+    ///
+    /// [`to_json`]: #method.to_json
+    pub fn to_json_for_input(&self, input: &str) -> String {
+        self.json(Some(input))
+    }
+
+    fn json(&self, input: Option<&str>) -> String {
+        let mut json = String::new();
+
+        json.push_str("{\n");
+        if let Some(input) = input {
+            writeln!(json, "  \"input\": {},", json_string(input)).unwrap();
+        }
+        writeln!(json, "  \"total_time_ms\": {},", millis(self.total_time)).unwrap();
+        writeln!(
+            json,
+            "  \"temporary_surface_bytes\": {},",
+            self.temporary_surface_bytes
+        )
+        .unwrap();
+        writeln!(
+            json,
+            "  \"referenced_elements\": {},",
+            self.referenced_elements
+        )
+        .unwrap();
+        writeln!(
+            json,
+            "  \"max_referenced_elements\": {},",
+            limits::MAX_REFERENCED_ELEMENTS
+        )
+        .unwrap();
+
+        json.push_str("  \"elements\": {");
+        for (i, (id, e)) in self.elements.iter().enumerate() {
+            write!(
+                json,
+                "{}\n    {}: {{ \"time_ms\": {}, \"times_drawn\": {}, \"cache_hits\": {} }}",
+                if i == 0 { "" } else { "," },
+                json_string(id),
+                millis(e.time),
+                e.times_drawn,
+                e.cache_hits
+            )
+            .unwrap();
+        }
+        json.push_str(if self.elements.is_empty() {
+            "},\n"
+        } else {
+            "\n  },\n"
+        });
+
+        json.push_str("  \"filter_primitives\": {");
+        for (i, (name, p)) in self.filter_primitives.iter().enumerate() {
+            write!(
+                json,
+                "{}\n    {}: {{ \"time_ms\": {}, \"times_rendered\": {}, \"output_bytes\": {} }}",
+                if i == 0 { "" } else { "," },
+                json_string(name),
+                millis(p.time),
+                p.times_rendered,
+                p.output_bytes
+            )
+            .unwrap();
+        }
+        json.push_str(if self.filter_primitives.is_empty() {
+            "}\n"
+        } else {
+            "\n  }\n"
+        });
+
+        json.push_str("}\n");
+
+        json
+    }
+}
+
+fn millis(d: Duration) -> f64 {
+    d.as_secs_f64() * 1000.0
+}
+
+fn json_string(s: &str) -> String {
+    let mut json = String::with_capacity(s.len() + 2);
+
+    json.push('"');
+
+    for c in s.chars() {
+        match c {
+            '"' => json.push_str("\\\""),
+            '\\' => json.push_str("\\\\"),
+            '\n' => json.push_str("\\n"),
+            '\r' => json.push_str("\\r"),
+            '\t' => json.push_str("\\t"),
+            c if (c as u32) < 0x20 => write!(json, "\\u{:04x}", c as u32).unwrap(),
+            c => json.push(c),
+        }
+    }
+
+    json.push('"');
+
+    json
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn escapes_json_strings() {
+        assert_eq!(json_string("foo"), "\"foo\"");
+        assert_eq!(json_string("a\"b\\c\nd\u{1}"), "\"a\\\"b\\\\c\\nd\\u0001\"");
+    }
+
+    #[test]
+    fn merges_stats() {
+        let mut a = RenderStats::default();
+        a.record_element("foo", Duration::from_millis(2));
+        a.record_primitive("feFlood", Duration::from_millis(1), 16);
+
+        let mut b = RenderStats::default();
+        b.record_element("foo", Duration::from_millis(3));
+        b.record_cache_hit("bar");
+        b.record_temporary_surface(2, 2);
+
+        a.merge(&b);
+
+        assert_eq!(
+            a.elements["foo"],
+            ElementStats {
+                time: Duration::from_millis(5),
+                times_drawn: 2,
+                cache_hits: 0,
+            }
+        );
+        assert_eq!(a.elements["bar"].cache_hits, 1);
+        assert_eq!(a.filter_primitives["feFlood"].output_bytes, 16);
+        assert_eq!(a.temporary_surface_bytes, 16);
+    }
+
+    #[test]
+    fn formats_json() {
+        let mut stats = RenderStats::default();
+        stats.record_cache_hit("pat");
+
+        let json = stats.to_json();
+
+        assert!(json.contains("\"temporary_surface_bytes\": 0,"));
+        assert!(json.contains("\"pat\": { \"time_ms\": 0, \"times_drawn\": 0, \"cache_hits\": 1 }"));
+        assert!(json.contains("\"filter_primitives\": {}\n"));
+    }
+
+    #[test]
+    fn json_starts_with_input() {
+        let json = RenderStats::default().to_json_for_input("dir/foo\".svg");
+
+        assert!(json.starts_with("{\n  \"input\": \"dir/foo\\\".svg\",\n  \"total_time_ms\": "));
+    }
+}
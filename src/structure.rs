@@ -6,7 +6,7 @@ use crate::aspect_ratio::*;
 use crate::bbox::BoundingBox;
 use crate::coord_units::CoordUnits;
 use crate::document::{AcquiredNodes, NodeId};
-use crate::drawing_ctx::{ClipMode, DrawingCtx, ViewParams};
+use crate::drawing_ctx::{ClipMode, DrawingCtx, LayerCache, ViewParams};
 use crate::element::{Draw, ElementResult, SetAttributes};
 use crate::error::*;
 use crate::href::{is_href, set_href};
@@ -19,7 +19,16 @@ use crate::viewbox::*;
 use crate::xml::Attributes;
 
 #[derive(Default)]
-pub struct Group();
+pub struct Group {
+    layer_cache: LayerCache,
+}
+
+impl Group {
+    /// Forgets the extents of the group's contents, after the document is restyled.
+    pub fn clear_layer_cache(&self) {
+        self.layer_cache.clear();
+    }
+}
 
 impl SetAttributes for Group {}
 
@@ -37,12 +46,12 @@ impl Draw for Group {
         let elt = node.borrow_element();
         let stacking_ctx = StackingContext::new(acquired_nodes, &elt, values.transform(), values);
 
-        draw_ctx.with_discrete_layer(
+        draw_ctx.with_cached_layer(
+            &self.layer_cache,
+            cascaded,
             &stacking_ctx,
             acquired_nodes,
-            values,
             clipping,
-            None,
             &mut |an, dc| node.draw_children(an, cascaded, dc, clipping),
         )
     }
@@ -78,6 +87,10 @@ impl Draw for Switch {
         let elt = node.borrow_element();
         let stacking_ctx = StackingContext::new(acquired_nodes, &elt, values.transform(), values);
 
+        // The child that gets drawn depends on the user's language, which the bounding
+        // boxes of enclosing groups are not cached for.
+        draw_ctx.mark_uncacheable();
+
         draw_ctx.with_discrete_layer(
             &stacking_ctx,
             acquired_nodes,
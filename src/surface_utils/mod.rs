@@ -4,8 +4,15 @@ use std::mem;
 use std::ops::DerefMut;
 use std::slice;
 
+use once_cell::sync::Lazy;
+use rayon::prelude::*;
+use rgb::FromSlice;
+
+use self::simd::AlphaTable;
+
 pub mod iterators;
 pub mod shared_surface;
+pub mod simd;
 pub mod srgb;
 
 // These two are for Cairo's platform-endian 0xaarrggbb pixels
@@ -84,23 +91,28 @@ pub trait PixelOps {
     fn from_u32(x: u32) -> Self;
 }
 
+/// Unpremultiplied components, indexed by alpha and then by the premultiplied component.
+///
+/// Unpremultiplying needs a division per component, which is a lot slower than a lookup in
+/// this table.  The row for zero alpha is all zeros, which gives a transparent black pixel.
+static UNPREMULTIPLY: Lazy<AlphaTable> = Lazy::new(|| {
+    AlphaTable::new(|a, x| {
+        if a == 0 {
+            0
+        } else {
+            let alpha = f32::from(a) / 255.0;
+            ((f32::from(x) / alpha) + 0.5) as u8
+        }
+    })
+});
+
 impl PixelOps for Pixel {
     /// Returns an unpremultiplied value of this pixel.
     ///
     /// For a fully transparent pixel, a transparent black pixel will be returned.
     #[inline]
     fn unpremultiply(self) -> Self {
-        if self.a == 0 {
-            Self {
-                r: 0,
-                g: 0,
-                b: 0,
-                a: 0,
-            }
-        } else {
-            let alpha = f32::from(self.a) / 255.0;
-            self.map_rgb(|x| ((f32::from(x) / alpha) + 0.5) as u8)
-        }
+        UNPREMULTIPLY.map(self)
     }
 
     /// Returns a premultiplied value of this pixel.
@@ -177,11 +189,69 @@ impl PixelOps for Pixel {
 impl<'a> ImageSurfaceDataExt for cairo::ImageSurfaceData<'a> {}
 impl<'a> ImageSurfaceDataExt for &'a mut [u8] {}
 
+/// Converts rows of pixels in the `cairo::Format::ARgb32` format to R, G, B, A bytes, in place.
+///
+/// If `unpremultiply` is true, the pixels are also converted to unpremultiplied alpha,
+/// as in a `GdkPixbuf`.  The padding at the end of each row is left untouched.
+pub fn argb32_to_rgba_in_place(
+    data: &mut [u8],
+    width: usize,
+    height: usize,
+    stride: usize,
+    unpremultiply: bool,
+) {
+    if unpremultiply {
+        // The table lookups cannot write over their own input, so each row is copied first.
+        data.par_chunks_mut(stride).take(height).for_each_init(
+            || Vec::with_capacity(width),
+            |src: &mut Vec<CairoARGB>, row| {
+                let row = &mut row[..width * 4];
+
+                src.clear();
+                src.extend_from_slice(row.as_cairo_argb());
+                UNPREMULTIPLY.map_row_to_rgba(src, row.as_rgba_mut());
+            },
+        );
+    } else {
+        data.par_chunks_mut(stride).take(height).for_each(|row| {
+            for p in row[..width * 4].chunks_exact_mut(4) {
+                let pixel = Pixel::from_u32(u32::from_ne_bytes([p[0], p[1], p[2], p[3]]));
+
+                p.copy_from_slice(&[pixel.r, pixel.g, pixel.b, pixel.a]);
+            }
+        });
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
     use proptest::prelude::*;
 
+    #[test]
+    fn argb32_to_rgba_in_place_converts_only_pixels() {
+        let pixel = Pixel::new(0x20, 0x40, 0x60, 0x80);
+
+        let mut data = Vec::new();
+        for _ in 0..2 {
+            data.extend_from_slice(&pixel.to_u32().to_ne_bytes());
+            data.extend_from_slice(&[0xaa; 4]);
+        }
+
+        let mut premultiplied = data.clone();
+        argb32_to_rgba_in_place(&mut premultiplied, 1, 2, 8, false);
+        assert_eq!(
+            premultiplied,
+            [0x20, 0x40, 0x60, 0x80, 0xaa, 0xaa, 0xaa, 0xaa].repeat(2)
+        );
+
+        let u = pixel.unpremultiply();
+        let mut unpremultiplied = data;
+        argb32_to_rgba_in_place(&mut unpremultiplied, 1, 2, 8, true);
+        assert_eq!(&unpremultiplied[..4], &[u.r, u.g, u.b, u.a]);
+        assert_eq!(&unpremultiplied[4..8], &[0xaa; 4]);
+    }
+
     #[test]
     fn pixel_diff() {
         let a = Pixel::new(0x10, 0x20, 0xf0, 0x40);
@@ -196,6 +266,16 @@ mod tests {
         pixel.map_rgb(|x| ((f64::from(x) * alpha) + 0.5) as u8)
     }
 
+    // Floating-point reference implementation
+    fn unpremultiply_float(pixel: Pixel) -> Pixel {
+        if pixel.a == 0 {
+            Pixel::default()
+        } else {
+            let alpha = f32::from(pixel.a) / 255.0;
+            pixel.map_rgb(|x| ((f32::from(x) / alpha) + 0.5) as u8)
+        }
+    }
+
     prop_compose! {
         fn arbitrary_pixel()(a: u8, r: u8, g: u8, b: u8) -> Pixel {
             Pixel { r, g, b, a }
@@ -208,6 +288,11 @@ mod tests {
             prop_assert_eq!(pixel.premultiply(), premultiply_float(pixel));
         }
 
+        #[test]
+        fn pixel_unpremultiply_matches_float(pixel in arbitrary_pixel()) {
+            prop_assert_eq!(pixel.unpremultiply(), unpremultiply_float(pixel));
+        }
+
         #[test]
         fn pixel_unpremultiply(pixel in arbitrary_pixel()) {
             let roundtrip = pixel.premultiply().unpremultiply();
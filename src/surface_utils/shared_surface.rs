@@ -1,13 +1,16 @@
 //! Shared access to Cairo image surfaces.
-use std::cmp::min;
+use std::cmp::{max, min};
+use std::hash::{Hash, Hasher};
 use std::marker::PhantomData;
 use std::ptr::NonNull;
 use std::slice;
 
 use gdk_pixbuf::{Colorspace, Pixbuf};
 use nalgebra::{storage::Storage, Dim, Matrix};
+use rayon::prelude::*;
 use rgb::FromSlice;
 
+use crate::budget::SurfaceAllocation;
 use crate::rect::{IRect, Rect};
 use crate::surface_utils::srgb;
 use crate::unit_interval::UnitInterval;
@@ -15,9 +18,12 @@ use crate::util::clamp;
 
 use super::{
     iterators::{PixelRectangle, Pixels},
-    AsCairoARGB, CairoARGB, EdgeMode, ImageSurfaceDataExt, Pixel, PixelOps,
+    simd, AsCairoARGB, CairoARGB, EdgeMode, ImageSurfaceDataExt, Pixel, PixelOps, UNPREMULTIPLY,
 };
 
+/// Width in pixels of the bands of columns that vertical box blurs compute in parallel.
+const VERTICAL_BOX_BLUR_BAND_WIDTH: usize = 64;
+
 /// Types of pixel data in a `ImageSurface`.
 #[derive(Debug, Clone, Copy, Eq, PartialEq, Hash)]
 pub enum SurfaceType {
@@ -149,6 +155,75 @@ pub struct Rows<'a> {
     next_row: i32,
 }
 
+/// Buffers for computing a running minimum or maximum along a line of pixels.
+#[derive(Default)]
+struct MinMaxScratch {
+    /// The input pixels.
+    line: Vec<Pixel>,
+
+    /// Channel-wise extremum from the start of each block up to each pixel.
+    prefix: Vec<Pixel>,
+
+    /// Channel-wise extremum from each pixel up to the end of its block.
+    suffix: Vec<Pixel>,
+}
+
+impl MinMaxScratch {
+    /// Computes `op` over a window of `radius` pixels on each side of every pixel in `self.line`.
+    ///
+    /// Pixels beyond the ends of the line are taken to be transparent black.
+    ///
+    /// This is the van Herk/Gil-Werman algorithm.  The padded line is split into blocks as
+    /// long as the window, so every window spans the end of one block and the start of the
+    /// next one.  With the running extremum from the start of each block, and the one up to
+    /// the end of each block, each output pixel needs a single `op`, no matter the radius.
+    fn run(&mut self, radius: usize, op: fn(u8, u8) -> u8, output: &mut [Pixel]) {
+        let n = self.line.len();
+        let window = 2 * radius + 1;
+        let padded_len = n + 2 * radius;
+
+        assert_eq!(output.len(), n);
+
+        let line = &self.line;
+        let padded = (0..padded_len).map(|i| {
+            if i >= radius && i < radius + n {
+                line[i - radius]
+            } else {
+                Pixel::default()
+            }
+        });
+
+        let combine = |a: Pixel, b: Pixel| Pixel {
+            r: op(a.r, b.r),
+            g: op(a.g, b.g),
+            b: op(a.b, b.b),
+            a: op(a.a, b.a),
+        };
+
+        self.prefix.clear();
+        self.prefix.extend(padded.clone());
+
+        self.suffix.clear();
+        self.suffix.extend(padded);
+
+        for i in 1..padded_len {
+            if i % window != 0 {
+                self.prefix[i] = combine(self.prefix[i - 1], self.prefix[i]);
+            }
+        }
+
+        for i in (0..padded_len - 1).rev() {
+            if (i + 1) % window != 0 {
+                self.suffix[i] = combine(self.suffix[i + 1], self.suffix[i]);
+            }
+        }
+
+        for (i, o) in output.iter_mut().enumerate() {
+            *o = combine(self.suffix[i], self.prefix[i + window - 1]);
+        }
+    }
+}
+
 /// Iterator over the mutable rows of an `ExclusiveImageSurface`.
 pub struct RowsMut<'a> {
     // Keep an ImageSurfaceData here instead of a raw mutable pointer to the bytes,
@@ -188,6 +263,11 @@ impl<T> ImageSurface<T> {
     pub fn stride(&self) -> isize {
         self.stride
     }
+
+    /// Keeps an allocation from a rendering's budget until the surface is freed.
+    pub fn attach_allocation(&self, allocation: SurfaceAllocation) {
+        allocation.attach_to(&self.surface);
+    }
 }
 
 impl ImageSurface<Shared> {
@@ -301,10 +381,9 @@ impl ImageSurface<Shared> {
 
         if has_alpha {
             pixbuf_rows
-                .map(|row| row.as_rgba())
+                .map(|row| &row.as_rgba()[..width as usize])
                 .zip(surf.rows_mut())
-                .flat_map(|(src_row, dest_row)| src_row.iter().zip(dest_row.iter_mut()))
-                .for_each(|(src, dest)| *dest = src.premultiply().into());
+                .for_each(|(src_row, dest_row)| simd::premultiply_row(src_row, dest_row));
         } else {
             pixbuf_rows
                 .map(|row| row.as_rgb())
@@ -339,10 +418,9 @@ impl ImageSurface<Shared> {
         pixbuf_data
             .chunks_mut(stride)
             .take(height as usize)
-            .map(|row| row.as_rgba_mut())
+            .map(|row| &mut row.as_rgba_mut()[..width as usize])
             .zip(self.rows())
-            .flat_map(|(dest_row, src_row)| src_row.iter().zip(dest_row.iter_mut()))
-            .for_each(|(src, dest)| *dest = Pixel::from(*src).unpremultiply());
+            .for_each(|(dest_row, src_row)| UNPREMULTIPLY.map_row_to_rgba(src_row, dest_row));
 
         Some(pixbuf)
     }
@@ -527,9 +605,16 @@ impl ImageSurface<Shared> {
         let stride = output_surface.stride() as usize;
         {
             let mut data = output_surface.data().unwrap();
-
-            for (x, y, pixel) in Pixels::within(self, bounds) {
-                data.set_pixel(stride, pixel.unpremultiply(), x, y);
+            let (x0, x1) = (bounds.x0 as usize, bounds.x1 as usize);
+
+            for (y, src) in self
+                .rows()
+                .enumerate()
+                .take(bounds.y1 as usize)
+                .skip(bounds.y0 as usize)
+            {
+                let dst = &mut data[y * stride..][x0 * 4..x1 * 4];
+                UNPREMULTIPLY.map_row(&src[x0..x1], dst.as_cairo_argb_mut());
             }
         }
 
@@ -683,15 +768,15 @@ impl ImageSurface<Shared> {
 
         {
             // The following code is needed for a parallel implementation of the blur loop. The
-            // blurring is done either for each row or for each column of pixels, depending on the
-            // value of `vertical`, independently of the others. Naturally, we want to run the
-            // outer loop on a thread pool.
+            // blurring is done either for each row or for each band of columns of pixels,
+            // depending on the value of `vertical`, independently of the others. Naturally, we
+            // want to run the outer loop on a thread pool.
             //
             // The case of `vertical == false` is simple since the input image slice can be
             // partitioned into chunks for each row of pixels and processed in parallel with rayon.
             // The case of `vertical == true`, however, is more involved because we can't just make
-            // mutable slices for all pixel columns (they would be overlapping which is forbidden
-            // by the aliasing rules).
+            // mutable slices for all bands of columns (they would be overlapping which is
+            // forbidden by the aliasing rules).
             //
             // This is where the following struct comes into play: it stores a sub-slice of the
             // pixel data and can be split at any row or column into two parts (similar to
@@ -727,22 +812,15 @@ impl ImageSurface<Shared> {
                     }
                 }
 
-                /// Sets a pixel value at the given coordinates.
+                /// Returns the pixels of row `y`.
                 #[inline]
-                fn set_pixel(&mut self, pixel: Pixel, x: u32, y: u32) {
-                    assert!(x < self.width);
+                fn row_mut(&mut self, y: u32) -> &mut [CairoARGB] {
                     assert!(y < self.height);
 
-                    let value = pixel.to_u32();
-
-                    #[allow(clippy::cast_ptr_alignment)]
                     unsafe {
-                        let ptr = self
-                            .ptr
-                            .as_ptr()
-                            .offset(y as isize * self.stride + x as isize * 4)
-                            as *mut u32;
-                        *ptr = value;
+                        let row_ptr = self.ptr.as_ptr().offset(y as isize * self.stride);
+                        slice::from_raw_parts_mut(row_ptr, self.width as usize * 4)
+                            .as_cairo_argb_mut()
                     }
                 }
 
@@ -807,32 +885,6 @@ impl ImageSurface<Shared> {
 
             let output_data = unsafe { UnsafeSendPixelData::new(output_surface) };
 
-            // Shift is target into the opposite direction.
-            let shift = (kernel_size - target) as i32;
-            let target = target as i32;
-
-            // Convert to f64 once since we divide by it.
-            let kernel_size_f64 = kernel_size as f64;
-            let compute = |x: u32| (f64::from(x) / kernel_size_f64 + 0.5) as u8;
-
-            // Depending on `vertical`, we're blurring either horizontally line-by-line, or
-            // vertically column-by-column. In the code below, the main axis is the axis along
-            // which the blurring happens (so if `vertical` is false, the main axis is the
-            // horizontal axis). The other axis is the outer loop axis. The code uses `i` and `j`
-            // for the other axis and main axis coordinates, respectively.
-            let (main_axis_min, main_axis_max, other_axis_min, other_axis_max) = if B::IS_VERTICAL {
-                (bounds.y0, bounds.y1, bounds.x0, bounds.x1)
-            } else {
-                (bounds.x0, bounds.x1, bounds.y0, bounds.y1)
-            };
-
-            // Helper function for getting the pixels.
-            let pixel = |i, j| {
-                let (x, y) = if B::IS_VERTICAL { (i, j) } else { (j, i) };
-
-                self.get_pixel(x as u32, y as u32)
-            };
-
             // The following loop assumes the first row or column of `output_data` is the first row
             // or column inside `bounds`.
             let mut output_data = if B::IS_VERTICAL {
@@ -841,110 +893,70 @@ impl ImageSurface<Shared> {
                 output_data.split_at_row(bounds.y0 as u32).1
             };
 
+            let (x0, x1) = (bounds.x0 as usize, bounds.x1 as usize);
+
             rayon::scope(|s| {
-                for i in other_axis_min..other_axis_max {
-                    // Split off one row or column and launch its processing on another thread.
-                    // Thanks to the initial split before the loop, there's no special case for the
-                    // very first split.
-                    let (mut current, remaining) = if B::IS_VERTICAL {
-                        output_data.split_at_column(1)
-                    } else {
-                        output_data.split_at_row(1)
-                    };
+                if B::IS_VERTICAL {
+                    // Columns are blurred in bands, going down all the rows at once, so that
+                    // the pixels are read and written a row at a time.
+                    for band_x0 in (x0..x1).step_by(VERTICAL_BOX_BLUR_BAND_WIDTH) {
+                        let band_x1 = min(x1, band_x0 + VERTICAL_BOX_BLUR_BAND_WIDTH);
 
-                    output_data = remaining;
-
-                    s.spawn(move |_| {
-                        // Helper function for setting the pixels.
-                        let mut set_pixel = |j, pixel| {
-                            // We're processing rows or columns one-by-one, so the other coordinate
-                            // is always 0.
-                            let (x, y) = if B::IS_VERTICAL { (0, j) } else { (j, 0) };
-                            current.set_pixel(pixel, x, y);
-                        };
-
-                        // The idea is that since all weights of the box blur kernel are equal, for
-                        // each step along the main axis, instead of recomputing the full sum, we
-                        // can take the previous sum, subtract the "oldest" pixel value and add the
-                        // "newest" pixel value.
-                        //
-                        // The sum is u32 so that it can fit MAXIMUM_KERNEL_SIZE * 255.
-                        let mut sum_r = 0;
-                        let mut sum_g = 0;
-                        let mut sum_b = 0;
-                        let mut sum_a = 0;
-
-                        // The whole sum needs to be computed for the first pixel. However, we know
-                        // that values outside of bounds are transparent, so the loop starts on the
-                        // first pixel in bounds.
-                        for j in main_axis_min..min(main_axis_max, main_axis_min + shift) {
-                            let Pixel { r, g, b, a } = pixel(i, j);
-
-                            if !A::IS_ALPHA_ONLY {
-                                sum_r += u32::from(r);
-                                sum_g += u32::from(g);
-                                sum_b += u32::from(b);
-                            }
+                        let (mut current, remaining) =
+                            output_data.split_at_column((band_x1 - band_x0) as u32);
 
-                            sum_a += u32::from(a);
-                        }
-
-                        set_pixel(
-                            main_axis_min as u32,
-                            Pixel {
-                                r: compute(sum_r),
-                                g: compute(sum_g),
-                                b: compute(sum_b),
-                                a: compute(sum_a),
-                            },
-                        );
-
-                        // Now, go through all the other pixels.
-                        //
-                        // j - target - 1 >= main_axis_min
-                        // j >= main_axis_min + target + 1
-                        let start_subtracting_at = main_axis_min + target + 1;
-
-                        // j + shift - 1 < main_axis_max
-                        // j < main_axis_max - shift + 1
-                        let stop_adding_at = main_axis_max - shift + 1;
-
-                        for j in main_axis_min + 1..main_axis_max {
-                            if j >= start_subtracting_at {
-                                let old_pixel = pixel(i, j - target - 1);
-
-                                if !A::IS_ALPHA_ONLY {
-                                    sum_r -= u32::from(old_pixel.r);
-                                    sum_g -= u32::from(old_pixel.g);
-                                    sum_b -= u32::from(old_pixel.b);
-                                }
+                        output_data = remaining;
+
+                        s.spawn(move |_| {
+                            let input_row = |y: i32| &self.row(y)[band_x0..band_x1];
+
+                            // Pixels outside of bounds are transparent, so the sums start with
+                            // the rows within bounds that precede the first output row.
+                            let shift = (kernel_size - target) as i32;
+                            let target = target as i32;
 
-                                sum_a -= u32::from(old_pixel.a);
+                            let mut sums = simd::BoxSums::new(band_x1 - band_x0);
+
+                            for y in bounds.y0..min(bounds.y1, bounds.y0 + shift - 1) {
+                                sums.add(input_row(y));
                             }
 
-                            if j < stop_adding_at {
-                                let new_pixel = pixel(i, j + shift - 1);
+                            for y in bounds.y0..bounds.y1 {
+                                if y - target - 1 >= bounds.y0 {
+                                    sums.sub(input_row(y - target - 1));
+                                }
 
-                                if !A::IS_ALPHA_ONLY {
-                                    sum_r += u32::from(new_pixel.r);
-                                    sum_g += u32::from(new_pixel.g);
-                                    sum_b += u32::from(new_pixel.b);
+                                if y + shift - 1 < bounds.y1 {
+                                    sums.add(input_row(y + shift - 1));
                                 }
 
-                                sum_a += u32::from(new_pixel.a);
+                                sums.average(
+                                    kernel_size,
+                                    A::IS_ALPHA_ONLY,
+                                    current.row_mut(y as u32),
+                                );
                             }
-
-                            set_pixel(
-                                j as u32,
-                                Pixel {
-                                    r: compute(sum_r),
-                                    g: compute(sum_g),
-                                    b: compute(sum_b),
-                                    a: compute(sum_a),
-                                },
+                        });
+                    }
+                } else {
+                    for y in bounds.y0..bounds.y1 {
+                        // Split off one row and launch its processing on another thread.
+                        // Thanks to the initial split before the loop, there's no special
+                        // case for the very first split.
+                        let (mut current, remaining) = output_data.split_at_row(1);
+
+                        output_data = remaining;
+
+                        s.spawn(move |_| {
+                            simd::box_blur_line(
+                                &self.row(y)[x0..x1],
+                                &mut current.row_mut(0)[x0..x1],
+                                kernel_size,
+                                target,
+                                A::IS_ALPHA_ONLY,
                             );
-                        }
-                    });
+                        });
+                    }
                 }
             });
         }
@@ -982,6 +994,215 @@ impl ImageSurface<Shared> {
         SharedImageSurface::wrap(output_surface, self.surface_type)
     }
 
+    /// Convolves the surface with a one-dimensional kernel in the direction `B`.
+    ///
+    /// This is the same as `convolve` with a single-row or single-column kernel whose
+    /// target is its center pixel, and with `EdgeMode::None`: pixels outside `bounds`
+    /// are taken to be transparent black.  It is meant for small Gaussian blurs, which
+    /// are separable, so it avoids the overhead of the general case: it reads rows of
+    /// pixels directly, accumulates in `f32`, only visits the kernel taps that fall
+    /// within `bounds`, and computes rows in parallel.
+    ///
+    /// # Panics
+    /// Panics if the length of `kernel` is not odd.
+    pub fn convolve_1d<B: BlurDirection>(
+        &self,
+        bounds: IRect,
+        kernel: &[f32],
+    ) -> Result<SharedImageSurface, cairo::Error> {
+        assert!(kernel.len() % 2 == 1);
+
+        let radius = (kernel.len() / 2) as i32;
+        let alpha_only = self.is_alpha_only();
+
+        let convert = |x: f32| (clamp(x, 0.0, 255.0) + 0.5) as u8;
+
+        let store = |out: &mut CairoARGB, [r, g, b, a]: [f32; 4]| {
+            *out = if alpha_only {
+                CairoARGB {
+                    r: 0,
+                    g: 0,
+                    b: 0,
+                    a: convert(a),
+                }
+            } else {
+                CairoARGB {
+                    r: convert(r),
+                    g: convert(g),
+                    b: convert(b),
+                    a: convert(a),
+                }
+            };
+        };
+
+        let accumulate = |sum: &mut [f32; 4], p: &CairoARGB, k: f32| {
+            sum[0] += f32::from(p.r) * k;
+            sum[1] += f32::from(p.g) * k;
+            sum[2] += f32::from(p.b) * k;
+            sum[3] += f32::from(p.a) * k;
+        };
+
+        // Output pixel `i` gets `kernel[j] * input[i + radius - j]`, for the `j` where
+        // the input pixel is within `[lo, hi)`.
+        let taps = |i: i32, lo: i32, hi: i32| {
+            let first = max(0, i + radius - hi + 1);
+            let last = min(kernel.len() as i32, i + radius - lo + 1);
+            first..max(first, last)
+        };
+
+        let mut output_surface =
+            ExclusiveImageSurface::new(self.width, self.height, self.surface_type)?;
+
+        let x0 = bounds.x0 as usize;
+        let x1 = bounds.x1 as usize;
+
+        if B::IS_VERTICAL {
+            output_surface.par_rows_mut(bounds, |y, out_row| {
+                let y = y as i32;
+                let mut sums = vec![[0.0f32; 4]; out_row.len()];
+
+                for j in taps(y, bounds.y0, bounds.y1) {
+                    let k = kernel[j as usize];
+                    let input_row = &self.row(y + radius - j)[x0..x1];
+
+                    for (sum, p) in sums.iter_mut().zip(input_row) {
+                        accumulate(sum, p, k);
+                    }
+                }
+
+                for (out, sum) in out_row.iter_mut().zip(sums) {
+                    store(out, sum);
+                }
+            });
+        } else {
+            output_surface.par_rows_mut(bounds, |y, out_row| {
+                let input_row = self.row(y as i32);
+
+                for (x, out) in (bounds.x0..).zip(out_row.iter_mut()) {
+                    let mut sum = [0.0f32; 4];
+
+                    for j in taps(x, bounds.x0, bounds.x1) {
+                        let p = &input_row[(x + radius - j) as usize];
+                        accumulate(&mut sum, p, kernel[j as usize]);
+                    }
+
+                    store(out, sum);
+                }
+            });
+        }
+
+        output_surface.share()
+    }
+
+    /// Returns the pixels of row `y`.
+    #[inline]
+    fn row(&self, y: i32) -> &[CairoARGB] {
+        assert!(y >= 0 && y < self.height);
+
+        unsafe {
+            let row_ptr = self.data_ptr.as_ptr().offset(y as isize * self.stride);
+            slice::from_raw_parts(row_ptr, self.width as usize * 4).as_cairo_argb()
+        }
+    }
+
+    /// Erodes the surface: each pixel gets the channel-wise minimum of the pixels around it.
+    ///
+    /// The window around each pixel extends `rx` pixels to the left and right, and `ry` pixels
+    /// up and down.  Pixels outside `bounds` are taken to be transparent black.
+    ///
+    /// This takes constant time per pixel regardless of the radii; see `min_max_filter()`.
+    pub fn erode(
+        &self,
+        bounds: IRect,
+        rx: usize,
+        ry: usize,
+    ) -> Result<SharedImageSurface, cairo::Error> {
+        self.min_max_filter(bounds, rx, ry, min)
+    }
+
+    /// Dilates the surface: each pixel gets the channel-wise maximum of the pixels around it.
+    ///
+    /// The window is the same as for [`erode`](#method.erode).
+    pub fn dilate(
+        &self,
+        bounds: IRect,
+        rx: usize,
+        ry: usize,
+    ) -> Result<SharedImageSurface, cairo::Error> {
+        self.min_max_filter(bounds, rx, ry, max)
+    }
+
+    /// Applies a rectangular minimum or maximum filter, as a horizontal and a vertical pass.
+    ///
+    /// Both passes are run in parallel over rows and columns, respectively.
+    fn min_max_filter(
+        &self,
+        bounds: IRect,
+        rx: usize,
+        ry: usize,
+        op: fn(u8, u8) -> u8,
+    ) -> Result<SharedImageSurface, cairo::Error> {
+        let mut output_surface =
+            cairo::ImageSurface::create(cairo::Format::ARgb32, self.width, self.height)?;
+
+        let width = bounds.width() as usize;
+        let height = bounds.height() as usize;
+
+        if width > 0 && height > 0 {
+            // Windows wider than the bounds see the same pixels as ones that just cover them.
+            let rx = rx.min(width);
+            let ry = ry.min(height);
+
+            // Horizontal pass, into a row-major buffer.
+            let mut rows = vec![Pixel::default(); width * height];
+
+            rows.par_chunks_mut(width).enumerate().for_each_init(
+                MinMaxScratch::default,
+                |scratch, (y, output)| {
+                    let y = (bounds.y0 + y as i32) as u32;
+
+                    scratch.line.clear();
+                    scratch
+                        .line
+                        .extend((bounds.x0..bounds.x1).map(|x| self.get_pixel(x as u32, y)));
+
+                    scratch.run(rx, op, output);
+                },
+            );
+
+            // Vertical pass, into a column-major buffer.
+            let mut columns = vec![Pixel::default(); width * height];
+
+            columns.par_chunks_mut(height).enumerate().for_each_init(
+                MinMaxScratch::default,
+                |scratch, (x, output)| {
+                    scratch.line.clear();
+                    scratch
+                        .line
+                        .extend((0..height).map(|y| rows[y * width + x]));
+
+                    scratch.run(ry, op, output);
+                },
+            );
+
+            let stride = output_surface.stride() as usize;
+            let mut data = output_surface.data().unwrap();
+
+            for (x, column) in columns.chunks(height).enumerate() {
+                for (y, pixel) in column.iter().enumerate() {
+                    data.set_pixel(
+                        stride,
+                        *pixel,
+                        (bounds.x0 + x as i32) as u32,
+                        (bounds.y0 + y as i32) as u32,
+                    );
+                }
+            }
+        }
+
+        SharedImageSurface::wrap(output_surface, self.surface_type)
+    }
+
     /// Fills the with a specified color.
     #[inline]
     pub fn flood(
@@ -1192,6 +1413,42 @@ impl ImageSurface<Shared> {
             next_row: 0,
         }
     }
+
+    /// Feeds the size, type, and pixels of the surface to a hasher.
+    ///
+    /// The padding at the end of each row is not hashed.
+    pub fn hash_pixels<H: Hasher>(&self, state: &mut H) {
+        self.width.hash(state);
+        self.height.hash(state);
+        self.surface_type.hash(state);
+
+        for y in 0..self.height {
+            unsafe {
+                let row_ptr = self.data_ptr.as_ptr().offset(y as isize * self.stride);
+                state.write(slice::from_raw_parts(row_ptr, self.width as usize * 4));
+            }
+        }
+    }
+
+    /// Whether two surfaces have the same size, type, and pixels.
+    ///
+    /// The padding at the end of each row is not compared.
+    pub fn same_pixels(&self, other: &SharedImageSurface) -> bool {
+        if self.width != other.width
+            || self.height != other.height
+            || self.surface_type != other.surface_type
+        {
+            return false;
+        }
+
+        (0..self.height).all(|y| unsafe {
+            let row_len = self.width as usize * 4;
+            let a = self.data_ptr.as_ptr().offset(y as isize * self.stride);
+            let b = other.data_ptr.as_ptr().offset(y as isize * other.stride);
+
+            slice::from_raw_parts(a, row_len) == slice::from_raw_parts(b, row_len)
+        })
+    }
 }
 
 impl<'a> Iterator for Rows<'a> {
@@ -1358,6 +1615,50 @@ impl ImageSurface<Exclusive> {
         draw_fn(cr)
     }
 
+    /// Computes the rows of pixels within `bounds` in parallel.
+    ///
+    /// The rows get distributed among rayon's threads.  For each row, `f` gets
+    /// called with the row's `y` coordinate and a slice with the pixels of that row
+    /// between `bounds.x0` and `bounds.x1`.  Pixels outside of `bounds` are left
+    /// untouched.
+    pub fn par_rows_mut<F>(&mut self, bounds: IRect, f: F)
+    where
+        F: Fn(u32, &mut [CairoARGB]) + Sync,
+    {
+        assert!(bounds.x0 >= 0 && bounds.x1 <= self.width && bounds.x0 <= bounds.x1);
+        assert!(bounds.y0 >= 0 && bounds.y1 <= self.height && bounds.y0 <= bounds.y1);
+
+        let stride = self.stride as usize;
+        let (x0, x1) = (bounds.x0 as usize, bounds.x1 as usize);
+        let (y0, y1) = (bounds.y0 as usize, bounds.y1 as usize);
+
+        let mut data = self.data();
+
+        data[y0 * stride..y1 * stride]
+            .par_chunks_mut(stride)
+            .zip(y0..y1)
+            .for_each(|(row, y)| f(y as u32, row[x0 * 4..x1 * 4].as_cairo_argb_mut()));
+    }
+
+    /// Computes each pixel within `bounds` in parallel.
+    ///
+    /// This is a convenience wrapper over `par_rows_mut` for filters that compute one
+    /// pixel at a time; `f` gets called with the `x` and `y` coordinates of each pixel
+    /// and returns its value.
+    pub fn par_map_pixels<F>(&mut self, bounds: IRect, f: F)
+    where
+        F: Fn(u32, u32) -> Pixel + Sync,
+    {
+        let x0 = bounds.x0 as u32;
+
+        self.par_rows_mut(bounds, |y, row| {
+            for (x, out) in (x0..).zip(row.iter_mut()) {
+                let Pixel { r, g, b, a } = f(x, y);
+                *out = CairoARGB { r, g, b, a };
+            }
+        });
+    }
+
     pub fn rows_mut(&mut self) -> RowsMut<'_> {
         let width = self.surface.width();
         let height = self.surface.height();
@@ -1408,7 +1709,205 @@ impl From<Operator> for cairo::Operator {
 #[cfg(test)]
 mod tests {
     use super::*;
-    use crate::surface_utils::iterators::Pixels;
+    use crate::surface_utils::iterators::{PixelRectangle, Pixels};
+
+    #[test]
+    fn erode_and_dilate_match_naive_implementation() {
+        const WIDTH: i32 = 32;
+        const HEIGHT: i32 = 24;
+
+        let bounds = IRect::new(3, 2, 29, 21);
+
+        let mut surface = ExclusiveImageSurface::new(WIDTH, HEIGHT, SurfaceType::SRgb).unwrap();
+
+        // Fill the surface with some data.
+        {
+            let mut data = surface.data();
+
+            let mut counter = 0u32;
+            for x in data.iter_mut() {
+                *x = (counter * 37 % 251) as u8;
+                counter += 1;
+            }
+        }
+
+        let surface = surface.share().unwrap();
+
+        for &(rx, ry) in &[(0, 0), (1, 0), (0, 2), (2, 3), (5, 1), (40, 40)] {
+            let eroded = surface.erode(bounds, rx, ry).unwrap();
+            let dilated = surface.dilate(bounds, rx, ry).unwrap();
+
+            for (x, y, _) in Pixels::within(&surface, bounds) {
+                let (x, y) = (x as i32, y as i32);
+                let (rx, ry) = (rx as i32, ry as i32);
+
+                let kernel = IRect::new(x - rx, y - ry, x + rx + 1, y + ry + 1);
+
+                let pixels: Vec<Pixel> =
+                    PixelRectangle::within(&surface, bounds, kernel, EdgeMode::None)
+                        .map(|(_, _, p)| p)
+                        .collect();
+
+                let fold = |op: fn(u8, u8) -> u8, init: u8| {
+                    pixels.iter().fold(
+                        Pixel {
+                            r: init,
+                            g: init,
+                            b: init,
+                            a: init,
+                        },
+                        |acc, p| Pixel {
+                            r: op(acc.r, p.r),
+                            g: op(acc.g, p.g),
+                            b: op(acc.b, p.b),
+                            a: op(acc.a, p.a),
+                        },
+                    )
+                };
+
+                assert_eq!(eroded.get_pixel(x as u32, y as u32), fold(min, 255));
+                assert_eq!(dilated.get_pixel(x as u32, y as u32), fold(max, 0));
+            }
+        }
+    }
+
+    #[test]
+    fn vertical_box_blur_matches_horizontal_one() {
+        // Wider than one band of columns, to check for the seams between them.
+        const SIDE: i32 = 150;
+
+        let bounds = IRect::new(3, 5, 140, 147);
+        let transposed_bounds = IRect::new(5, 3, 147, 140);
+
+        let pixel = |x: u32, y: u32| {
+            let a = ((x * 37 + y * 11) % 256) as u8;
+            Pixel {
+                r: ((x * 7 + y * 3) % 256) as u8,
+                g: ((x * 13) % 256) as u8,
+                b: ((y * 17) % 256) as u8,
+                a,
+            }
+            .premultiply()
+        };
+
+        let mut surface = ExclusiveImageSurface::new(SIDE, SIDE, SurfaceType::SRgb).unwrap();
+        surface.par_map_pixels(IRect::from_size(SIDE, SIDE), pixel);
+        let surface = surface.share().unwrap();
+
+        let mut transposed = ExclusiveImageSurface::new(SIDE, SIDE, SurfaceType::SRgb).unwrap();
+        transposed.par_map_pixels(IRect::from_size(SIDE, SIDE), |x, y| pixel(y, x));
+        let transposed = transposed.share().unwrap();
+
+        for &(kernel_size, target) in &[(1, 0), (4, 1), (9, 4), (200, 100)] {
+            let horizontal = surface
+                .box_blur::<Horizontal>(bounds, kernel_size, target)
+                .unwrap();
+            let vertical = transposed
+                .box_blur::<Vertical>(transposed_bounds, kernel_size, target)
+                .unwrap();
+
+            for y in 0..SIDE as u32 {
+                for x in 0..SIDE as u32 {
+                    assert_eq!(horizontal.get_pixel(x, y), vertical.get_pixel(y, x));
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn convolve_1d_matches_convolve() {
+        use nalgebra::{DMatrix, Dynamic, VecStorage};
+
+        const WIDTH: i32 = 32;
+        const HEIGHT: i32 = 24;
+
+        let bounds = IRect::new(3, 2, 29, 21);
+        let kernel: [f32; 7] = [0.05, 0.1, 0.2, 0.3, 0.2, 0.1, 0.05];
+
+        let mut surface = ExclusiveImageSurface::new(WIDTH, HEIGHT, SurfaceType::SRgb).unwrap();
+
+        // Fill the surface with premultiplied data.
+        surface.par_map_pixels(IRect::from_size(WIDTH, HEIGHT), |x, y| {
+            let a = ((x * 37 + y * 11) % 256) as u8;
+            Pixel {
+                r: ((x * 7 + y * 3) % 256) as u8,
+                g: ((x * 13) % 256) as u8,
+                b: ((y * 17) % 256) as u8,
+                a,
+            }
+            .premultiply()
+        });
+
+        let surface = surface.share().unwrap();
+
+        for &vertical in &[false, true] {
+            let (rows, cols) = if vertical {
+                (kernel.len(), 1)
+            } else {
+                (1, kernel.len())
+            };
+
+            let matrix = DMatrix::from_data(VecStorage::new(
+                Dynamic::new(rows),
+                Dynamic::new(cols),
+                kernel.iter().map(|&k| f64::from(k)).collect::<Vec<_>>(),
+            ));
+
+            let expected = surface
+                .convolve(
+                    bounds,
+                    ((cols / 2) as i32, (rows / 2) as i32),
+                    &matrix,
+                    EdgeMode::None,
+                )
+                .unwrap();
+
+            let actual = if vertical {
+                surface.convolve_1d::<Vertical>(bounds, &kernel).unwrap()
+            } else {
+                surface.convolve_1d::<Horizontal>(bounds, &kernel).unwrap()
+            };
+
+            for (x, y, pixel) in Pixels::within(&expected, bounds) {
+                let p = actual.get_pixel(x, y);
+                let diff = |a: u8, b: u8| (i16::from(a) - i16::from(b)).abs();
+
+                assert!(diff(p.r, pixel.r) <= 1);
+                assert!(diff(p.g, pixel.g) <= 1);
+                assert!(diff(p.b, pixel.b) <= 1);
+                assert!(diff(p.a, pixel.a) <= 1);
+            }
+        }
+    }
+
+    #[test]
+    fn par_map_pixels_writes_only_within_bounds() {
+        const WIDTH: i32 = 32;
+        const HEIGHT: i32 = 24;
+
+        let bounds = IRect::new(3, 2, 29, 21);
+
+        let pixel_at = |x: u32, y: u32| Pixel {
+            r: x as u8,
+            g: y as u8,
+            b: (x * y) as u8,
+            a: 255,
+        };
+
+        let mut surface = ExclusiveImageSurface::new(WIDTH, HEIGHT, SurfaceType::SRgb).unwrap();
+        surface.par_map_pixels(bounds, pixel_at);
+        let surface = surface.share().unwrap();
+
+        let full = IRect::from_size(WIDTH, HEIGHT);
+
+        for (x, y, pixel) in Pixels::within(&surface, full) {
+            if bounds.contains(x as i32, y as i32) {
+                assert_eq!(pixel, pixel_at(x, y));
+            } else {
+                assert_eq!(pixel, Pixel::default());
+            }
+        }
+    }
 
     #[test]
     fn test_extract_alpha() {
@@ -0,0 +1,972 @@
+//! Operations on whole rows of pixels, with SIMD versions chosen at runtime.
+//!
+//! Every filter input and output in linear RGB gets converted from and to sRGB, and every
+//! image that gets loaded from or exported to a `GdkPixbuf` gets premultiplied or
+//! unpremultiplied.  The functions here do those conversions a row at a time, as well as
+//! the running sums of box blurs, which approximate Gaussian blurs.  On x86-64 they use
+//! AVX2 if the processor supports it, and SSE2 otherwise, and they fall back to plain Rust
+//! on other architectures and for the last few pixels of each row.
+//!
+//! Unpremultiplying and converting color spaces look up each component in an
+//! [`AlphaTable`], since that is faster than the divisions that they would need otherwise.
+//! SSE2 cannot look up several values at once, so these conversions only have an AVX2
+//! version, which uses its gather instructions.  Premultiplying is plain arithmetic, which
+//! has both an SSE2 and an AVX2 version.  The box blurs keep a sum for each of the four
+//! channels of a pixel in the lanes of a SIMD register.
+//!
+//! All the versions give the same results bit for bit; the tests check them against each
+//! other.
+
+use std::cmp::min;
+
+use super::{CairoARGB, Pixel, PixelOps};
+
+const TABLE_SIZE: usize = 256 * 256;
+
+/// The AVX2 version of the lookups reads 4 bytes at a time from the table.
+const TABLE_PADDING: usize = 3;
+
+/// Values of a function of the alpha and a color component of a pixel.
+///
+/// The table has one row of 256 values for each value of alpha, so it takes 64 KiB.
+pub struct AlphaTable(Box<[u8]>);
+
+impl AlphaTable {
+    /// Creates a table with the values of `f(alpha, component)`.
+    pub fn new<F: Fn(u8, u8) -> u8>(f: F) -> AlphaTable {
+        let mut table = vec![0; TABLE_SIZE + TABLE_PADDING];
+
+        for (a, row) in table.chunks_exact_mut(256).enumerate() {
+            for (c, value) in row.iter_mut().enumerate() {
+                *value = f(a as u8, c as u8);
+            }
+        }
+
+        AlphaTable(table.into_boxed_slice())
+    }
+
+    #[inline]
+    pub fn get(&self, alpha: u8, component: u8) -> u8 {
+        self.0[usize::from(alpha) * 256 + usize::from(component)]
+    }
+
+    /// Looks up the color components of a pixel; its alpha stays the same.
+    #[inline]
+    pub fn map(&self, pixel: Pixel) -> Pixel {
+        Pixel {
+            r: self.get(pixel.a, pixel.r),
+            g: self.get(pixel.a, pixel.g),
+            b: self.get(pixel.a, pixel.b),
+            a: pixel.a,
+        }
+    }
+
+    /// Looks up the color components of a row of pixels.
+    pub fn map_row(&self, src: &[CairoARGB], dst: &mut [CairoARGB]) {
+        assert_eq!(src.len(), dst.len());
+
+        let done = unsafe {
+            self.map_row_simd(
+                src.as_ptr().cast(),
+                dst.as_mut_ptr().cast(),
+                src.len(),
+                false,
+            )
+        };
+
+        for (src, dst) in src[done..].iter().zip(dst[done..].iter_mut()) {
+            *dst = self.map(Pixel::from(*src)).into();
+        }
+    }
+
+    /// Looks up the color components of a row of pixels, and stores them in RGBA order.
+    ///
+    /// This is for copying Cairo's pixels into a `GdkPixbuf`.
+    pub fn map_row_to_rgba(&self, src: &[CairoARGB], dst: &mut [Pixel]) {
+        assert_eq!(src.len(), dst.len());
+
+        let done = unsafe {
+            self.map_row_simd(
+                src.as_ptr().cast(),
+                dst.as_mut_ptr().cast(),
+                src.len(),
+                true,
+            )
+        };
+
+        for (src, dst) in src[done..].iter().zip(dst[done..].iter_mut()) {
+            *dst = self.map(Pixel::from(*src));
+        }
+    }
+
+    /// Maps as many pixels as possible with SIMD instructions, and returns how many it did.
+    #[cfg(target_arch = "x86_64")]
+    unsafe fn map_row_simd(
+        &self,
+        src: *const u8,
+        dst: *mut u8,
+        len: usize,
+        to_rgba: bool,
+    ) -> usize {
+        if is_x86_feature_detected!("avx2") {
+            x86::map_row_avx2(self.0.as_ptr(), src, dst, len, to_rgba)
+        } else {
+            0
+        }
+    }
+
+    #[cfg(not(target_arch = "x86_64"))]
+    unsafe fn map_row_simd(
+        &self,
+        _src: *const u8,
+        _dst: *mut u8,
+        _len: usize,
+        _to_rgba: bool,
+    ) -> usize {
+        0
+    }
+}
+
+/// Premultiplies a row of pixels from a `GdkPixbuf`, and stores them in Cairo's order.
+pub fn premultiply_row(src: &[Pixel], dst: &mut [CairoARGB]) {
+    assert_eq!(src.len(), dst.len());
+
+    let done =
+        unsafe { premultiply_row_simd(src.as_ptr().cast(), dst.as_mut_ptr().cast(), src.len()) };
+
+    for (src, dst) in src[done..].iter().zip(dst[done..].iter_mut()) {
+        *dst = src.premultiply().into();
+    }
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn premultiply_row_simd(src: *const u8, dst: *mut u8, len: usize) -> usize {
+    if is_x86_feature_detected!("avx2") {
+        x86::premultiply_row_avx2(src, dst, len)
+    } else {
+        x86::premultiply_row_sse2(src, dst, len)
+    }
+}
+
+#[cfg(not(target_arch = "x86_64"))]
+unsafe fn premultiply_row_simd(_src: *const u8, _dst: *mut u8, _len: usize) -> usize {
+    0
+}
+
+/// Kernels smaller than this get the averages of box blurs computed in `f32`, which is exact
+/// for them.
+const MAX_SIMD_KERNEL_SIZE: usize = 1 << 15;
+
+/// Box blurs a line of pixels, for blurs in the horizontal direction.
+///
+/// Pixel `j` of `dst` gets the average of the `kernel_size` pixels of `src` that start at
+/// `j - target`; pixels beyond the ends of `src` are taken to be transparent black.  If
+/// `alpha_only` is true, only the alpha channel gets computed, and the others are zero.
+///
+/// Since all the weights of the kernel are equal, instead of recomputing the full sum for
+/// each pixel, this takes the previous sum, subtracts the oldest pixel and adds the newest.
+///
+/// # Panics
+/// Panics if `target >= kernel_size`.
+pub fn box_blur_line(
+    src: &[CairoARGB],
+    dst: &mut [CairoARGB],
+    kernel_size: usize,
+    target: usize,
+    alpha_only: bool,
+) {
+    assert_eq!(src.len(), dst.len());
+    assert!(target < kernel_size);
+
+    if kernel_size < MAX_SIMD_KERNEL_SIZE {
+        let done = unsafe {
+            box_blur_line_simd(
+                src.as_ptr().cast(),
+                dst.as_mut_ptr().cast(),
+                src.len(),
+                kernel_size,
+                target,
+                alpha_only,
+            )
+        };
+
+        if done {
+            return;
+        }
+    }
+
+    let shift = kernel_size - target;
+    let mut sum = [0; 4];
+
+    for p in &src[..min(src.len(), shift - 1)] {
+        add_components(&mut sum, *p);
+    }
+
+    for (j, out) in dst.iter_mut().enumerate() {
+        if j > target {
+            sub_components(&mut sum, src[j - target - 1]);
+        }
+
+        if j + shift - 1 < src.len() {
+            add_components(&mut sum, src[j + shift - 1]);
+        }
+
+        *out = average(&sum, kernel_size, alpha_only);
+    }
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn box_blur_line_simd(
+    src: *const u8,
+    dst: *mut u8,
+    len: usize,
+    kernel_size: usize,
+    target: usize,
+    alpha_only: bool,
+) -> bool {
+    x86::box_blur_line_sse2(src, dst, len, kernel_size, target, alpha_only);
+    true
+}
+
+#[cfg(not(target_arch = "x86_64"))]
+unsafe fn box_blur_line_simd(
+    _src: *const u8,
+    _dst: *mut u8,
+    _len: usize,
+    _kernel_size: usize,
+    _target: usize,
+    _alpha_only: bool,
+) -> bool {
+    false
+}
+
+/// Sums of the channels of the pixels in a row, for box blurs in the vertical direction.
+///
+/// A vertical box blur goes down a band of columns with one sum for each of them.  For each
+/// row of output pixels, it subtracts the input row that leaves the kernel, adds the one
+/// that enters it, and stores the averages.
+pub struct BoxSums(Vec<[u32; 4]>);
+
+impl BoxSums {
+    /// Creates the sums for a row of `len` pixels, all zero.
+    pub fn new(len: usize) -> BoxSums {
+        BoxSums(vec![[0; 4]; len])
+    }
+
+    /// Adds a row of pixels to the sums.
+    pub fn add(&mut self, row: &[CairoARGB]) {
+        self.add_or_sub(row, false);
+    }
+
+    /// Subtracts a row of pixels, which must have been added before, from the sums.
+    pub fn sub(&mut self, row: &[CairoARGB]) {
+        self.add_or_sub(row, true);
+    }
+
+    fn add_or_sub(&mut self, row: &[CairoARGB], sub: bool) {
+        assert_eq!(self.0.len(), row.len());
+
+        let done = unsafe {
+            add_or_sub_row_simd(
+                self.0.as_mut_ptr().cast(),
+                row.as_ptr().cast(),
+                row.len(),
+                sub,
+            )
+        };
+
+        for (sum, p) in self.0[done..].iter_mut().zip(&row[done..]) {
+            if sub {
+                sub_components(sum, *p);
+            } else {
+                add_components(sum, *p);
+            }
+        }
+    }
+
+    /// Stores the sums divided by `kernel_size`, rounded, as pixels.  If `alpha_only` is
+    /// true, only the alpha channel gets stored, and the others are zero.
+    pub fn average(&self, kernel_size: usize, alpha_only: bool, dst: &mut [CairoARGB]) {
+        assert_eq!(self.0.len(), dst.len());
+
+        let done = if kernel_size < MAX_SIMD_KERNEL_SIZE {
+            unsafe {
+                average_row_simd(
+                    self.0.as_ptr().cast(),
+                    dst.as_mut_ptr().cast(),
+                    dst.len(),
+                    kernel_size,
+                    alpha_only,
+                )
+            }
+        } else {
+            0
+        };
+
+        for (sum, out) in self.0[done..].iter().zip(&mut dst[done..]) {
+            *out = average(sum, kernel_size, alpha_only);
+        }
+    }
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn add_or_sub_row_simd(sums: *mut u32, row: *const u8, len: usize, sub: bool) -> usize {
+    if is_x86_feature_detected!("avx2") {
+        x86::add_or_sub_row_avx2(sums, row, len, sub)
+    } else {
+        x86::add_or_sub_row_sse2(sums, row, len, sub)
+    }
+}
+
+#[cfg(not(target_arch = "x86_64"))]
+unsafe fn add_or_sub_row_simd(_sums: *mut u32, _row: *const u8, _len: usize, _sub: bool) -> usize {
+    0
+}
+
+#[cfg(target_arch = "x86_64")]
+unsafe fn average_row_simd(
+    sums: *const u32,
+    dst: *mut u8,
+    len: usize,
+    kernel_size: usize,
+    alpha_only: bool,
+) -> usize {
+    if is_x86_feature_detected!("avx2") {
+        x86::average_row_avx2(sums, dst, len, kernel_size, alpha_only)
+    } else {
+        x86::average_row_sse2(sums, dst, len, kernel_size, alpha_only)
+    }
+}
+
+#[cfg(not(target_arch = "x86_64"))]
+unsafe fn average_row_simd(
+    _sums: *const u32,
+    _dst: *mut u8,
+    _len: usize,
+    _kernel_size: usize,
+    _alpha_only: bool,
+) -> usize {
+    0
+}
+
+// The sums keep the channels in the order of the components in memory on little-endian
+// machines, which is the order of the lanes in the SIMD versions.
+
+#[inline]
+fn add_components(sum: &mut [u32; 4], p: CairoARGB) {
+    sum[0] += u32::from(p.b);
+    sum[1] += u32::from(p.g);
+    sum[2] += u32::from(p.r);
+    sum[3] += u32::from(p.a);
+}
+
+#[inline]
+fn sub_components(sum: &mut [u32; 4], p: CairoARGB) {
+    sum[0] -= u32::from(p.b);
+    sum[1] -= u32::from(p.g);
+    sum[2] -= u32::from(p.r);
+    sum[3] -= u32::from(p.a);
+}
+
+/// Divides the sums by `kernel_size`, rounding to the nearest integer and halves up.
+#[inline]
+fn average(sum: &[u32; 4], kernel_size: usize, alpha_only: bool) -> CairoARGB {
+    let k = kernel_size as u64;
+    let average = |x: u32| ((2 * u64::from(x) + k) / (2 * k)) as u8;
+
+    if alpha_only {
+        CairoARGB {
+            b: 0,
+            g: 0,
+            r: 0,
+            a: average(sum[3]),
+        }
+    } else {
+        CairoARGB {
+            b: average(sum[0]),
+            g: average(sum[1]),
+            r: average(sum[2]),
+            a: average(sum[3]),
+        }
+    }
+}
+
+/// The SIMD versions of the conversions.
+///
+/// These work on Cairo's pixels as little-endian `u32` values of the form 0xAARRGGBB, and on
+/// `GdkPixbuf`'s pixels as values of the form 0xAABBGGRR.  Each function converts the largest
+/// multiple of 4 or 8 pixels that fits in `len`, and returns the number of pixels it did.
+#[cfg(target_arch = "x86_64")]
+mod x86 {
+    use std::arch::x86_64::*;
+    use std::cmp::min;
+
+    #[target_feature(enable = "avx2")]
+    pub unsafe fn map_row_avx2(
+        table: *const u8,
+        src: *const u8,
+        dst: *mut u8,
+        len: usize,
+        to_rgba: bool,
+    ) -> usize {
+        let n = len / 8 * 8;
+
+        let table = table as *const i32;
+        let byte = _mm256_set1_epi32(0xff);
+        let alpha_mask = _mm256_set1_epi32(0xff00_0000_u32 as i32);
+
+        for i in (0..n).step_by(8) {
+            let p = _mm256_loadu_si256(src.add(i * 4) as *const __m256i);
+
+            // Each component indexes into the row for its pixel's alpha.  The gathers
+            // read 4 bytes at each index; only the lowest one is the value.
+            let row = _mm256_slli_epi32(_mm256_srli_epi32(p, 24), 8);
+
+            let r = _mm256_add_epi32(row, _mm256_and_si256(_mm256_srli_epi32(p, 16), byte));
+            let g = _mm256_add_epi32(row, _mm256_and_si256(_mm256_srli_epi32(p, 8), byte));
+            let b = _mm256_add_epi32(row, _mm256_and_si256(p, byte));
+
+            let r = _mm256_and_si256(_mm256_i32gather_epi32(table, r, 1), byte);
+            let g = _mm256_and_si256(_mm256_i32gather_epi32(table, g, 1), byte);
+            let b = _mm256_and_si256(_mm256_i32gather_epi32(table, b, 1), byte);
+
+            let (r, b) = if to_rgba {
+                (r, _mm256_slli_epi32(b, 16))
+            } else {
+                (_mm256_slli_epi32(r, 16), b)
+            };
+
+            let out = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(p, alpha_mask), r),
+                _mm256_or_si256(_mm256_slli_epi32(g, 8), b),
+            );
+
+            _mm256_storeu_si256(dst.add(i * 4) as *mut __m256i, out);
+        }
+
+        n
+    }
+
+    #[target_feature(enable = "sse2")]
+    pub unsafe fn premultiply_row_sse2(src: *const u8, dst: *mut u8, len: usize) -> usize {
+        let n = len / 4 * 4;
+        let zero = _mm_setzero_si128();
+
+        for i in (0..n).step_by(4) {
+            let p = _mm_loadu_si128(src.add(i * 4) as *const __m128i);
+
+            let lo = premultiply_sse2(_mm_unpacklo_epi8(p, zero));
+            let hi = premultiply_sse2(_mm_unpackhi_epi8(p, zero));
+
+            _mm_storeu_si128(dst.add(i * 4) as *mut __m128i, _mm_packus_epi16(lo, hi));
+        }
+
+        n
+    }
+
+    /// Premultiplies two pixels with 16-bit R, G, B, A components, and swaps R and B.
+    ///
+    /// Computes `(x * a + 127) / 255` like `PixelOps::premultiply`.  Writing `t` for the
+    /// dividend, which is less than 65280, `t / 255` is the same as `(t + 1 + (t >> 8)) >> 8`.
+    /// The alpha components get multiplied by 255, so they stay the same.
+    #[inline]
+    #[target_feature(enable = "sse2")]
+    unsafe fn premultiply_sse2(x: __m128i) -> __m128i {
+        let alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        let alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+        let a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xff), 0xff);
+        let a = _mm_or_si128(_mm_andnot_si128(alpha_lanes, a), alpha_255);
+
+        let t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(127));
+        let t = _mm_add_epi16(t, _mm_add_epi16(_mm_srli_epi16(t, 8), _mm_set1_epi16(1)));
+        let t = _mm_srli_epi16(t, 8);
+
+        // R, G, B, A -> B, G, R, A
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, 0xc6), 0xc6)
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub unsafe fn premultiply_row_avx2(src: *const u8, dst: *mut u8, len: usize) -> usize {
+        let n = len / 8 * 8;
+        let zero = _mm256_setzero_si256();
+
+        for i in (0..n).step_by(8) {
+            let p = _mm256_loadu_si256(src.add(i * 4) as *const __m256i);
+
+            // These work within each 128-bit half, so the pixels stay in order.
+            let lo = premultiply_avx2(_mm256_unpacklo_epi8(p, zero));
+            let hi = premultiply_avx2(_mm256_unpackhi_epi8(p, zero));
+
+            _mm256_storeu_si256(dst.add(i * 4) as *mut __m256i, _mm256_packus_epi16(lo, hi));
+        }
+
+        n
+    }
+
+    /// Like `premultiply_sse2`, for four pixels.
+    #[inline]
+    #[target_feature(enable = "avx2")]
+    unsafe fn premultiply_avx2(x: __m256i) -> __m256i {
+        let alpha_lanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+        let alpha_255 = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+
+        let a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, 0xff), 0xff);
+        let a = _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, a), alpha_255);
+
+        let t = _mm256_add_epi16(_mm256_mullo_epi16(x, a), _mm256_set1_epi16(127));
+        let t = _mm256_add_epi16(
+            t,
+            _mm256_add_epi16(_mm256_srli_epi16(t, 8), _mm256_set1_epi16(1)),
+        );
+        let t = _mm256_srli_epi16(t, 8);
+
+        _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(t, 0xc6), 0xc6)
+    }
+
+    /// Averages for box blurs: `(2 * sum + k) / (2 * k)` rounds `sum / k` to the nearest
+    /// integer, and halves up.  For `k` below `MAX_SIMD_KERNEL_SIZE` the dividend and the
+    /// divisor are exact in `f32`, and so is the integer part of the quotient.
+    #[inline]
+    #[target_feature(enable = "sse2")]
+    unsafe fn average_sse2(sum: __m128i, k: __m128i, two_k: __m128) -> __m128i {
+        let dividend = _mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(sum, sum), k));
+        _mm_cvttps_epi32(_mm_div_ps(dividend, two_k))
+    }
+
+    /// Zero-extends the components of a pixel to the 32-bit lanes of a register.
+    #[inline]
+    #[target_feature(enable = "sse2")]
+    unsafe fn load_pixel_sse2(p: *const u8) -> __m128i {
+        let zero = _mm_setzero_si128();
+        let p = _mm_cvtsi32_si128((p as *const i32).read_unaligned());
+        _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero)
+    }
+
+    #[target_feature(enable = "sse2")]
+    pub unsafe fn box_blur_line_sse2(
+        src: *const u8,
+        dst: *mut u8,
+        len: usize,
+        kernel_size: usize,
+        target: usize,
+        alpha_only: bool,
+    ) {
+        let k = _mm_set1_epi32(kernel_size as i32);
+        let two_k = _mm_set1_ps(2.0 * kernel_size as f32);
+        let mask = _mm_set1_epi32(if alpha_only {
+            0xff00_0000_u32 as i32
+        } else {
+            -1
+        });
+
+        let shift = kernel_size - target;
+        let mut sum = _mm_setzero_si128();
+
+        for j in 0..min(len, shift - 1) {
+            sum = _mm_add_epi32(sum, load_pixel_sse2(src.add(j * 4)));
+        }
+
+        for j in 0..len {
+            if j > target {
+                sum = _mm_sub_epi32(sum, load_pixel_sse2(src.add((j - target - 1) * 4)));
+            }
+
+            if j + shift - 1 < len {
+                sum = _mm_add_epi32(sum, load_pixel_sse2(src.add((j + shift - 1) * 4)));
+            }
+
+            let a = average_sse2(sum, k, two_k);
+            let a = _mm_packs_epi32(a, a);
+            let a = _mm_packus_epi16(a, a);
+            let a = _mm_and_si128(a, mask);
+
+            (dst.add(j * 4) as *mut i32).write_unaligned(_mm_cvtsi128_si32(a));
+        }
+    }
+
+    #[target_feature(enable = "sse2")]
+    pub unsafe fn add_or_sub_row_sse2(
+        sums: *mut u32,
+        row: *const u8,
+        len: usize,
+        sub: bool,
+    ) -> usize {
+        let n = len / 4 * 4;
+        let zero = _mm_setzero_si128();
+
+        for i in (0..n).step_by(4) {
+            let p = _mm_loadu_si128(row.add(i * 4) as *const __m128i);
+            let lo = _mm_unpacklo_epi8(p, zero);
+            let hi = _mm_unpackhi_epi8(p, zero);
+
+            let pixels = [
+                _mm_unpacklo_epi16(lo, zero),
+                _mm_unpackhi_epi16(lo, zero),
+                _mm_unpacklo_epi16(hi, zero),
+                _mm_unpackhi_epi16(hi, zero),
+            ];
+
+            for (j, p) in pixels.iter().enumerate() {
+                let s = sums.add((i + j) * 4) as *mut __m128i;
+                let sum = _mm_loadu_si128(s);
+                let sum = if sub {
+                    _mm_sub_epi32(sum, *p)
+                } else {
+                    _mm_add_epi32(sum, *p)
+                };
+                _mm_storeu_si128(s, sum);
+            }
+        }
+
+        n
+    }
+
+    #[target_feature(enable = "sse2")]
+    pub unsafe fn average_row_sse2(
+        sums: *const u32,
+        dst: *mut u8,
+        len: usize,
+        kernel_size: usize,
+        alpha_only: bool,
+    ) -> usize {
+        let n = len / 4 * 4;
+
+        let k = _mm_set1_epi32(kernel_size as i32);
+        let two_k = _mm_set1_ps(2.0 * kernel_size as f32);
+        let mask = _mm_set1_epi32(if alpha_only {
+            0xff00_0000_u32 as i32
+        } else {
+            -1
+        });
+
+        for i in (0..n).step_by(4) {
+            let s = sums.add(i * 4) as *const __m128i;
+            let a0 = average_sse2(_mm_loadu_si128(s), k, two_k);
+            let a1 = average_sse2(_mm_loadu_si128(s.add(1)), k, two_k);
+            let a2 = average_sse2(_mm_loadu_si128(s.add(2)), k, two_k);
+            let a3 = average_sse2(_mm_loadu_si128(s.add(3)), k, two_k);
+
+            let a = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+
+            _mm_storeu_si128(dst.add(i * 4) as *mut __m128i, _mm_and_si128(a, mask));
+        }
+
+        n
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub unsafe fn add_or_sub_row_avx2(
+        sums: *mut u32,
+        row: *const u8,
+        len: usize,
+        sub: bool,
+    ) -> usize {
+        let n = len / 2 * 2;
+
+        for i in (0..n).step_by(2) {
+            let p = _mm_loadl_epi64(row.add(i * 4) as *const __m128i);
+            let p = _mm256_cvtepu8_epi32(p);
+
+            let s = sums.add(i * 4) as *mut __m256i;
+            let sum = _mm256_loadu_si256(s);
+            let sum = if sub {
+                _mm256_sub_epi32(sum, p)
+            } else {
+                _mm256_add_epi32(sum, p)
+            };
+            _mm256_storeu_si256(s, sum);
+        }
+
+        n
+    }
+
+    /// Like `average_sse2`, for two pixels.
+    #[inline]
+    #[target_feature(enable = "avx2")]
+    unsafe fn average_avx2(sum: __m256i, k: __m256i, two_k: __m256) -> __m256i {
+        let dividend = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(sum, sum), k));
+        _mm256_cvttps_epi32(_mm256_div_ps(dividend, two_k))
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub unsafe fn average_row_avx2(
+        sums: *const u32,
+        dst: *mut u8,
+        len: usize,
+        kernel_size: usize,
+        alpha_only: bool,
+    ) -> usize {
+        let n = len / 8 * 8;
+
+        let k = _mm256_set1_epi32(kernel_size as i32);
+        let two_k = _mm256_set1_ps(2.0 * kernel_size as f32);
+        let mask = _mm256_set1_epi32(if alpha_only {
+            0xff00_0000_u32 as i32
+        } else {
+            -1
+        });
+
+        for i in (0..n).step_by(8) {
+            // Each register has two pixels, one in each 128-bit half.
+            let s = sums.add(i * 4) as *const __m256i;
+            let a01 = average_avx2(_mm256_loadu_si256(s), k, two_k);
+            let a23 = average_avx2(_mm256_loadu_si256(s.add(1)), k, two_k);
+            let a45 = average_avx2(_mm256_loadu_si256(s.add(2)), k, two_k);
+            let a67 = average_avx2(_mm256_loadu_si256(s.add(3)), k, two_k);
+
+            // The packs work within each half, so this gives pixels 0, 2, 4, 6 in the low
+            // half and 1, 3, 5, 7 in the high one.
+            let a = _mm256_packus_epi16(_mm256_packs_epi32(a01, a23), _mm256_packs_epi32(a45, a67));
+            let a = _mm256_permutevar8x32_epi32(a, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+
+            _mm256_storeu_si256(dst.add(i * 4) as *mut __m256i, _mm256_and_si256(a, mask));
+        }
+
+        n
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// All combinations of alpha and a component, in pixels with the component in a
+    /// different channel each time; the row length is not a multiple of 8, to test the ends.
+    fn all_pixels() -> Vec<Pixel> {
+        (0..TABLE_SIZE + 5)
+            .map(|i| {
+                let a = (i / 256) as u8;
+                let c = i as u8;
+
+                Pixel {
+                    r: c,
+                    g: c.wrapping_mul(7),
+                    b: c.wrapping_add(a),
+                    a,
+                }
+            })
+            .collect()
+    }
+
+    fn test_table() -> AlphaTable {
+        AlphaTable::new(|a, c| a ^ c.wrapping_mul(3))
+    }
+
+    #[test]
+    fn map_row_matches_map() {
+        let table = test_table();
+        let pixels = all_pixels();
+
+        let src: Vec<CairoARGB> = pixels.iter().map(|&p| p.into()).collect();
+        let mut dst = vec![CairoARGB::default(); src.len()];
+        table.map_row(&src, &mut dst);
+
+        for (p, d) in pixels.iter().zip(dst.iter()) {
+            assert_eq!(Pixel::from(*d), table.map(*p));
+        }
+    }
+
+    #[test]
+    fn map_row_to_rgba_matches_map() {
+        let table = test_table();
+        let pixels = all_pixels();
+
+        let src: Vec<CairoARGB> = pixels.iter().map(|&p| p.into()).collect();
+        let mut dst = vec![Pixel::default(); src.len()];
+        table.map_row_to_rgba(&src, &mut dst);
+
+        for (p, d) in pixels.iter().zip(dst.iter()) {
+            assert_eq!(*d, table.map(*p));
+        }
+    }
+
+    #[test]
+    fn premultiply_row_matches_premultiply() {
+        let pixels = all_pixels();
+
+        let mut dst = vec![CairoARGB::default(); pixels.len()];
+        premultiply_row(&pixels, &mut dst);
+
+        for (p, d) in pixels.iter().zip(dst.iter()) {
+            assert_eq!(Pixel::from(*d), p.premultiply());
+        }
+    }
+
+    #[cfg(target_arch = "x86_64")]
+    #[test]
+    fn premultiply_sse2_matches_premultiply() {
+        let pixels = all_pixels();
+
+        let mut dst = vec![CairoARGB::default(); pixels.len()];
+        let done = unsafe {
+            x86::premultiply_row_sse2(
+                pixels.as_ptr().cast(),
+                dst.as_mut_ptr().cast(),
+                pixels.len(),
+            )
+        };
+
+        assert_eq!(done, pixels.len() / 4 * 4);
+
+        for (p, d) in pixels.iter().zip(dst.iter()).take(done) {
+            assert_eq!(Pixel::from(*d), p.premultiply());
+        }
+    }
+
+    /// Box blurs a line by adding up the whole kernel for each pixel, and averaging like
+    /// `SharedImageSurface::box_blur_loop` used to.
+    fn box_blur_reference(
+        src: &[CairoARGB],
+        kernel_size: usize,
+        target: usize,
+        alpha_only: bool,
+    ) -> Vec<CairoARGB> {
+        let compute = |x: u32| (f64::from(x) / kernel_size as f64 + 0.5) as u8;
+
+        (0..src.len())
+            .map(|j| {
+                let mut sum = [0; 4];
+
+                for i in (j as isize - target as isize)..(j + kernel_size - target) as isize {
+                    if i >= 0 && (i as usize) < src.len() {
+                        add_components(&mut sum, src[i as usize]);
+                    }
+                }
+
+                let p = CairoARGB {
+                    b: compute(sum[0]),
+                    g: compute(sum[1]),
+                    r: compute(sum[2]),
+                    a: compute(sum[3]),
+                };
+
+                if alpha_only {
+                    CairoARGB {
+                        b: 0,
+                        g: 0,
+                        r: 0,
+                        ..p
+                    }
+                } else {
+                    p
+                }
+            })
+            .collect()
+    }
+
+    fn blur_pixels(len: usize) -> Vec<CairoARGB> {
+        (0..len)
+            .map(|i| {
+                Pixel {
+                    r: (i * 37) as u8,
+                    g: (i * 101 + 7) as u8,
+                    b: (i * i) as u8,
+                    a: (i * 59 + 200) as u8,
+                }
+                .into()
+            })
+            .collect()
+    }
+
+    #[test]
+    fn box_blur_line_matches_reference() {
+        for &len in &[0, 1, 5, 13, 100] {
+            let src = blur_pixels(len);
+
+            for &kernel_size in &[1, 2, 3, 8, 9, 50, 501, 40000] {
+                for &target in &[0, kernel_size / 2, kernel_size - 1] {
+                    for &alpha_only in &[false, true] {
+                        let mut dst = vec![CairoARGB::default(); len];
+                        box_blur_line(&src, &mut dst, kernel_size, target, alpha_only);
+
+                        assert_eq!(
+                            dst,
+                            box_blur_reference(&src, kernel_size, target, alpha_only)
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn box_sums_match_reference() {
+        // Blur a single column down as many rows as there are pixels, but with the pixel
+        // for each row repeated along it, to check the sums for every position in a row.
+        for &width in &[1, 3, 8, 17] {
+            let column = blur_pixels(100);
+
+            for &kernel_size in &[1, 4, 9, 40000] {
+                for &alpha_only in &[false, true] {
+                    let expected = box_blur_reference(&column, kernel_size, 0, alpha_only);
+
+                    let mut sums = BoxSums::new(width);
+                    let mut dst = vec![CairoARGB::default(); width];
+
+                    for (j, p) in column.iter().enumerate() {
+                        if j >= kernel_size {
+                            sums.sub(&vec![column[j - kernel_size]; width]);
+                        }
+                        sums.add(&vec![*p; width]);
+
+                        // The output lags behind by kernel_size - 1 pixels.
+                        if j + 1 >= kernel_size {
+                            sums.average(kernel_size, alpha_only, &mut dst);
+                            assert!(dst.iter().all(|d| *d == expected[j + 1 - kernel_size]));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    #[cfg(target_arch = "x86_64")]
+    #[test]
+    fn box_sums_sse2_match_scalar() {
+        let row = blur_pixels(103);
+
+        let mut sums = vec![[0; 4]; row.len()];
+        let mut expected = vec![[0; 4]; row.len()];
+
+        let done = unsafe {
+            x86::add_or_sub_row_sse2(
+                sums.as_mut_ptr().cast(),
+                row.as_ptr().cast(),
+                row.len(),
+                false,
+            )
+        };
+        assert_eq!(done, row.len() / 4 * 4);
+
+        for (sum, p) in expected.iter_mut().zip(&row).take(done) {
+            add_components(sum, *p);
+            add_components(sum, *p);
+            add_components(sum, *p);
+        }
+        for (sum, p) in sums.iter_mut().zip(&row).take(done) {
+            add_components(sum, *p);
+            add_components(sum, *p);
+        }
+        assert_eq!(sums, expected);
+
+        for &kernel_size in &[3, 7, 32767] {
+            for &alpha_only in &[false, true] {
+                let mut dst = vec![CairoARGB::default(); done];
+                unsafe {
+                    x86::average_row_sse2(
+                        sums.as_ptr().cast(),
+                        dst.as_mut_ptr().cast(),
+                        done,
+                        kernel_size,
+                        alpha_only,
+                    )
+                };
+
+                for (sum, d) in sums.iter().zip(&dst) {
+                    assert_eq!(*d, average(sum, kernel_size, alpha_only));
+                }
+            }
+        }
+    }
+}
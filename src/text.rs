@@ -2,15 +2,18 @@
 
 use markup5ever::{expanded_name, local_name, namespace_url, ns};
 use std::cell::RefCell;
+use std::collections::hash_map::DefaultHasher;
+use std::hash::{Hash, Hasher};
 use std::rc::Rc;
 
 use crate::bbox::BoundingBox;
-use crate::document::{AcquiredNodes, NodeId};
+use crate::document::{AcquiredNodes, Document, NodeId};
 use crate::drawing_ctx::DrawingCtx;
 use crate::element::{Draw, Element, ElementResult, SetAttributes};
 use crate::error::*;
 use crate::layout::{self, FontProperties, StackingContext, Stroke};
 use crate::length::*;
+use crate::lru::LruCache;
 use crate::node::{CascadedValues, Node, NodeBorrow};
 use crate::parsers::ParseValue;
 use crate::properties::{
@@ -81,9 +84,9 @@ struct PositionedSpan {
 }
 
 impl Chunk {
-    fn new(values: &ComputedValues, x: Option<f64>, y: Option<f64>) -> Chunk {
+    fn new(values: Rc<ComputedValues>, x: Option<f64>, y: Option<f64>) -> Chunk {
         Chunk {
-            values: Rc::new(values.clone()),
+            values,
             x,
             y,
             spans: Vec::new(),
@@ -92,11 +95,11 @@ impl Chunk {
 }
 
 impl MeasuredChunk {
-    fn from_chunk(chunk: &Chunk, draw_ctx: &DrawingCtx) -> MeasuredChunk {
+    fn from_chunk(chunk: &Chunk, document: &Document, draw_ctx: &DrawingCtx) -> MeasuredChunk {
         let measured_spans: Vec<MeasuredSpan> = chunk
             .spans
             .iter()
-            .map(|span| MeasuredSpan::from_span(span, draw_ctx))
+            .map(|span| MeasuredSpan::from_span(span, document, draw_ctx))
             .collect();
 
         let advance = measured_spans.iter().fold((0.0, 0.0), |acc, measured| {
@@ -185,14 +188,14 @@ impl Span {
 }
 
 impl MeasuredSpan {
-    fn from_span(span: &Span, draw_ctx: &DrawingCtx) -> MeasuredSpan {
+    fn from_span(span: &Span, document: &Document, draw_ctx: &DrawingCtx) -> MeasuredSpan {
         let values = span.values.clone();
 
         let view_params = draw_ctx.get_view_params();
         let params = NormalizeParams::new(&values, &view_params);
 
         let properties = FontProperties::new(&values, &params);
-        let layout = create_pango_layout(draw_ctx, &properties, &span.text);
+        let layout = create_pango_layout(draw_ctx, document, &properties, &span.text);
         let (w, h) = layout.size();
 
         let w = f64::from(w) / f64::from(pango::SCALE);
@@ -318,10 +321,9 @@ fn children_to_chunks(
 ) {
     for child in node.children() {
         if child.is_chars() {
-            let values = cascaded.get();
             child
                 .borrow_chars()
-                .to_chunks(&child, Rc::new(values.clone()), chunks, dx, dy, depth);
+                .to_chunks(&child, cascaded.get_shared(), chunks, dx, dy, depth);
         } else {
             assert!(child.is_element());
 
@@ -457,6 +459,16 @@ impl Chars {
     pub fn get_string(&self) -> String {
         self.string.borrow().clone()
     }
+
+    /// Approximate number of bytes that the text takes in memory.
+    pub fn approximate_size(&self) -> usize {
+        self.string.borrow().capacity()
+            + self
+                .space_normalized
+                .borrow()
+                .as_ref()
+                .map_or(0, String::capacity)
+    }
 }
 
 #[derive(Default)]
@@ -483,7 +495,7 @@ impl Text {
         let view_params = draw_ctx.get_view_params();
         let params = NormalizeParams::new(&values, &view_params);
 
-        chunks.push(Chunk::new(&values, Some(x), Some(y)));
+        chunks.push(Chunk::new(cascaded.get_shared(), Some(x), Some(y)));
 
         let dx = self.dx.to_user(&params);
         let dy = self.dy.to_user(&params);
@@ -549,7 +561,7 @@ impl Draw for Text {
 
                 let mut measured_chunks = Vec::new();
                 for chunk in &chunks {
-                    measured_chunks.push(MeasuredChunk::from_chunk(chunk, dc));
+                    measured_chunks.push(MeasuredChunk::from_chunk(chunk, an.document(), dc));
                 }
 
                 let mut positioned_chunks = Vec::new();
@@ -607,12 +619,7 @@ impl TRef {
 
         if let Ok(acquired) = acquired_nodes.acquire(link) {
             let c = acquired.get();
-            extract_chars_children_to_chunks_recursively(
-                chunks,
-                &c,
-                Rc::new(values.clone()),
-                depth,
-            );
+            extract_chars_children_to_chunks_recursively(chunks, &c, cascaded.get_shared(), depth);
         } else {
             rsvg_log!(
                 "element {} references a nonexistent text source \"{}\"",
@@ -693,7 +700,7 @@ impl TSpan {
         let span_dy = dy + self.dy.to_user(&params);
 
         if x.is_some() || y.is_some() {
-            chunks.push(Chunk::new(values, x, y));
+            chunks.push(Chunk::new(cascaded.get_shared(), x, y));
         }
 
         children_to_chunks(
@@ -814,7 +821,80 @@ impl From<WritingMode> for pango::Gravity {
     }
 }
 
-fn create_pango_layout(draw_ctx: &DrawingCtx, props: &FontProperties, text: &str) -> pango::Layout {
+/// A shaped layout in the `LayoutCache`, with the text and font properties it was created for.
+struct LayoutCacheEntry {
+    text: String,
+    props: FontProperties,
+    layout: pango::Layout,
+}
+
+/// Cache of shaped text for a document.
+///
+/// Creating a `pango::Layout` and shaping its text is the slowest part of
+/// rendering text.  A layout only depends on its text and font properties;
+/// the transform and font options it was shaped for are updated when it gets
+/// used again, and Pango only shapes the text again if those changed.
+///
+/// Layouts are looked up by a hash of their text and font size, so that
+/// lookups don't need to build a key, and the entry is then compared with the
+/// text and font properties.  If two of them have the same hash, the one that
+/// was inserted last replaces the other.
+///
+/// The cache is bounded by the number of layouts in it, and the least recently
+/// used ones are evicted first.
+pub struct LayoutCache(LruCache<u64, LayoutCacheEntry>);
+
+fn layout_hash(text: &str, props: &FontProperties) -> u64 {
+    let mut hasher = DefaultHasher::new();
+
+    text.hash(&mut hasher);
+    props.font_size.to_bits().hash(&mut hasher);
+    props.letter_spacing.to_bits().hash(&mut hasher);
+
+    hasher.finish()
+}
+
+impl LayoutCache {
+    pub fn new(max_entries: usize) -> LayoutCache {
+        LayoutCache(LruCache::new(max_entries))
+    }
+
+    pub fn get(&mut self, text: &str, props: &FontProperties) -> Option<pango::Layout> {
+        self.0
+            .get(&layout_hash(text, props))
+            .filter(|e| e.text == text && e.props == *props)
+            .map(|e| e.layout.clone())
+    }
+
+    pub fn insert(&mut self, text: &str, props: &FontProperties, layout: pango::Layout) {
+        let entry = LayoutCacheEntry {
+            text: String::from(text),
+            props: props.clone(),
+            layout,
+        };
+
+        self.0.insert(layout_hash(text, props), entry, 1);
+    }
+}
+
+/// Returns a layout for a span's text, reusing a cached one from the document if possible.
+fn create_pango_layout(
+    draw_ctx: &DrawingCtx,
+    document: &Document,
+    props: &FontProperties,
+    text: &str,
+) -> pango::Layout {
+    if let Some(layout) = document.lookup_text_layout(text, props) {
+        draw_ctx.update_pango_layout(&layout);
+        return layout;
+    }
+
+    let layout = shape_pango_layout(draw_ctx, props, text);
+    document.store_text_layout(text, props, layout.clone());
+    layout
+}
+
+fn shape_pango_layout(draw_ctx: &DrawingCtx, props: &FontProperties, text: &str) -> pango::Layout {
     let pango_context = pango::Context::from(draw_ctx);
 
     if let XmlLang(Some(ref lang)) = props.xml_lang {
@@ -896,7 +976,9 @@ fn create_pango_layout(draw_ctx: &DrawingCtx, props: &FontProperties, text: &str
 
 #[cfg(test)]
 mod tests {
-    use super::Chars;
+    use super::*;
+    use crate::dpi::Dpi;
+    use crate::drawing_ctx::ViewParams;
 
     #[test]
     fn chars_default() {
@@ -912,4 +994,31 @@ mod tests {
         assert_eq!(c.get_string(), example);
         assert!(c.space_normalized.borrow().is_none());
     }
+
+    #[test]
+    fn layout_cache_evicts_least_recently_used() {
+        let values = ComputedValues::default();
+        let view_params = ViewParams::new(Dpi::new(96.0, 96.0), 100.0, 100.0);
+        let params = NormalizeParams::new(&values, &view_params);
+        let props = FontProperties::new(&values, &params);
+
+        let layout = pango::Layout::new(&pango::Context::new());
+
+        let mut cache = LayoutCache::new(2);
+
+        cache.insert("a", &props, layout.clone());
+        cache.insert("b", &props, layout.clone());
+
+        assert!(cache.get("a", &props).is_some());
+
+        cache.insert("c", &props, layout.clone());
+
+        assert!(cache.get("a", &props).is_some());
+        assert!(cache.get("b", &props).is_none());
+        assert!(cache.get("c", &props).is_some());
+
+        let mut larger = props.clone();
+        larger.font_size *= 2.0;
+        assert!(cache.get("a", &larger).is_none());
+    }
 }
@@ -1,5 +1,6 @@
 //! Store XML element attributes and their values.
 
+use std::mem;
 use std::slice;
 use std::str;
 
@@ -100,6 +101,20 @@ impl Attributes {
         self.0.len()
     }
 
+    /// Approximate number of bytes that the attributes take in memory.
+    ///
+    /// The values are counted twice, once for the string and once as a proxy
+    /// for what elements parse from them, like the commands of path data.
+    pub fn approximate_size(&self) -> usize {
+        self.0
+            .iter()
+            .map(|(_, value)| {
+                let value: &str = value.as_ref();
+                mem::size_of::<(QualName, AttributeValue)>() + 2 * value.len()
+            })
+            .sum()
+    }
+
     /// Creates an iterator that yields `(QualName, &'a str)` tuples.
     pub fn iter(&self) -> AttributesIter<'_> {
         AttributesIter(self.0.iter())
@@ -4,7 +4,7 @@ use encoding::label::encoding_from_whatwg_label;
 use encoding::DecoderTrap;
 use gio::{
     prelude::BufferedInputStreamExt, BufferedInputStream, Cancellable, ConverterInputStream,
-    InputStream, ZlibCompressorFormat, ZlibDecompressor,
+    InputStream, MemoryInputStream, ZlibCompressorFormat, ZlibDecompressor,
 };
 use glib::Cast;
 use markup5ever::{
@@ -13,6 +13,7 @@ use markup5ever::{
 };
 use std::cell::RefCell;
 use std::collections::HashMap;
+use std::mem;
 use std::rc::{Rc, Weak};
 use std::str;
 use std::string::ToString;
@@ -599,6 +600,10 @@ impl XmlState {
     ) -> Result<Document, LoadingError> {
         self.parse_from_stream(stream, cancellable)?;
 
+        self.build()
+    }
+
+    fn build(&self) -> Result<Document, LoadingError> {
         self.inner
             .borrow_mut()
             .document_builder
@@ -698,6 +703,108 @@ pub fn xml_load_from_possibly_compressed_stream(
     state.build_document(&stream, cancellable)
 }
 
+/// Loads a document from data that arrives in chunks, like from the `rsvg_handle_write()` API.
+///
+/// Plain XML gets fed to libxml2's push parser as it arrives, so the tree is built while the
+/// rest of the data is still being written.  Gzipped data (SVGZ) is buffered and decompressed
+/// when the loader is closed, as is done for streams.
+pub struct XmlPushLoader {
+    state: Rc<XmlState>,
+    input: PushInput,
+}
+
+enum PushInput {
+    /// Not enough data yet to know whether it is compressed.
+    Start(Vec<u8>),
+
+    /// Plain XML; the parser, or the first error it returned.
+    Xml(Result<Box<Xml2Parser>, LoadingError>),
+
+    /// Gzipped data, to be parsed in `close()`.
+    Compressed(Vec<u8>),
+}
+
+impl XmlPushLoader {
+    pub fn new(document_builder: DocumentBuilder, unlimited_size: bool) -> XmlPushLoader {
+        let state = Rc::new(XmlState::new(document_builder, unlimited_size));
+
+        state.inner.borrow_mut().weak = Some(Rc::downgrade(&state));
+
+        XmlPushLoader {
+            state,
+            input: PushInput::Start(Vec::new()),
+        }
+    }
+
+    /// Feeds a chunk of data to the loader.
+    ///
+    /// Parsing errors are kept until `close()`; data written after an error is ignored.
+    pub fn write(&mut self, buf: &[u8]) {
+        match self.input {
+            PushInput::Start(ref mut start) => {
+                start.extend_from_slice(buf);
+
+                if start.len() >= 2 {
+                    let start = mem::take(start);
+
+                    if start[0..2] == [GZ_MAGIC_0, GZ_MAGIC_1] {
+                        self.input = PushInput::Compressed(start);
+                    } else {
+                        let parser =
+                            Xml2Parser::for_push(self.state.clone(), self.state.unlimited_size);
+                        self.input = PushInput::Xml(parser);
+                        self.push_xml(&start);
+                    }
+                }
+            }
+
+            PushInput::Xml(_) => self.push_xml(buf),
+
+            PushInput::Compressed(ref mut buffer) => buffer.extend_from_slice(buf),
+        }
+    }
+
+    /// Returns the root element, once its start tag has been parsed.
+    ///
+    /// Its attributes are set, but styles have not been cascaded yet.
+    pub fn root(&self) -> Option<Node> {
+        self.state
+            .inner
+            .borrow()
+            .document_builder
+            .as_ref()
+            .and_then(|builder| builder.root())
+    }
+
+    fn push_xml(&mut self, buf: &[u8]) {
+        if let PushInput::Xml(Ok(ref parser)) = self.input {
+            if let Err(e) = parser.push(buf) {
+                self.input = PushInput::Xml(Err(e));
+            }
+        }
+    }
+
+    /// Finishes parsing and builds the document.
+    pub fn close(self, cancellable: Option<&Cancellable>) -> Result<Document, LoadingError> {
+        match self.input {
+            PushInput::Xml(parser) => {
+                parser.and_then(|parser| parser.finish())?;
+                self.state.check_last_error()?;
+                self.state.build()
+            }
+
+            // When the data is too short to tell, this gives the same error as for streams.
+            PushInput::Start(buffer) | PushInput::Compressed(buffer) => {
+                let bytes = glib::Bytes::from_owned(buffer);
+                let stream = MemoryInputStream::from_bytes(&bytes).upcast::<InputStream>();
+                let stream = get_input_stream_for_loading(&stream, cancellable)?;
+
+                self.state.build_document(&stream, cancellable)
+            }
+        }
+    }
+}
+
 // Header of a gzip data stream
 const GZ_MAGIC_0: u8 = 0x1f;
 const GZ_MAGIC_1: u8 = 0x8b;
@@ -189,6 +189,21 @@ extern "C" {
         enc: xmlCharEncoding,
     ) -> xmlParserCtxtPtr;
 
+    pub fn xmlCreatePushParserCtxt(
+        sax: xmlSAXHandlerPtr,
+        user_data: *mut libc::c_void,
+        chunk: *const libc::c_char,
+        size: libc::c_int,
+        filename: *const libc::c_char,
+    ) -> xmlParserCtxtPtr;
+
+    pub fn xmlParseChunk(
+        ctxt: xmlParserCtxtPtr,
+        chunk: *const libc::c_char,
+        size: libc::c_int,
+        terminate: libc::c_int,
+    ) -> libc::c_int;
+
     pub fn xmlStopParser(ctxt: xmlParserCtxtPtr);
 
     pub fn xmlParseDocument(ctxt: xmlParserCtxtPtr) -> libc::c_int;
@@ -1,7 +1,8 @@
 //! Glue between the libxml2 API and our xml parser module.
 //!
 //! This file provides functions to create a libxml2 xmlParserCtxtPtr, configured
-//! to read from a gio::InputStream, and to maintain its loading data in an XmlState.
+//! to read from a gio::InputStream or to be pushed chunks of data, and to maintain
+//! its loading data in an XmlState.
 
 use gio::prelude::*;
 use std::borrow::Cow;
@@ -446,27 +447,98 @@ impl Xml2Parser {
         }
     }
 
-    pub fn parse(&self) -> Result<(), LoadingError> {
-        unsafe {
-            let parser = self.parser.get();
+    /// Creates a parser that gets fed data with `push()`, instead of reading it from a stream.
+    pub fn for_push(
+        state: Rc<XmlState>,
+        unlimited_size: bool,
+    ) -> Result<Box<Xml2Parser>, LoadingError> {
+        init_libxml2();
 
-            let xml_parse_success = xmlParseDocument(parser) == 0;
+        let mut sax_handler = get_xml2_sax_handler();
+
+        let mut xml2_parser = Box::new(Xml2Parser {
+            parser: Cell::new(ptr::null_mut()),
+            state,
+            gio_error: Rc::new(RefCell::new(None)),
+        });
 
-            let mut err_ref = self.gio_error.borrow_mut();
+        unsafe {
+            let xml2_parser_ptr: *mut Xml2Parser = xml2_parser.as_mut();
 
-            let io_error = err_ref.take();
+            // libxml2 detects the encoding from the first chunk that gets pushed.
+            let parser = xmlCreatePushParserCtxt(
+                &mut sax_handler,
+                xml2_parser_ptr as *mut _,
+                ptr::null(),
+                0,
+                ptr::null(),
+            );
 
-            if let Some(io_error) = io_error {
-                Err(LoadingError::from(io_error))
-            } else if !xml_parse_success {
-                let xerr = xmlCtxtGetLastError(parser as *mut _);
-                let msg = xml2_error_to_string(xerr);
-                Err(LoadingError::XmlParseError(msg))
+            if parser.is_null() {
+                Err(LoadingError::OutOfMemory(String::from(
+                    "could not create XML parser",
+                )))
             } else {
-                Ok(())
+                xml2_parser.parser.set(parser);
+
+                set_xml_parse_options(parser, unlimited_size);
+
+                Ok(xml2_parser)
             }
         }
     }
+
+    pub fn parse(&self) -> Result<(), LoadingError> {
+        let xml_parse_success = unsafe { xmlParseDocument(self.parser.get()) == 0 };
+
+        self.check_result(xml_parse_success)
+    }
+
+    /// Parses a chunk of data for a parser created with `for_push()`.
+    ///
+    /// Elements get created as soon as their start tag has been pushed.  Once this returns an
+    /// error, the parser is stopped and will not accept more data.
+    pub fn push(&self, buf: &[u8]) -> Result<(), LoadingError> {
+        for chunk in buf.chunks(libc::c_int::MAX as usize) {
+            self.parse_chunk(chunk, false)?;
+        }
+
+        Ok(())
+    }
+
+    /// Tells a parser created with `for_push()` that there is no more data, and finishes parsing.
+    pub fn finish(&self) -> Result<(), LoadingError> {
+        self.parse_chunk(&[], true)
+    }
+
+    fn parse_chunk(&self, chunk: &[u8], terminate: bool) -> Result<(), LoadingError> {
+        let xml_parse_success = unsafe {
+            xmlParseChunk(
+                self.parser.get(),
+                chunk.as_ptr() as *const libc::c_char,
+                chunk.len() as libc::c_int,
+                terminate.into(),
+            ) == 0
+        };
+
+        self.check_result(xml_parse_success)
+    }
+
+    fn check_result(&self, xml_parse_success: bool) -> Result<(), LoadingError> {
+        let mut err_ref = self.gio_error.borrow_mut();
+
+        let io_error = err_ref.take();
+
+        if let Some(io_error) = io_error {
+            Err(LoadingError::from(io_error))
+        } else if !xml_parse_success {
+            let xerr = unsafe { xmlCtxtGetLastError(self.parser.get() as *mut _) };
+            let msg = xml2_error_to_string(xerr);
+            Err(LoadingError::XmlParseError(msg))
+        } else {
+            Ok(())
+        }
+    }
 }
 
 impl Drop for Xml2Parser {
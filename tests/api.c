@@ -13,6 +13,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #include <cairo.h>
 
@@ -743,6 +744,41 @@ reset_size_callback (void)
     g_assert_true (data_2.destroyed);
 }
 
+static void
+record_size_func (gint *width, gint *height, gpointer user_data)
+{
+    gint *size = user_data;
+
+    size[0] = *width;
+    size[1] = *height;
+}
+
+static void
+size_callback_during_write (void)
+{
+    const char *start = "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"100\" height=\"50\">";
+    const char *end = "<rect width=\"10\" height=\"10\"/></svg>";
+    gint size[2] = { 0, 0 };
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_handle_new ();
+    rsvg_handle_set_size_callback (handle, record_size_func, size, NULL);
+
+    /* The size is known as soon as the root element's start tag is parsed */
+    g_assert_true (rsvg_handle_write (handle, (const guchar *) start, strlen (start), &error));
+    g_assert_no_error (error);
+    g_assert_cmpint (size[0], ==, 100);
+    g_assert_cmpint (size[1], ==, 50);
+
+    g_assert_true (rsvg_handle_write (handle, (const guchar *) end, strlen (end), &error));
+    g_assert_no_error (error);
+
+    g_assert_true (rsvg_handle_close (handle, &error));
+    g_assert_no_error (error);
+
+    g_object_unref (handle);
+}
+
 static void
 zero_size_func (gint *width, gint *height, gpointer user_data)
 {
@@ -1074,6 +1110,300 @@ render_document (void)
     g_object_unref (handle);
 }
 
+static void
+paint_tile (cairo_surface_t *surface, int x, int y, gpointer user_data)
+{
+    cairo_t *cr = user_data;
+
+    cairo_set_source_surface (cr, surface, x, y);
+    cairo_paint (cr);
+}
+
+static void
+render_tiles (void)
+{
+    char *filename = get_test_filename ("document.svg");
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_handle_new_from_file (filename, &error);
+    g_free (filename);
+
+    g_assert_nonnull (handle);
+    g_assert_no_error (error);
+
+    cairo_surface_t *output = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+    cairo_t *cr = cairo_create (output);
+
+    RsvgRectangle viewport = { 50.0, 50.0, 50.0, 50.0 };
+
+    g_assert (rsvg_handle_render_tiles (handle, &viewport, 32, 32, 16.0, paint_tile, cr, &error));
+    g_assert_no_error (error);
+
+    cairo_destroy (cr);
+
+    cairo_surface_t *expected = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+    cr = cairo_create (expected);
+
+    cairo_translate (cr, 50.0, 50.0);
+    cairo_rectangle (cr, 10.0, 10.0, 30.0, 30.0);
+    cairo_set_source_rgba (cr, 0.0, 0.0, 1.0, 0.5);
+    cairo_fill (cr);
+    cairo_destroy (cr);
+
+    cairo_surface_t *diff = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+
+    TestUtilsBufferDiffResult result = {0, 0};
+    test_utils_compare_surfaces (output, expected, diff, &result);
+
+    if (result.pixels_changed && result.max_diff > 0) {
+        g_test_fail ();
+    }
+
+    cairo_surface_destroy (diff);
+    cairo_surface_destroy (expected);
+    cairo_surface_destroy (output);
+    g_object_unref (handle);
+}
+
+static gpointer
+render_snapshot_in_thread (gpointer data)
+{
+    RsvgSnapshot *snapshot = data;
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_snapshot_new_handle (snapshot, &error);
+    g_assert_nonnull (handle);
+    g_assert_no_error (error);
+
+    rsvg_snapshot_unref (snapshot);
+
+    cairo_surface_t *output = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+    cairo_t *cr = cairo_create (output);
+
+    RsvgRectangle viewport = { 50.0, 50.0, 50.0, 50.0 };
+
+    g_assert (rsvg_handle_render_document (handle, cr, &viewport, &error));
+    g_assert_no_error (error);
+
+    cairo_destroy (cr);
+    g_object_unref (handle);
+
+    return output;
+}
+
+static void
+render_from_snapshot (void)
+{
+    char *filename = get_test_filename ("document.svg");
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_handle_new_from_file (filename, &error);
+    g_free (filename);
+
+    g_assert_nonnull (handle);
+    g_assert_no_error (error);
+
+    RsvgSnapshot *snapshot = rsvg_handle_freeze (handle, &error);
+    g_assert_nonnull (snapshot);
+    g_assert_no_error (error);
+
+    /* The snapshot does not depend on the original handle */
+    g_object_unref (handle);
+
+    GThread *threads[2];
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        threads[i] = g_thread_new ("render_from_snapshot",
+                                   render_snapshot_in_thread,
+                                   rsvg_snapshot_ref (snapshot));
+    }
+
+    cairo_surface_t *expected = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+    cairo_t *cr = cairo_create (expected);
+
+    cairo_translate (cr, 50.0, 50.0);
+    cairo_rectangle (cr, 10.0, 10.0, 30.0, 30.0);
+    cairo_set_source_rgba (cr, 0.0, 0.0, 1.0, 0.5);
+    cairo_fill (cr);
+    cairo_destroy (cr);
+
+    for (i = 0; i < 2; i++) {
+        cairo_surface_t *output = g_thread_join (threads[i]);
+        cairo_surface_t *diff = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+
+        TestUtilsBufferDiffResult result = {0, 0};
+        test_utils_compare_surfaces (output, expected, diff, &result);
+
+        if (result.pixels_changed && result.max_diff > 0) {
+            g_test_fail ();
+        }
+
+        cairo_surface_destroy (diff);
+        cairo_surface_destroy (output);
+    }
+
+    cairo_surface_destroy (expected);
+    rsvg_snapshot_unref (snapshot);
+}
+
+static void
+render_damage (void)
+{
+    char *filename = get_test_filename ("document.svg");
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_handle_new_from_file (filename, &error);
+    g_free (filename);
+
+    g_assert_nonnull (handle);
+    g_assert_no_error (error);
+
+    cairo_surface_t *output = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+    cairo_t *cr = cairo_create (output);
+
+    RsvgRectangle viewport = { 50.0, 50.0, 50.0, 50.0 };
+    RsvgRectangle damage;
+
+    g_assert (rsvg_handle_render_document (handle, cr, &viewport, &error));
+    g_assert_no_error (error);
+
+    /* Nothing changed since the last rendering */
+    g_assert (rsvg_handle_render_damage (handle, cr, &viewport, &damage, &error));
+    g_assert_no_error (error);
+    g_assert_cmpfloat (damage.width, ==, 0.0);
+    g_assert_cmpfloat (damage.height, ==, 0.0);
+
+    const char *css = "rect { fill: lime; }";
+    g_assert (rsvg_handle_set_stylesheet (handle, (const guint8 *) css, strlen (css), &error));
+    g_assert_no_error (error);
+
+    g_assert (rsvg_handle_render_damage (handle, cr, &viewport, &damage, &error));
+    g_assert_no_error (error);
+
+    /* The rectangle, rounded out to whole pixels plus one */
+    g_assert_cmpfloat (damage.x, ==, 59.0);
+    g_assert_cmpfloat (damage.y, ==, 59.0);
+    g_assert_cmpfloat (damage.width, ==, 32.0);
+    g_assert_cmpfloat (damage.height, ==, 32.0);
+
+    cairo_destroy (cr);
+
+    cairo_surface_t *expected = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+    cr = cairo_create (expected);
+
+    cairo_translate (cr, 50.0, 50.0);
+    cairo_rectangle (cr, 10.0, 10.0, 30.0, 30.0);
+    cairo_set_source_rgba (cr, 0.0, 1.0, 0.0, 0.5);
+    cairo_fill (cr);
+    cairo_destroy (cr);
+
+    cairo_surface_t *diff = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 150, 150);
+
+    TestUtilsBufferDiffResult result = {0, 0};
+    test_utils_compare_surfaces (output, expected, diff, &result);
+
+    if (result.pixels_changed && result.max_diff > 0) {
+        g_test_fail ();
+    }
+
+    cairo_surface_destroy (diff);
+    cairo_surface_destroy (expected);
+    cairo_surface_destroy (output);
+    g_object_unref (handle);
+}
+
+static void
+render_limits (void)
+{
+    char *filename = get_test_filename ("document.svg");
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_handle_new_from_file (filename, &error);
+    g_free (filename);
+
+    g_assert_nonnull (handle);
+    g_assert_no_error (error);
+
+    cairo_surface_t *output = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 50, 50);
+    cairo_t *cr = cairo_create (output);
+
+    RsvgRectangle viewport = { 0.0, 0.0, 50.0, 50.0 };
+
+    /* The group with opacity needs a temporary surface of 50x50 pixels */
+    rsvg_handle_set_render_limits (handle, 0, 1000);
+    g_assert (!rsvg_handle_render_document (handle, cr, &viewport, &error));
+    g_assert_error (error, RSVG_ERROR, RSVG_ERROR_FAILED);
+    g_clear_error (&error);
+
+    rsvg_handle_set_render_limits (handle, 0, 0);
+    g_assert (rsvg_handle_render_document (handle, cr, &viewport, &error));
+    g_assert_no_error (error);
+
+    GCancellable *cancellable = g_cancellable_new ();
+    g_cancellable_cancel (cancellable);
+
+    rsvg_handle_set_render_cancellable (handle, cancellable);
+    g_assert (!rsvg_handle_render_document (handle, cr, &viewport, &error));
+    g_assert_error (error, RSVG_ERROR, RSVG_ERROR_FAILED);
+    g_clear_error (&error);
+
+    rsvg_handle_set_render_cancellable (handle, NULL);
+    g_assert (rsvg_handle_render_document (handle, cr, &viewport, &error));
+    g_assert_no_error (error);
+
+    g_object_unref (cancellable);
+    cairo_destroy (cr);
+    cairo_surface_destroy (output);
+    g_object_unref (handle);
+}
+
+static void
+render_document_to_buffer (void)
+{
+    char *filename = get_test_filename ("document.svg");
+    GError *error = NULL;
+
+    RsvgHandle *handle = rsvg_handle_new_from_file (filename, &error);
+    g_free (filename);
+
+    g_assert_nonnull (handle);
+    g_assert_no_error (error);
+
+    int stride = 50 * 4;
+    guint8 *buffer = g_malloc (stride * 50);
+
+    RsvgRectangle viewport = { 0.0, 0.0, 50.0, 50.0 };
+
+    g_assert (rsvg_handle_render_document_to_buffer (handle,
+                                                     buffer,
+                                                     50,
+                                                     50,
+                                                     stride,
+                                                     RSVG_PIXEL_FORMAT_RGBA,
+                                                     &viewport,
+                                                     &error));
+    g_assert_no_error (error);
+
+    /* Outside the rectangle */
+    guint8 *p = buffer + 5 * stride + 5 * 4;
+    g_assert_cmpuint (p[0], ==, 0);
+    g_assert_cmpuint (p[1], ==, 0);
+    g_assert_cmpuint (p[2], ==, 0);
+    g_assert_cmpuint (p[3], ==, 0);
+
+    /* Inside the rectangle, which is blue with 0.5 opacity */
+    p = buffer + 20 * stride + 20 * 4;
+    g_assert_cmpuint (p[0], ==, 0);
+    g_assert_cmpuint (p[1], ==, 0);
+    g_assert_cmpuint (p[2], >=, 254);
+    g_assert_cmpuint (p[3], >=, 127);
+    g_assert_cmpuint (p[3], <=, 128);
+
+    g_free (buffer);
+    g_object_unref (handle);
+}
+
 static void
 get_geometry_for_layer (void)
 {
@@ -1265,6 +1595,28 @@ empty_write_close (void)
     g_object_unref (handle);
 }
 
+static void
+write_invalid_xml_close (void)
+{
+    RsvgHandle *handle = rsvg_handle_new();
+    GError *error = NULL;
+    const char *chunks[] = { "<svg xmlns=\"http://www.w3.org/2000/svg\">", "<rect>", "</svg>" };
+    int i;
+
+    /* The chunks get parsed as they are written, but the error is reported by close() */
+    for (i = 0; i < G_N_ELEMENTS (chunks); i++) {
+        g_assert_true (rsvg_handle_write (handle, (const guchar *) chunks[i], strlen (chunks[i]), &error));
+        g_assert_no_error (error);
+    }
+
+    g_assert_false (rsvg_handle_close (handle, &error));
+    g_assert_error (error, RSVG_ERROR, RSVG_ERROR_FAILED);
+
+    g_error_free (error);
+
+    g_object_unref (handle);
+}
+
 static void
 cannot_request_external_elements (void)
 {
@@ -1670,6 +2022,7 @@ add_api_tests (void)
     g_test_add_func ("/api/dimensions_and_position", dimensions_and_position);
     g_test_add_func ("/api/set_size_callback", set_size_callback);
     g_test_add_func ("/api/reset_size_callback", reset_size_callback);
+    g_test_add_func ("/api/size_callback_during_write", size_callback_during_write);
     g_test_add_func ("/api/render_with_zero_size_callback", render_with_zero_size_callback);
     g_test_add_func ("/api/get_pixbuf_with_size_callback", get_pixbuf_with_size_callback);
     g_test_add_func ("/api/detects_cairo_context_in_error", detects_cairo_context_in_error);
@@ -1679,11 +2032,17 @@ add_api_tests (void)
     g_test_add_func ("/api/get_intrinsic_size_in_pixels/yes", get_intrinsic_size_in_pixels_yes);
     g_test_add_func ("/api/get_intrinsic_size_in_pixels/no", get_intrinsic_size_in_pixels_no);
     g_test_add_func ("/api/render_document", render_document);
+    g_test_add_func ("/api/render_tiles", render_tiles);
+    g_test_add_func ("/api/render_from_snapshot", render_from_snapshot);
+    g_test_add_func ("/api/render_damage", render_damage);
+    g_test_add_func ("/api/render_limits", render_limits);
+    g_test_add_func ("/api/render_document_to_buffer", render_document_to_buffer);
     g_test_add_func ("/api/get_geometry_for_layer", get_geometry_for_layer);
     g_test_add_func ("/api/render_layer", render_layer);
     g_test_add_func ("/api/untransformed_element", untransformed_element);
     g_test_add_func ("/api/no_write_before_close", no_write_before_close);
     g_test_add_func ("/api/empty_write_close", empty_write_close);
+    g_test_add_func ("/api/write_invalid_xml_close", write_invalid_xml_close);
     g_test_add_func ("/api/cannot_request_external_elements", cannot_request_external_elements);
     g_test_add_func ("/api/property_flags", property_flags);
     g_test_add_func ("/api/property_dpi", property_dpi);
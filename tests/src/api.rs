@@ -1,6 +1,12 @@
 use cairo;
+use gio::prelude::*;
 use librsvg::surface_utils::shared_surface::{SharedImageSurface, SurfaceType};
-use librsvg::{CairoRenderer, RenderingError};
+use librsvg::{
+    CairoRenderer, ImplementationLimit, Loader, ParallelTileRenderer, PixelFormat, RenderingError,
+    SvgHandle, SvgSnapshot,
+};
+use std::thread;
+use std::time::Duration;
 
 use crate::reference_utils::{Compare, Evaluate, Reference};
 use crate::utils::load_svg;
@@ -219,3 +225,775 @@ fn set_stylesheet() {
         .compare(&output_surf)
         .evaluate(&output_surf, "set_stylesheet");
 }
+
+#[test]
+fn snapshot_renders_like_handle_in_other_threads() {
+    fn assert_send_sync<T: Send + Sync>() {}
+    assert_send_sync::<SvgSnapshot>();
+
+    let mut svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <style>
+    .big { fill: #0000ff; }
+  </style>
+  <rect id="foo" x="10" y="20" width="30" height="40" fill="black"/>
+  <rect class="big" x="50" y="50" width="40" height="40"/>
+  <text x="10" y="90" font-size="10">hello <tspan fill="#ff0000">world</tspan></text>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    svg.set_stylesheet("#foo { fill: #00ff00; }")
+        .expect("should be a valid stylesheet");
+
+    fn render(svg: &SvgHandle) -> Vec<u8> {
+        let viewport = cairo::Rectangle {
+            x: 0.0,
+            y: 0.0,
+            width: 100.0,
+            height: 100.0,
+        };
+
+        let mut buffer = vec![0u8; 400 * 100];
+
+        CairoRenderer::new(svg)
+            .test_mode()
+            .render_document_to_buffer(
+                &mut buffer,
+                100,
+                100,
+                400,
+                PixelFormat::Argb32Premultiplied,
+                &viewport,
+            )
+            .unwrap();
+
+        buffer
+    }
+
+    let reference = render(&svg);
+
+    let snapshot = svg.freeze();
+
+    let threads: Vec<_> = (0..2)
+        .map(|_| {
+            let snapshot = snapshot.clone();
+            thread::spawn(move || render(&snapshot.to_handle().unwrap()))
+        })
+        .collect();
+
+    for thread in threads {
+        assert!(thread.join().unwrap() == reference);
+    }
+}
+
+/// Renders a 100x100 document as four tiles of 50x50 pixels, and puts them together.
+fn render_in_quarters(
+    renderer: &CairoRenderer,
+    viewport: &cairo::Rectangle,
+) -> cairo::ImageSurface {
+    let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+
+    {
+        let output_cr = cairo::Context::new(&output).expect("Failed to create a cairo context");
+
+        for &(x, y) in &[(0, 0), (50, 0), (0, 50), (50, 50)] {
+            let tile = cairo::ImageSurface::create(cairo::Format::ARgb32, 50, 50).unwrap();
+
+            {
+                let cr = cairo::Context::new(&tile).expect("Failed to create a cairo context");
+                cr.translate(-f64::from(x), -f64::from(y));
+                renderer.render_document(&cr, viewport).unwrap();
+            }
+
+            output_cr
+                .set_source_surface(&tile, f64::from(x), f64::from(y))
+                .unwrap();
+            output_cr.paint().unwrap();
+        }
+    }
+
+    output
+}
+
+/// Checks that a 100x100 rendering put together from tiles looks like the whole
+/// document rendered in one go.
+fn assert_matches_full_rendering(
+    svg: &SvgHandle,
+    viewport: &cairo::Rectangle,
+    output: cairo::ImageSurface,
+    output_name: &str,
+) {
+    let reference_surf = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+
+    {
+        let cr = cairo::Context::new(&reference_surf).expect("Failed to create a cairo context");
+        CairoRenderer::new(svg)
+            .render_document(&cr, viewport)
+            .unwrap();
+    }
+
+    let output_surf = SharedImageSurface::wrap(output, SurfaceType::SRgb).unwrap();
+
+    Reference::from_surface(reference_surf)
+        .compare(&output_surf)
+        .evaluate(&output_surf, output_name);
+}
+
+#[test]
+fn render_document_in_tiles_with_bleed() {
+    let svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <defs>
+    <filter id="blur">
+      <feGaussianBlur stdDeviation="2"/>
+    </filter>
+  </defs>
+  <g opacity="0.5">
+    <rect x="10" y="10" width="60" height="60" fill="#00ff00"/>
+    <rect x="30" y="30" width="60" height="60" fill="#0000ff"/>
+  </g>
+  <circle cx="50" cy="50" r="20" fill="#ff0000" filter="url(#blur)"/>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let renderer = CairoRenderer::new(&svg).with_tile_bleed(16.0);
+
+    assert_matches_full_rendering(
+        &svg,
+        &viewport,
+        render_in_quarters(&renderer, &viewport),
+        "render_document_in_tiles_with_bleed",
+    );
+}
+
+#[test]
+fn render_pattern_with_opacity_in_tiles() {
+    let svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <defs>
+    <pattern id="pat" patternUnits="userSpaceOnUse" width="40" height="40">
+      <g opacity="0.5">
+        <rect x="0" y="0" width="30" height="30" fill="#00ff00"/>
+        <rect x="10" y="10" width="30" height="30" fill="#0000ff"/>
+      </g>
+    </pattern>
+  </defs>
+  <rect x="5" y="5" width="90" height="90" fill="url(#pat)"/>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let renderer = CairoRenderer::new(&svg).with_tile_bleed(0.0);
+
+    assert_matches_full_rendering(
+        &svg,
+        &viewport,
+        render_in_quarters(&renderer, &viewport),
+        "render_pattern_with_opacity_in_tiles",
+    );
+}
+
+#[test]
+fn render_tiles_covers_viewport() {
+    let svg = load_svg(
+        br#"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="70">
+  <rect width="100" height="70" fill="blue"/>
+</svg>
+"#,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 70.0,
+    };
+
+    let mut tiles = Vec::new();
+
+    CairoRenderer::new(&svg)
+        .render_tiles(&viewport, 64, 64, |x, y, surface| {
+            tiles.push((x, y, surface.width(), surface.height()));
+        })
+        .unwrap();
+
+    assert_eq!(
+        tiles,
+        vec![
+            (0, 0, 64, 64),
+            (64, 0, 36, 64),
+            (0, 64, 64, 6),
+            (64, 64, 36, 6)
+        ]
+    );
+}
+
+#[test]
+fn parallel_tile_renderer_matches_full_rendering() {
+    let mut svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <g opacity="0.5">
+    <rect x="10" y="10" width="60" height="60" fill="#00ff00"/>
+    <rect x="30" y="30" width="60" height="60" fill="#0000ff"/>
+  </g>
+  <circle cx="50" cy="50" r="20" fill="#ff0000"/>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    // The workers must render with the user stylesheet, too.
+    svg.set_stylesheet("circle { fill: #ff00ff; }")
+        .expect("should be a valid stylesheet");
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let renderer =
+        ParallelTileRenderer::new(&CairoRenderer::new(&svg).with_tile_bleed(0.0)).with_threads(3);
+
+    let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+    let mut num_tiles = 0;
+
+    {
+        let output_cr = cairo::Context::new(&output).expect("Failed to create a cairo context");
+
+        renderer
+            .render_tiles(&viewport, 30, 30, |x, y, tile| {
+                output_cr
+                    .set_source_surface(&tile, f64::from(x), f64::from(y))
+                    .unwrap();
+                output_cr.paint().unwrap();
+                num_tiles += 1;
+            })
+            .unwrap();
+    }
+
+    assert_eq!(num_tiles, 16);
+
+    assert_matches_full_rendering(&svg, &viewport, output, "parallel_tile_renderer");
+}
+
+#[test]
+fn culled_groups_render_like_full_document() {
+    let mut svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <defs>
+    <mask id="half" maskContentUnits="objectBoundingBox">
+      <rect width="0.5" height="1" fill="white"/>
+    </mask>
+    <marker id="dot" markerWidth="40" markerHeight="40" refX="40" refY="20">
+      <circle cx="20" cy="20" r="20" fill="#ff00ff"/>
+    </marker>
+    <filter id="offset" filterUnits="userSpaceOnUse" x="0" y="0" width="100" height="100">
+      <feOffset dx="-50" dy="0"/>
+    </filter>
+  </defs>
+
+  <!-- the second group is culled in the left tiles, but still counts for the mask's bbox -->
+  <g mask="url(#half)">
+    <g><rect x="10" y="10" width="20" height="20" fill="#00ff00"/></g>
+    <g><rect x="70" y="20" width="20" height="20" fill="#0000ff"/></g>
+  </g>
+
+  <g transform="rotate(10 25 75)" opacity="0.5">
+    <rect x="10" y="60" width="30" height="30" fill="#ff0000"/>
+  </g>
+
+  <!-- these paint outside of their group's bbox, into the tiles to their left -->
+  <g><path d="M 80 60 L 90 60" stroke="black" marker-start="url(#dot)"/></g>
+  <g filter="url(#offset)"><rect x="80" y="80" width="10" height="10" fill="#00ffff"/></g>
+
+  <g id="wide"><rect x="60" y="45" width="40" height="1" stroke="#ffff00"/></g>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    // The first rendering fills the groups' caches, and the second one culls with them.
+    for _ in 0..2 {
+        assert_matches_full_rendering(
+            &svg,
+            &viewport,
+            render_in_quarters(&CairoRenderer::new(&svg).with_tile_bleed(0.0), &viewport),
+            "culled_groups_before_stylesheet",
+        );
+    }
+
+    // A wider stroke makes the last group visible in the left tiles, too.
+    svg.set_stylesheet("#wide rect { stroke-width: 150; }")
+        .expect("should be a valid stylesheet");
+
+    assert_matches_full_rendering(
+        &svg,
+        &viewport,
+        render_in_quarters(&CairoRenderer::new(&svg).with_tile_bleed(0.0), &viewport),
+        "culled_groups_after_stylesheet",
+    );
+}
+
+#[test]
+fn filter_result_cache_is_cleared_by_set_stylesheet() {
+    let bytes = glib::Bytes::from_static(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <defs>
+    <filter id="flood">
+      <feFlood flood-color="red"/>
+    </filter>
+  </defs>
+  <rect x="20" y="20" width="60" height="60" filter="url(#flood)"/>
+</svg>
+"##,
+    );
+    let stream = gio::MemoryInputStream::from_bytes(&bytes);
+
+    let mut svg = Loader::new()
+        .with_filter_result_cache(true)
+        .read_stream(&stream, None::<&gio::File>, None::<&gio::Cancellable>)
+        .unwrap();
+
+    let render = |svg: &librsvg::SvgHandle| {
+        let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+
+        {
+            let cr = cairo::Context::new(&output).expect("Failed to create a cairo context");
+            let viewport = cairo::Rectangle {
+                x: 0.0,
+                y: 0.0,
+                width: 100.0,
+                height: 100.0,
+            };
+
+            CairoRenderer::new(svg)
+                .render_document(&cr, &viewport)
+                .unwrap();
+        }
+
+        SharedImageSurface::wrap(output, SurfaceType::SRgb).unwrap()
+    };
+
+    let reference = |r, g, b| {
+        let surface = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+
+        {
+            let cr = cairo::Context::new(&surface).expect("Failed to create a cairo context");
+
+            // The default filter region is the bounding box plus 10% on each side.
+            cr.rectangle(14.0, 14.0, 72.0, 72.0);
+            cr.set_source_rgba(r, g, b, 1.0);
+            cr.fill().unwrap();
+        }
+
+        Reference::from_surface(surface)
+    };
+
+    // The second rendering reuses the cached result of the first one.
+    for _ in 0..2 {
+        let output_surf = render(&svg);
+
+        reference(1.0, 0.0, 0.0)
+            .compare(&output_surf)
+            .evaluate(&output_surf, "filter_result_cache_before_stylesheet");
+    }
+
+    svg.set_stylesheet("feFlood { flood-color: #00ff00; }")
+        .expect("should be a valid stylesheet");
+
+    let output_surf = render(&svg);
+
+    reference(0.0, 1.0, 0.0)
+        .compare(&output_surf)
+        .evaluate(&output_surf, "filter_result_cache_after_stylesheet");
+}
+
+#[test]
+fn cached_paths_are_rebuilt_for_a_new_scale() {
+    const SVG: &[u8] = br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <path d="M 10 50 A 40 30 0 1 1 90 50 Q 50 95 10 50 z" fill="#00ff00"
+        stroke="#0000ff" stroke-width="4"/>
+</svg>
+"##;
+
+    let render = |svg: &librsvg::SvgHandle, size: i32| {
+        let output = cairo::ImageSurface::create(cairo::Format::ARgb32, size, size).unwrap();
+
+        {
+            let cr = cairo::Context::new(&output).expect("Failed to create a cairo context");
+            let viewport = cairo::Rectangle {
+                x: 0.0,
+                y: 0.0,
+                width: f64::from(size),
+                height: f64::from(size),
+            };
+
+            CairoRenderer::new(svg)
+                .render_document(&cr, &viewport)
+                .unwrap();
+        }
+
+        output
+    };
+
+    let svg = load_svg(SVG).unwrap();
+
+    // Render the same handle at alternating sizes; each rendering must match the one
+    // from a handle that has not cached anything yet.
+    for &size in &[100, 400, 100, 400] {
+        let output_surf = SharedImageSurface::wrap(render(&svg, size), SurfaceType::SRgb).unwrap();
+        let reference_surf = render(&load_svg(SVG).unwrap(), size);
+
+        Reference::from_surface(reference_surf)
+            .compare(&output_surf)
+            .evaluate(&output_surf, "cached_paths_are_rebuilt_for_a_new_scale");
+    }
+}
+
+#[test]
+fn shape_opacity_without_temporary_surface() {
+    // The rect's opacity gets folded into its fill color; the group's opacity
+    // always goes through a temporary surface.
+    let render = |input: &'static [u8]| {
+        let svg = load_svg(input).unwrap();
+        let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+
+        {
+            let cr = cairo::Context::new(&output).expect("Failed to create a cairo context");
+            let viewport = cairo::Rectangle {
+                x: 0.0,
+                y: 0.0,
+                width: 100.0,
+                height: 100.0,
+            };
+
+            CairoRenderer::new(&svg)
+                .render_document(&cr, &viewport)
+                .unwrap();
+        }
+
+        output
+    };
+
+    let output = render(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <rect x="10" y="10" width="50" height="50" fill="#00ff00" opacity="0.5"/>
+  <circle cx="60" cy="60" r="30" fill="none" stroke="#0000ff" stroke-width="8" opacity="0.3"/>
+</svg>
+"##,
+    );
+
+    let reference = render(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <g opacity="0.5">
+    <rect x="10" y="10" width="50" height="50" fill="#00ff00"/>
+  </g>
+  <g opacity="0.3">
+    <circle cx="60" cy="60" r="30" fill="none" stroke="#0000ff" stroke-width="8"/>
+  </g>
+</svg>
+"##,
+    );
+
+    let output_surf = SharedImageSurface::wrap(output, SurfaceType::SRgb).unwrap();
+
+    Reference::from_surface(reference)
+        .compare(&output_surf)
+        .evaluate(&output_surf, "shape_opacity_without_temporary_surface");
+}
+
+#[test]
+fn render_damage_repaints_restyled_element() {
+    let mut svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <rect id="a" x="10" y="10" width="20" height="20" fill="black"/>
+  <rect id="b" x="50" y="50" width="30" height="20" fill="black"/>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 200, 200).unwrap();
+    let cr = cairo::Context::new(&output).expect("Failed to create cairo context");
+    cr.scale(2.0, 2.0);
+
+    CairoRenderer::new(&svg)
+        .render_document(&cr, &viewport)
+        .unwrap();
+
+    assert_eq!(
+        CairoRenderer::new(&svg)
+            .render_damage(&cr, &viewport)
+            .unwrap(),
+        None
+    );
+
+    svg.set_stylesheet("#b { fill: #00ff00; }")
+        .expect("should be a valid stylesheet");
+
+    let damage = CairoRenderer::new(&svg)
+        .render_damage(&cr, &viewport)
+        .unwrap();
+
+    // Only the second rectangle, in device space, rounded out to whole pixels plus one.
+    assert_eq!(
+        damage,
+        Some(cairo::Rectangle {
+            x: 99.0,
+            y: 99.0,
+            width: 62.0,
+            height: 42.0,
+        })
+    );
+
+    drop(cr);
+
+    let output_surf = SharedImageSurface::wrap(output, SurfaceType::SRgb).unwrap();
+
+    let reference_surf = cairo::ImageSurface::create(cairo::Format::ARgb32, 200, 200).unwrap();
+
+    {
+        let cr = cairo::Context::new(&reference_surf).expect("Failed to create a cairo context");
+
+        cr.scale(2.0, 2.0);
+
+        cr.rectangle(10.0, 10.0, 20.0, 20.0);
+        cr.set_source_rgba(0.0, 0.0, 0.0, 1.0);
+        cr.fill().unwrap();
+
+        cr.rectangle(50.0, 50.0, 30.0, 20.0);
+        cr.set_source_rgba(0.0, 1.0, 0.0, 1.0);
+        cr.fill().unwrap();
+    }
+
+    Reference::from_surface(reference_surf)
+        .compare(&output_surf)
+        .evaluate(&output_surf, "render_damage_repaints_restyled_element");
+}
+
+#[test]
+fn render_document_to_buffer_converts_pixels() {
+    let svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="4" height="2">
+  <rect width="2" height="2" fill="#336699"/>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 4.0,
+        height: 2.0,
+    };
+
+    let render = |format| {
+        // Rows have 8 bytes of padding, which must be left alone.
+        let mut buffer = vec![0xaa_u8; 24 * 2];
+
+        CairoRenderer::new(&svg)
+            .render_document_to_buffer(&mut buffer, 4, 2, 24, format, &viewport)
+            .unwrap();
+
+        buffer
+    };
+
+    let row = |pixel: [u8; 4]| {
+        let mut row = Vec::new();
+        row.extend_from_slice(&pixel);
+        row.extend_from_slice(&pixel);
+        row.extend_from_slice(&[0; 8]);
+        row.extend_from_slice(&[0xaa; 8]);
+        row.repeat(2)
+    };
+
+    assert_eq!(
+        render(PixelFormat::Argb32Premultiplied),
+        row(0xff336699_u32.to_ne_bytes())
+    );
+    assert_eq!(
+        render(PixelFormat::RgbaPremultiplied),
+        row([0x33, 0x66, 0x99, 0xff])
+    );
+    assert_eq!(render(PixelFormat::Rgba), row([0x33, 0x66, 0x99, 0xff]));
+}
+
+#[test]
+fn render_document_with_stats_reports_elements_and_primitives() {
+    let svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" xmlns:xlink="http://www.w3.org/1999/xlink" width="100" height="100">
+  <defs>
+    <filter id="blur">
+      <feGaussianBlur stdDeviation="2"/>
+    </filter>
+  </defs>
+  <rect id="a" x="10" y="10" width="20" height="20" fill="black" filter="url(#blur)"/>
+  <use xlink:href="#a" x="50"/>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+    let cr = cairo::Context::new(&output).expect("Failed to create cairo context");
+
+    let stats = CairoRenderer::new(&svg)
+        .render_document_with_stats(&cr, &viewport)
+        .unwrap();
+
+    assert_eq!(stats.elements["a"].times_drawn, 2);
+    assert_eq!(stats.filter_primitives["feGaussianBlur"].times_rendered, 2);
+    assert!(stats.referenced_elements > 0);
+    assert!(stats.temporary_surface_bytes > 0);
+}
+
+#[test]
+fn render_stops_when_budget_runs_out() {
+    let svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <g opacity="0.5">
+    <rect x="10" y="10" width="20" height="20" fill="black"/>
+  </g>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+    let cr = cairo::Context::new(&output).expect("Failed to create cairo context");
+
+    // The group's opacity needs a temporary surface of 100x100 pixels.
+    assert!(matches!(
+        CairoRenderer::new(&svg)
+            .with_max_temporary_surface_bytes(100 * 100 * 4 - 1)
+            .render_document(&cr, &viewport),
+        Err(RenderingError::LimitExceeded(
+            ImplementationLimit::TooManyTemporarySurfaceBytes
+        ))
+    ));
+
+    assert!(CairoRenderer::new(&svg)
+        .with_max_temporary_surface_bytes(100 * 100 * 4)
+        .render_document(&cr, &viewport)
+        .is_ok());
+
+    assert!(matches!(
+        CairoRenderer::new(&svg)
+            .with_render_timeout(Duration::from_secs(0))
+            .render_document(&cr, &viewport),
+        Err(RenderingError::LimitExceeded(
+            ImplementationLimit::RenderingTimeExceeded
+        ))
+    ));
+
+    let cancellable = gio::Cancellable::new();
+    let renderer = CairoRenderer::new(&svg).with_cancellable(&cancellable);
+
+    assert!(renderer.render_document(&cr, &viewport).is_ok());
+
+    cancellable.cancel();
+
+    assert!(matches!(
+        renderer.render_document(&cr, &viewport),
+        Err(RenderingError::Cancelled)
+    ));
+}
+
+#[test]
+fn freed_temporary_surfaces_do_not_count_against_budget() {
+    let svg = load_svg(
+        br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" width="100" height="100">
+  <g opacity="0.5">
+    <rect x="10" y="10" width="20" height="20" fill="black"/>
+  </g>
+  <g opacity="0.5">
+    <rect x="50" y="50" width="20" height="20" fill="black"/>
+  </g>
+</svg>
+"##,
+    )
+    .unwrap();
+
+    let viewport = cairo::Rectangle {
+        x: 0.0,
+        y: 0.0,
+        width: 100.0,
+        height: 100.0,
+    };
+
+    let output = cairo::ImageSurface::create(cairo::Format::ARgb32, 100, 100).unwrap();
+    let cr = cairo::Context::new(&output).expect("Failed to create cairo context");
+
+    // Each group needs a temporary surface of 100x100 pixels, but the first one
+    // is freed before the second one is created.
+    assert!(CairoRenderer::new(&svg)
+        .with_max_temporary_surface_bytes(100 * 100 * 4)
+        .render_document(&cr, &viewport)
+        .is_ok());
+}
@@ -25,6 +25,8 @@ use url::Url;
 //  - limit on output size (32767 pixels) ✔
 //  - output formats (PNG, PDF, PS, EPS, SVG) ✔
 //  - multi-page output (for PDF) ✔
+//  - batch conversion with an output template ✔
+//  - rendering statistics ✔
 //  - output file option ✔
 //  - SOURCE_DATA_EPOCH environment variable for PDF output ✔
 //  - background color option ✔
@@ -245,6 +247,94 @@ fn multiple_input_files_not_allowed_for_png_output() {
         ));
 }
 
+#[test]
+fn output_template_converts_each_input_to_its_own_file() {
+    let dir = Builder::new().tempdir().unwrap();
+    let template = dir.path().join("{}.png");
+
+    RsvgConvert::new()
+        .arg("--jobs=2")
+        .arg(format!("--output-template={}", template.display()))
+        .arg("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .arg("tests/fixtures/dimensions/sub-rect-no-unit.svg")
+        .assert()
+        .success()
+        .stdout(is_empty());
+
+    assert!(predicates::path::is_file().eval(&dir.path().join("521-with-viewbox.png")));
+    assert!(predicates::path::is_file().eval(&dir.path().join("sub-rect-no-unit.png")));
+}
+
+#[test]
+fn output_template_reports_failures_and_converts_the_rest() {
+    let dir = Builder::new().tempdir().unwrap();
+    let template = dir.path().join("{}.png");
+
+    RsvgConvert::new()
+        .arg(format!("--output-template={}", template.display()))
+        .arg("tests/fixtures/dimensions/empty.svg")
+        .arg("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .assert()
+        .failure()
+        .stderr(contains("has no dimensions").and(contains("1 of 2 files could not be converted")));
+
+    assert!(predicates::path::is_file().eval(&dir.path().join("521-with-viewbox.png")));
+}
+
+#[test]
+fn output_template_refuses_inputs_with_the_same_output() {
+    let dir = Builder::new().tempdir().unwrap();
+    let template = dir.path().join("{}.png");
+
+    RsvgConvert::new()
+        .arg(format!("--output-template={}", template.display()))
+        .arg("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .arg("tests/fixtures/dimensions/sub-rect-no-unit.svg")
+        .arg("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .assert()
+        .failure()
+        .stderr(contains("would be converted to").and(contains(
+            "1 of 3 files would overwrite the output of another file",
+        )));
+
+    assert!(predicates::path::missing().eval(&dir.path().join("521-with-viewbox.png")));
+    assert!(predicates::path::missing().eval(&dir.path().join("sub-rect-no-unit.png")));
+}
+
+#[test]
+fn profile_prints_render_stats() {
+    RsvgConvert::new()
+        .arg("--profile")
+        .arg("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .assert()
+        .success()
+        .stderr(
+            starts_with(
+                "{\n  \"input\": \"tests/fixtures/dimensions/521-with-viewbox.svg\",\n  \
+                 \"total_time_ms\": ",
+            )
+            .and(contains("\"temporary_surface_bytes\": "))
+            .and(contains("\"filter_primitives\": ")),
+        );
+}
+
+#[test]
+fn profile_names_stdin() {
+    RsvgConvert::new_with_input("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .arg("--profile")
+        .assert()
+        .success()
+        .stderr(starts_with("{\n  \"input\": \"stdin\",\n"));
+}
+
+#[test]
+fn jobs_requires_output_template() {
+    RsvgConvert::new_with_input("tests/fixtures/dimensions/521-with-viewbox.svg")
+        .arg("--jobs=2")
+        .assert()
+        .failure();
+}
+
 #[cfg(system_deps_have_cairo_ps)]
 #[test]
 fn multiple_input_files_accepted_for_eps_output() {
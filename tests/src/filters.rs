@@ -346,3 +346,30 @@ test_compare_render_output!(
 </svg>
 "##,
 );
+
+test_compare_render_output!(
+    named_results_outlive_unrelated_primitives,
+    400,
+    400,
+    br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg version="1.1" xmlns="http://www.w3.org/2000/svg" width="400" height="400">
+  <defs>
+    <filter id="filter" filterUnits="userSpaceOnUse" x="100" y="100" width="200" height="200">
+      <feFlood flood-color="lime" result="green"/>
+      <feFlood flood-color="red" result="red"/>
+      <feOffset in="red" dx="10" result="unused"/>
+      <feMerge>
+        <feMergeNode in="green"/>
+      </feMerge>
+    </filter>
+  </defs>
+
+  <rect x="0" y="0" width="400" height="400" filter="url(#filter)"/>
+</svg>
+"##,
+    br##"<?xml version="1.0" encoding="UTF-8"?>
+<svg version="1.1" xmlns="http://www.w3.org/2000/svg" width="400" height="400">
+  <rect x="100" y="100" width="200" height="200" fill="lime"/>
+</svg>
+"##,
+);